@@ -29,9 +29,18 @@
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 
+#ifdef __SSE2__
+# include <immintrin.h>
+#endif
+
 #include "bitpdb.h"
 #include "index.h"
 #include "puzzle.h"
@@ -49,12 +58,14 @@ bitpdb_allocate(tileset ts)
 	struct bitpdb *bpdb;
 	int error;
 
-	bpdb = malloc(sizeof *bpdb);
+	bpdb = aligned_alloc(alignof(struct bitpdb), sizeof *bpdb);
 	if (bpdb == NULL)
 		return (NULL);
 
 	make_index_aux(&bpdb->aux, ts);
 	bpdb->mapped = 0;
+	bpdb->anchor_shift = 0;
+	bpdb->anchors = NULL;
 	bpdb->data = malloc(bitpdb_size(&bpdb->aux));
 	if (bpdb->data == NULL) {
 		error = errno;
@@ -78,39 +89,53 @@ bitpdb_free(struct bitpdb *bpdb)
 	else
 		free(bpdb->data);
 
+	free(bpdb->anchors);
 	free(bpdb);
 }
 
+/*
+ * Read the data of bpdb from FILE f.  Return 0 on success.  On error,
+ * return -1 and set errno to indicate the problem.  pdbfile must be a
+ * binary file opened for reading with the file pointer positioned
+ * right at the beginning of the bitpdb.  The file pointer is located at
+ * the end of the bitpdb on success and is undefined on failure.
+ */
+extern int
+bitpdb_read(struct bitpdb *bpdb, FILE *pdbfile)
+{
+	size_t count, size;
+
+	size = bitpdb_size(&bpdb->aux);
+	count = fread((void *)bpdb->data, 1, size, pdbfile);
+	if (count != size) {
+		/* tell apart short read from IO error */
+		if (!ferror(pdbfile))
+			errno = EINVAL;
+
+		return (-1);
+	}
+
+	return (0);
+}
+
 /*
  * Load a bitpdb for tileset ts from FILE f and return a pointer to the
  * bitpdb just loaded.  On error, return NULL and set errno to indicate
- * the problem.  pdbfile must be a binary file opened for reading with
- * the file pointer positioned right at the beginning of the bitpdb.
- * The file pointer is located at the end of the bitpdb on success and
- * is undefined on failure.
+ * the problem.  The file pointer is treated as with bitpdb_read().
  */
 extern struct bitpdb *
 bitpdb_load(tileset ts, FILE *pdbfile)
 {
 	struct bitpdb *bpdb = bitpdb_allocate(ts);
-	size_t count, size;
 	int error;
 
 	if (bpdb == NULL)
 		return (NULL);
 
-	size = bitpdb_size(&bpdb->aux);
-	count = fread((void *)bpdb->data, 1, size, pdbfile);
-	if (count != size) {
+	if (bitpdb_read(bpdb, pdbfile) != 0) {
 		error = errno;
 		bitpdb_free(bpdb);
-
-		/* tell apart short read from IO error */
-		if (!ferror(pdbfile))
-			errno = EINVAL;
-
-		else
-			errno = error;
+		errno = error;
 
 		return (NULL);
 	}
@@ -180,12 +205,14 @@ bitpdb_mmap(tileset ts, int fd, int mapflags)
 		return (NULL);
 	}
 
-	bpdb = malloc(sizeof *bpdb);
+	bpdb = aligned_alloc(alignof(struct bitpdb), sizeof *bpdb);
 	if (bpdb == NULL)
 		return (NULL);
 
 	make_index_aux(&bpdb->aux, ts);
 	bpdb->mapped = 1;
+	bpdb->anchor_shift = 0;
+	bpdb->anchors = NULL;
 	bpdb->data = mmap(NULL, bitpdb_size(&bpdb->aux), prot, flags, fd, 0);
 	if (bpdb->data == MAP_FAILED) {
 		error = errno;
@@ -197,32 +224,198 @@ bitpdb_mmap(tileset ts, int fd, int mapflags)
 	return (bpdb);
 }
 
+/*
+ * Pack the second least significant bit of each of the n bytes in in
+ * into out, least significant bit first.  n must be a multiple of 8.
+ */
+static void
+pack_bits(unsigned char *restrict out, const unsigned char *restrict in, size_t n)
+{
+	size_t i = 0;
+	unsigned char buf;
+	int j;
+
+	assert(n % 8 == 0);
+
+	/* shift bit 1 of each byte into bit 7 where movemask finds it */
+#ifdef __AVX2__
+	unsigned mask;
+
+	for (; i + 32 <= n; i += 32) {
+		mask = _mm256_movemask_epi8(_mm256_slli_epi64(
+		    _mm256_loadu_si256((const __m256i *)(in + i)), 6));
+		out[i / 8 + 0] = mask;
+		out[i / 8 + 1] = mask >> 8;
+		out[i / 8 + 2] = mask >> 16;
+		out[i / 8 + 3] = mask >> 24;
+	}
+#elif defined(__SSE2__)
+	unsigned mask;
+
+	for (; i + 16 <= n; i += 16) {
+		mask = _mm_movemask_epi8(_mm_slli_epi64(
+		    _mm_loadu_si128((const __m128i *)(in + i)), 6));
+		out[i / 8 + 0] = mask;
+		out[i / 8 + 1] = mask >> 8;
+	}
+#endif
+
+	for (; i < n; i += 8) {
+		buf = 0;
+		for (j = 0; j < 8; j++)
+			buf |= (in[i + j] >> 1 & 1) << j;
+
+		out[i / 8] = buf;
+	}
+}
+
+/*
+ * A part of the PDB to be packed by pack_worker().
+ */
+struct pack_task {
+	unsigned char *out;
+	const unsigned char *in;
+	size_t n;
+};
+
+static void *
+pack_worker(void *taskarg)
+{
+	struct pack_task *task = taskarg;
+
+	pack_bits(task->out, task->in, task->n);
+
+	return (NULL);
+}
+
+/*
+ * Like pack_bits(), but split the work into pdb_jobs parts of whole
+ * bytes and pack them in parallel.  If fewer threads can be spawned,
+ * the remaining parts are packed on the calling thread.
+ */
+static void
+pack_bits_parallel(unsigned char *out, const unsigned char *in, size_t n)
+{
+	pthread_t pool[PDB_MAX_JOBS];
+	struct pack_task tasks[PDB_MAX_JOBS];
+	size_t begin, end, n_bytes = n / 8;
+	int i, jobs = pdb_jobs, spawned, error;
+
+	if (jobs == 1 || n_bytes < (size_t)jobs) {
+		pack_bits(out, in, n);
+		return;
+	}
+
+	for (i = 0; i < jobs; i++) {
+		begin = n_bytes * i / jobs;
+		end = n_bytes * (i + 1) / jobs;
+		tasks[i].out = out + begin;
+		tasks[i].in = in + 8 * begin;
+		tasks[i].n = 8 * (end - begin);
+	}
+
+	for (i = 0; i < jobs; i++) {
+		error = pthread_create(pool + i, NULL, pack_worker, tasks + i);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_create");
+			break;
+		}
+	}
+
+	spawned = i;
+	for (; i < jobs; i++)
+		pack_worker(tasks + i);
+
+	for (i = 0; i < spawned; i++) {
+		error = pthread_join(pool[i], NULL);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_join");
+			abort();
+		}
+	}
+}
+
 /*
  * Generate a bitpdb from pdb by throwing away all but the second least
- * significant bit of each entry.  On success, return the bitpdb, on
- * failure return NULL and set errno to indicate the error that occurred.
+ * significant bit of each entry.  The conversion uses pdb_jobs threads.
+ * pdb must be in the linear layout.  On success, return the bitpdb, on
+ * failure return NULL and set errno to indicate the error that
+ * occurred.
  */
 extern struct bitpdb *
 bitpdb_from_pdb(struct patterndb *pdb)
 {
-	struct bitpdb *bpdb = bitpdb_allocate(pdb->aux.ts);
-	size_t i, j, n;
-	unsigned char buf, *data = (unsigned char *)pdb->data;
+	struct bitpdb *bpdb;
+
+	if (pdb->layout != PDB_LAYOUT_LINEAR) {
+		errno = EINVAL;
+		return (NULL);
+	}
 
+	bpdb = bitpdb_allocate(pdb->aux.ts);
 	if (bpdb == NULL)
 		return (NULL);
 
-	n = search_space_size(&pdb->aux);
+	pack_bits_parallel(bpdb->data, (const unsigned char *)pdb->data,
+	    search_space_size(&pdb->aux));
+
+	return (bpdb);
+}
+
+/*
+ * Convert pdb into a bitpdb and write it to f without holding the whole
+ * bitpdb in memory.  The PDB is processed in windows of
+ * BITPDB_STREAM_WINDOW entries, each of which is converted using
+ * pdb_jobs threads.  If pdb is mapped, the kernel is told that we read
+ * it sequentially.  pdb must be in the linear layout.  Return 0 on
+ * success, -1 with errno set on failure.
+ */
+extern int
+bitpdb_store_from_pdb(FILE *f, struct patterndb *pdb)
+{
+	size_t i, n = search_space_size(&pdb->aux), len;
+	unsigned char *buf;
+	const unsigned char *data = (const unsigned char *)pdb->data;
+	int error;
+
 	assert(n % 8 == 0);
-	for (i = 0; i < n / 8; i++) {
-		buf = 0;
-		for (j = 0; j < 8; j++)
-			buf |= (data[i * 8 + j] >> 1 & 1) << j;
 
-		bpdb->data[i] = buf;
+	if (pdb->layout != PDB_LAYOUT_LINEAR) {
+		errno = EINVAL;
+		return (-1);
 	}
 
-	return (bpdb);
+	buf = malloc(BITPDB_STREAM_WINDOW / 8);
+	if (buf == NULL)
+		return (-1);
+
+	if (pdb->mapped)
+		posix_madvise((void *)pdb->data, n, POSIX_MADV_SEQUENTIAL);
+
+	for (i = 0; i < n; i += len) {
+		len = n - i < BITPDB_STREAM_WINDOW ? n - i : BITPDB_STREAM_WINDOW;
+		pack_bits_parallel(buf, data + i, len);
+		if (fwrite(buf, 1, len / 8, f) != len / 8)
+			break;
+	}
+
+	free(buf);
+
+	if (i < n || fflush(f) != 0) {
+		error = errno;
+
+		/* tell apart end of medium from IO error */
+		if (!ferror(f))
+			errno = ENOSPC;
+		else
+			errno = error;
+
+		return (-1);
+	}
+
+	return (0);
 }
 
 /*
@@ -282,12 +475,33 @@ bitpdb_diff_lookup(struct bitpdb *bpdb, const struct puzzle *p, int old_h)
 	return (bitpdb_diff_lookup_idx(bpdb, p, old_h, &idx));
 }
 
+/*
+ * If bpdb has an anchor for the configuration with index idx, return
+ * its h value given that h is congruent to it modulo 4.  Otherwise
+ * return -1.
+ */
+static int
+anchor_hval(struct bitpdb *bpdb, const struct index *idx, int h)
+{
+	int min;
+
+	if (bpdb->anchors == NULL)
+		return (-1);
+
+	min = bpdb->anchors[index_offset(&bpdb->aux, idx) >> bpdb->anchor_shift];
+	if (min == BITPDB_NO_ANCHOR)
+		return (-1);
+
+	return (min + (h - min & 3));
+}
+
 /*
  * Determine the h value for puzzle configuration p by looking up a
  * shortest path in the quotient graph induced by bpdb->aux.ts in bpdb.
  * This operation is rather slow and should only be used to get an
  * initial h value, for further search, bitpdb_diff_lookup() should be
- * used instead.
+ * used instead.  If bpdb has anchors, the search stops at the first
+ * configuration with an anchor.
  */
 extern int
 bitpdb_lookup_puzzle(struct bitpdb *bpdb, const struct puzzle *parg)
@@ -296,7 +510,7 @@ bitpdb_lookup_puzzle(struct bitpdb *bpdb, const struct puzzle *parg)
 	struct index idx;
 	struct puzzle p = *parg;
 	size_t n_moves, i;
-	int initial_h, cur_h, next_h;
+	int initial_h, cur_h, next_h, anchor_h;
 
 	/* some multiple of 4 higher than the diameter of the search space */
 	enum { DUMMY_HVAL = 256 };
@@ -305,6 +519,10 @@ bitpdb_lookup_puzzle(struct bitpdb *bpdb, const struct puzzle *parg)
 	initial_h = DUMMY_HVAL | partial_parity(&bpdb->aux, &p) | bitpdb_lookup_bit(bpdb, &idx);
 	next_h = initial_h;
 
+	anchor_h = anchor_hval(bpdb, &idx, initial_h);
+	if (anchor_h >= 0)
+		return (anchor_h);
+
 	do {
 		cur_h = next_h;
 		n_moves = generate_moves(moves, eqclass_from_index(&bpdb->aux, &idx));
@@ -316,6 +534,12 @@ bitpdb_lookup_puzzle(struct bitpdb *bpdb, const struct puzzle *parg)
 
 			compute_index(&bpdb->aux, &idx, &p);
 			next_h = bitpdb_diff_lookup_idx(bpdb, &p, cur_h, &idx);
+
+			/* h values are relative to initial_h until now */
+			anchor_h = anchor_hval(bpdb, &idx, next_h);
+			if (anchor_h >= 0)
+				return (initial_h - next_h + anchor_h);
+
 			if (next_h < cur_h)
 				break;
 
@@ -330,3 +554,179 @@ bitpdb_lookup_puzzle(struct bitpdb *bpdb, const struct puzzle *parg)
 	assert(puzzle_partially_equal(&solved_puzzle, &p, &bpdb->aux));
 	return (initial_h - cur_h);
 }
+
+/*
+ * Compute the index corresponding to offset in the index space
+ * described by aux.  This is the inverse of index_offset().
+ */
+static void
+index_from_offset(const struct index_aux *aux, struct index *idx, size_t offset)
+{
+	size_t map_offset = offset / aux->n_perm;
+	tsrank lo, hi, mid;
+
+	idx->pidx = offset % aux->n_perm;
+	if (!tileset_has(aux->ts, ZERO_TILE)) {
+		idx->maprank = map_offset;
+		idx->eqidx = -1;
+		return;
+	}
+
+	/* find the last maprank whose first offset is not past map_offset */
+	lo = 0;
+	hi = aux->n_maprank;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (aux->idxt[mid].offset <= map_offset)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	idx->maprank = lo;
+	idx->eqidx = map_offset - aux->idxt[lo].offset;
+}
+
+/*
+ * Compute an anchor table for bpdb with 1 << shift entries per anchor
+ * (see bitpdb.h), replacing the anchor table bpdb had before.  If pdb
+ * is not NULL, it must be the PDB bpdb was generated from and the h
+ * values are taken from it and it must be in the linear layout.
+ * Otherwise, they are computed from bpdb itself, which is much slower.
+ * Return 0 on success, or -1 with errno set on failure.
+ */
+extern int
+bitpdb_add_anchors(struct bitpdb *bpdb, const struct patterndb *pdb, int shift)
+{
+	struct index idx;
+	struct puzzle p;
+	size_t i, j, n, n_anchor, block;
+	int h, min, max;
+
+	if (shift < 0 || shift > BITPDB_MAX_ANCHOR_SHIFT
+	    || (pdb != NULL && pdb->layout != PDB_LAYOUT_LINEAR)) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	n = search_space_size(&bpdb->aux);
+	n_anchor = bitpdb_anchor_count(&bpdb->aux, shift);
+
+	free(bpdb->anchors);
+	bpdb->anchors = malloc(n_anchor);
+	if (bpdb->anchors == NULL)
+		return (-1);
+
+	/* anchors of completed blocks already speed up the walks below */
+	bpdb->anchor_shift = shift;
+	memset(bpdb->anchors, BITPDB_NO_ANCHOR, n_anchor);
+
+	block = (size_t)1 << shift;
+	for (i = 0; i < n_anchor; i++) {
+		min = INT_MAX;
+		max = 0;
+		for (j = i * block; j < (i + 1) * block && j < n; j++) {
+			if (pdb != NULL)
+				h = atomic_load_explicit(pdb->data + j, memory_order_relaxed);
+			else {
+				index_from_offset(&bpdb->aux, &idx, j);
+				invert_index(&bpdb->aux, &p, &idx);
+				h = bitpdb_lookup_puzzle(bpdb, &p);
+			}
+
+			if (h < min)
+				min = h;
+
+			if (h > max)
+				max = h;
+		}
+
+		if (max - min < 4 && min < BITPDB_NO_ANCHOR)
+			bpdb->anchors[i] = min;
+	}
+
+	return (0);
+}
+
+/*
+ * Load an anchor table for bpdb from anchorfile, replacing the anchor
+ * table bpdb had before.  The file contains the anchor shift in its
+ * first byte followed by the anchors.  Return 0 on success.  On
+ * failure, return -1 and set errno.  bpdb is left without anchors in
+ * this case.
+ */
+extern int
+bitpdb_load_anchors(struct bitpdb *bpdb, FILE *anchorfile)
+{
+	size_t count, n_anchor;
+	int shift, error;
+
+	free(bpdb->anchors);
+	bpdb->anchors = NULL;
+
+	shift = getc(anchorfile);
+	if (shift == EOF || shift > BITPDB_MAX_ANCHOR_SHIFT) {
+		if (!ferror(anchorfile))
+			errno = EINVAL;
+
+		return (-1);
+	}
+
+	n_anchor = bitpdb_anchor_count(&bpdb->aux, shift);
+	bpdb->anchors = malloc(n_anchor);
+	if (bpdb->anchors == NULL)
+		return (-1);
+
+	count = fread(bpdb->anchors, 1, n_anchor, anchorfile);
+	if (count != n_anchor) {
+		error = errno;
+		free(bpdb->anchors);
+		bpdb->anchors = NULL;
+
+		/* tell apart short read from IO error */
+		if (!ferror(anchorfile))
+			errno = EINVAL;
+		else
+			errno = error;
+
+		return (-1);
+	}
+
+	bpdb->anchor_shift = shift;
+
+	return (0);
+}
+
+/*
+ * Write the anchor table of bpdb to anchorfile in the format read by
+ * bitpdb_load_anchors().  Return 0 on success, -1 with errno set on
+ * failure.  It is an error to call this function if bpdb has no
+ * anchors.
+ */
+extern int
+bitpdb_store_anchors(FILE *anchorfile, const struct bitpdb *bpdb)
+{
+	size_t count, n_anchor;
+	int error;
+
+	if (bpdb->anchors == NULL) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	n_anchor = bitpdb_anchor_count(&bpdb->aux, bpdb->anchor_shift);
+	putc(bpdb->anchor_shift, anchorfile);
+	count = fwrite(bpdb->anchors, 1, n_anchor, anchorfile);
+	if (count != n_anchor || fflush(anchorfile) != 0) {
+		error = errno;
+
+		if (!ferror(anchorfile))
+			errno = ENOSPC;
+		else
+			errno = error;
+
+		return (-1);
+	}
+
+	return (0);
+}
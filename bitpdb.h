@@ -64,22 +64,51 @@
  * struct bitpdb represents such a bitpdb.  The layout is similar to the
  * layout of a normal PDB, but looking up a position directly is slower.
  * For best performance, only differential lookups should be performed.
+ *
+ * To speed up direct lookups, a bitpdb can optionally carry a table of
+ * anchors.  The entries of the bitpdb are grouped into blocks of
+ * 1 << anchor_shift entries.  If the h values in a block differ by
+ * less than 4, the anchor for that block is the least h value in the
+ * block.  As the h value modulo 4 is known for each entry, this gives
+ * the h value of every entry in the block.  Otherwise, the anchor is
+ * BITPDB_NO_ANCHOR.  A direct lookup stops as soon as it encounters a
+ * configuration with an anchor instead of walking all the way to the
+ * goal.  The anchor table is stored in a separate file.
  */
 struct bitpdb {
 	struct index_aux aux;
 	int mapped;
+	int anchor_shift;
 	unsigned char *data;
+	unsigned char *anchors;
+};
+
+enum {
+	/* default block size for anchors: 16 entries (two bytes of data) */
+	BITPDB_ANCHOR_SHIFT = 4,
+	BITPDB_MAX_ANCHOR_SHIFT = 20,
+
+	/* marks a block without anchor */
+	BITPDB_NO_ANCHOR = UCHAR_MAX,
+
+	/* number of PDB entries converted at once by bitpdb_store_from_pdb */
+	BITPDB_STREAM_WINDOW = 1 << 26,
 };
 
 /* bitpdb.c */
 extern struct bitpdb	*bitpdb_allocate(tileset);
 extern void		 bitpdb_free(struct bitpdb *);
 extern struct bitpdb	*bitpdb_load(tileset, FILE *);
+extern int		 bitpdb_read(struct bitpdb *, FILE *);
 extern struct bitpdb	*bitpdb_mmap(tileset, int, int);
 extern int		 bitpdb_store(FILE *, struct bitpdb *);
 extern struct bitpdb	*bitpdb_from_pdb(struct patterndb *);
+extern int		 bitpdb_store_from_pdb(FILE *, struct patterndb *);
 extern int		 bitpdb_lookup_puzzle(struct bitpdb *, const struct puzzle *);
 extern int		 bitpdb_diff_lookup(struct bitpdb *, const struct puzzle *, int);
+extern int		 bitpdb_add_anchors(struct bitpdb *, const struct patterndb *, int);
+extern int		 bitpdb_load_anchors(struct bitpdb *, FILE *);
+extern int		 bitpdb_store_anchors(FILE *, const struct bitpdb *);
 
 /* bitpdbzstd.c */
 
@@ -87,6 +116,7 @@ extern int		 bitpdb_diff_lookup(struct bitpdb *, const struct puzzle *, int);
 enum { BITPDB_COMPRESSION_LEVEL = 22, };
 
 extern struct bitpdb	*bitpdb_load_compressed(tileset, FILE *);
+extern int		 bitpdb_read_compressed(struct bitpdb *, FILE *);
 extern int		 bitpdb_store_compressed(FILE *, struct bitpdb *);
 
 /*
@@ -98,4 +128,14 @@ size_t bitpdb_size(struct index_aux *aux)
 	return ((search_space_size(aux) + CHAR_BIT - 1) / CHAR_BIT);
 }
 
+/*
+ * Return the number of anchors for a bitpdb corresponding to aux with
+ * 1 << shift entries per anchor.
+ */
+static inline size_t
+bitpdb_anchor_count(const struct index_aux *aux, int shift)
+{
+	return ((search_space_size(aux) + ((size_t)1 << shift) - 1) >> shift);
+}
+
 #endif /* BITPDB_H */
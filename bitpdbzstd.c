@@ -41,39 +41,32 @@
 #include "tileset.h"
 
 /*
- * Load a compressed bitpdb from pdbfile.  pdbfile must refer to an
- * ordinary file, the entirety of which contains the compressed bitpdb.
+ * Read the data of bpdb from the compressed bitpdb in pdbfile.
+ * pdbfile must refer to an ordinary file, the entirety of which
+ * contains the compressed bitpdb.  Return 0 on success, -1 with errno
+ * set on failure.
  */
-extern struct bitpdb *
-bitpdb_load_compressed(tileset ts, FILE *pdbfile)
+extern int
+bitpdb_read_compressed(struct bitpdb *bpdb, FILE *pdbfile)
 {
-	struct bitpdb *bpdb;
 	struct stat st;
 	size_t size, cap;
 	void *inbuf;
 	int error;
 
-	bpdb = bitpdb_allocate(ts);
-	if (bpdb == NULL)
-		return (NULL);
-
-	if (fstat(fileno(pdbfile), &st) != 0) {
-		error = errno;
-		goto fail1;
-	}
+	if (fstat(fileno(pdbfile), &st) != 0)
+		return (-1);
 
 	/* make sure we don't get wrong results due to overflow */
 	assert(st.st_size >= 0);
 	if (st.st_size != (off_t)(size_t)st.st_size) {
-		error = EFBIG;
-		goto fail1;
+		errno = EFBIG;
+		return (-1);
 	}
 
 	inbuf = malloc((size_t)st.st_size);
-	if (inbuf == NULL) {
-		error = errno;
-		goto fail1;
-	}
+	if (inbuf == NULL)
+		return (-1);
 
 	cap = bitpdb_size(&bpdb->aux);
 	rewind(pdbfile);
@@ -82,30 +75,54 @@ bitpdb_load_compressed(tileset ts, FILE *pdbfile)
 		error = errno;
 		if (!ferror(pdbfile))
 			error = EINVAL;
-		goto fail2;
+		goto fail;
 	}
 
 	/* sanity check: make sure the PDB size matches */
 	size = ZSTD_getFrameContentSize(inbuf, (size_t)st.st_size);
 	if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != cap) {
 		error = EINVAL;
-		goto fail2;
+		goto fail;
 	}
 
 	size = ZSTD_decompress(bpdb->data, cap, inbuf, (size_t)st.st_size);
 	if (ZSTD_isError(size) || size != cap) {
 		error = EINVAL;
-		goto fail2;
+		goto fail;
 	}
 
 	free(inbuf);
-	return (bpdb);
+	return (0);
 
-fail2:	free(inbuf);
-fail1:	bitpdb_free(bpdb);
+fail:	free(inbuf);
 	errno = error;
 
-	return (NULL);
+	return (-1);
+}
+
+/*
+ * Load a compressed bitpdb from pdbfile.  pdbfile must refer to an
+ * ordinary file, the entirety of which contains the compressed bitpdb.
+ */
+extern struct bitpdb *
+bitpdb_load_compressed(tileset ts, FILE *pdbfile)
+{
+	struct bitpdb *bpdb;
+	int error;
+
+	bpdb = bitpdb_allocate(ts);
+	if (bpdb == NULL)
+		return (NULL);
+
+	if (bitpdb_read_compressed(bpdb, pdbfile) != 0) {
+		error = errno;
+		bitpdb_free(bpdb);
+		errno = error;
+
+		return (NULL);
+	}
+
+	return (bpdb);
 }
 
 /*
@@ -39,6 +39,7 @@
 #include "puzzle.h"
 #include "tileset.h"
 #include "heuristic.h"
+#include "perimeter.h"
 
 enum { LINEBUF_LEN = 512 };
 
@@ -47,7 +48,11 @@ enum { LINEBUF_LEN = 512 };
  * heuristic in cat.  If the PDB is not already present, load or
  * generate it, possibly generatic files in pdbdir.  Print status
  * information to f if f is not NULL.  If f&CAT_IDENTIFY, identify PDB
- * entries on load and build.  On success return the index of the PDB
+ * entries on load and build.  PDBs are verified on load according to
+ * f&CAT_VERIFY_MASK.  If f&CAT_SHARED, share generated tables with
+ * other processes.  CAT_WARMUP and CAT_MLOCK warm up and lock PDBs
+ * loaded from disk.  CAT_BLOCKED rearranges PDBs into the blocked
+ * layout.  On success return the index of the PDB
  * loaded, on error set errno and return -1.
  */
 static int
@@ -71,6 +76,19 @@ add_pdb(struct pdb_catalogue *cat, const char *tsbuf, const char *pdbdir,
 		ts = tileset_remove(ts, ZERO_TILE);
 	}
 
+	heuflags |= (flags & CAT_VERIFY_MASK) >> CAT_VERIFY_SHIFT << HEU_VERIFY_SHIFT;
+	if (flags & CAT_SHARED)
+		heuflags |= HEU_SHARED;
+
+	if (flags & CAT_WARMUP)
+		heuflags |= HEU_WARMUP;
+
+	if (flags & CAT_MLOCK)
+		heuflags |= HEU_MLOCK;
+
+	if (flags & CAT_BLOCKED)
+		heuflags |= HEU_BLOCKED;
+
 	/* TODO: Replace f with a verbose flag */
 	if (f != NULL)
 		heuflags |= HEU_VERBOSE;
@@ -247,9 +265,41 @@ catalogue_free(struct pdb_catalogue *cat)
 	for (i = 0; i < cat->n_heus; i++)
 		heu_free(cat->heus + i);
 
+	if (cat->perimeter != NULL)
+		perimeter_free(cat->perimeter);
+
 	free(cat);
 }
 
+/*
+ * Generate a perimeter of the given depth and add it to cat, replacing
+ * any perimeter cat had before.  Print status information to f if f is
+ * not NULL.  Return 0 on success, -1 on failure with errno set.  On
+ * failure, cat is unchanged.
+ */
+extern int
+catalogue_add_perimeter(struct pdb_catalogue *cat, int depth, FILE *f)
+{
+	struct perimeter *per;
+
+	if (f != NULL)
+		fprintf(f, "Generating perimeter of depth %d\n", depth);
+
+	per = perimeter_generate(depth, f);
+	if (per == NULL)
+		return (-1);
+
+	if (cat->perimeter != NULL)
+		perimeter_free(cat->perimeter);
+
+	cat->perimeter = per;
+
+	if (f != NULL)
+		fprintf(f, "Perimeter holds %zu configurations\n", per->cps.len);
+
+	return (0);
+}
+
 /*
  * Amend a PDB catalogue to also include transposed PDBs.
  */
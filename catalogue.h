@@ -35,6 +35,7 @@
 #include "tileset.h"
 #include "puzzle.h"
 #include "heuristic.h"
+#include "perimeter.h"
 
 /*
  * A struct pdb_catalogue stores a catalogue of pattern databases.
@@ -45,7 +46,8 @@
  * of which PDBs make up which heuristic.  The member heuristics
  * contains a bitmap of which heuristics each PDB is used for.  The
  * member pdbs_ts contains for the PDB's tile sets for better cache
- * locality.
+ * locality.  If perimeter is not NULL, IDA* uses it for perimeter
+ * search, see perimeter.h for details.
  */
 enum {
 	CATALOGUE_HEUS_LEN = 64,
@@ -53,6 +55,20 @@ enum {
 
 	/* flags for catalogue_load() */
 	CAT_IDENTIFY = 1 << 0,
+
+	/* PDB verification level (PDB_VERIFY_*) to apply on load */
+	CAT_VERIFY_SHIFT = 1,
+	CAT_VERIFY_MASK = 3 << CAT_VERIFY_SHIFT,
+
+	/* share tables with other processes, see HEU_SHARED */
+	CAT_SHARED = 1 << 3,
+
+	/* warm up and lock PDBs, see HEU_WARMUP and HEU_MLOCK */
+	CAT_WARMUP = 1 << 4,
+	CAT_MLOCK = 1 << 5,
+
+	/* rearrange PDBs into the blocked layout, see HEU_BLOCKED */
+	CAT_BLOCKED = 1 << 6,
 };
 
 struct pdb_catalogue {
@@ -60,6 +76,7 @@ struct pdb_catalogue {
 	tileset pdbs_ts[CATALOGUE_HEUS_LEN];
 	unsigned long long parts[HEURISTICS_LEN];
 	size_t n_heus, n_heuristics;
+	struct perimeter *perimeter;
 };
 
 /*
@@ -78,6 +95,7 @@ struct partial_hvals {
 extern struct pdb_catalogue	*catalogue_load(const char *, const char *, int, FILE *);
 extern void	catalogue_free(struct pdb_catalogue *);
 extern int	catalogue_add_transpositions(struct pdb_catalogue *cat);
+extern int	catalogue_add_perimeter(struct pdb_catalogue *, int, FILE *);
 extern void	catalogue_partial_hvals(struct partial_hvals *, struct pdb_catalogue *, const struct puzzle *);
 extern void	catalogue_diff_hvals(struct partial_hvals *, struct pdb_catalogue *, const struct puzzle *, unsigned);
 
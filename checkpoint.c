@@ -0,0 +1,389 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* checkpoint.c -- save and restore the state of an IDA* search */
+
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "puzzle.h"
+#include "search.h"
+
+/*
+ * A checkpoint file is a text file with one "key value" pair per line.
+ * The keys are written in the order given below, but may appear in any
+ * order when loading.  An empty path is written as "-".  The solution
+ * key is only written if solutions is not zero.  For example:
+ *
+ *     puzzle 0,24,10,3,...
+ *     fingerprint 5e2b93c0d1f8a467
+ *     bound 82
+ *     expanded 138174527281
+ *     round 4018311852
+ *     solutions 0
+ *     path 5,10,15,16,...
+ */
+enum {
+	LINEBUF_LEN = 1024,
+
+	/* bitmap of the keys found */
+	CP_PUZZLE = 1 << 0,
+	CP_BOUND = 1 << 1,
+	CP_EXPANDED = 1 << 2,
+	CP_ROUND = 1 << 3,
+	CP_SOLUTIONS = 1 << 4,
+	CP_PATH = 1 << 5,
+	CP_FINGERPRINT = 1 << 6,
+	CP_ALL = (1 << 7) - 1,
+
+	/* optional keys */
+	CP_SOLUTION = 1 << 7,
+
+	/* number of configurations whose h values go into the fingerprint */
+	FINGERPRINT_WALK = 64,
+};
+
+/* FNV-1a parameters */
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+/*
+ * Check if path can be walked from p, i.e. if every move in path
+ * moves the zero tile to an adjacent square.  Return 1 if it can,
+ * 0 if it can't.
+ */
+static int
+path_legal(const struct puzzle *p, const struct path *path)
+{
+	size_t i;
+	int zloc = zero_location(p), dest;
+
+	for (i = 0; i < path->pathlen; i++) {
+		dest = path->moves[i];
+		if (moveidx_idxs[zloc][moveidx_diffs[dest - zloc + TILE_COUNT - 1]] == -1)
+			return (0);
+
+		zloc = dest;
+	}
+
+	return (1);
+}
+
+/*
+ * Check if path solves p.  Return 1 if it does, 0 if it doesn't.
+ */
+static int
+path_solves(const struct puzzle *p, const struct path *path)
+{
+	struct puzzle pp = *p;
+
+	if (!path_legal(p, path))
+		return (0);
+
+	path_walk(&pp, path);
+
+	return (memcmp(pp.tiles, solved_puzzle.tiles, TILE_COUNT) == 0);
+}
+
+/*
+ * Return the number of moves in the path string str.  This is used to
+ * avoid overflowing struct path in path_parse().
+ */
+static size_t
+count_moves(const char *str)
+{
+	size_t n = 1;
+
+	for (; *str != '\0'; str++)
+		n += *str == ',';
+
+	return (n);
+}
+
+/*
+ * Parse the path str into path as written by checkpoint_store().
+ * Return 0 on success, -1 if str is malformed.
+ */
+static int
+parse_path(struct path *path, const char *str)
+{
+	char *end;
+
+	if (strcmp(str, "-") == 0) {
+		path->pathlen = 0;
+		return (0);
+	}
+
+	if (count_moves(str) >= SEARCH_PATH_LEN)
+		return (-1);
+
+	end = path_parse(path, str);
+	if (end == NULL || *end != '\0')
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Format path into str as expected by parse_path().
+ */
+static void
+format_path(char str[PATH_STR_LEN], const struct path *path)
+{
+	if (path->pathlen == 0)
+		strcpy(str, "-");
+	else
+		path_string(str, path);
+}
+
+/*
+ * Mix the len bytes at data into the FNV-1a hash h and return the
+ * result.
+ */
+static unsigned long long
+fnv_mix(unsigned long long h, const void *data, size_t len)
+{
+	const unsigned char *bytes = data;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ bytes[i]) * FNV_PRIME;
+
+	return (h);
+}
+
+/*
+ * Compute a fingerprint of the catalogue cat and the finite state
+ * machine fsm for the search for p, so a checkpoint is not resumed
+ * with a different catalogue or finite state machine.  The catalogue
+ * is represented by its structure, its perimeter depth, and the
+ * partial h values of the configurations along a fixed walk starting
+ * at p, which tells apart PDBs of different types for the same tile
+ * set.  The finite state machine is represented by its tables.
+ */
+extern unsigned long long
+checkpoint_fingerprint(struct pdb_catalogue *cat, const struct fsm *fsm,
+    const struct puzzle *p)
+{
+	struct partial_hvals ph;
+	struct puzzle pp = *p;
+	unsigned long long h = FNV_OFFSET;
+	size_t i, zloc;
+	int depth = cat->perimeter != NULL ? cat->perimeter->depth : 0;
+
+	h = fnv_mix(h, &cat->n_heus, sizeof cat->n_heus);
+	h = fnv_mix(h, &cat->n_heuristics, sizeof cat->n_heuristics);
+	h = fnv_mix(h, cat->pdbs_ts, cat->n_heus * sizeof *cat->pdbs_ts);
+	h = fnv_mix(h, cat->parts, cat->n_heuristics * sizeof *cat->parts);
+	h = fnv_mix(h, &depth, sizeof depth);
+
+	for (i = 0; i < FINGERPRINT_WALK; i++) {
+		catalogue_partial_hvals(&ph, cat, &pp);
+		h = fnv_mix(h, ph.hvals, cat->n_heus);
+
+		zloc = zero_location(&pp);
+		move(&pp, get_moves(zloc)[(3 * i + 1) % move_count(zloc)]);
+	}
+
+	for (i = 0; i < TILE_COUNT; i++) {
+		h = fnv_mix(h, &fsm->sizes[i], sizeof fsm->sizes[i]);
+		h = fnv_mix(h, fsm->tables[i], fsm->sizes[i] * sizeof *fsm->tables[i]);
+		if (fsm->moribund[i] != NULL)
+			h = fnv_mix(h, fsm->moribund[i], fsm->sizes[i]);
+	}
+
+	return (h);
+}
+
+/*
+ * Load a checkpoint from f into cp.  The members filename and interval
+ * are not touched.  On success, set cp->valid and return 0.  On
+ * failure, return -1 and set errno.  Malformed checkpoints are
+ * reported as EINVAL.
+ */
+extern int
+checkpoint_load(struct search_checkpoint *cp, FILE *f)
+{
+	int found = 0, n;
+	char linebuf[LINEBUF_LEN], *value;
+
+	cp->valid = 0;
+
+	while (fgets(linebuf, sizeof linebuf, f) != NULL) {
+		linebuf[strcspn(linebuf, "\n")] = '\0';
+		value = strchr(linebuf, ' ');
+		if (value == NULL)
+			goto invalid;
+
+		*value++ = '\0';
+
+		if (strcmp(linebuf, "puzzle") == 0) {
+			if (puzzle_parse(&cp->p, value) != 0)
+				goto invalid;
+
+			found |= CP_PUZZLE;
+		} else if (strcmp(linebuf, "bound") == 0) {
+			if (sscanf(value, "%zu%n", &cp->bound, &n) != 1 || value[n] != '\0')
+				goto invalid;
+
+			found |= CP_BOUND;
+		} else if (strcmp(linebuf, "expanded") == 0) {
+			if (sscanf(value, "%llu%n", &cp->expanded, &n) != 1 || value[n] != '\0')
+				goto invalid;
+
+			found |= CP_EXPANDED;
+		} else if (strcmp(linebuf, "round") == 0) {
+			if (sscanf(value, "%llu%n", &cp->round_expanded, &n) != 1 || value[n] != '\0')
+				goto invalid;
+
+			found |= CP_ROUND;
+		} else if (strcmp(linebuf, "solutions") == 0) {
+			if (sscanf(value, "%d%n", &cp->n_solutions, &n) != 1 || value[n] != '\0')
+				goto invalid;
+
+			found |= CP_SOLUTIONS;
+		} else if (strcmp(linebuf, "fingerprint") == 0) {
+			if (sscanf(value, "%llx%n", &cp->fingerprint, &n) != 1 || value[n] != '\0')
+				goto invalid;
+
+			found |= CP_FINGERPRINT;
+		} else if (strcmp(linebuf, "path") == 0) {
+			if (parse_path(&cp->path, value) != 0)
+				goto invalid;
+
+			found |= CP_PATH;
+		} else if (strcmp(linebuf, "solution") == 0) {
+			if (parse_path(&cp->solution, value) != 0)
+				goto invalid;
+
+			found |= CP_SOLUTION;
+		} else
+			goto invalid;
+	}
+
+	if (ferror(f))
+		return (-1);
+
+	if ((found & CP_ALL) != CP_ALL || cp->path.pathlen >= SEARCH_PATH_LEN
+	    || cp->path.pathlen > cp->bound || !path_legal(&cp->p, &cp->path))
+		goto invalid;
+
+	/* if solutions have been found, we need the last one */
+	if (cp->n_solutions > 0 && (~found & CP_SOLUTION
+	    || cp->solution.pathlen != cp->bound || !path_solves(&cp->p, &cp->solution)))
+		goto invalid;
+
+	cp->valid = 1;
+
+	return (0);
+
+invalid:
+	errno = EINVAL;
+	return (-1);
+}
+
+/*
+ * Write the search state in cp to f.  Return 0 on success, -1 on
+ * failure with errno set to indicate the problem.
+ */
+extern int
+checkpoint_store(FILE *f, const struct search_checkpoint *cp)
+{
+	int error;
+	char puzzlestr[PUZZLE_STR_LEN], pathstr[PATH_STR_LEN];
+
+	puzzle_string(puzzlestr, &cp->p);
+	format_path(pathstr, &cp->path);
+
+	fprintf(f, "puzzle %s\nfingerprint %016llx\nbound %zu\nexpanded %llu\nround %llu\nsolutions %d\npath %s\n",
+	    puzzlestr, cp->fingerprint, cp->bound, cp->expanded, cp->round_expanded,
+	    cp->n_solutions, pathstr);
+
+	if (cp->n_solutions > 0) {
+		format_path(pathstr, &cp->solution);
+		fprintf(f, "solution %s\n", pathstr);
+	}
+
+	if (fflush(f) != 0 || ferror(f)) {
+		error = errno;
+
+		/* tell apart end of medium from IO error */
+		if (!ferror(f))
+			errno = ENOSPC;
+		else
+			errno = error;
+
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Atomically replace the checkpoint file cp->filename with the search
+ * state in cp.  The checkpoint is first written to a temporary file
+ * which is then renamed, so a crash never leaves a partially written
+ * checkpoint behind.  Return 0 on success, -1 on failure with errno
+ * set to indicate the problem.
+ */
+extern int
+checkpoint_update(const struct search_checkpoint *cp)
+{
+	FILE *f;
+	int error;
+	char tmpname[PATH_MAX];
+
+	if (snprintf(tmpname, sizeof tmpname, "%s.tmp", cp->filename) >= (int)sizeof tmpname) {
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+
+	f = fopen(tmpname, "w");
+	if (f == NULL)
+		return (-1);
+
+	if (checkpoint_store(f, cp) != 0 || fsync(fileno(f)) != 0) {
+		error = errno;
+		fclose(f);
+		unlink(tmpname);
+		errno = error;
+
+		return (-1);
+	}
+
+	if (fclose(f) != 0 || rename(tmpname, cp->filename) != 0) {
+		error = errno;
+		unlink(tmpname);
+		errno = error;
+
+		return (-1);
+	}
+
+	return (0);
+}
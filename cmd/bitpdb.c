@@ -51,38 +51,15 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include "bitpdb.h"
 #include "pdb.h"
 #include "index.h"
 #include "tileset.h"
 
-/*
- * Copy the second-to-least signficiant bit of each byte in pdb to
- * ofile in liddle-endian order.
- */
-static void
-write_bitpdb(FILE *ofile, struct patterndb *pdb)
-{
-	unsigned char buf, *data = (unsigned char *)pdb->data;
-	size_t n = search_space_size(&pdb->aux), i, j;
-
-	flockfile(ofile);
-
-	/* assumes 8 divides n which holds for two tiles or more */
-	for (i = 0; i < n; i += 8) {
-		buf = 0;
-		for (j = 0; j < 8; j++)
-			buf |= (data[i + j] >> 1 & 1) << j;
-
-		putc_unlocked(buf, ofile);
-	}
-
-	funlockfile(ofile);
-}
-
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s -t tileset [-o file.bpdb] [file.pdb]\n", argv0);
+	fprintf(stderr, "Usage: %s -t tileset [-j nproc] [-o file.bpdb] [-a file.bpdb.anc] [-A shift] [file.pdb]\n", argv0);
 	exit(EXIT_FAILURE);
 }
 
@@ -91,12 +68,42 @@ extern int
 main(int argc, char *argv[])
 {
 	struct patterndb *pdb;
-	FILE *f = stdin, *o = stdout;
+	struct bitpdb *bpdb;
+	FILE *f = stdin, *o = stdout, *a = NULL;
 	tileset ts = DEFAULT_TILESET;
-	int optchar;
+	int optchar, shift = BITPDB_ANCHOR_SHIFT;
 
-	while (optchar = getopt(argc, argv, "t:o:"), optchar != -1)
+	while (optchar = getopt(argc, argv, "A:a:j:o:t:"), optchar != -1)
 		switch (optchar) {
+		case 'A':
+			shift = atoi(optarg);
+			if (shift < 0 || shift > BITPDB_MAX_ANCHOR_SHIFT) {
+				fprintf(stderr, "Anchor shift must be between 0 and %d\n",
+				    BITPDB_MAX_ANCHOR_SHIFT);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 'a':
+			a = fopen(optarg, "wb");
+			if (a == NULL) {
+				perror(optarg);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 'j':
+			pdb_jobs = atoi(optarg);
+			if (pdb_jobs < 1 || pdb_jobs > PDB_MAX_JOBS) {
+				fprintf(stderr, "Number of threads must be between 1 and %d\n",
+				    PDB_MAX_JOBS);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
 		case 'o':
 			o = fopen(optarg, "wb");
 			if (o == NULL) {
@@ -142,7 +149,30 @@ main(int argc, char *argv[])
 		return (EXIT_FAILURE);
 	}
 
-	write_bitpdb(o, pdb);
+	if (bitpdb_store_from_pdb(o, pdb) != 0) {
+		perror("bitpdb_store_from_pdb");
+		return (EXIT_FAILURE);
+	}
+
+	if (a != NULL) {
+		bpdb = bitpdb_from_pdb(pdb);
+		if (bpdb == NULL) {
+			perror("bitpdb_from_pdb");
+			return (EXIT_FAILURE);
+		}
+
+		if (bitpdb_add_anchors(bpdb, pdb, shift) != 0) {
+			perror("bitpdb_add_anchors");
+			return (EXIT_FAILURE);
+		}
+
+		if (bitpdb_store_anchors(a, bpdb) != 0) {
+			perror("bitpdb_store_anchors");
+			return (EXIT_FAILURE);
+		}
+
+		fclose(a);
+	}
 
 	return (EXIT_SUCCESS);
 }
@@ -35,8 +35,46 @@
 
 #include "puzzle.h"
 #include "compact.h"
+#include "cpblock.h"
+#include "cpfile.h"
+#include "pdb.h"
 #include "search.h"
 
+/*
+ * The expansion rounds found so far.  If cpb is not NULL, they are kept
+ * in compressed form in cpb, otherwise they are held in cps.
+ */
+struct layers {
+	struct cp_slice *cps;
+	struct cp_blocks *cpb;
+};
+
+/*
+ * Look up cp in round i of rounds and return its move mask.  The
+ * configuration must be present.
+ */
+static int
+layer_mask(const struct layers *rounds, size_t i, const struct compact_puzzle *cp)
+{
+	struct compact_puzzle *hit;
+	size_t idx;
+	int found;
+
+	if (rounds->cpb != NULL) {
+		found = cpb_find(&idx, rounds->cpb + i, cp);
+		assert(found);
+		(void)found;
+
+		return (cpb_mask(rounds->cpb + i, idx));
+	}
+
+	hit = bsearch(cp, rounds->cps[i].data, rounds->cps[i].len,
+	    sizeof *rounds->cps->data, compare_cp_nomask);
+	assert(hit != NULL);
+
+	return (move_mask(hit));
+}
+
 /*
  * Determine a path leading to configuration p, the inverse last move of
  * which is last_move.  It is assumed that the path comprises len nodes,
@@ -46,10 +84,10 @@
  */
 static void
 find_path(struct path *path, const struct puzzle *p, int last_move,
-    const struct cp_slice *rounds, size_t len)
+    const struct layers *rounds, size_t len)
 {
-	struct puzzle pp = *p, p_hit;
-	struct compact_puzzle cp, *hit;
+	struct puzzle pp = *p;
+	struct compact_puzzle cp;
 	size_t i;
 	int mask;
 
@@ -60,11 +98,7 @@ find_path(struct path *path, const struct puzzle *p, int last_move,
 
 	for (i = 2; i < len; i++) {
 		pack_puzzle(&cp, &pp);
-		hit = bsearch(&cp, rounds[len - i].data, rounds[len - i].len,
-		    sizeof *rounds->data, compare_cp_nomask);
-		assert(hit != NULL);
-		unpack_puzzle(&p_hit, hit);
-		mask = move_mask(hit);
+		mask = layer_mask(rounds, len - i, &cp);
 		assert(mask != 0);
 		last_move = get_moves(zero_location(&pp))[ctz(mask)];
 		path->moves[len - i -1] = last_move;
@@ -84,7 +118,7 @@ find_path(struct path *path, const struct puzzle *p, int last_move,
  */
 static void
 do_loop(struct compact_puzzle *cp, FILE *fsmfile,
-    struct cp_slice *rounds, size_t len)
+    const struct layers *rounds, size_t len)
 {
 	struct path paths[4];
 	struct puzzle p;
@@ -186,7 +220,7 @@ do_loop(struct compact_puzzle *cp, FILE *fsmfile,
  */
 static void
 do_loop_weak(struct compact_puzzle *cp, FILE *fsmfile,
-    struct cp_slice *rounds, size_t len)
+    const struct layers *rounds, size_t len)
 {
 	struct path paths[4];
 	struct puzzle p;
@@ -248,19 +282,39 @@ do_loop_weak(struct compact_puzzle *cp, FILE *fsmfile,
 /*
  * If all_paths is clear, execute do_loop() for every half loop in
  * rounds[len - 1].  Otherwise execute do_loop_weak() for every half
- * loop in rounds[len - 1].
+ * loop in rounds[len - 1].  Compressed rounds are processed one block
+ * at a time with the pruned move masks written back afterwards.
  */
 static void
-do_loops(FILE *fsmfile, struct cp_slice *rounds, size_t len, int all_paths)
+do_loops(FILE *fsmfile, const struct layers *rounds, size_t len, int all_paths)
 {
-	struct compact_puzzle *cps = rounds[len - 1].data;
-	size_t i, n_cps = rounds[len - 1].len;
-
-	for (i = 0; i < n_cps; i++)
-		if (all_paths)
-			do_loop_weak(cps + i, fsmfile, rounds, len);
-		else
-			do_loop(cps + i, fsmfile, rounds, len);
+	struct compact_puzzle *cps, block[CPB_BLOCK_LEN];
+	struct cp_blocks *cpb;
+	size_t i, j, n_cps;
+
+	if (rounds->cpb == NULL) {
+		cps = rounds->cps[len - 1].data;
+		n_cps = rounds->cps[len - 1].len;
+		for (i = 0; i < n_cps; i++)
+			if (all_paths)
+				do_loop_weak(cps + i, fsmfile, rounds, len);
+			else
+				do_loop(cps + i, fsmfile, rounds, len);
+
+		return;
+	}
+
+	cpb = rounds->cpb + len - 1;
+	for (i = 0; i < cpb->n_block; i++) {
+		n_cps = cpb_block(block, cpb, i);
+		for (j = 0; j < n_cps; j++)
+			if (all_paths)
+				do_loop_weak(block + j, fsmfile, rounds, len);
+			else {
+				do_loop(block + j, fsmfile, rounds, len);
+				cpb_set_mask(cpb, i * CPB_BLOCK_LEN + j, move_mask(block + j));
+			}
+	}
 }
 
 /*
@@ -282,26 +336,44 @@ trivial_loops(FILE *fsmfile, int sq)
 static noreturn void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-a] [-l limit] [-s start_tile] [fsm]\n", argv0);
+	fprintf(stderr, "Usage: %s [-a] [-j nproc] [-l limit] [-s start_tile] [-t tmpdir] [-M runsize] [-z] [fsm]\n", argv0);
 	exit(EXIT_FAILURE);
 }
 
 extern int
 main(int argc, char *argv[])
 {
-	FILE *fsmfile;
+	FILE *fsmfile, *layerfile;
 	struct puzzle p;
 	struct compact_puzzle cp;
 	struct cp_slice cps[PDB_HISTOGRAM_LEN];
+	struct cp_blocks cpbs[PDB_HISTOGRAM_LEN];
+	struct layers rounds = { cps, NULL };
+	size_t runsize = CPF_DEFAULT_RUNSIZE, count;
 	int all_paths = 0, i, optchar, limit = PDB_HISTOGRAM_LEN, start_tile = 0;
+	const char *tmpdir = NULL;
 
-	while (optchar = getopt(argc, argv, "al:s:"), optchar != -1)
+	while (optchar = getopt(argc, argv, "M:aj:l:s:t:z"), optchar != -1)
 		switch (optchar) {
+		case 'M':
+			runsize = strtoull(optarg, NULL, 0) << 20;
+			break;
+
 		case 'a':
 			/* preserve all shortest paths at the cost of pruning efficiency */
 			all_paths = 1;
 			break;
 
+		case 'j':
+			pdb_jobs = atoi(optarg);
+			if (pdb_jobs < 1 || pdb_jobs > PDB_MAX_JOBS) {
+				fprintf(stderr, "Number of threads must be between 1 and %d\n",
+				    PDB_MAX_JOBS);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
 		case 'l':
 			limit = atoi(optarg);
 			if (limit > PDB_HISTOGRAM_LEN)
@@ -322,6 +394,14 @@ main(int argc, char *argv[])
 
 			break;
 
+		case 't':
+			tmpdir = optarg;
+			break;
+
+		case 'z':
+			rounds.cpb = cpbs;
+			break;
+
 		default:
 			usage(argv[0]);
 		}
@@ -345,6 +425,11 @@ main(int argc, char *argv[])
 		break;
 	}
 
+	if (rounds.cpb != NULL && tmpdir != NULL) {
+		fprintf(stderr, "Options -t and -z are mutually exclusive\n");
+		usage(argv[0]);
+	}
+
 	trivial_loops(fsmfile, start_tile);
 
 	p = solved_puzzle;
@@ -353,15 +438,68 @@ main(int argc, char *argv[])
 	cps_init(cps + 0);
 	cps_append(cps + 0, &cp);
 
+	if (rounds.cpb != NULL) {
+		cpb_init(cpbs + 0);
+		if (cpb_append(cpbs + 0, &cp) != 0) {
+			perror("cpb_append");
+			return (EXIT_FAILURE);
+		}
+
+		for (i = 1; i <= limit; i++) {
+			fflush(stdout);
+
+			cpb_init(cpbs + i);
+			if (cpb_round(cpbs + i, cpbs + i - 1, runsize) != 0) {
+				perror("cpb_round");
+				return (EXIT_FAILURE);
+			}
+
+			do_loops(fsmfile, &rounds, i, all_paths);
+		}
+
+		do_loops(fsmfile, &rounds, i, all_paths);
+
+		return (EXIT_SUCCESS);
+	}
+
 	for (i = 1; i <= limit; i++) {
 		fflush(stdout);
 
 		cps_init(cps + i);
-		cps_round(cps + i, cps + i - 1);
-		do_loops(fsmfile, cps, i, all_paths);
+		if (tmpdir == NULL) {
+			if (cps_round(cps + i, cps + i - 1) != 0) {
+				perror("cps_round");
+				return (EXIT_FAILURE);
+			}
+
+			do_loops(fsmfile, &rounds, i, all_paths);
+			continue;
+		}
+
+		/*
+		 * Keep the layers in temporary files.  The mapping is
+		 * shared so do_loop() can prune the layer in place.
+		 * The files are unlinked, so they disappear once
+		 * unmapped.
+		 */
+		layerfile = cpf_tmpfile(tmpdir);
+		if (layerfile == NULL) {
+			perror("cpf_tmpfile");
+			return (EXIT_FAILURE);
+		}
+
+		if (cpf_round(layerfile, &count, cps + i - 1, tmpdir, runsize) != 0
+		    || cpf_map(cps + i, layerfile, CPF_MAP_SHARED) != 0) {
+			perror("cpf_round");
+			return (EXIT_FAILURE);
+		}
+
+		/* the mapping stays valid after closing the file */
+		fclose(layerfile);
+		do_loops(fsmfile, &rounds, i, all_paths);
 	}
 
-	do_loops(fsmfile, cps, i, all_paths);
+	do_loops(fsmfile, &rounds, i, all_paths);
 
 	return (EXIT_SUCCESS);
 }
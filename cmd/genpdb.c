@@ -34,11 +34,88 @@
 #include "tileset.h"
 #include "index.h"
 #include "pdb.h"
+#include "perfcount.h"
+
+/*
+ * Tile sets to benchmark with if none is given on the command line.
+ * These are the first four tile sets from test/indexbench.c, i.e. the
+ * PDBs of the small catalogue without the zero tile.
+ */
+static const tileset bench_ts[] = {
+	0x00001c62, /* A: 1,5,6,10,11,12 */
+	0x000001ce, /* B: 2,3,4,7,8,9 */
+	0x00738000, /* C: 15,16,17,20,21,22 */
+	0x018c6000, /* D: 13,14,18,19,23,24 */
+};
+
+/*
+ * Generate a PDB for tile set ts with 1, 2, 4, ... threads up to
+ * max_jobs threads (always including max_jobs itself) and report on
+ * how long it took.  For each round, print the wall time, the number
+ * of entries expanded per second and the scan bandwidth, i.e. the
+ * bytes of the PDB read per second.  As each round reads half the PDB
+ * (see generate_cohort() in pdbgen.c), this is a lower bound for the
+ * memory bandwidth achieved; the random writes to neighbouring entries
+ * come on top.  For the whole PDB, also print the parallel efficiency
+ * relative to the run with one thread.  If verbose is 0, only print
+ * the totals.  Return 0 on success, -1 on failure with errno set.
+ */
+static int
+benchmark(tileset ts, int max_jobs, int verbose)
+{
+	struct pdbgen_round rounds[PDB_HISTOGRAM_LEN];
+	struct patterndb *pdb;
+	size_t size;
+	double seconds, single = 0.0, half_mb;
+	int i, n_rounds, jobs;
+	char tsstr[TILESET_LIST_LEN];
+
+	pdb = pdb_allocate(ts);
+	if (pdb == NULL)
+		return (-1);
+
+	size = search_space_size(&pdb->aux);
+	half_mb = size / 2.0 / (1024.0 * 1024.0);
+	tileset_list_string(tsstr, ts);
+	printf("Tile set %s, %zu entries\n", tsstr, size);
+	printf("jobs round              entries      seconds        entries/s         MB/s\n");
+
+	for (jobs = 1;; jobs = jobs * 2 < max_jobs ? jobs * 2 : max_jobs) {
+		pdb_jobs = jobs;
+		n_rounds = pdb_generate_rounds(pdb, NULL, rounds);
+		if (n_rounds > PDB_HISTOGRAM_LEN)
+			n_rounds = PDB_HISTOGRAM_LEN;
+
+		seconds = 0.0;
+		for (i = 0; i < n_rounds; i++) {
+			seconds += rounds[i].seconds;
+			if (verbose)
+				printf("%4d %5d %20zu %12.6f %16.2f %12.2f\n", jobs, i,
+				    rounds[i].count, rounds[i].seconds,
+				    rounds[i].count / rounds[i].seconds, half_mb / rounds[i].seconds);
+		}
+
+		if (jobs == 1)
+			single = seconds;
+
+		printf("%4d total %20zu %12.6f %16.2f %12.2f   %5.1f%% efficiency\n", jobs,
+		    size, seconds, size / seconds, n_rounds * half_mb / seconds,
+		    100.0 * single / (jobs * seconds));
+		fflush(stdout);
+
+		if (jobs == max_jobs)
+			break;
+	}
+
+	pdb_free(pdb);
+
+	return (0);
+}
 
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-q] [-f file] [-t tile,tile,...] [-j nproc]\n", argv0);
+	fprintf(stderr, "Usage: %s [-Bpq] [-f file] [-t tile,tile,...] [-j nproc]\n", argv0);
 
 	exit(EXIT_FAILURE);
 }
@@ -48,12 +125,17 @@ main(int argc, char *argv[])
 {
 	struct patterndb *pdb;
 	tileset ts = DEFAULT_TILESET;
-	int optchar, verbose = 1;
+	size_t i;
+	int optchar, verbose = 1, bench = 0, have_ts = 0;
 	const char *fname = NULL;
 	FILE *f = NULL;
 
-	while (optchar = getopt(argc, argv, "f:j:t:q"), optchar != -1)
+	while (optchar = getopt(argc, argv, "Bf:j:pt:q"), optchar != -1)
 		switch (optchar) {
+		case 'B':
+			bench = 1;
+			break;
+
 		case 'f':
 			fname = optarg;
 			break;
@@ -68,12 +150,17 @@ main(int argc, char *argv[])
 
 			break;
 
+		case 'p':
+			perf_enabled = 1;
+			break;
+
 		case 't':
 			if (tileset_parse(&ts, optarg) != 0) {
 				fprintf(stderr, "Cannot parse tile set: %s\n", optarg);
 				return (EXIT_FAILURE);
 			}
 
+			have_ts = 1;
 			break;
 
 		case 'q':
@@ -91,6 +178,16 @@ main(int argc, char *argv[])
 		return (EXIT_FAILURE);
 	}
 
+	if (bench) {
+		for (i = 0; i < (have_ts ? 1 : sizeof bench_ts / sizeof *bench_ts); i++)
+			if (benchmark(have_ts ? ts : bench_ts[i], pdb_jobs, verbose) != 0) {
+				perror("benchmark");
+				return (EXIT_FAILURE);
+			}
+
+		return (EXIT_SUCCESS);
+	}
+
 	if (fname != NULL) {
 		f = fopen(fname, "wb");
 		if (f == NULL) {
@@ -0,0 +1,121 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* mod3pdb.c -- reduce PDBs to their entries modulo 3 */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "mod3pdb.h"
+#include "pdb.h"
+#include "tileset.h"
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s -t tileset [-b shift] [-o file.m3pdb] [file.pdb]\n", argv0);
+	exit(EXIT_FAILURE);
+}
+
+extern int
+main(int argc, char *argv[])
+{
+	struct patterndb *pdb;
+	struct mod3pdb *m3pdb;
+	FILE *f = stdin, *o = stdout;
+	tileset ts = DEFAULT_TILESET;
+	int optchar, shift = MOD3PDB_BASE_SHIFT;
+
+	while (optchar = getopt(argc, argv, "b:o:t:"), optchar != -1)
+		switch (optchar) {
+		case 'b':
+			shift = atoi(optarg);
+			if (shift < 0 || shift > MOD3PDB_MAX_BASE_SHIFT) {
+				fprintf(stderr, "Base shift must be between 0 and %d\n",
+				    MOD3PDB_MAX_BASE_SHIFT);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 'o':
+			o = fopen(optarg, "wb");
+			if (o == NULL) {
+				perror(optarg);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 't':
+			if (tileset_parse(&ts, optarg) != 0) {
+				fprintf(stderr, "Cannot parse tile set: %s\n", optarg);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+
+	switch (argc - optind) {
+	case 0:
+		break;
+
+	case 1:
+		f = fopen(argv[optind], "rb");
+		if (f == NULL) {
+			perror(argv[optind]);
+			return (EXIT_FAILURE);
+		}
+
+		break;
+
+	default:
+		usage(argv[0]);
+	}
+
+	pdb = pdb_mmap(ts, fileno(f), PDB_MAP_RDONLY);
+	if (pdb == NULL) {
+		perror("pdb_mmap");
+		return (EXIT_FAILURE);
+	}
+
+	m3pdb = mod3pdb_from_pdb(pdb, shift);
+	if (m3pdb == NULL) {
+		perror("mod3pdb_from_pdb");
+		return (EXIT_FAILURE);
+	}
+
+	if (mod3pdb_store(o, m3pdb) != 0) {
+		perror("mod3pdb_store");
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
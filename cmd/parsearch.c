@@ -40,6 +40,7 @@
 #include "fsm.h"
 #include "pdb.h"
 #include "index.h"
+#include "perimeter.h"
 #include "puzzle.h"
 #include "tileset.h"
 
@@ -50,19 +51,48 @@ struct psearch_config {
 	FILE *puzzles;
 	struct pdb_catalogue *cat;
 	const struct fsm *fsm;
+	struct search_stats *stats; /* if not NULL, statistics for all searches */
 	int idaflags;
 };
 
+/*
+ * Add stats to cfg->stats while holding cfg->lock.
+ */
+static void
+merge_stats(struct psearch_config *cfg, const struct search_stats *stats)
+{
+	int error;
+
+	error = pthread_mutex_lock(&cfg->lock);
+	if (error != 0) {
+		errno = error;
+		perror("pthread_mutex_lock");
+		abort();
+	}
+
+	search_stats_merge(cfg->stats, stats);
+
+	error = pthread_mutex_unlock(&cfg->lock);
+	if (error != 0) {
+		errno = error;
+		perror("pthread_mutex_unlock");
+		abort();
+	}
+}
+
 static void *
 lookup_worker(void *cfgarg)
 {
 	struct psearch_config *cfg = cfgarg;
 	struct puzzle p;
 	struct path path;
+	struct search_stats stats;
 	unsigned long long expansions;
 	int error;
 	char linebuf[BUFSIZ], *line;
 
+	search_stats_init(&stats);
+
 	for (;;) {
 		error = pthread_mutex_lock(&cfg->lock);
 		if (error != 0) {
@@ -79,15 +109,20 @@ lookup_worker(void *cfgarg)
 			abort();
 		}
 
-		if (line == NULL)
+		if (line == NULL) {
+			if (cfg->stats != NULL)
+				merge_stats(cfg, &stats);
+
 			return (NULL);
+		}
 
 		if (puzzle_parse(&p, linebuf) != 0) {
 			fprintf(stderr, "Invalid puzzle, ignoring: %s", linebuf);
 			continue;
 		}
 
-		expansions = search_ida(cfg->cat, cfg->fsm, &p, &path, NULL, NULL, cfg->idaflags);
+		expansions = search_ida_bounded(cfg->cat, cfg->fsm, &p, SEARCH_PATH_LEN, &path,
+		    NULL, NULL, cfg->idaflags, NULL, cfg->stats != NULL ? &stats : NULL);
 		linebuf[strcspn(linebuf, "\n")] = '\0';
 		flockfile(stdout);
 		printf("%s %3zu %12llu ", linebuf, path.pathlen, expansions);
@@ -100,11 +135,12 @@ lookup_worker(void *cfgarg)
 /*
  * Read puzzles from puzzles and look them up in cat, using fsm for
  * pruning.  Use up to pdb_threads job to do that.  Print solutions and
- * node counts to stdout.
+ * node counts to stdout.  If stats is not NULL, add statistics about
+ * all searches to stats.
  */
 static void
 lookup_multiple(struct pdb_catalogue *cat, const struct fsm *fsm,
-    FILE *puzzles, int idaflags)
+    FILE *puzzles, int idaflags, struct search_stats *stats)
 {
 	struct psearch_config cfg;
 	pthread_t pool[PDB_MAX_JOBS];
@@ -113,6 +149,7 @@ lookup_multiple(struct pdb_catalogue *cat, const struct fsm *fsm,
 	cfg.puzzles = puzzles;
 	cfg.cat = cat;
 	cfg.fsm = fsm;
+	cfg.stats = stats;
 	cfg.idaflags = idaflags;
 	error = pthread_mutex_init(&cfg.lock, NULL);
 	if (error != 0) {
@@ -157,7 +194,7 @@ lookup_multiple(struct pdb_catalogue *cat, const struct fsm *fsm,
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-Fit] [-j nproc] [-m fsmfile] [-d pdbdir] catalogue puzzles\n", argv0);
+	fprintf(stderr, "Usage: %s [-BFLMWit] [-j nproc] [-m fsmfile] [-d pdbdir] [-P depth] [-S statsfile] [-V level] catalogue puzzles\n", argv0);
 
 	exit(EXIT_FAILURE);
 }
@@ -166,17 +203,59 @@ extern int
 main(int argc, char *argv[])
 {
 	struct pdb_catalogue *cat;
+	struct search_stats stats;
 	const struct fsm *fsm = &fsm_simple, *newfsm;
-	FILE *puzzles, *fsmfile;
-	int optchar, catflags = 0, idaflags = 0, transpose = 0;
-	char *pdbdir = NULL;
+	FILE *puzzles, *fsmfile, *statsfile;
+	int optchar, catflags = 0, idaflags = 0, transpose = 0, perimeter = 0, level;
+	char *pdbdir = NULL, *statsname = NULL;
 
-	while (optchar = getopt(argc, argv, "Fd:ij:m:t"), optchar != -1)
+	while (optchar = getopt(argc, argv, "BFLMP:S:V:Wd:ij:m:t"), optchar != -1)
 		switch (optchar) {
+		case 'B':
+			catflags |= CAT_BLOCKED;
+			break;
+
 		case 'F':
 			idaflags |= IDA_LAST_FULL;
 			break;
 
+		case 'W':
+			catflags |= CAT_WARMUP;
+			break;
+
+		case 'L':
+			catflags |= CAT_MLOCK;
+			break;
+
+		case 'M':
+			catflags |= CAT_SHARED;
+			break;
+
+		case 'P':
+			perimeter = atoi(optarg);
+			if (perimeter < 0 || perimeter > PERIMETER_MAX_DEPTH) {
+				fprintf(stderr, "Perimeter depth must be between 0 and %d\n",
+				    PERIMETER_MAX_DEPTH);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 'S':
+			statsname = optarg;
+			break;
+
+		case 'V':
+			level = atoi(optarg);
+			if (level < PDB_VERIFY_NONE || level > PDB_VERIFY_FULL) {
+				fprintf(stderr, "Verification level must be between %d and %d\n",
+				    PDB_VERIFY_NONE, PDB_VERIFY_FULL);
+				return (EXIT_FAILURE);
+			}
+
+			catflags = (catflags & ~CAT_VERIFY_MASK) | level << CAT_VERIFY_SHIFT;
+			break;
+
 		case 'd':
 			pdbdir = optarg;
 			break;
@@ -236,6 +315,11 @@ main(int argc, char *argv[])
 		fprintf(stderr, "Proceeding anyway...\n");
 	}
 
+	if (perimeter > 0 && catalogue_add_perimeter(cat, perimeter, NULL) != 0) {
+		perror("catalogue_add_perimeter");
+		fprintf(stderr, "Proceeding anyway...\n");
+	}
+
 	puzzles = fopen(argv[optind + 1], "r");
 	if (puzzles == NULL) {
 		perror("fopen");
@@ -250,7 +334,26 @@ main(int argc, char *argv[])
 	 */
 	setvbuf(stdout, NULL, _IOLBF, 0);
 
-	lookup_multiple(cat, fsm, puzzles, idaflags);
+	if (statsname == NULL) {
+		lookup_multiple(cat, fsm, puzzles, idaflags, NULL);
+		return (EXIT_SUCCESS);
+	}
+
+	search_stats_init(&stats);
+	lookup_multiple(cat, fsm, puzzles, idaflags, &stats);
+
+	statsfile = fopen(statsname, "w");
+	if (statsfile == NULL) {
+		perror(statsname);
+		return (EXIT_FAILURE);
+	}
+
+	if (search_stats_dump(statsfile, &stats, cat) != 0) {
+		perror(statsname);
+		return (EXIT_FAILURE);
+	}
+
+	fclose(statsfile);
 
 	return (EXIT_SUCCESS);
 }
@@ -26,6 +26,8 @@
 /* pdbmatch.c -- find optimal PDB partitionings */
 
 #define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -37,9 +39,56 @@
 
 #define QUALITIES_FILENAME "qualities.txt"
 
+enum {
+	/* number of PDBs loaded ahead of the lookups by default */
+	DEFAULT_PREFETCH = 2,
+
+	/* minimal number of puzzles per lookup thread */
+	LOOKUP_CHUNK = 256,
+};
+
+/*
+ * A PDB opened for pattern ts.
+ */
+struct pattern_pdb {
+	struct heuristic heu;
+	tileset ts;
+};
+
+/*
+ * The match vectors are built by a pipeline of two stages.  Loader
+ * threads open the PDBs for the patterns in turn and place them in a
+ * queue.  The main thread takes the PDBs out of the queue and looks up
+ * the puzzles in them, distributing the puzzles over pdb_jobs threads.
+ * A loader only starts opening a PDB if there is room for it in the
+ * queue, so at most prefetch PDBs are held by the loaders and the queue
+ * besides the one being looked up.
+ */
+struct pipeline {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	const tileset *patterns;	/* canonical patterns to look up */
+	struct pattern_pdb *queue;	/* ring buffer of opened PDBs */
+	const char *pdbdir;
+	size_t n_pattern, next;		/* patterns total, next to open */
+	size_t prefetch, head, count;	/* capacity, first in queue, entries */
+	size_t in_flight;		/* PDBs being opened */
+};
+
+/*
+ * Look up puzzles begin to end - 1 in heu and all its admissible
+ * morphisms, storing the results in the corresponding match vectors.
+ */
+struct lookup_task {
+	struct pattern_pdb *pp;
+	unsigned char **vs;
+	const struct puzzle *puzzles;
+	size_t begin, end;
+};
+
 static struct puzzle	 *read_puzzles(size_t *, FILE *);
-static unsigned char	**lookup_puzzles(const struct puzzle *, size_t, const char *);
-static void		  lookup_pattern(unsigned char **, tileset, const struct puzzle *, size_t, const char *);
+static unsigned char	**lookup_puzzles(const struct puzzle *, size_t, const char *, size_t);
+static void		  lookup_pattern(unsigned char **, struct pattern_pdb *, const struct puzzle *, size_t);
 static void		  store_match_vector(const char *, unsigned char **, size_t);
 static unsigned char	**load_match_vector(const char *, size_t);
 static void		  find_matches(const struct quality[MATCH_SIZE], struct match *, const struct puzzle *, unsigned char **, size_t);
@@ -48,7 +97,7 @@ static void		  print_matches(struct match *, const struct puzzle *, size_t);
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-r|-d pdbdir] [-m matchfile] [puzzles]\n", argv0);
+	fprintf(stderr, "Usage: %s [-r|-d pdbdir] [-j nproc] [-p prefetch] [-m matchfile] [puzzles]\n", argv0);
 
 	exit(EXIT_FAILURE);
 }
@@ -60,21 +109,41 @@ main(int argc, char *argv[])
 	struct puzzle *puzzles;
 	struct match *matches;
 	struct quality *qualities;
-	size_t n_puzzle;
+	size_t n_puzzle, prefetch = DEFAULT_PREFETCH;
 	int optchar, read_matches = 0;
 	char *pdbdir = NULL, *matchfile = NULL, pathbuf[PATH_MAX];
 	unsigned char **vs;
 
-	while (optchar = getopt(argc, argv, "d:m:r"), optchar != -1)
+	while (optchar = getopt(argc, argv, "d:j:m:p:r"), optchar != -1)
 		switch (optchar) {
 		case 'd':
 			pdbdir = optarg;
 			break;
 
+		case 'j':
+			pdb_jobs = atoi(optarg);
+			if (pdb_jobs < 1 || pdb_jobs > PDB_MAX_JOBS) {
+				fprintf(stderr, "Number of threads must be between 1 and %d\n",
+				    PDB_MAX_JOBS);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
 		case 'm':
 			matchfile = optarg;
 			break;
 
+		case 'p':
+			prefetch = strtoull(optarg, NULL, 0);
+			if (prefetch < 1 || prefetch > PDB_MAX_JOBS) {
+				fprintf(stderr, "Prefetch count must be between 1 and %d\n",
+				    PDB_MAX_JOBS);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
 		case 'r':
 			read_matches = 1;
 			break;
@@ -114,7 +183,7 @@ main(int argc, char *argv[])
 		if (pdbdir == NULL)
 			usage(argv[0]);
 
-		vs = lookup_puzzles(puzzles, n_puzzle, pdbdir);
+		vs = lookup_puzzles(puzzles, n_puzzle, pdbdir, prefetch);
 		if (matchfile != NULL)
 			store_match_vector(matchfile, vs, n_puzzle);
 	} else {
@@ -185,10 +254,91 @@ read_puzzles(size_t *n_puzzle, FILE *puzzlefile)
 	return (puzzles);
 }
 
+/*
+ * Loader thread: open the next pattern's PDB whenever there is room in
+ * the queue and enqueue it.
+ */
+static void *
+loader(void *plarg)
+{
+	struct pipeline *pl = plarg;
+	struct pattern_pdb pp;
+
+	for (;;) {
+		pthread_mutex_lock(&pl->lock);
+		while (pl->next < pl->n_pattern && pl->count + pl->in_flight >= pl->prefetch)
+			pthread_cond_wait(&pl->cond, &pl->lock);
+
+		if (pl->next >= pl->n_pattern) {
+			pthread_mutex_unlock(&pl->lock);
+			return (NULL);
+		}
+
+		pp.ts = pl->patterns[pl->next++];
+		pl->in_flight++;
+		pthread_mutex_unlock(&pl->lock);
+
+		if (heu_open(&pp.heu, pl->pdbdir, pp.ts, "zbpdb.zst",
+		    HEU_NOMORPH | HEU_SIMILAR | HEU_VERBOSE) != 0) {
+			perror("heu_open");
+			exit(EXIT_FAILURE);
+		}
+
+		pthread_mutex_lock(&pl->lock);
+		pl->queue[(pl->head + pl->count++) % pl->prefetch] = pp;
+		pl->in_flight--;
+		pthread_cond_broadcast(&pl->cond);
+		pthread_mutex_unlock(&pl->lock);
+	}
+}
+
+/*
+ * Take the next opened PDB out of the queue and store it in pp.
+ */
+static void
+dequeue(struct pattern_pdb *pp, struct pipeline *pl)
+{
+	pthread_mutex_lock(&pl->lock);
+	while (pl->count == 0)
+		pthread_cond_wait(&pl->cond, &pl->lock);
+
+	*pp = pl->queue[pl->head];
+	pl->head = (pl->head + 1) % pl->prefetch;
+	pl->count--;
+	pthread_cond_broadcast(&pl->cond);
+	pthread_mutex_unlock(&pl->lock);
+}
+
+/*
+ * Collect the patterns we need to look up, i.e. those six tile patterns
+ * which are canonical with respect to automorphism, in patterns.
+ * Return the number of patterns found.
+ */
+static size_t
+canonical_patterns(tileset patterns[MATCH_SIZE])
+{
+	size_t i, n = 0;
+	tileset ts;
+
+	for (i = 0; i < MATCH_SIZE; i++) {
+		ts = tileset_add(tileset_unrank(6, (tsrank)i) << 1, ZERO_TILE);
+		if (canonical_automorphism(ts) == 0)
+			patterns[n++] = ts;
+	}
+
+	return (n);
+}
+
 static unsigned char **
-lookup_puzzles(const struct puzzle *puzzles, size_t n_puzzles, const char *pdbdir)
+lookup_puzzles(const struct puzzle *puzzles, size_t n_puzzles,
+    const char *pdbdir, size_t prefetch)
 {
+	struct pipeline pl;
+	struct pattern_pdb pp;
+	pthread_t loaders[PDB_MAX_JOBS];
+	tileset *patterns;
 	size_t i;
+	int error;
 	unsigned char **vs;
 
 	vs = malloc(n_puzzles * sizeof *vs);
@@ -207,44 +357,131 @@ lookup_puzzles(const struct puzzle *puzzles, size_t n_puzzles, const char *pdbdi
 
 	tileset_unrank_init(6);
 
-	for (i = 0; i < MATCH_SIZE; i++) {
-		lookup_pattern(vs, tileset_unrank(6, (tsrank)i) << 1,
-		    puzzles, n_puzzles, pdbdir);
+	patterns = malloc(MATCH_SIZE * sizeof *patterns);
+	pl.queue = malloc(prefetch * sizeof *pl.queue);
+	if (patterns == NULL || pl.queue == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	pthread_mutex_init(&pl.lock, NULL);
+	pthread_cond_init(&pl.cond, NULL);
+	pl.patterns = patterns;
+	pl.pdbdir = pdbdir;
+	pl.n_pattern = canonical_patterns(patterns);
+	pl.next = 0;
+	pl.prefetch = prefetch;
+	pl.head = 0;
+	pl.count = 0;
+	pl.in_flight = 0;
+
+	for (i = 0; i < prefetch; i++) {
+		error = pthread_create(loaders + i, NULL, loader, &pl);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (i = 0; i < pl.n_pattern; i++) {
+		dequeue(&pp, &pl);
+		lookup_pattern(vs, &pp, puzzles, n_puzzles);
+		heu_free(&pp.heu);
+	}
+
+	for (i = 0; i < prefetch; i++) {
+		error = pthread_join(loaders[i], NULL);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_join");
+			exit(EXIT_FAILURE);
+		}
 	}
 
+	pthread_cond_destroy(&pl.cond);
+	pthread_mutex_destroy(&pl.lock);
+	free(pl.queue);
+	free(patterns);
+
 	return (vs);
 }
 
-static void
-lookup_pattern(unsigned char **vs, tileset ts, const struct puzzle *puzzles,
-    size_t n_puzzle, const char *pdbdir)
+/*
+ * Look up the puzzles of task in all admissible morphisms of its
+ * heuristic.  This is a thread worker.
+ */
+static void *
+lookup_worker(void *taskarg)
 {
-	struct heuristic heu, morphheu;
+	struct lookup_task *task = taskarg;
+	struct heuristic morphheu;
 	size_t j;
 	unsigned i;
 
-	assert(tileset_count(ts) == 6);
-	ts = tileset_add(ts, ZERO_TILE);
-
-	if (canonical_automorphism(ts) != 0)
-		return;
+	for (i = 0; i < AUTOMORPHISM_COUNT; i++) {
+		if (!is_admissible_morphism(task->pp->ts, i))
+			continue;
 
-	if (heu_open(&heu, pdbdir, ts, "zbpdb.zst",
-	    HEU_NOMORPH | HEU_SIMILAR | HEU_VERBOSE) != 0) {
-		perror("heu_open");
-		exit(EXIT_FAILURE);
+		heu_morph(&morphheu, &task->pp->heu, i);
+		for (j = task->begin; j < task->end; j++)
+			match_amend(task->vs[j], task->puzzles + j, &morphheu);
 	}
 
-	for (i = 0; i < AUTOMORPHISM_COUNT; i++) {
-		if (!is_admissible_morphism(ts, i))
-			continue;
+	return (NULL);
+}
+
+/*
+ * Look up all puzzles in the PDB of pp and its admissible morphisms and
+ * store the results in vs.  If there are enough puzzles, distribute them over
+ * pdb_jobs threads.
+ */
+static void
+lookup_pattern(unsigned char **vs, struct pattern_pdb *pp,
+    const struct puzzle *puzzles, size_t n_puzzle)
+{
+	struct lookup_task tasks[PDB_MAX_JOBS];
+	pthread_t pool[PDB_MAX_JOBS];
+	size_t i, jobs, spawned;
+	int error;
+
+	jobs = n_puzzle / LOOKUP_CHUNK;
+	if (jobs > (size_t)pdb_jobs)
+		jobs = pdb_jobs;
+	else if (jobs < 1)
+		jobs = 1;
+
+	for (i = 0; i < jobs; i++) {
+		tasks[i].pp = pp;
+		tasks[i].vs = vs;
+		tasks[i].puzzles = puzzles;
+		tasks[i].begin = n_puzzle * i / jobs;
+		tasks[i].end = n_puzzle * (i + 1) / jobs;
+	}
 
-		heu_morph(&morphheu, &heu, i);
-		for (j = 0; j < n_puzzle; j++)
-			match_amend(vs[j], puzzles + j, &morphheu);
+	/* the calling thread takes the first task */
+	for (i = 1; i < jobs; i++) {
+		error = pthread_create(pool + i, NULL, lookup_worker, tasks + i);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_create");
+			break;
+		}
 	}
 
-	heu_free(&heu);
+	spawned = i;
+	lookup_worker(tasks + 0);
+	for (i = spawned; i < jobs; i++)
+		lookup_worker(tasks + i);
+
+	for (i = 1; i < spawned; i++) {
+		error = pthread_join(pool[i], NULL);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_join");
+			exit(EXIT_FAILURE);
+		}
+	}
 }
 
 static void
@@ -322,15 +559,13 @@ find_matches(const struct quality qualities[MATCH_SIZE],
 {
 	size_t i;
 
-
-
-	for (i = 0; i < n_puzzle; i++) {
+	for (i = 0; i < n_puzzle; i++)
 		assert(match_all_filled_in(vs[i]));
 
-		if (match_find_best(matches + i, vs[i], qualities) == 0) {
-			perror("match_find_best");
-			exit(EXIT_FAILURE);
-		}
+	if (match_find_best_batch(matches, (const unsigned char *const *)vs,
+	    n_puzzle, qualities) == 0) {
+		perror("match_find_best_batch");
+		exit(EXIT_FAILURE);
 	}
 }
 
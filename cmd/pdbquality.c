@@ -26,32 +26,197 @@
 /* pdbquality.c -- compute and print the quality of a PDB */
 
 #define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdnoreturn.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "pdb.h"
 #include "tileset.h"
 
+/*
+ * One PDB whose quality is to be determined when processing multiple
+ * PDBs with -d.
+ */
+struct quality_task {
+	tileset ts;
+	int error;		/* errno value on failure, 0 on success */
+	struct pdb_stats stats;
+};
+
+/*
+ * Tasks shared between the threads of quality_all().
+ */
+struct quality_pool {
+	const char *pdbdir;
+	struct quality_task *tasks;
+	size_t n_tasks;
+	atomic_size_t next;
+};
+
 static noreturn void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-v] [-t tile,...] [-j nproc] [file.pdb]\n", argv0);
+	fprintf(stderr, "Usage: %s [-v] [-t tile,...] [-j nproc] [file.pdb]\n"
+	    "       %s [-j nproc] -d pdbdir tile,... [tile,... ...]\n", argv0, argv0);
 	exit(EXIT_FAILURE);
 }
 
+/*
+ * Map the PDB for task->ts from pool->pdbdir and compute its
+ * statistics.  Set task->error on failure.
+ */
+static void
+quality_one(struct quality_pool *pool, struct quality_task *task)
+{
+	struct patterndb *pdb;
+	FILE *pdbfile;
+	char tsstr[TILESET_LIST_LEN], pathbuf[PATH_MAX];
+
+	tileset_list_string(tsstr, task->ts);
+	if (snprintf(pathbuf, sizeof pathbuf, "%s/%s.pdb", pool->pdbdir, tsstr) >= (int)sizeof pathbuf) {
+		task->error = ENAMETOOLONG;
+		return;
+	}
+
+	pdbfile = fopen(pathbuf, "rb");
+	if (pdbfile == NULL) {
+		task->error = errno;
+		return;
+	}
+
+	pdb = pdb_mmap(task->ts, fileno(pdbfile), PDB_MAP_RDONLY);
+	task->error = errno;
+	fclose(pdbfile);
+	if (pdb == NULL)
+		return;
+
+	task->error = pdb_statistics(&task->stats, pdb) == 0 ? 0 : errno;
+	pdb_free(pdb);
+}
+
+static void *
+quality_worker(void *poolarg)
+{
+	struct quality_pool *pool = poolarg;
+	size_t i;
+
+	while (i = atomic_fetch_add(&pool->next, 1), i < pool->n_tasks)
+		quality_one(pool, pool->tasks + i);
+
+	return (NULL);
+}
+
+/*
+ * Compute the statistics for all tasks in pool, processing up to jobs
+ * PDBs at once.  Threads left over when there are fewer PDBs than jobs
+ * are used to process each PDB in parallel.
+ */
+static void
+quality_all(struct quality_pool *pool, int jobs)
+{
+	pthread_t threads[PDB_MAX_JOBS];
+	int i, n_threads, spawned, error;
+
+	n_threads = (size_t)jobs < pool->n_tasks ? jobs : (int)pool->n_tasks;
+	pdb_jobs = jobs / n_threads;
+	atomic_init(&pool->next, 0);
+
+	/* the calling thread processes PDBs, too */
+	for (i = 1; i < n_threads; i++) {
+		error = pthread_create(threads + i, NULL, quality_worker, pool);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_create");
+			break;
+		}
+	}
+
+	spawned = i;
+	quality_worker(pool);
+
+	for (i = 1; i < spawned; i++) {
+		error = pthread_join(threads[i], NULL);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_join");
+			abort();
+		}
+	}
+}
+
+/*
+ * Print the quality of the PDBs for the tile sets given in argv, which
+ * are found in pdbdir, processing up to jobs of them at once.  The
+ * results are printed in the order the tile sets were given.
+ */
+static int
+quality_dir(const char *pdbdir, char *argv[], int argc, int jobs)
+{
+	struct quality_pool pool;
+	size_t i;
+	int status = EXIT_SUCCESS;
+	char tsstr[TILESET_LIST_LEN];
+
+	if (argc == 0)
+		return (EXIT_SUCCESS);
+
+	pool.pdbdir = pdbdir;
+	pool.n_tasks = argc;
+	pool.tasks = calloc(argc, sizeof *pool.tasks);
+	if (pool.tasks == NULL) {
+		perror("calloc");
+		return (EXIT_FAILURE);
+	}
+
+	for (i = 0; i < pool.n_tasks; i++)
+		if (tileset_parse(&pool.tasks[i].ts, argv[i]) != 0) {
+			fprintf(stderr, "Cannot parse tile set: %s\n", argv[i]);
+			free(pool.tasks);
+			return (EXIT_FAILURE);
+		}
+
+	quality_all(&pool, jobs);
+
+	for (i = 0; i < pool.n_tasks; i++) {
+		tileset_list_string(tsstr, pool.tasks[i].ts);
+		if (pool.tasks[i].error != 0) {
+			fprintf(stderr, "%s: %s\n", tsstr, strerror(pool.tasks[i].error));
+			status = EXIT_FAILURE;
+			continue;
+		}
+
+		printf("%.18f %.18e %s\n", pool.tasks[i].stats.h_average,
+		    pool.tasks[i].stats.eta, tsstr);
+	}
+
+	free(pool.tasks);
+
+	return (status);
+}
+
 extern int
 main(int argc, char *argv[])
 {
 	struct patterndb *pdb;
+	struct pdb_stats stats;
 	FILE *pdbfile;
 	tileset ts = DEFAULT_TILESET;
 	int optchar, verbose = 0, jobs = pdb_jobs;
 	char tsstr[TILESET_LIST_LEN];
+	const char *pdbdir = NULL;
 
-	while (optchar = getopt(argc, argv, "j:t:v"), optchar != -1)
+	while (optchar = getopt(argc, argv, "d:j:t:v"), optchar != -1)
 		switch (optchar) {
+		case 'd':
+			pdbdir = optarg;
+			break;
+
 		case 'j':
 			jobs = atoi(optarg);
 			if (jobs < 1 || jobs > PDB_MAX_JOBS) {
@@ -78,6 +243,9 @@ main(int argc, char *argv[])
 			usage(argv[0]);
 		}
 
+	if (pdbdir != NULL)
+		return (quality_dir(pdbdir, argv + optind, argc - optind, jobs));
+
 	pdb_jobs = jobs;
 
 	switch (argc - optind) {
@@ -111,8 +279,13 @@ main(int argc, char *argv[])
 		usage(argv[0]);
 	}
 
+	if (pdb_statistics(&stats, pdb) != 0) {
+		perror("pdb_statistics");
+		return (EXIT_FAILURE);
+	}
+
 	tileset_list_string(tsstr, ts);
-	printf("%.18f %.18e %s\n", pdb_h_average(pdb), pdb_eta(pdb), tsstr);
+	printf("%.18f %.18e %s\n", stats.h_average, stats.eta, tsstr);
 
 	return (EXIT_SUCCESS);
 }
@@ -38,36 +38,125 @@
 #include "fsm.h"
 #include "pdb.h"
 #include "index.h"
+#include "perfcount.h"
+#include "perimeter.h"
 #include "puzzle.h"
 #include "tileset.h"
 
 enum { CHUNK_SIZE = 1024 };
 
+/* seconds between two checkpoints unless configured otherwise */
+#define DEFAULT_CHECKPOINT_INTERVAL 600.0
+
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-Fit] [-j nproc] [-m fsmfile] [-d pdbdir] catalogue\n", argv0);
+	fprintf(stderr, "Usage: %s [-BFLMWaipt] [-j nproc] [-m fsmfile] [-d pdbdir] [-P depth] [-c checkpoint] [-C interval] [-S statsfile] [-V level] catalogue\n", argv0);
 
 	exit(EXIT_FAILURE);
 }
 
+/*
+ * Write stats to statsfile, replacing what was there before.
+ */
+static void
+write_stats(const char *statsfile, const struct search_stats *stats,
+    const struct pdb_catalogue *cat)
+{
+	FILE *f;
+
+	f = fopen(statsfile, "w");
+	if (f == NULL) {
+		perror(statsfile);
+		return;
+	}
+
+	if (search_stats_dump(f, stats, cat) != 0)
+		perror(statsfile);
+
+	fclose(f);
+}
+
 extern int
 main(int argc, char *argv[])
 {
 	const struct fsm *fsm = &fsm_simple;
 	struct pdb_catalogue *cat;
+	struct search_checkpoint cp;
+	struct search_enumeration se;
+	struct search_stats stats, *statsp = NULL;
 	struct path path;
 	struct puzzle p;
-	FILE *fsmfile;
-	int optchar, catflags = 0, idaflags = IDA_VERBOSE, transpose = 0;
-	char linebuf[1024], pathstr[PATH_STR_LEN], *pdbdir = NULL;
+	FILE *fsmfile, *cpfile;
+	int optchar, catflags = 0, idaflags = IDA_VERBOSE, transpose = 0, perimeter = 0, level;
+	int enumerate = 0;
+	char linebuf[1024], pathstr[PATH_STR_LEN], *pdbdir = NULL, *statsfile = NULL;
 
-	while (optchar = getopt(argc, argv, "Fd:ij:m:t"), optchar != -1)
+	cp.filename = NULL;
+	cp.interval = DEFAULT_CHECKPOINT_INTERVAL;
+	cp.valid = 0;
+
+	while (optchar = getopt(argc, argv, "BC:FLMP:S:V:Wac:d:ij:m:pt"), optchar != -1)
 		switch (optchar) {
+		case 'C':
+			cp.interval = strtod(optarg, NULL);
+			break;
+
+		case 'B':
+			catflags |= CAT_BLOCKED;
+			break;
+
 		case 'F':
 			idaflags |= IDA_LAST_FULL;
 			break;
 
+		case 'W':
+			catflags |= CAT_WARMUP;
+			break;
+
+		case 'L':
+			catflags |= CAT_MLOCK;
+			break;
+
+		case 'M':
+			catflags |= CAT_SHARED;
+			break;
+
+		case 'P':
+			perimeter = atoi(optarg);
+			if (perimeter < 0 || perimeter > PERIMETER_MAX_DEPTH) {
+				fprintf(stderr, "Perimeter depth must be between 0 and %d\n",
+				    PERIMETER_MAX_DEPTH);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 'S':
+			statsfile = optarg;
+			statsp = &stats;
+			search_stats_init(&stats);
+			break;
+
+		case 'V':
+			level = atoi(optarg);
+			if (level < PDB_VERIFY_NONE || level > PDB_VERIFY_FULL) {
+				fprintf(stderr, "Verification level must be between %d and %d\n",
+				    PDB_VERIFY_NONE, PDB_VERIFY_FULL);
+				return (EXIT_FAILURE);
+			}
+
+			catflags = (catflags & ~CAT_VERIFY_MASK) | level << CAT_VERIFY_SHIFT;
+			break;
+
+		case 'a':
+			enumerate = 1;
+			break;
+
+		case 'c':
+			cp.filename = optarg;
+			break;
+
 		case 'd':
 			pdbdir = optarg;
 			break;
@@ -103,6 +192,10 @@ main(int argc, char *argv[])
 			fclose(fsmfile);
 			break;
 
+		case 'p':
+			perf_enabled = 1;
+			break;
+
 		case 't':
 			transpose = 1;
 			break;
@@ -125,6 +218,43 @@ main(int argc, char *argv[])
 		fprintf(stderr, "Proceeding anyway...\n");
 	}
 
+	if (perimeter > 0 && catalogue_add_perimeter(cat, perimeter, stderr) != 0) {
+		perror("catalogue_add_perimeter");
+		fprintf(stderr, "Proceeding anyway...\n");
+	}
+
+	/* if there is a checkpoint, finish the search it belongs to first */
+	if (cp.filename != NULL) {
+		cpfile = fopen(cp.filename, "r");
+		if (cpfile != NULL) {
+			if (checkpoint_load(&cp, cpfile) != 0) {
+				perror(cp.filename);
+				fprintf(stderr, "Ignoring checkpoint...\n");
+			}
+
+			fclose(cpfile);
+		} else if (errno != ENOENT)
+			perror(cp.filename);
+	}
+
+	if (cp.valid && cp.fingerprint != checkpoint_fingerprint(cat, fsm, &cp.p)) {
+		fprintf(stderr, "%s: checkpoint was written for a different catalogue or finite state machine\n",
+		    cp.filename);
+		return (EXIT_FAILURE);
+	}
+
+	if (cp.valid) {
+		puzzle_string(linebuf, &cp.p);
+		fprintf(stderr, "Resuming puzzle %s from checkpoint %s\n", linebuf, cp.filename);
+		p = cp.p;
+		search_ida_bounded(cat, fsm, &p, SEARCH_PATH_LEN, &path, NULL, NULL, idaflags, &cp, statsp);
+		path_string(pathstr, &path);
+		printf("Solution found: %s\n", pathstr);
+
+		if (statsfile != NULL)
+			write_stats(statsfile, &stats, cat);
+	}
+
 	for (;;) {
 		printf("Enter instance to solve:\n");
 		if (fgets(linebuf, sizeof linebuf, stdin) == NULL)
@@ -143,8 +273,21 @@ main(int argc, char *argv[])
 		}
 
 		fprintf(stderr, "Solving puzzle...\n");
-		search_ida(cat, fsm, &p, &path, NULL, NULL, idaflags);
+		if (enumerate) {
+			if (search_ida_enumerate(cat, fsm, &p, SEARCH_PATH_LEN, stdout,
+			    NULL, NULL, idaflags, &se) != 0)
+				perror("search_ida_enumerate");
+
+			printf("Found %llu optimal solution(s) of length %zu\n",
+			    se.n_solutions, se.pathlen);
+			continue;
+		}
+
+		search_ida_bounded(cat, fsm, &p, SEARCH_PATH_LEN, &path, NULL, NULL, idaflags, &cp, statsp);
 		path_string(pathstr, &path);
 		printf("Solution found: %s\n", pathstr);
+
+		if (statsfile != NULL)
+			write_stats(statsfile, &stats, cat);
 	}
 }
@@ -35,33 +35,39 @@
 #include <unistd.h>
 
 #include "pdb.h"
+#include "tileset.h"
+
+enum { READ_BUFFER_LEN = 65536 };
 
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-t tileset] [-p] pdbfile\n", argv0);
+	fprintf(stderr, "Usage: %s [-t label] [-T tileset] [-j nproc] [-p] pdbfile\n", argv0);
 
 	exit(EXIT_FAILURE);
 }
 
 /*
- * Gather statistics about the PDB.  Store how often each entry occured
- * in histogram.  Return the number of bytes read from pdbfile.
+ * Gather statistics about the PDB if its tile set is not known.  Store
+ * how often each entry occured in histogram.  Return the number of
+ * bytes read from pdbfile.
  */
 static off_t
-gather_data(FILE *pdbfile, off_t histogram[PDB_HISTOGRAM_LEN])
+gather_data(FILE *pdbfile, unsigned long long histogram[PDB_HISTOGRAM_LEN])
 {
 	off_t size = 0;
-	int c;
-
-	flockfile(pdbfile);
+	size_t i, count;
+	unsigned char buf[READ_BUFFER_LEN];
 
-	while (c = getc_unlocked(pdbfile), c != EOF) {
-		size++;
-		histogram[c]++;
+	while (count = fread(buf, 1, sizeof buf, pdbfile), count > 0) {
+		size += count;
+		for (i = 0; i < count; i++)
+			histogram[buf[i]]++;
 	}
 
-	funlockfile(pdbfile);
+	if (ferror(pdbfile))
+		perror("fread");
+
 	fclose(pdbfile);
 	return (size);
 }
@@ -71,7 +77,7 @@ gather_data(FILE *pdbfile, off_t histogram[PDB_HISTOGRAM_LEN])
  * PDB and print it.
  */
 static void
-print_histogram(off_t histogram[PDB_HISTOGRAM_LEN], off_t size)
+print_histogram(unsigned long long histogram[PDB_HISTOGRAM_LEN], off_t size)
 {
 	size_t i;
 	double quotient = 1.0 / (double)size, entropy, bits, prob, accum = 0.0;
@@ -88,7 +94,7 @@ print_histogram(off_t histogram[PDB_HISTOGRAM_LEN], off_t size)
 		accum += bits;
 
 		printf("0x%02zx: %20llu * %6.2fb (%6.2f%%) = %23.2fb (%23.2fB)\n",
-		    i, (unsigned long long)histogram[i], entropy, 100.0 * prob, bits, bits / 8);
+		    i, histogram[i], entropy, 100.0 * prob, bits, bits / 8);
 	}
 
 	printf("total %.2fb (%.2fB)\n\n", accum, accum / 8);
@@ -98,7 +104,7 @@ print_histogram(off_t histogram[PDB_HISTOGRAM_LEN], off_t size)
  * Compute eta from the histogram and print it out.
  */
 static void
-print_eta(off_t histogram[PDB_HISTOGRAM_LEN], off_t size)
+print_eta(unsigned long long histogram[PDB_HISTOGRAM_LEN], off_t size)
 {
 	double eta = 0.0, invb = 1.0 / B;
 	size_t i;
@@ -118,7 +124,7 @@ print_eta(off_t histogram[PDB_HISTOGRAM_LEN], off_t size)
  * ending with the first 0 entry.
  */
 static void
-histogram_line(const char *tsstr, off_t histogram[PDB_HISTOGRAM_LEN])
+histogram_line(const char *tsstr, unsigned long long histogram[PDB_HISTOGRAM_LEN])
 {
 	size_t i;
 
@@ -126,7 +132,7 @@ histogram_line(const char *tsstr, off_t histogram[PDB_HISTOGRAM_LEN])
 		printf("%s ", tsstr);
 
 	for (i = 0; i < PDB_HISTOGRAM_LEN && histogram[i] != 0; i++)
-		printf("%llu ", (unsigned long long)histogram[i]);
+		printf("%llu ", histogram[i]);
 
 	printf("0\n");
 }
@@ -135,16 +141,41 @@ extern int
 main(int argc, char *argv[])
 {
 	FILE *pdbfile;
-	off_t size, histogram[PDB_HISTOGRAM_LEN] = {};
-	int single_line = 0, optchar;
+	struct patterndb *pdb = NULL;
+	struct pdb_header *hdr;
+	struct pdb_stats stats;
+	off_t size;
+	tileset ts;
+	int single_line = 0, have_ts = 0, optchar;
 	const char *tsstr = NULL;
 
-	while (optchar = getopt(argc, argv, "t:p"), optchar != -1)
+	memset(&stats, 0, sizeof stats);
+
+	while (optchar = getopt(argc, argv, "T:j:pt:"), optchar != -1)
 		switch (optchar) {
+		case 'j':
+			pdb_jobs = atoi(optarg);
+			if (pdb_jobs < 1 || pdb_jobs > PDB_MAX_JOBS) {
+				fprintf(stderr, "Number of threads must be between 1 and %d\n",
+				    PDB_MAX_JOBS);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
 		case 'p':
 			single_line = 1;
 			break;
 
+		case 'T':
+			if (tileset_parse(&ts, optarg) != 0) {
+				fprintf(stderr, "Cannot parse tile set: %s\n", optarg);
+				return (EXIT_FAILURE);
+			}
+
+			have_ts = 1;
+			break;
+
 		case 't':
 			tsstr = optarg;
 			break;
@@ -162,15 +193,50 @@ main(int argc, char *argv[])
 		return (EXIT_FAILURE);
 	}
 
+	/* if no tile set is given, take it from the PDB header */
+	if (!have_ts) {
+		switch (pdb_header_read(&hdr, fileno(pdbfile))) {
+		case -1:
+			perror(argv[optind]);
+			return (EXIT_FAILURE);
+
+		case 1:
+			ts = hdr->tileset;
+			have_ts = 1;
+			free(hdr);
+			break;
+		}
+	}
+
+	/* if the tile set is known, we can do a parallel pass over the PDB */
+	if (have_ts) {
+		pdb = pdb_mmap(ts, fileno(pdbfile), PDB_MAP_RDONLY);
+		if (pdb == NULL) {
+			perror("pdb_mmap");
+			return (EXIT_FAILURE);
+		}
 
-	size = gather_data(pdbfile, histogram);
+		fclose(pdbfile);
+
+		if (pdb_statistics(&stats, pdb) != 0) {
+			perror("pdb_statistics");
+			return (EXIT_FAILURE);
+		}
+
+		size = search_space_size(&pdb->aux);
+	} else
+		size = gather_data(pdbfile, stats.histogram);
 
 	if (single_line)
-		histogram_line(tsstr, histogram);
+		histogram_line(tsstr, stats.histogram);
 	else {
-		printf("size %zuB\n\n", size);
-		print_histogram(histogram, size);
-		print_eta(histogram, size);
+		printf("size %zuB\n\n", (size_t)size);
+		print_histogram(stats.histogram, size);
+		print_eta(stats.histogram, size);
+
+		if (pdb != NULL)
+			printf("weighted eta = %.20e\nh average = %.20f\n",
+			    stats.eta, stats.h_average);
 	}
 
 	return (EXIT_SUCCESS);
@@ -28,6 +28,7 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <assert.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,27 +38,27 @@
 #include <unistd.h>
 
 #include "compact.h"
+#include "cpblock.h"
+#include "cpfile.h"
+#include "pdb.h"
 #include "puzzle.h"
 #include "random.h"
 #include "statistics.h"
 
 /*
  * Use samplefile as a prefix for a file name of the form %s.%d suffixed
- * with round and store up to n_samples randomly selected samples from
- * cps in it.  The samples are stored as struct sample with the move bits
- * cleared and the probability set to the reciprocal of the sphere size.
- * On error, report the error, discard the sample file, and then continue.
- * The ordering of cps is destroyed in the process.  If sorted is set,
- * sort the randomly picked samples before writing them out.
+ * with round and store the n samples in it.  The samples are stored as
+ * struct sample with the move bits cleared and the probability set to
+ * the reciprocal of the sphere size total.  On error, report the error,
+ * discard the sample file, and then continue.
  */
 static void
-do_sampling(const char *samplefile, struct cp_slice *cps, int round,
-    size_t n_samples, int sorted)
+write_samples(const char *samplefile, int round,
+    const struct compact_puzzle *samples, size_t n, size_t total)
 {
 	FILE *f;
 	struct sample s;
-	struct compact_puzzle tmp;
-	size_t i, j, count;
+	size_t i, count;
 	char pathbuf[PATH_MAX];
 
 	snprintf(pathbuf, PATH_MAX, "%s%d.sample", samplefile, round);
@@ -67,6 +68,39 @@ do_sampling(const char *samplefile, struct cp_slice *cps, int round,
 		return;
 	}
 
+	for (i = 0; i < n; i++) {
+		s.cp = samples[i];
+		clear_move_mask(&s.cp);
+		s.p = 1.0 / total;
+		count = fwrite(&s, sizeof s, 1, f);
+		if (count != 1) {
+			if (ferror(f))
+				perror(pathbuf);
+			else
+				fprintf(stderr, "%s: end of file encountered while writing\n", pathbuf);
+
+			fclose(f);
+			remove(pathbuf);
+			return;
+		}
+	}
+
+	fclose(f);
+}
+
+/*
+ * Store up to n_samples randomly selected samples from cps in a sample
+ * file as described in write_samples().  The ordering of cps is
+ * destroyed in the process.  If sorted is set, sort the randomly
+ * picked samples before writing them out.
+ */
+static void
+do_sampling(const char *samplefile, struct cp_slice *cps, int round,
+    size_t n_samples, int sorted)
+{
+	struct compact_puzzle tmp;
+	size_t i, j;
+
 	/* can't take more samples than we have */
 	if (n_samples >= cps->len)
 		n_samples = cps->len;
@@ -82,30 +116,208 @@ do_sampling(const char *samplefile, struct cp_slice *cps, int round,
 	if (sorted)
 		qsort(cps->data, n_samples, sizeof *cps->data, compare_cp);
 
-	for (i = 0; i < n_samples; i++) {
-		s.cp = cps->data[i];
-		clear_move_mask(&s.cp);
-		s.p = 1.0 / cps->len;
-		count = fwrite(&s, sizeof s, 1, f);
-		if (count != 1) {
-			if (ferror(f))
-				perror(pathbuf);
-			else
-				fprintf(stderr, "%s: end of file encountered while writing\n", pathbuf);
+	write_samples(samplefile, round, cps->data, n_samples, cps->len);
+}
 
-			fclose(f);
-			remove(pathbuf);
-			return;
+/*
+ * Like do_sampling(), but take the samples from the compressed layer
+ * cpb.  The samples are picked in one pass over cpb by selection
+ * sampling (Knuth's algorithm S) and come out sorted.  Unless sorted
+ * is set, they are shuffled afterwards.
+ */
+static void
+do_sampling_blocks(const char *samplefile, const struct cp_blocks *cpb,
+    int round, size_t n_samples, int sorted)
+{
+	struct compact_puzzle *samples, tmp, block[CPB_BLOCK_LEN];
+	size_t i, j, k, n, n_picked = 0;
+
+	if (n_samples >= cpb->len)
+		n_samples = cpb->len;
+
+	samples = malloc(n_samples * sizeof *samples);
+	if (samples == NULL && n_samples > 0) {
+		perror("malloc");
+		return;
+	}
+
+	for (i = 0, k = 0; i < cpb->n_block && n_picked < n_samples; i++) {
+		n = cpb_block(block, cpb, i);
+		for (j = 0; j < n; j++, k++)
+			if (random64() % (cpb->len - k) < n_samples - n_picked)
+				samples[n_picked++] = block[j];
+	}
+
+	assert(n_picked == n_samples);
+
+	if (!sorted)
+		for (i = 0; i < n_samples; i++) {
+			j = i + random64() % (n_samples - i);
+			tmp = samples[i];
+			samples[i] = samples[j];
+			samples[j] = tmp;
 		}
+
+	write_samples(samplefile, round, samples, n_samples, cpb->len);
+	free(samples);
+}
+
+/*
+ * Like the breadth-first search in main(), but keep the layers in
+ * compressed form (see cpblock.h) and expand them in runs of runsize
+ * bytes (see cpb_round()).  Return 0 on success, -1 on error with
+ * errno set.
+ */
+static int
+compressed_bfs(size_t runsize, int limit, const char *samplefile,
+    size_t n_samples, int sorted)
+{
+	struct cp_blocks old_cpb, new_cpb;
+	struct compact_puzzle cp;
+	int i, error;
+
+	cpb_init(&new_cpb);
+	pack_puzzle(&cp, &solved_puzzle);
+	if (cpb_append(&new_cpb, &cp) != 0)
+		goto fail;
+
+	for (i = 0; i <= limit; i++) {
+		if (i > 0) {
+			old_cpb = new_cpb;
+			cpb_init(&new_cpb);
+			error = cpb_round(&new_cpb, &old_cpb, runsize);
+			cpb_free(&old_cpb);
+			if (error != 0)
+				goto fail;
+		}
+
+		if (samplefile != NULL)
+			do_sampling_blocks(samplefile, &new_cpb, i, n_samples, sorted);
+
+		if (i == 0)
+			/* keep format compatible with samplegen */
+			printf("%s\n\n", CONFCOUNTSTR);
+
+		printf("%3d: %18zu/%s = %24.18e", i,
+		    new_cpb.len, CONFCOUNTSTR, new_cpb.len / CONFCOUNT);
+		if (new_cpb.len > 0)
+			printf(" (%.2f bytes per entry)",
+			    (double)cpb_storage(&new_cpb) / new_cpb.len);
+
+		printf("\n");
+		fflush(stdout);
+
+		if (new_cpb.len == 0)
+			break;
 	}
 
-	fclose(f);
+	cpb_free(&new_cpb);
+
+	return (0);
+
+fail:	error = errno;
+	cpb_free(&new_cpb);
+	errno = error;
+
+	return (-1);
+}
+
+/*
+ * Print the number of configurations in round.
+ */
+static void
+print_round(int round, size_t len)
+{
+	printf("%3d: %18zu/%s = %24.18e\n", round,
+	    len, CONFCOUNTSTR, len / CONFCOUNT);
+}
+
+/*
+ * Like the breadth-first search in main(), but keep the layers in
+ * temporary files in tmpdir and expand them in runs of runsize bytes
+ * (see cpf_round()).  This allows for layers larger than RAM.  Return
+ * 0 on success, -1 on error with errno set.
+ */
+static int
+external_bfs(const char *tmpdir, size_t runsize, int limit,
+    const char *samplefile, size_t n_samples, int sorted)
+{
+	FILE *oldfile, *newfile;
+	struct cp_slice cps;
+	struct compact_puzzle cp;
+	size_t count;
+	int i, error;
+
+	newfile = cpf_tmpfile(tmpdir);
+	if (newfile == NULL)
+		return (-1);
+
+	pack_puzzle(&cp, &solved_puzzle);
+	if (fwrite(&cp, sizeof cp, 1, newfile) != 1)
+		goto fail;
+
+	for (i = 0; i <= limit; i++) {
+		if (i > 0) {
+			oldfile = newfile;
+			if (cpf_map(&cps, oldfile, CPF_MAP_RDONLY) != 0) {
+				error = errno;
+				fclose(oldfile);
+				errno = error;
+				return (-1);
+			}
+
+			newfile = cpf_tmpfile(tmpdir);
+			if (newfile == NULL || cpf_round(newfile, &count, &cps, tmpdir, runsize) != 0) {
+				error = errno;
+				cpf_unmap(&cps);
+				fclose(oldfile);
+				if (newfile != NULL)
+					fclose(newfile);
+
+				errno = error;
+				return (-1);
+			}
+
+			cpf_unmap(&cps);
+			fclose(oldfile);
+		} else
+			count = 1;
+
+		/* the shuffle in do_sampling() must not modify the layer file */
+		if (samplefile != NULL) {
+			if (cpf_map(&cps, newfile, CPF_MAP_PRIVATE) != 0)
+				goto fail;
+
+			do_sampling(samplefile, &cps, i, n_samples, sorted);
+			cpf_unmap(&cps);
+		}
+
+		if (i == 0)
+			/* keep format compatible with samplegen */
+			printf("%s\n\n", CONFCOUNTSTR);
+
+		print_round(i, count);
+		fflush(stdout);
+
+		if (count == 0)
+			break;
+	}
+
+	fclose(newfile);
+
+	return (0);
+
+fail:	error = errno;
+	fclose(newfile);
+	errno = error;
+
+	return (-1);
 }
 
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-S] [-l limit] [-f prefix] [-n n_samples] [-s seed]\n", argv0);
+	fprintf(stderr, "Usage: %s [-S] [-j nproc] [-l limit] [-f prefix] [-n n_samples] [-s seed] [-t tmpdir] [-M runsize] [-z]\n", argv0);
 	exit(EXIT_FAILURE);
 }
 
@@ -114,16 +326,30 @@ main(int argc, char *argv[])
 {
 	struct cp_slice old_cps, new_cps;
 	struct compact_puzzle cp;
-	int optchar, i, limit = INT_MAX, sorted = 0;
-	size_t n_samples = 1 << 20;
-	const char *samplefile = NULL;
+	int optchar, i, limit = INT_MAX, sorted = 0, compressed = 0;
+	size_t n_samples = 1 << 20, runsize = CPF_DEFAULT_RUNSIZE;
+	const char *samplefile = NULL, *tmpdir = NULL;
 
-	while (optchar = getopt(argc, argv, "f:l:n:s:S"), optchar != -1)
+	while (optchar = getopt(argc, argv, "M:f:j:l:n:s:St:z"), optchar != -1)
 		switch (optchar) {
+		case 'M':
+			runsize = strtoull(optarg, NULL, 0) << 20;
+			break;
+
 		case 'f':
 			samplefile = optarg;
 			break;
 
+		case 'j':
+			pdb_jobs = atoi(optarg);
+			if (pdb_jobs < 1 || pdb_jobs > PDB_MAX_JOBS) {
+				fprintf(stderr, "Number of threads must be between 1 and %d\n",
+				    PDB_MAX_JOBS);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
 		case 'l':
 			limit = atoi(optarg);
 			break;
@@ -140,6 +366,14 @@ main(int argc, char *argv[])
 			sorted = 1;
 			break;
 
+		case 't':
+			tmpdir = optarg;
+			break;
+
+		case 'z':
+			compressed = 1;
+			break;
+
 		default:
 			usage(argv[0]);
 			break;
@@ -148,6 +382,29 @@ main(int argc, char *argv[])
 	if (argc != optind)
 		usage(argv[0]);
 
+	if (compressed) {
+		if (tmpdir != NULL) {
+			fprintf(stderr, "Options -t and -z are mutually exclusive\n");
+			usage(argv[0]);
+		}
+
+		if (compressed_bfs(runsize, limit, samplefile, n_samples, sorted) != 0) {
+			perror("compressed_bfs");
+			return (EXIT_FAILURE);
+		}
+
+		return (EXIT_SUCCESS);
+	}
+
+	if (tmpdir != NULL) {
+		if (external_bfs(tmpdir, runsize, limit, samplefile, n_samples, sorted) != 0) {
+			perror("external_bfs");
+			return (EXIT_FAILURE);
+		}
+
+		return (EXIT_SUCCESS);
+	}
+
 	cps_init(&new_cps);
 	pack_puzzle(&cp, &solved_puzzle);
 	cps_append(&new_cps, &cp);
@@ -158,8 +415,7 @@ main(int argc, char *argv[])
 	/* keep format compatible with samplegen */
 	printf("%s\n\n", CONFCOUNTSTR);
 
-	printf("%3d: %18zu/%s = %24.18e\n", 0,
-	    new_cps.len, CONFCOUNTSTR, new_cps.len / CONFCOUNT);
+	print_round(0, new_cps.len);
 
 	for (i = 1; i <= limit; i++) {
 
@@ -168,13 +424,16 @@ main(int argc, char *argv[])
 		old_cps = new_cps;
 		cps_init(&new_cps);
 
-		cps_round(&new_cps, &old_cps);
+		if (cps_round(&new_cps, &old_cps) != 0) {
+			perror("cps_round");
+			return (EXIT_FAILURE);
+		}
+
 		if (samplefile != NULL)
 			do_sampling(samplefile, &new_cps, i, n_samples, sorted);
 
 		cps_free(&old_cps);
 
-		printf("%3d: %18zu/%s = %24.18e\n", i,
-		    new_cps.len, CONFCOUNTSTR, new_cps.len / CONFCOUNT);
+		print_round(i, new_cps.len);
 	}
 }
@@ -27,10 +27,12 @@
 #define _POSIX_C_SOURCE 200809L
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <limits.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "catalogue.h"
 #include "statistics.h"
@@ -156,20 +158,71 @@ rest_size(int limit)
 }
 
 /*
- * generate n_samples random samples from the search space.  If VERIFY
- * is set in flags, use vcat to make sure they have a distance of more
- * than lower. If VERBOSE is set in flags, print a human-readable record
- * to stderr. Return 0 on success, -1 on error.  Store statistical data
- * to str.
+ * A worker thread taking samples from the rest of the search space.
+ * Each worker draws its puzzles from its own random number stream, so
+ * the samples taken are reproducible for a given seed and number of
+ * threads.
+ */
+struct restworker {
+	struct pdb_catalogue *cat, *vcat;
+	unsigned char *hvals;	/* where to store the h values of the samples */
+	long long n_samples;	/* number of samples this worker takes */
+	long long rejects;	/* number of samples rejected */
+	int lower, flags;
+	unsigned stream;	/* random number stream to use */
+};
+
+/*
+ * Take w->n_samples samples from the search space and store their h
+ * values to w->hvals.  If VERIFY is set in w->flags, use w->vcat to
+ * make sure they have a distance of more than w->lower, counting the
+ * samples rejected in w->rejects.  This function always returns NULL
+ * for compatibility with pthread_create.
+ */
+static void *
+take_rest_samples(void *warg)
+{
+	struct restworker *w = warg;
+	struct puzzle p;
+	struct path pa;
+	long long i = 0;
+
+	random_stream(w->stream);
+
+	while (i < w->n_samples) {
+		random_puzzle(&p);
+
+		if (w->flags & VERIFY) {
+			search_ida_bounded(w->vcat, &fsm_simple, &p, w->lower, &pa, NULL, NULL, 0, NULL, NULL);
+			if (pa.pathlen != SEARCH_NO_PATH) {
+				w->rejects++;
+				continue;
+			}
+		}
+
+		w->hvals[i++] = get_hval(&p, w->cat, w->flags);
+	}
+
+	return (NULL);
+}
+
+/*
+ * generate n_samples random samples from the search space using up to
+ * pdb_jobs threads.  If VERIFY is set in flags, use vcat to make sure
+ * they have a distance of more than lower. If VERBOSE is set in flags,
+ * print a human-readable record to stderr. Return 0 on success, -1 on
+ * error.  Store statistical data to str.
  */
 static int
 sample_rest(int lower, struct stratum *str, struct pdb_catalogue *cat,
     struct pdb_catalogue *vcat, long long rest_samples, int flags)
 {
-	struct puzzle p;
-	long long i = 0, rejects = 0;
+	pthread_t pool[PDB_MAX_JOBS];
+	struct restworker workers[PDB_MAX_JOBS];
+	long long i, rejects = 0, offset = 0;
 	double accum, obs;
 	unsigned char *hvals;
+	int j, jobs = pdb_jobs, spawned, error;
 
 	assert(rest_samples >= 0);
 	hvals = malloc(rest_samples * sizeof *hvals);
@@ -177,23 +230,45 @@ sample_rest(int lower, struct stratum *str, struct pdb_catalogue *cat,
 		return (-1);
 
 	/* take samples */
-	while (i < rest_samples) {
-		struct path pa;
-
-		random_puzzle(&p);
+	for (j = 0; j < jobs; j++) {
+		workers[j].cat = cat;
+		workers[j].vcat = vcat;
+		workers[j].hvals = hvals + offset;
+		workers[j].n_samples = rest_samples / jobs + (j < rest_samples % jobs);
+		workers[j].rejects = 0;
+		workers[j].lower = lower;
+		workers[j].flags = flags;
+		workers[j].stream = j;
+		offset += workers[j].n_samples;
+	}
 
-		if (flags & VERIFY) {
-			search_ida_bounded(vcat, &fsm_simple, &p, lower, &pa, NULL, NULL, 0);
-			if (pa.pathlen != SEARCH_NO_PATH) {
-				rejects++;
-				continue;
+	/* for easier debugging, don't multithread when jobs == 1 */
+	spawned = 0;
+	if (jobs > 1)
+		for (; spawned < jobs; spawned++) {
+			error = pthread_create(pool + spawned, NULL, take_rest_samples, workers + spawned);
+			if (error != 0) {
+				/* accept less threads */
+				fprintf(stderr, "pthread_create: %s\n", strerror(error));
+				break;
 			}
 		}
 
-		hvals[i++] = get_hval(&p, cat, flags);
+	/* do the work of threads we could not spawn */
+	for (j = spawned; j < jobs; j++)
+		take_rest_samples(workers + j);
+
+	/* collect threads */
+	for (j = 0; j < spawned; j++) {
+		error = pthread_join(pool[j], NULL);
+		if (error != 0)
+			fprintf(stderr, "pthread_join: %s\n", strerror(error));
 	}
 
-	str->n_samples = i;
+	for (j = 0; j < jobs; j++)
+		rejects += workers[j].rejects;
+
+	str->n_samples = rest_samples;
 
 	/* compute arithmetic mean */
 	accum = 0.0;
@@ -44,7 +44,7 @@
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-vr] [-d pdbdir] [-j nproc] [-m fsmfile] [-n n_puzzle] [-N n_written] -o outfile [-s seed] catalogue distance\n", argv0);
+	fprintf(stderr, "Usage: %s [-Mvr] [-d pdbdir] [-j nproc] [-m fsmfile] [-n n_puzzle] [-N n_written] -o outfile [-s seed] catalogue distance\n", argv0);
 
 	exit(EXIT_FAILURE);
 }
@@ -204,40 +204,54 @@ print_state(const struct samplestate *state)
 }
 
 /*
- * Take state->n_puzzle samples at state->steps steps using
- * state->fsmfile for pruning and write them to state->outfile.  Use
- * state->cat as an aid to solve the puzzle.  If state->verbose is
- * set, print status information every now and then.  This function
- * always returns NULL for compatibility with pthread_create.
+ * A worker thread taking samples.  Each worker draws its random walks
+ * from its own random number stream, so the samples taken are
+ * reproducible for a given seed and number of threads.
+ */
+struct sampleworker {
+	struct samplestate *state;
+	long long n_puzzle;	/* number of samples this worker takes */
+	unsigned stream;	/* random number stream to use */
+};
+
+/*
+ * Take w->n_puzzle samples at state->steps steps using state->fsm for
+ * pruning and write them to state->outfile.  Use state->cat as an aid
+ * to solve the puzzle.  If state->verbose is set, print status
+ * information every now and then.  This function always returns NULL
+ * for compatibility with pthread_create.
  */
 static void *
-take_samples(void *starg)
+take_samples(void *warg)
 {
-	struct samplestate *state = (struct samplestate *)starg;
-	struct path pa;
+	struct sampleworker *w = (struct sampleworker *)warg;
+	struct samplestate *state = w->state;
+	struct search_enumeration se;
 	struct puzzle p;
 	struct payload pl;
-	int error, success;
+	long long i;
+	int error, success, walked;
 
 	pl.fsm = state->fsm;
+	random_stream(w->stream);
 
-	error = pthread_mutex_lock(&state->lock);
-	if (error != 0) {
-		fprintf(stderr, "pthread_mutex_lock: %s\n", strerror(error));
-		abort();
-	}
+	for (i = 0; i < w->n_puzzle; i++) {
+		p = solved_puzzle;
+		walked = random_walk(&p, state->steps, state->fsm);
+
+		error = pthread_mutex_lock(&state->lock);
+		if (error != 0) {
+			fprintf(stderr, "pthread_mutex_lock: %s\n", strerror(error));
+			abort();
+		}
 
-	while (state->n_samples < state->n_puzzle) {
 		/* print state every once in a while */
 		if (state->verbose && state->n_samples % 1000 == 0)
 			print_state(state);
 
-		p = solved_puzzle;
 		state->n_samples++;
-		if (!random_walk(&p, state->steps, state->fsm)) {
+		if (!walked)
 			state->n_aborted++;
-			continue;
-		}
 
 		error = pthread_mutex_unlock(&state->lock);
 		if (error != 0) {
@@ -245,24 +259,33 @@ take_samples(void *starg)
 			abort();
 		}
 
+		if (!walked)
+			continue;
+
 		pl.prob = 0.0;
 		pl.n_solution = 0;
 		pl.zloc = zero_location(&p);
 
-		search_ida(state->cat, &fsm_simple, &p, &pa, add_solution, &pl, IDA_LAST_FULL);
-		assert(pa.pathlen <= state->steps);
-		success = pa.pathlen == state->steps;
+		if (search_ida_enumerate(state->cat, &fsm_simple, &p, SEARCH_PATH_LEN,
+		    NULL, add_solution, &pl, 0, &se) != 0) {
+			perror("search_ida_enumerate");
+			abort();
+		}
 
-		if (success)  {
-			/* we came there some way, so we should always find a solution */
-			assert(pl.n_solution > 0);
+		assert(se.pathlen <= state->steps);
+		success = se.pathlen == state->steps;
 
-			/*
-			 * A FILE structure has its own lock, so this can be
-			 * done without holding state->lock.
-			 */
-			write_sample(state->outfile, &p, pl.prob);
-		}
+		if (!success)
+			continue;
+
+		/* we came there some way, so we should always find a solution */
+		assert(pl.n_solution > 0);
+
+		/*
+		 * A FILE structure has its own lock, so this can be
+		 * done without holding state->lock.
+		 */
+		write_sample(state->outfile, &p, pl.prob);
 
 		error = pthread_mutex_lock(&state->lock);
 		if (error != 0) {
@@ -270,17 +293,15 @@ take_samples(void *starg)
 			abort();
 		}
 
-		if (success) {
-			state->n_accepted++;
-			state->path_sum += pl.n_solution;
-			state->size_sum += 1.0 / pl.prob;
-		}
-	}
+		state->n_accepted++;
+		state->path_sum += pl.n_solution;
+		state->size_sum += 1.0 / pl.prob;
 
-	error = pthread_mutex_unlock(&state->lock);
-	if (error != 0) {
-		fprintf(stderr, "pthread_mutex_unlock: %s\n", strerror(error));
-		abort();
+		error = pthread_mutex_unlock(&state->lock);
+		if (error != 0) {
+			fprintf(stderr, "pthread_mutex_unlock: %s\n", strerror(error));
+			abort();
+		}
 	}
 
 	return (NULL);
@@ -289,27 +310,35 @@ take_samples(void *starg)
 /*
  * Take state->n_puzzle samples using up to pdb_jobs threads in
  * parallel.  Otherwise same as take_samples (which does the
- * heavy lifting).
+ * heavy lifting).  The samples are split evenly between pdb_jobs
+ * workers; if fewer threads can be spawned, the remaining workers
+ * run on the calling thread.
  */
 static void
 take_samples_parallel(struct samplestate *state)
 {
 	/* shamelessly ripped from parallel.c */
 	pthread_t pool[PDB_MAX_JOBS];
+	struct sampleworker workers[PDB_MAX_JOBS];
 
-	int i, jobs, error;
+	int i, jobs, spawned, error;
 
 	jobs = pdb_jobs;
+	for (i = 0; i < jobs; i++) {
+		workers[i].state = state;
+		workers[i].n_puzzle = state->n_puzzle / jobs + (i < state->n_puzzle % jobs);
+		workers[i].stream = i;
+	}
 
 	/* for easier debugging, don't multithread when jobs == 1 */
 	if (jobs == 1) {
-		take_samples(state);
+		take_samples(workers);
 		goto end;
 	}
 
 	/* spawn threads */
 	for (i = 0; i < jobs; i++) {
-		error = pthread_create(pool + i, NULL, take_samples, state);
+		error = pthread_create(pool + i, NULL, take_samples, workers + i);
 		if (error != 0) {
 			/* accept less threads, but not none */
 			if (i > 0)
@@ -320,10 +349,14 @@ take_samples_parallel(struct samplestate *state)
 		}
 	}
 
-	jobs = i;
+	spawned = i;
+
+	/* do the work of threads we could not spawn */
+	for (; i < jobs; i++)
+		take_samples(workers + i);
 
 	/* collect threads */
-	for (i = 0; i < jobs; i++) {
+	for (i = 0; i < spawned; i++) {
 		error = pthread_join(pool[i], NULL);
 		if (error != 0)
 			fprintf(stderr, "pthread_join: %s\n", strerror(error));
@@ -423,11 +456,15 @@ main(int argc, char *argv[])
 	struct pdb_catalogue *cat;
 	FILE *fsmfile, *prelimfile, *outfile = NULL;
 	long long n_puzzle = 1000, n_out = -1;
-	int optchar, report = 0, verbose = 0, error;
+	int optchar, report = 0, verbose = 0, catflags = 0, error;
 	char *pdbdir = NULL;
 
-	while (optchar = getopt(argc, argv, "d:j:m:n:N:o:rs:v"), optchar != -1)
+	while (optchar = getopt(argc, argv, "Md:j:m:n:N:o:rs:v"), optchar != -1)
 		switch (optchar) {
+		case 'M':
+			catflags |= CAT_SHARED;
+			break;
+
 		case 'd':
 			pdbdir = optarg;
 			break;
@@ -499,7 +536,7 @@ main(int argc, char *argv[])
 		usage(argv[0]);
 	}
 
-	cat = catalogue_load(argv[optind], pdbdir, 0, verbose ? stderr : NULL);
+	cat = catalogue_load(argv[optind], pdbdir, catflags, verbose ? stderr : NULL);
 	if (cat == NULL) {
 		perror("catalogue_load");
 		return (EXIT_FAILURE);
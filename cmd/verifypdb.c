@@ -28,6 +28,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "tileset.h"
@@ -37,7 +38,7 @@
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s -f file [-j nproc] [-t tile,tile,...]\n", argv0);
+	fprintf(stderr, "Usage: %s -f file [-c] [-l level] [-n n_samples] [-j nproc] [-t tile,tile,...]\n", argv0);
 
 	exit(EXIT_FAILURE);
 }
@@ -46,13 +47,19 @@ extern int
 main(int argc, char *argv[])
 {
 	struct patterndb *pdb;
+	struct pdb_header *hdr = NULL;
 	tileset ts = DEFAULT_TILESET;
-	int optchar;
+	size_t n_samples = PDB_VERIFY_SAMPLES;
+	int optchar, level = PDB_VERIFY_FULL, have_ts = 0;
 	const char *fname = NULL;
 	FILE *f = NULL;
 
-	while (optchar = getopt(argc, argv, "f:j:t:"), optchar != -1)
+	while (optchar = getopt(argc, argv, "cf:j:l:n:t:"), optchar != -1)
 		switch (optchar) {
+		case 'c':
+			level = PDB_VERIFY_HEADER;
+			break;
+
 		case 'f':
 			fname = optarg;
 			break;
@@ -67,12 +74,27 @@ main(int argc, char *argv[])
 
 			break;
 
+		case 'l':
+			level = atoi(optarg);
+			if (level < PDB_VERIFY_HEADER || level > PDB_VERIFY_FULL) {
+				fprintf(stderr, "Verification level must be between %d and %d\n",
+				    PDB_VERIFY_HEADER, PDB_VERIFY_FULL);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 'n':
+			n_samples = strtoull(optarg, NULL, 0);
+			break;
+
 		case 't':
 			if (tileset_parse(&ts, optarg) != 0) {
 				fprintf(stderr, "Cannot parse tile set: %s\n", optarg);
 				return (EXIT_FAILURE);
 			}
 
+			have_ts = 1;
 			break;
 
 		case '?':
@@ -80,12 +102,6 @@ main(int argc, char *argv[])
 			usage(argv[0]);
 		}
 
-	if (tileset_count(tileset_remove(ts, ZERO_TILE)) >= INDEX_MAX_TILES) {
-		fprintf(stderr, "%d tiles are too many tiles. Up to %d tiles allowed.\n",
-		    tileset_count(tileset_remove(ts, ZERO_TILE)), INDEX_MAX_TILES);
-		return (EXIT_FAILURE);
-	}
-
 	if (fname != NULL) {
 		f = fopen(fname, "rb");
 		if (f == NULL) {
@@ -96,13 +112,39 @@ main(int argc, char *argv[])
 	} else
 		usage(argv[0]);
 
-	pdb = pdb_load(ts, f);
+	if (pdb_header_read(&hdr, fileno(f)) < 0) {
+		perror(fname);
+		return (EXIT_FAILURE);
+	}
+
+	/* default to the tile set recorded in the header */
+	if (!have_ts && hdr != NULL)
+		ts = hdr->tileset;
+
+	if (tileset_count(tileset_remove(ts, ZERO_TILE)) >= INDEX_MAX_TILES) {
+		fprintf(stderr, "%d tiles are too many tiles. Up to %d tiles allowed.\n",
+		    tileset_count(tileset_remove(ts, ZERO_TILE)), INDEX_MAX_TILES);
+		return (EXIT_FAILURE);
+	}
+
+	if (level == PDB_VERIFY_HEADER && hdr == NULL) {
+		fprintf(stderr, "%s: PDB has no header, cannot verify checksums\n", fname);
+		return (EXIT_FAILURE);
+	}
+
+	/* only the checksums are needed, don't bother loading the PDB */
+	if (level == PDB_VERIFY_HEADER)
+		pdb = pdb_mmap(ts, fileno(f), PDB_MAP_RDONLY);
+	else
+		pdb = pdb_load(ts, f);
+
 	if (pdb == NULL) {
-		perror("pdb_load");
+		perror(fname);
 		return (EXIT_FAILURE);
 	}
 
 	fclose(f);
 
-	return (pdb_verify(pdb, stderr));
+	return (pdb_verify_level(pdb, hdr, level, n_samples, stderr) == 0 ?
+	    EXIT_SUCCESS : EXIT_FAILURE);
 }
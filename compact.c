@@ -30,6 +30,10 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -37,6 +41,19 @@
 #include "compact.h"
 #include "puzzle.h"
 #include "builtins.h"
+#include "pdb.h"
+
+enum {
+	/* rounds smaller than this are processed on one thread */
+	PARALLEL_THRESHOLD = 1 << 16,
+
+	/* buckets smaller than this are sorted by insertion sort */
+	INSERTION_THRESHOLD = 32,
+
+	/* the shift of the first and last radix sort digit */
+	RADIX_FIRST_SHIFT = 116,
+	RADIX_LAST_SHIFT = -4,
+};
 
 /*
  * Translate a struct puzzle into a struct compact_puzzle.
@@ -253,35 +270,158 @@ cps_expand(struct cp_slice *cps, const struct compact_puzzle *cp)
 }
 
 /*
- * Given a sorted struct cp_slice cps, coalesce identical puzzles,
- * oring their move masks.  Since the move mask bits are the least
- * significatn bits in lo, puzzles differing only by their move
- * masks end up next to each other.
+ * Return the radix sort digit of cp at shift, i.e. bits shift to
+ * shift + 7 of the 128 bit key hi:lo.  The key has 124 significant
+ * bits, so the digits are taken at shifts 116, 108, ..., 4, -4 with
+ * the last digit holding just the move mask.
+ */
+static inline unsigned
+cp_digit(const struct compact_puzzle *cp, int shift)
+{
+	if (shift >= 64)
+		return (cp->hi >> shift - 64 & 0xff);
+	else if (shift > 56)
+		return ((cp->hi << 64 - shift | cp->lo >> shift) & 0xff);
+	else if (shift >= 0)
+		return (cp->lo >> shift & 0xff);
+	else
+		return (cp->lo << -shift & 0xff);
+}
+
+/*
+ * Sort the n entries of a in the order given by compare_cp using
+ * insertion sort.
  */
 static void
-cps_coalesce(struct cp_slice *cps)
+insertion_sort(struct compact_puzzle *a, size_t n)
 {
-	struct compact_puzzle *a, *b, *newdata;
+	struct compact_puzzle x;
 	size_t i, j;
 
-	if (cps->len == 0)
+	for (i = 1; i < n; i++) {
+		x = a[i];
+		for (j = i; j > 0 && compare_cp(a + j - 1, &x) > 0; j--)
+			a[j] = a[j - 1];
+
+		a[j] = x;
+	}
+}
+
+/*
+ * Move the entries of a in the ranges next[b] to end[b] - 1 such that
+ * each range only holds entries with digit b at shift.  The ranges
+ * must hold exactly as many entries of each digit as there is room
+ * for.  next is overwritten.
+ */
+static void
+permute_ranges(struct compact_puzzle *a, size_t next[256],
+    const size_t end[256], int shift)
+{
+	struct compact_puzzle x, tmp;
+	unsigned b, d;
+
+	for (b = 0; b < 256; b++)
+		while (next[b] < end[b]) {
+			x = a[next[b]];
+			d = cp_digit(&x, shift);
+			while (d != b) {
+				tmp = a[next[d]];
+				a[next[d]++] = x;
+				x = tmp;
+				d = cp_digit(&x, shift);
+			}
+
+			a[next[b]++] = x;
+		}
+}
+
+/*
+ * Permute the n entries of a in place such that they are grouped by
+ * their digit at shift (American flag sort).  count must hold the
+ * number of entries for each digit.
+ */
+static void
+radix_permute(struct compact_puzzle *a, const size_t count[256], int shift)
+{
+	size_t next[256], end[256], offset = 0;
+	unsigned b;
+
+	for (b = 0; b < 256; b++) {
+		next[b] = offset;
+		offset += count[b];
+		end[b] = offset;
+	}
+
+	permute_ranges(a, next, end, shift);
+}
+
+/*
+ * Sort the n entries of a in the order given by compare_cp, assuming
+ * that they agree in all digits before shift.  This is an in-place
+ * MSD radix sort.
+ */
+static void
+radix_sort(struct compact_puzzle *a, size_t n, int shift)
+{
+	size_t count[256], i, offset;
+	unsigned b;
+
+	if (n < INSERTION_THRESHOLD) {
+		insertion_sort(a, n);
 		return;
+	}
 
-	/* invariant: i < j */
-	for (i = 0, j = 1; j < cps->len; j++) {
-		a = &cps->data[i];
-		b = &cps->data[j];
+	memset(count, 0, sizeof count);
+	for (i = 0; i < n; i++)
+		count[cp_digit(a + i, shift)]++;
+
+	radix_permute(a, count, shift);
 
-		/* are a and b equal, ignoring the move mask? */
-		if (a->hi == b->hi && ((a->lo ^ b->lo) & ~MOVE_MASK) == 0)
-			a->lo |= b->lo;
+	if (shift <= RADIX_LAST_SHIFT)
+		return;
+
+	for (b = 0, offset = 0; b < 256; offset += count[b++])
+		if (count[b] > 1)
+			radix_sort(a + offset, count[b], shift - 8);
+}
+
+/*
+ * Coalesce identical puzzles in the n sorted entries of a, oring their
+ * move masks.  Since the move mask bits are the least significant bits
+ * in lo, puzzles differing only by their move masks end up next to
+ * each other.  Return the number of entries left.
+ */
+static size_t
+coalesce(struct compact_puzzle *a, size_t n)
+{
+	size_t i, j;
+
+	if (n == 0)
+		return (0);
+
+	/* invariant: i < j */
+	for (i = 0, j = 1; j < n; j++) {
+		/* are a[i] and a[j] equal, ignoring the move mask? */
+		if (a[i].hi == a[j].hi && ((a[i].lo ^ a[j].lo) & ~MOVE_MASK) == 0)
+			a[i].lo |= a[j].lo;
 		else
-			cps->data[++i] = *b;
+			a[++i] = a[j];
 	}
 
-	cps->len = i + 1;
+	return (i + 1);
+}
+
+/*
+ * Release unused storage at the end of cps.
+ */
+static void
+cps_shrink(struct cp_slice *cps)
+{
+	struct compact_puzzle *newdata;
+
+	if (cps->len == 0)
+		return;
 
-	/* conserve storage */
 	newdata = realloc(cps->data, cps->len * sizeof *cps->data);
 	if (newdata != NULL) {
 		cps->data = newdata;
@@ -290,20 +430,573 @@ cps_coalesce(struct cp_slice *cps)
 }
 
 /*
- * Expand vertices in cps and store them in new_cps.  Then sort and
- * coalesce new_cps.
+ * The state of a parallel radix sort pass over data at shift, see
+ * partition_parallel().  Entries head[b] to tail[b] - 1 make up the
+ * part of bucket b that still needs to be filled in.  For the repair
+ * phase, buckets are taken from next_bucket.
  */
-extern void
-cps_round(struct cp_slice *restrict new_cps, const struct cp_slice *restrict cps)
+struct partition {
+	struct compact_puzzle *data;
+	struct cps_task *tasks;
+	size_t head[256], tail[256];
+	atomic_uint next_bucket;
+	int jobs, shift;
+};
+
+/*
+ * One part of a cps_round() carried out by a single thread.  Depending
+ * on the phase, the thread counts or expands the vertices src[begin]
+ * to src[end-1] to dst, computes a histogram of data[begin] to
+ * data[end-1], moves entries into its stripes first[b] to
+ * stripe_end[b] - 1 of each bucket of part, sorts buckets of data taken from
+ * *next_bucket, or coalesces data[begin] to data[end-1].
+ */
+struct cps_task {
+	const struct compact_puzzle *src;
+	struct compact_puzzle *dst, *data;
+	size_t begin, end, count;
+	size_t histogram[256];
+	size_t first[256], next[256], limit[256], stripe_end[256];
+	struct partition *part;
+	const size_t *buckets;
+	atomic_uint *next_bucket;
+	int shift;
+};
+
+/*
+ * Run fn on each of the n tasks, using a thread for each task.
+ * If fewer threads can be spawned, the remaining tasks are run
+ * on the calling thread.
+ */
+static void
+run_tasks(void *(*fn)(void *), struct cps_task *tasks, int n)
+{
+	pthread_t pool[PDB_MAX_JOBS];
+	int i, spawned, error;
+
+	for (i = 0; i < n; i++) {
+		error = pthread_create(pool + i, NULL, fn, tasks + i);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_create");
+			break;
+		}
+	}
+
+	spawned = i;
+	for (; i < n; i++)
+		fn(tasks + i);
+
+	for (i = 0; i < spawned; i++) {
+		error = pthread_join(pool[i], NULL);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_join");
+			abort();
+		}
+	}
+}
+
+/*
+ * Count the vertices generated by expanding cp.
+ */
+static size_t
+expansion_count(const struct compact_puzzle *cp)
 {
+	struct puzzle p;
+	int n_move;
+
+	unpack_puzzle(&p, cp);
+	n_move = move_count(zero_location(&p));
+
+	return (popcount(~move_mask(cp) & (1 << n_move) - 1));
+}
+
+/*
+ * Count the vertices generated by expanding task->src[begin] to
+ * task->src[end-1].
+ */
+static void *
+count_task(void *arg)
+{
+	struct cps_task *task = arg;
 	size_t i;
 
-	for (i = 0; i < cps->len; i++)
-		cps_expand(new_cps, &cps->data[i]);
+	task->count = 0;
+	for (i = task->begin; i < task->end; i++)
+		task->count += expansion_count(task->src + i);
+
+	return (NULL);
+}
+
+/*
+ * Expand task->src[begin] to task->src[end-1] into task->dst, in the
+ * same order as cps_expand() would.
+ */
+static void *
+expand_task(void *arg)
+{
+	struct cps_task *task = arg;
+	struct cp_slice cps;
+	size_t i;
+
+	/* cps_append() never needs to grow this slice */
+	cps.data = task->dst;
+	cps.len = 0;
+	cps.cap = task->count;
+
+	for (i = task->begin; i < task->end; i++)
+		cps_expand(&cps, task->src + i);
+
+	assert(cps.len == task->count);
+
+	return (NULL);
+}
+
+/*
+ * Compute a histogram of the radix sort digit at task->shift of
+ * task->data[begin] to task->data[end-1].
+ */
+static void *
+histogram_task(void *arg)
+{
+	struct cps_task *task = arg;
+	size_t i;
+
+	memset(task->histogram, 0, sizeof task->histogram);
+	for (i = task->begin; i < task->end; i++)
+		task->histogram[cp_digit(task->data + i, task->shift)]++;
+
+	return (NULL);
+}
+
+/*
+ * Move entries into the stripes of task, one per bucket.  Entries
+ * are only moved between the stripes of task, so the tasks can run
+ * concurrently.  An entry that has no room left in the stripe of its
+ * bucket is set aside at the end of the stripe it was found in, to
+ * be moved in a later round.  Afterwards, each stripe holds entries
+ * for its bucket from first[b] to next[b] - 1 and entries set aside
+ * from next[b] to stripe_end[b] - 1.
+ */
+static void *
+partition_task(void *arg)
+{
+	struct cps_task *task = arg;
+	struct compact_puzzle *a = task->part->data, tmp;
+	int shift = task->part->shift;
+	unsigned b, d;
+
+	for (b = 0; b < 256; b++)
+		while (task->next[b] < task->limit[b]) {
+			d = cp_digit(a + task->next[b], shift);
+			if (d == b) {
+				task->next[b]++;
+				continue;
+			}
+
+			/* skip entries already in the right stripe */
+			while (task->next[d] < task->limit[d]
+			    && cp_digit(a + task->next[d], shift) == d)
+				task->next[d]++;
+
+			if (task->next[d] < task->limit[d]) {
+				tmp = a[task->next[d]];
+				a[task->next[d]++] = a[task->next[b]];
+				a[task->next[b]] = tmp;
+			} else {
+				tmp = a[--task->limit[b]];
+				a[task->limit[b]] = a[task->next[b]];
+				a[task->next[b]] = tmp;
+			}
+		}
+
+	return (NULL);
+}
+
+/*
+ * Find the next entry of bucket b at or after *pos in the stripes of
+ * tasks, starting with stripe *t, that has been moved to its place
+ * by partition_task(), and is at or after min.  Update *t and *pos to
+ * refer to it.
+ */
+static void
+next_placed(const struct cps_task *tasks, unsigned b, int *t, size_t *pos,
+    size_t min)
+{
+	for (;;) {
+		if (*pos < tasks[*t].first[b])
+			*pos = tasks[*t].first[b];
+
+		if (*pos < min)
+			*pos = min;
+
+		if (*pos < tasks[*t].next[b])
+			return;
+
+		++*t;
+	}
+}
+
+/*
+ * Find the next entry of bucket b at or after *pos in the stripes of
+ * tasks, starting with stripe *t, that has been set aside by
+ * partition_task().  Update *t and *pos to refer to it.  If there is
+ * none, set *pos to SIZE_MAX.
+ */
+static void
+next_aside(const struct cps_task *tasks, int jobs, unsigned b, int *t,
+    size_t *pos)
+{
+	for (;;) {
+		if (*t >= jobs) {
+			*pos = SIZE_MAX;
+			return;
+		}
+
+		if (*pos < tasks[*t].next[b])
+			*pos = tasks[*t].next[b];
+
+		if (*pos < tasks[*t].stripe_end[b])
+			return;
+
+		++*t;
+	}
+}
+
+/*
+ * After partition_task(), the buckets hold the entries moved to their
+ * place and the entries set aside, interleaved by stripe.  For each
+ * bucket taken off part->next_bucket, swap the entries set aside with
+ * entries in place such that the entries in place come first and
+ * advance part->head past them.
+ */
+static void *
+repair_task(void *arg)
+{
+	struct cps_task *task = arg;
+	struct partition *part = task->part;
+	struct compact_puzzle tmp;
+	size_t head, aside, placed, n_placed;
+	int i, t_aside, t_placed;
+	unsigned b;
+
+	while (b = atomic_fetch_add(&part->next_bucket, 1), b < 256) {
+		n_placed = 0;
+		for (i = 0; i < part->jobs; i++)
+			n_placed += part->tasks[i].next[b]
+			    - part->tasks[i].first[b];
+
+		head = part->head[b] + n_placed;
+		t_aside = 0;
+		aside = 0;
+		t_placed = 0;
+		placed = head;
+		for (;;) {
+			next_aside(part->tasks, part->jobs, b, &t_aside,
+			    &aside);
+			if (aside >= head)
+				break;
+
+			next_placed(part->tasks, b, &t_placed, &placed, head);
+			tmp = part->data[aside];
+			part->data[aside++] = part->data[placed];
+			part->data[placed++] = tmp;
+		}
+
+		part->head[b] = head;
+	}
+
+	return (NULL);
+}
+
+/*
+ * Sort the buckets of task->data delimited by task->buckets, grabbing
+ * them off *task->next_bucket until none are left.  Buckets with more
+ * than task->count entries are skipped.
+ */
+static void *
+sort_task(void *arg)
+{
+	struct cps_task *task = arg;
+	size_t n;
+	unsigned b;
+
+	while (b = atomic_fetch_add(task->next_bucket, 1), b < 256) {
+		n = task->buckets[b + 1] - task->buckets[b];
+		if (n > 1 && n <= task->count)
+			radix_sort(task->data + task->buckets[b], n,
+			    task->shift - 8);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Coalesce task->data[begin] to task->data[end-1], storing the number
+ * of entries left in task->count.
+ */
+static void *
+coalesce_task(void *arg)
+{
+	struct cps_task *task = arg;
+
+	task->count = coalesce(task->data + task->begin, task->end - task->begin);
+
+	return (NULL);
+}
+
+/*
+ * Split the range 0 to n - 1 into jobs tasks of about equal size.
+ */
+static void
+split_tasks(struct cps_task *tasks, int jobs, size_t n)
+{
+	int i;
+
+	for (i = 0; i < jobs; i++) {
+		tasks[i].begin = n * i / jobs;
+		tasks[i].end = n * (i + 1) / jobs;
+	}
+}
+
+/*
+ * Expand the vertices in cps into new_cps using jobs threads.  The
+ * vertices are generated in the same order as by a sequential
+ * expansion.  Return 0 on success, -1 on error with errno set.  On
+ * error, new_cps is unchanged.
+ */
+static int
+expand_parallel(struct cp_slice *restrict new_cps,
+    const struct cp_slice *restrict cps, struct cps_task *tasks, int jobs)
+{
+	struct compact_puzzle *newdata;
+	size_t total = new_cps->len;
+	int i;
+
+	split_tasks(tasks, jobs, cps->len);
+	for (i = 0; i < jobs; i++)
+		tasks[i].src = cps->data;
+
+	run_tasks(count_task, tasks, jobs);
+
+	for (i = 0; i < jobs; i++)
+		total += tasks[i].count;
 
-	qsort(new_cps->data, new_cps->len, sizeof *new_cps->data, compare_cp);
-	cps_coalesce(new_cps);
+	if (total > new_cps->cap) {
+		newdata = realloc(new_cps->data, total * sizeof *new_cps->data);
+		if (newdata == NULL)
+			return (-1);
+
+		new_cps->data = newdata;
+		new_cps->cap = total;
+	}
+
+	for (i = 0; i < jobs; i++) {
+		tasks[i].dst = new_cps->data + new_cps->len;
+		new_cps->len += tasks[i].count;
+	}
+
+	run_tasks(expand_task, tasks, jobs);
+
+	return (0);
+}
+
+/*
+ * Permute the n entries of data in place such that they are grouped
+ * by their digit at shift, like radix_permute() but using jobs
+ * threads.  This follows the PARADIS algorithm: in each round, the
+ * part of each bucket that is yet to be filled is split into one
+ * stripe per thread.  Each thread moves entries between its own
+ * stripes, setting aside those it has no room for.  Then the entries
+ * set aside are gathered at the end of each bucket for the next
+ * round.  Once few entries are left, the rest is done sequentially.
+ * count must hold the number of entries for each digit.
+ */
+static void
+partition_parallel(struct compact_puzzle *data, const size_t count[256],
+    int shift, struct cps_task *tasks, int jobs)
+{
+	struct partition part;
+	size_t len, left, offset = 0, last_left = (size_t)-1;
+	int i;
+	unsigned b;
+
+	part.data = data;
+	part.tasks = tasks;
+	part.jobs = jobs;
+	part.shift = shift;
+	for (b = 0; b < 256; b++) {
+		part.head[b] = offset;
+		offset += count[b];
+		part.tail[b] = offset;
+	}
+
+	for (left = offset; left >= PARALLEL_THRESHOLD && left < last_left; ) {
+		for (i = 0; i < jobs; i++) {
+			tasks[i].part = &part;
+			for (b = 0; b < 256; b++) {
+				len = part.tail[b] - part.head[b];
+				tasks[i].first[b] = part.head[b]
+				    + len * i / jobs;
+				tasks[i].stripe_end[b] = part.head[b]
+				    + len * (i + 1) / jobs;
+				tasks[i].next[b] = tasks[i].first[b];
+				tasks[i].limit[b] = tasks[i].stripe_end[b];
+			}
+		}
+
+		run_tasks(partition_task, tasks, jobs);
+
+		atomic_init(&part.next_bucket, 0);
+		run_tasks(repair_task, tasks, jobs);
+
+		last_left = left;
+		left = 0;
+		for (b = 0; b < 256; b++)
+			left += part.tail[b] - part.head[b];
+	}
+
+	permute_ranges(data, part.head, part.tail, shift);
 }
 
+/*
+ * Sort the n entries of data in the order given by compare_cp using
+ * jobs threads, assuming that they agree in all digits before shift.
+ * The entries are distributed by their digit at shift with
+ * partition_parallel().  Then the small buckets thus formed are
+ * sorted in parallel, one bucket per thread, while large buckets are
+ * sorted with sort_parallel() in turn.
+ */
+static void
+sort_parallel(struct compact_puzzle *data, size_t n, int shift,
+    struct cps_task *tasks, int jobs)
+{
+	atomic_uint next_bucket = 0;
+	size_t count[256], buckets[257], large;
+	int i;
+	unsigned b;
+
+	split_tasks(tasks, jobs, n);
+	for (i = 0; i < jobs; i++) {
+		tasks[i].data = data;
+		tasks[i].shift = shift;
+	}
+
+	run_tasks(histogram_task, tasks, jobs);
+
+	memset(count, 0, sizeof count);
+	for (i = 0; i < jobs; i++)
+		for (b = 0; b < 256; b++)
+			count[b] += tasks[i].histogram[b];
 
+	partition_parallel(data, count, shift, tasks, jobs);
+	if (shift <= RADIX_LAST_SHIFT)
+		return;
+
+	buckets[0] = 0;
+	for (b = 0; b < 256; b++)
+		buckets[b + 1] = buckets[b] + count[b];
+
+	/* buckets too large for one thread to sort in good time */
+	large = n / jobs;
+	if (large < PARALLEL_THRESHOLD)
+		large = PARALLEL_THRESHOLD;
+
+	for (i = 0; i < jobs; i++) {
+		tasks[i].data = data;
+		tasks[i].shift = shift;
+		tasks[i].count = large;
+		tasks[i].buckets = buckets;
+		tasks[i].next_bucket = &next_bucket;
+	}
 
+	run_tasks(sort_task, tasks, jobs);
+
+	for (b = 0; b < 256; b++)
+		if (count[b] > large)
+			sort_parallel(data + buckets[b], count[b], shift - 8,
+			    tasks, jobs);
+}
+
+/*
+ * Coalesce the sorted slice cps using jobs threads.  The task
+ * boundaries are moved such that no run of identical puzzles is
+ * split between two tasks, then each task is coalesced on its own
+ * and the results are moved together.
+ */
+static void
+coalesce_parallel(struct cp_slice *cps, struct cps_task *tasks, int jobs)
+{
+	const struct compact_puzzle *a = cps->data;
+	size_t b, len = 0;
+	int i;
+
+	split_tasks(tasks, jobs, cps->len);
+	for (i = 1; i < jobs; i++) {
+		b = tasks[i].begin;
+		if (b < tasks[i - 1].begin)
+			b = tasks[i - 1].begin;
+
+		while (b > 0 && b < cps->len && a[b].hi == a[b - 1].hi
+		    && ((a[b].lo ^ a[b - 1].lo) & ~MOVE_MASK) == 0)
+			b++;
+
+		tasks[i - 1].end = b;
+		tasks[i].begin = b;
+	}
+
+	for (i = 0; i < jobs; i++)
+		tasks[i].data = cps->data;
+
+	run_tasks(coalesce_task, tasks, jobs);
+
+	for (i = 0; i < jobs; i++) {
+		memmove(cps->data + len, cps->data + tasks[i].begin,
+		    tasks[i].count * sizeof *cps->data);
+		len += tasks[i].count;
+	}
+
+	cps->len = len;
+}
+
+/*
+ * Expand vertices in cps and store them in new_cps.  Then sort and
+ * coalesce new_cps.  Large rounds are processed with pdb_jobs threads.
+ * The result does not depend on the number of threads used.  Return 0
+ * on success, -1 on error with errno set.
+ */
+extern int
+cps_round(struct cp_slice *restrict new_cps, const struct cp_slice *restrict cps)
+{
+	struct cps_task *tasks = NULL;
+	size_t i;
+	int jobs = pdb_jobs;
+
+	if (jobs > 1 && cps->len >= PARALLEL_THRESHOLD)
+		tasks = malloc(jobs * sizeof *tasks);
+
+	/* if tasks cannot be allocated, just do it on one thread */
+	if (tasks == NULL) {
+		for (i = 0; i < cps->len; i++)
+			cps_expand(new_cps, &cps->data[i]);
+
+		radix_sort(new_cps->data, new_cps->len, RADIX_FIRST_SHIFT);
+		new_cps->len = coalesce(new_cps->data, new_cps->len);
+	} else {
+		if (expand_parallel(new_cps, cps, tasks, jobs) != 0) {
+			free(tasks);
+			return (-1);
+		}
+
+		sort_parallel(new_cps->data, new_cps->len, RADIX_FIRST_SHIFT,
+		    tasks, jobs);
+		coalesce_parallel(new_cps, tasks, jobs);
+		free(tasks);
+	}
+
+	/* conserve storage */
+	cps_shrink(new_cps);
+
+	return (0);
+}
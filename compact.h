@@ -62,7 +62,7 @@ extern int	compare_cp(const void *, const void *);
 extern int	compare_cp_nomask(const void *, const void *);
 
 extern void	cps_append(struct cp_slice *, const struct compact_puzzle *);
-extern void	cps_round(struct cp_slice *restrict, const struct cp_slice *restrict);
+extern int	cps_round(struct cp_slice *restrict, const struct cp_slice *restrict);
 
 /*
  * Initialize the content of cps to an empty slice.
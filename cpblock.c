@@ -0,0 +1,548 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* cpblock.c -- delta-compressed sorted arrays of compact puzzles */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compact.h"
+#include "cpblock.h"
+
+/* maximum length of a varint encoded 120 bit key difference */
+enum { MAX_VARINT_LEN = 18 };
+
+/*
+ * Return the key of cp, i.e. the puzzle without the move mask, as a
+ * 120 bit number.
+ */
+static inline __uint128_t
+cp_key(const struct compact_puzzle *cp)
+{
+	return ((__uint128_t)cp->hi << 60 | cp->lo >> 4);
+}
+
+/*
+ * Set cp to the puzzle with key and an empty move mask.
+ */
+static inline void
+cp_from_key(struct compact_puzzle *cp, __uint128_t key)
+{
+	cp->hi = key >> 60;
+	cp->lo = (unsigned long long)key << 4;
+}
+
+/*
+ * Grow the allocation ptr of *cap elements of the given size to hold at
+ * least need elements.  Return the possibly moved allocation.  On
+ * failure, return NULL and set errno, leaving ptr and *cap unchanged.
+ */
+static void *
+grow(void *ptr, size_t *cap, size_t need, size_t size)
+{
+	void *newptr;
+	size_t newcap;
+
+	if (need <= *cap)
+		return (ptr);
+
+	newcap = *cap < 64 ? 64 : *cap * 13 / 8;
+	if (newcap < need)
+		newcap = need;
+
+	newptr = realloc(ptr, newcap * size);
+	if (newptr == NULL)
+		return (NULL);
+
+	*cap = newcap;
+
+	return (newptr);
+}
+
+/*
+ * Initialize cpb to an empty array.
+ */
+extern void
+cpb_init(struct cp_blocks *cpb)
+{
+	memset(cpb, 0, sizeof *cpb);
+}
+
+/*
+ * Release all storage associated with cpb.  The content of cpb is
+ * undefined afterwards.
+ */
+extern void
+cpb_free(struct cp_blocks *cpb)
+{
+	free(cpb->data);
+	free(cpb->masks);
+	free(cpb->index);
+}
+
+/*
+ * Append cp to cpb.  cp must compare larger than the last entry of cpb
+ * when ignoring the move mask.  Return 0 on success, -1 on error with
+ * errno set.  On error, cpb is unchanged.
+ */
+extern int
+cpb_append(struct cp_blocks *cpb, const struct compact_puzzle *cp)
+{
+	struct cpb_index *newindex;
+	__uint128_t delta;
+	unsigned char *p, *newdata, *newmasks;
+
+	/* make room first so we don't fail half way through */
+	if (cpb->len % 2 == 0) {
+		newmasks = grow(cpb->masks, &cpb->mask_cap, cpb->len / 2 + 1, 1);
+		if (newmasks == NULL)
+			return (-1);
+
+		cpb->masks = newmasks;
+	}
+
+	if (cpb->len % CPB_BLOCK_LEN == 0) {
+		newindex = grow(cpb->index, &cpb->index_cap, cpb->n_block + 1,
+		    sizeof *cpb->index);
+		if (newindex == NULL)
+			return (-1);
+
+		cpb->index = newindex;
+		cpb->index[cpb->n_block].first = *cp;
+		clear_move_mask(&cpb->index[cpb->n_block].first);
+		cpb->index[cpb->n_block].offset = cpb->size;
+		cpb->n_block++;
+	} else {
+		assert(compare_cp_nomask(&cpb->last, cp) < 0);
+
+		newdata = grow(cpb->data, &cpb->data_cap, cpb->size + MAX_VARINT_LEN, 1);
+		if (newdata == NULL)
+			return (-1);
+
+		cpb->data = newdata;
+		delta = cp_key(cp) - cp_key(&cpb->last);
+		p = cpb->data + cpb->size;
+		while (delta >= 0x80) {
+			*p++ = delta & 0x7f | 0x80;
+			delta >>= 7;
+		}
+
+		*p++ = delta;
+		cpb->size = p - cpb->data;
+	}
+
+	if (cpb->len % 2 == 0)
+		cpb->masks[cpb->len / 2] = 0;
+
+	cpb_set_mask(cpb, cpb->len, move_mask(cp));
+	cpb->last = *cp;
+	cpb->len++;
+
+	return (0);
+}
+
+/*
+ * Release unused storage at the end of cpb.
+ */
+extern void
+cpb_shrink(struct cp_blocks *cpb)
+{
+	void *newptr;
+
+	if (cpb->len == 0)
+		return;
+
+	if (cpb->size > 0) {
+		newptr = realloc(cpb->data, cpb->size);
+		if (newptr != NULL) {
+			cpb->data = newptr;
+			cpb->data_cap = cpb->size;
+		}
+	}
+
+	newptr = realloc(cpb->masks, (cpb->len + 1) / 2);
+	if (newptr != NULL) {
+		cpb->masks = newptr;
+		cpb->mask_cap = (cpb->len + 1) / 2;
+	}
+
+	newptr = realloc(cpb->index, cpb->n_block * sizeof *cpb->index);
+	if (newptr != NULL) {
+		cpb->index = newptr;
+		cpb->index_cap = cpb->n_block;
+	}
+}
+
+/*
+ * Decode block i of cpb into out, which must have room for
+ * CPB_BLOCK_LEN entries.  Return the number of entries in the block.
+ */
+extern size_t
+cpb_block(struct compact_puzzle *out, const struct cp_blocks *cpb, size_t i)
+{
+	__uint128_t key, delta;
+	const unsigned char *p;
+	size_t j, n, base = i * CPB_BLOCK_LEN;
+	int shift;
+
+	assert(i < cpb->n_block);
+
+	n = cpb->len - base < CPB_BLOCK_LEN ? cpb->len - base : CPB_BLOCK_LEN;
+	p = cpb->data + cpb->index[i].offset;
+	key = cp_key(&cpb->index[i].first);
+	cp_from_key(out, key);
+	out->lo |= cpb_mask(cpb, base);
+
+	for (j = 1; j < n; j++) {
+		delta = 0;
+		shift = 0;
+		do {
+			delta |= (__uint128_t)(*p & 0x7f) << shift;
+			shift += 7;
+		} while (*p++ & 0x80);
+
+		key += delta;
+		cp_from_key(out + j, key);
+		out[j].lo |= cpb_mask(cpb, base + j);
+	}
+
+	return (n);
+}
+
+/*
+ * Look up cp in cpb, ignoring the move mask.  If it is found, store
+ * its position to *idx and return 1.  Otherwise return 0.
+ */
+extern int
+cpb_find(size_t *idx, const struct cp_blocks *cpb, const struct compact_puzzle *cp)
+{
+	struct compact_puzzle block[CPB_BLOCK_LEN];
+	size_t lo = 0, hi = cpb->n_block, mid, i, n;
+	int cmp;
+
+	if (cpb->n_block == 0)
+		return (0);
+
+	/* find the last block whose first entry is not larger than cp */
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (compare_cp_nomask(&cpb->index[mid].first, cp) <= 0)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	n = cpb_block(block, cpb, lo);
+	for (i = 0; i < n; i++) {
+		cmp = compare_cp_nomask(block + i, cp);
+		if (cmp == 0) {
+			*idx = lo * CPB_BLOCK_LEN + i;
+			return (1);
+		} else if (cmp > 0)
+			break;
+	}
+
+	return (0);
+}
+
+/* maximal number of runs kept by cpb_round() */
+enum { MERGE_FANIN = 8 };
+
+/*
+ * A sorted run generated by cpb_round().  level is the number of
+ * merges that went into the run.
+ */
+struct run {
+	struct cp_blocks cpb;
+	unsigned level;
+};
+
+/*
+ * A cursor reading the entries of a struct cp_blocks in order.
+ */
+struct cursor {
+	const struct cp_blocks *cpb;
+	size_t block, pos, len;
+	struct compact_puzzle buf[CPB_BLOCK_LEN];
+};
+
+/*
+ * Advance c to its next entry.  Return 1 if there is one, 0 if c is
+ * exhausted.
+ */
+static int
+cursor_next(struct cursor *c)
+{
+	if (++c->pos < c->len)
+		return (1);
+
+	if (c->block >= c->cpb->n_block)
+		return (0);
+
+	c->len = cpb_block(c->buf, c->cpb, c->block++);
+	c->pos = 0;
+
+	return (1);
+}
+
+/*
+ * Restore the heap property of the binary heap heap of n cursors,
+ * ordered by their current entry, after the entry at index i was
+ * replaced.
+ */
+static void
+sift_down(struct cursor **heap, size_t n, size_t i)
+{
+	struct cursor *tmp;
+	size_t child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= n)
+			break;
+
+		if (child + 1 < n && compare_cp(heap[child + 1]->buf + heap[child + 1]->pos,
+		    heap[child]->buf + heap[child]->pos) < 0)
+			child++;
+
+		if (compare_cp(heap[i]->buf + heap[i]->pos,
+		    heap[child]->buf + heap[child]->pos) <= 0)
+			break;
+
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+/*
+ * Merge the n_run sorted runs into out, coalescing identical puzzles.
+ * Return 0 on success, -1 on error with errno set.
+ */
+static int
+merge_runs(struct cp_blocks *out, const struct run *runs, size_t n_run)
+{
+	struct cursor *cursors, **heap;
+	struct compact_puzzle cur, *next;
+	size_t i, n_heap = 0;
+	int have_cur = 0, res = -1;
+
+	cursors = malloc(n_run * sizeof *cursors);
+	heap = malloc(n_run * sizeof *heap);
+	if (cursors == NULL || heap == NULL)
+		goto fail;
+
+	for (i = 0; i < n_run; i++) {
+		cursors[i].cpb = &runs[i].cpb;
+		cursors[i].block = 0;
+		cursors[i].pos = 0;
+		cursors[i].len = 0;
+		if (cursor_next(cursors + i))
+			heap[n_heap++] = cursors + i;
+	}
+
+	for (i = n_heap; i-- > 0; )
+		sift_down(heap, n_heap, i);
+
+	while (n_heap > 0) {
+		next = heap[0]->buf + heap[0]->pos;
+
+		/* are cur and next equal, ignoring the move mask? */
+		if (have_cur && cur.hi == next->hi && ((cur.lo ^ next->lo) & ~MOVE_MASK) == 0)
+			cur.lo |= next->lo;
+		else {
+			if (have_cur && cpb_append(out, &cur) != 0)
+				goto fail;
+
+			cur = *next;
+			have_cur = 1;
+		}
+
+		if (!cursor_next(heap[0]))
+			heap[0] = heap[--n_heap];
+
+		sift_down(heap, n_heap, 0);
+	}
+
+	if (have_cur && cpb_append(out, &cur) != 0)
+		goto fail;
+
+	res = 0;
+
+fail:	free(heap);
+	free(cursors);
+
+	return (res);
+}
+
+/*
+ * Find the longest sequence of at least two runs in the n_run runs in
+ * runs that went through the same number of merges, preferring later
+ * (i.e. smaller) runs, as merge_group() in cpfile.c does.  Store the
+ * index of its first run in *first and return its length.
+ */
+static size_t
+merge_group(size_t *first, const struct run *runs, size_t n_run)
+{
+	size_t i, j, len = 0;
+
+	for (i = 0; i < n_run; i = j) {
+		for (j = i + 1; j < n_run && runs[j].level == runs[i].level; j++)
+			;
+
+		if (j - i >= len) {
+			*first = i;
+			len = j - i;
+		}
+	}
+
+	if (len < 2) {
+		*first = n_run - 2;
+		len = 2;
+	}
+
+	return (len);
+}
+
+/*
+ * Merge a group of runs chosen by merge_group() into a new run, which
+ * takes their place.  Return 0 on success, -1 on error with errno set.
+ * On error, runs is unchanged.
+ */
+static int
+merge_some(struct run *runs, size_t *n_run)
+{
+	struct run merged;
+	size_t i, first, len;
+	int error;
+
+	len = merge_group(&first, runs, *n_run);
+
+	cpb_init(&merged.cpb);
+	merged.level = runs[first].level == runs[first + len - 1].level ?
+	    runs[first].level + 1 : runs[first].level;
+	if (merge_runs(&merged.cpb, runs + first, len) != 0) {
+		error = errno;
+		cpb_free(&merged.cpb);
+		errno = error;
+		return (-1);
+	}
+
+	cpb_shrink(&merged.cpb);
+	for (i = first; i < first + len; i++)
+		cpb_free(&runs[i].cpb);
+
+	runs[first] = merged;
+	memmove(runs + first + 1, runs + first + len,
+	    (*n_run - first - len) * sizeof *runs);
+	*n_run -= len - 1;
+
+	return (0);
+}
+
+/*
+ * Expand the vertices in old and store the coalesced result in
+ * new_cpb.  Like cpf_round(), this is done in runs: chunks of old are
+ * decompressed and expanded with cps_round() into runs of at most
+ * runsize bytes, which are compressed and then merged.  So duplicates
+ * do not pile up in memory, a group of runs of about the same size is
+ * merged whenever MERGE_FANIN runs have accumulated.
+ * Return 0 on success, -1 on error with errno set.  On error, new_cpb
+ * may hold a partial result and must still be released with
+ * cpb_free().
+ */
+extern int
+cpb_round(struct cp_blocks *restrict new_cpb, const struct cp_blocks *restrict old,
+    size_t runsize)
+{
+	struct run *runs = NULL, *newruns;
+	struct cp_slice chunk, run;
+	size_t i, j, blocks_per_chunk, n_run = 0;
+	int error, res = -1;
+
+	/* each vertex has at most four successors */
+	blocks_per_chunk = runsize / (4 * CPB_BLOCK_LEN * sizeof *chunk.data);
+	if (blocks_per_chunk == 0)
+		blocks_per_chunk = 1;
+
+	chunk.cap = blocks_per_chunk * CPB_BLOCK_LEN;
+	chunk.data = malloc(chunk.cap * sizeof *chunk.data);
+	if (chunk.data == NULL)
+		return (-1);
+
+	for (i = 0; i < old->n_block; ) {
+		chunk.len = 0;
+		for (j = 0; j < blocks_per_chunk && i < old->n_block; j++)
+			chunk.len += cpb_block(chunk.data + chunk.len, old, i++);
+
+		cps_init(&run);
+		if (cps_round(&run, &chunk) != 0)
+			goto fail_run;
+
+		newruns = realloc(runs, (n_run + 1) * sizeof *runs);
+		if (newruns == NULL)
+			goto fail_run;
+
+		runs = newruns;
+		cpb_init(&runs[n_run].cpb);
+		runs[n_run].level = 0;
+		n_run++;
+		for (j = 0; j < run.len; j++)
+			if (cpb_append(&runs[n_run - 1].cpb, run.data + j) != 0)
+				goto fail_run;
+
+		cpb_shrink(&runs[n_run - 1].cpb);
+		cps_free(&run);
+
+		if (n_run >= MERGE_FANIN && merge_some(runs, &n_run) != 0)
+			goto fail;
+	}
+
+	free(chunk.data);
+	chunk.data = NULL;
+
+	if (merge_runs(new_cpb, runs, n_run) != 0)
+		goto fail;
+
+	cpb_shrink(new_cpb);
+	res = 0;
+	goto fail;
+
+fail_run:
+	cps_free(&run);
+
+fail:	error = errno;
+	free(chunk.data);
+	for (i = 0; i < n_run; i++)
+		cpb_free(&runs[i].cpb);
+
+	free(runs);
+	errno = error;
+
+	return (res);
+}
@@ -0,0 +1,99 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* cpblock.h -- delta-compressed sorted arrays of compact puzzles */
+
+#ifndef CPBLOCK_H
+#define CPBLOCK_H
+
+#include <stddef.h>
+
+#include "compact.h"
+
+/*
+ * A struct cp_blocks stores a sorted array of struct compact_puzzle
+ * without duplicates (ignoring move masks), as generated by cps_round(),
+ * in compressed form.  The 120 bit keys (the puzzle without the move
+ * mask) are split into blocks of CPB_BLOCK_LEN entries.  The first key
+ * of each block is stored in the index, the others as the difference to
+ * their predecessor, encoded as a LEB128 varint.  The index allows for
+ * binary search and random access to blocks.  The move masks are kept
+ * in a separate array with two masks per byte, so they can be changed
+ * in place.  Sorted layers take about 7 bytes per entry this way
+ * instead of 16.
+ */
+enum { CPB_BLOCK_LEN = 128 };
+
+struct cpb_index {
+	struct compact_puzzle first;	/* first key, move mask cleared */
+	size_t offset;			/* offset of the block in data */
+};
+
+struct cp_blocks {
+	unsigned char *data;		/* varint encoded differences */
+	unsigned char *masks;		/* move masks, two per byte */
+	struct cpb_index *index;	/* one entry per block */
+	size_t len, size, n_block;	/* entries, bytes in data, blocks */
+	size_t mask_cap, data_cap, index_cap; /* allocated bytes and blocks */
+	struct compact_puzzle last;	/* last entry appended */
+};
+
+extern void	cpb_init(struct cp_blocks *);
+extern void	cpb_free(struct cp_blocks *);
+extern int	cpb_append(struct cp_blocks *, const struct compact_puzzle *);
+extern void	cpb_shrink(struct cp_blocks *);
+extern size_t	cpb_block(struct compact_puzzle *, const struct cp_blocks *, size_t);
+extern int	cpb_find(size_t *, const struct cp_blocks *, const struct compact_puzzle *);
+extern int	cpb_round(struct cp_blocks *restrict, const struct cp_blocks *restrict, size_t);
+
+/*
+ * Return the number of bytes of storage used by cpb.
+ */
+static inline size_t
+cpb_storage(const struct cp_blocks *cpb)
+{
+	return (cpb->size + (cpb->len + 1) / 2 + cpb->n_block * sizeof *cpb->index);
+}
+
+/*
+ * Return the move mask of entry i of cpb.
+ */
+static inline int
+cpb_mask(const struct cp_blocks *cpb, size_t i)
+{
+	return (cpb->masks[i / 2] >> 4 * (i % 2) & MOVE_MASK);
+}
+
+/*
+ * Set the move mask of entry i of cpb to mask.
+ */
+static inline void
+cpb_set_mask(struct cp_blocks *cpb, size_t i, int mask)
+{
+	cpb->masks[i / 2] &= ~(MOVE_MASK << 4 * (i % 2));
+	cpb->masks[i / 2] |= mask << 4 * (i % 2);
+}
+
+#endif /* CPBLOCK_H */
@@ -0,0 +1,477 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* cpfile.c -- disk-backed breadth-first search layers */
+
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compact.h"
+#include "cpfile.h"
+
+enum {
+	/* number of entries buffered for each run while merging */
+	MERGE_BUFSIZE = 4096,
+
+	/* maximal number of runs kept at once */
+	MERGE_FANIN = 64,
+};
+
+/*
+ * A sorted run in a temporary file.  level is the number of merges
+ * that went into the run.  While merging, buf holds the entries read
+ * from the run, of which the ones from pos to len have not been
+ * merged yet.
+ */
+struct run {
+	FILE *f;
+	struct compact_puzzle *buf;
+	size_t pos, len;
+	unsigned level;
+};
+
+/*
+ * Create a temporary file in directory tmpdir or in the default
+ * location if tmpdir is NULL.  The file is unlinked right away, so it
+ * disappears once closed.  Return the file opened for reading and
+ * writing or NULL on error with errno set.
+ */
+extern FILE *
+cpf_tmpfile(const char *tmpdir)
+{
+	FILE *f;
+	int fd, error;
+	char path[PATH_MAX];
+
+	if (tmpdir == NULL)
+		return (tmpfile());
+
+	if (snprintf(path, sizeof path, "%s/cpfileXXXXXX", tmpdir) >= (int)sizeof path) {
+		errno = ENAMETOOLONG;
+		return (NULL);
+	}
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		return (NULL);
+
+	unlink(path);
+
+	f = fdopen(fd, "w+b");
+	if (f == NULL) {
+		error = errno;
+		close(fd);
+		errno = error;
+	}
+
+	return (f);
+}
+
+/*
+ * Write the n entries of data to f.  Return 0 on success, -1 on error
+ * with errno set.
+ */
+static int
+write_entries(FILE *f, const struct compact_puzzle *data, size_t n)
+{
+	size_t count;
+	int error;
+
+	count = fwrite(data, sizeof *data, n, f);
+	if (count != n) {
+		error = errno;
+
+		/* tell apart end of medium from IO error */
+		if (!ferror(f))
+			errno = ENOSPC;
+		else
+			errno = error;
+
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Refill the buffer of r if it is empty.  Return 1 if r has entries
+ * left, 0 if it is exhausted, -1 on error with errno set.
+ */
+static int
+run_fill(struct run *r)
+{
+	if (r->pos < r->len)
+		return (1);
+
+	r->pos = 0;
+	r->len = fread(r->buf, sizeof *r->buf, MERGE_BUFSIZE, r->f);
+	if (r->len == 0)
+		return (ferror(r->f) ? -1 : 0);
+
+	return (1);
+}
+
+/*
+ * Restore the heap property of the binary heap heap of n runs, ordered
+ * by their current entry, after the entry at index i was replaced.
+ */
+static void
+sift_down(struct run **heap, size_t n, size_t i)
+{
+	struct run *tmp;
+	size_t child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= n)
+			break;
+
+		if (child + 1 < n && compare_cp(heap[child + 1]->buf + heap[child + 1]->pos,
+		    heap[child]->buf + heap[child]->pos) < 0)
+			child++;
+
+		if (compare_cp(heap[i]->buf + heap[i]->pos,
+		    heap[child]->buf + heap[child]->pos) <= 0)
+			break;
+
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+/*
+ * Merge the n_run sorted runs into outfile, coalescing identical
+ * puzzles.  Store the number of entries written to *count.  Return
+ * 0 on success, -1 on error with errno set.
+ */
+static int
+merge_runs(FILE *outfile, size_t *count, struct run *runs, size_t n_run)
+{
+	struct run **heap;
+	struct compact_puzzle cur, *next;
+	size_t i, n_heap = 0;
+	int error, res;
+
+	*count = 0;
+
+	if (n_run == 0)
+		return (0);
+
+	heap = malloc(n_run * sizeof *heap);
+	if (heap == NULL)
+		return (-1);
+
+	for (i = 0; i < n_run; i++)
+		runs[i].buf = NULL;
+
+	for (i = 0; i < n_run; i++) {
+		runs[i].buf = malloc(MERGE_BUFSIZE * sizeof *runs[i].buf);
+		if (runs[i].buf == NULL)
+			goto fail;
+
+		runs[i].pos = 0;
+		runs[i].len = 0;
+		if (fseeko(runs[i].f, 0, SEEK_SET) != 0)
+			goto fail;
+
+		res = run_fill(runs + i);
+		if (res < 0)
+			goto fail;
+		else if (res > 0)
+			heap[n_heap++] = runs + i;
+	}
+
+	for (i = n_heap; i-- > 0; )
+		sift_down(heap, n_heap, i);
+
+	while (n_heap > 0) {
+		next = heap[0]->buf + heap[0]->pos++;
+
+		/* are cur and next equal, ignoring the move mask? */
+		if (*count > 0 && cur.hi == next->hi && ((cur.lo ^ next->lo) & ~MOVE_MASK) == 0)
+			cur.lo |= next->lo;
+		else {
+			if (*count > 0 && write_entries(outfile, &cur, 1) != 0)
+				goto fail;
+
+			cur = *next;
+			++*count;
+		}
+
+		res = run_fill(heap[0]);
+		if (res < 0)
+			goto fail;
+		else if (res == 0)
+			heap[0] = heap[--n_heap];
+
+		sift_down(heap, n_heap, 0);
+	}
+
+	if (*count > 0 && write_entries(outfile, &cur, 1) != 0)
+		goto fail;
+
+	for (i = 0; i < n_run; i++)
+		free(runs[i].buf);
+
+	free(heap);
+
+	return (fflush(outfile) == 0 ? 0 : -1);
+
+fail:	error = errno;
+	for (i = 0; i < n_run; i++)
+		free(runs[i].buf);
+
+	free(heap);
+	errno = error;
+
+	return (-1);
+}
+
+/*
+ * Find the longest sequence of at least two runs in the n_run runs in
+ * runs that went through the same number of merges, preferring later
+ * (i.e. smaller) runs.  Store the index of its first run in *first and
+ * return its length.  The levels of the runs never increase towards
+ * the end of runs, so runs of the same level are next to each other.
+ * If all runs have distinct levels, the last two runs are chosen.
+ */
+static size_t
+merge_group(size_t *first, const struct run *runs, size_t n_run)
+{
+	size_t i, j, len = 0;
+
+	for (i = 0; i < n_run; i = j) {
+		for (j = i + 1; j < n_run && runs[j].level == runs[i].level; j++)
+			;
+
+		if (j - i >= len) {
+			*first = i;
+			len = j - i;
+		}
+	}
+
+	if (len < 2) {
+		*first = n_run - 2;
+		len = 2;
+	}
+
+	return (len);
+}
+
+/*
+ * Merge a group of runs chosen by merge_group() into a new run in a
+ * temporary file in tmpdir, which takes their place.  Return 0 on
+ * success, -1 on error with errno set.  On error, runs is unchanged.
+ */
+static int
+merge_some(struct run *runs, size_t *n_run, const char *tmpdir)
+{
+	struct run merged;
+	size_t i, count, first, len;
+	int error;
+
+	len = merge_group(&first, runs, *n_run);
+
+	merged.f = cpf_tmpfile(tmpdir);
+	if (merged.f == NULL)
+		return (-1);
+
+	merged.buf = NULL;
+	merged.pos = 0;
+	merged.len = 0;
+	merged.level = runs[first].level == runs[first + len - 1].level ?
+	    runs[first].level + 1 : runs[first].level;
+
+	if (merge_runs(merged.f, &count, runs + first, len) != 0) {
+		error = errno;
+		fclose(merged.f);
+		errno = error;
+		return (-1);
+	}
+
+	for (i = first; i < first + len; i++)
+		fclose(runs[i].f);
+
+	runs[first] = merged;
+	memmove(runs + first + 1, runs + first + len,
+	    (*n_run - first - len) * sizeof *runs);
+	*n_run -= len - 1;
+
+	return (0);
+}
+
+/*
+ * Expand the layer old and write the next layer to outfile, storing
+ * the number of entries in the new layer to *count.  The expansion is
+ * carried out in runs of at most runsize bytes which are written to
+ * temporary files in tmpdir (see cpf_tmpfile()) and then merged.  Each
+ * run is generated with cps_round(), so pdb_jobs threads are used for
+ * large runs.  To keep the number of open files bounded, there are
+ * never more than MERGE_FANIN runs at once: once this many runs have
+ * accumulated, a group of runs of about the same size is merged into
+ * a single run (see merge_group()).  outfile is positioned at the end of the layer.
+ * Return 0 on success, -1 on error with errno set.
+ */
+extern int
+cpf_round(FILE *outfile, size_t *count, const struct cp_slice *old,
+    const char *tmpdir, size_t runsize)
+{
+	struct run *runs = NULL, *newruns;
+	struct cp_slice chunk, run;
+	size_t i, chunksize, n_run = 0;
+	int error, res = -1;
+
+	/* each vertex has at most four successors */
+	chunksize = runsize / (4 * sizeof *old->data);
+	if (chunksize == 0)
+		chunksize = 1;
+
+	for (i = 0; i < old->len; i += chunk.len) {
+		chunk.data = old->data + i;
+		chunk.len = old->len - i < chunksize ? old->len - i : chunksize;
+		chunk.cap = chunk.len;
+
+		cps_init(&run);
+		if (cps_round(&run, &chunk) != 0)
+			goto fail_run;
+
+		newruns = realloc(runs, (n_run + 1) * sizeof *runs);
+		if (newruns == NULL)
+			goto fail_run;
+
+		runs = newruns;
+		runs[n_run].f = cpf_tmpfile(tmpdir);
+		if (runs[n_run].f == NULL)
+			goto fail_run;
+
+		runs[n_run].buf = NULL;
+		runs[n_run].pos = 0;
+		runs[n_run].len = 0;
+		runs[n_run].level = 0;
+		n_run++;
+
+		if (write_entries(runs[n_run - 1].f, run.data, run.len) != 0)
+			goto fail_run;
+
+		cps_free(&run);
+
+		if (n_run >= MERGE_FANIN && merge_some(runs, &n_run, tmpdir) != 0)
+			goto fail;
+	}
+
+	res = merge_runs(outfile, count, runs, n_run);
+	goto fail;
+
+fail_run:
+	cps_free(&run);
+
+fail:	error = errno;
+	for (i = 0; i < n_run; i++)
+		fclose(runs[i].f);
+
+	free(runs);
+	errno = error;
+
+	return (res);
+}
+
+/*
+ * Map the layer file f into memory, setting up cps to refer to it.
+ * mapflags is one of CPF_MAP_RDONLY, CPF_MAP_PRIVATE, and
+ * CPF_MAP_SHARED.  Pending output on f is flushed first.  The slice
+ * must be released with cpf_unmap(), not with cps_free().  Return 0 on
+ * success, -1 on error with errno set.
+ */
+extern int
+cpf_map(struct cp_slice *cps, FILE *f, int mapflags)
+{
+	struct stat st;
+	void *data;
+	int prot, flags;
+
+	switch (mapflags) {
+	case CPF_MAP_RDONLY:
+		prot = PROT_READ;
+		flags = MAP_SHARED;
+		break;
+
+	case CPF_MAP_PRIVATE:
+		prot = PROT_READ | PROT_WRITE;
+		flags = MAP_PRIVATE;
+		break;
+
+	case CPF_MAP_SHARED:
+		prot = PROT_READ | PROT_WRITE;
+		flags = MAP_SHARED;
+		break;
+
+	default:
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if (fflush(f) != 0 || fstat(fileno(f), &st) != 0)
+		return (-1);
+
+	if (st.st_size % sizeof *cps->data != 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	cps_init(cps);
+	if (st.st_size == 0)
+		return (0);
+
+	data = mmap(NULL, st.st_size, prot, flags, fileno(f), 0);
+	if (data == MAP_FAILED)
+		return (-1);
+
+	cps->data = data;
+	cps->len = st.st_size / sizeof *cps->data;
+	cps->cap = cps->len;
+
+	return (0);
+}
+
+/*
+ * Release a slice mapped with cpf_map().
+ */
+extern void
+cpf_unmap(struct cp_slice *cps)
+{
+	if (cps->len > 0)
+		munmap(cps->data, cps->len * sizeof *cps->data);
+
+	cps_init(cps);
+}
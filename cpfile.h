@@ -0,0 +1,62 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* cpfile.h -- disk-backed breadth-first search layers */
+
+#ifndef CPFILE_H
+#define CPFILE_H
+
+#include <stdio.h>
+
+#include "compact.h"
+
+/*
+ * A layer file holds a BFS layer as it would be generated by
+ * cps_round(): a sorted array of struct compact_puzzle with identical
+ * puzzles coalesced, stored in host byte order without any header.
+ * Layer files are generated by cpf_round() which expands the previous
+ * layer in runs of a bounded size, writes each run as a sorted
+ * temporary file and then merges the runs.  This way, BFS layers are
+ * only limited by the size of the disk, not by the size of RAM.  To
+ * access a layer file, it is mapped into memory as a struct cp_slice
+ * using cpf_map().
+ */
+
+/* flags for cpf_map() */
+enum {
+	CPF_MAP_RDONLY = 0,	/* read only mapping */
+	CPF_MAP_PRIVATE = 1,	/* writable mapping, changes are discarded */
+	CPF_MAP_SHARED = 2,	/* writable mapping, changes are written back */
+};
+
+/* default run size in bytes */
+#define CPF_DEFAULT_RUNSIZE ((size_t)1 << 30)
+
+extern FILE	*cpf_tmpfile(const char *);
+extern int	cpf_round(FILE *, size_t *, const struct cp_slice *, const char *, size_t);
+extern int	cpf_map(struct cp_slice *, FILE *, int);
+extern void	cpf_unmap(struct cp_slice *);
+
+#endif /* CPFILE_H */
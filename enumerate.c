@@ -0,0 +1,115 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* enumerate.c -- enumerate all optimal solutions of a puzzle */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+
+#include "catalogue.h"
+#include "fsm.h"
+#include "puzzle.h"
+#include "search.h"
+
+/*
+ * Every solution search_ida_bounded() reports is a distinct leaf of the
+ * search tree and hence a distinct move sequence.  No solution is thus
+ * reported twice and each can be written out right away without
+ * remembering the ones found before.
+ */
+struct enum_state {
+	struct search_enumeration *result;
+	FILE *out;
+	void (*on_solved)(const struct path *, void *);
+	void *payload;
+};
+
+/*
+ * Callback for search_ida_bounded().  Write each solution to est->out
+ * and pass it on to est->on_solved.
+ */
+static void
+add_solution(const struct path *path, void *estarg)
+{
+	struct enum_state *est = estarg;
+	char pathstr[PATH_STR_LEN];
+
+	est->result->n_solutions++;
+
+	if (est->out != NULL) {
+		/* path_string() can't deal with empty paths */
+		if (path->pathlen == 0)
+			fputs("-\n", est->out);
+		else {
+			path_string(pathstr, path);
+			fprintf(est->out, "%s\n", pathstr);
+		}
+	}
+
+	if (est->on_solved != NULL)
+		est->on_solved(path, est->payload);
+}
+
+/*
+ * Find all optimal solutions to p of length up to limit using IDA*.
+ * Each solution is written to out (if not NULL) as soon as it is
+ * found, one per line in the format of path_string(), and passed to
+ * on_solved (if not NULL).  The optimal solution length (or
+ * SEARCH_NO_PATH), the number of solutions, and the number of nodes
+ * expanded are stored in result.  As the round with the optimal bound
+ * is searched in full, the search needs not be repeated to count the
+ * solutions.  flags is passed on to search_ida_bounded() with
+ * IDA_LAST_FULL implied.
+ *
+ * Return 0 on success.  On failure, return -1 and set errno.  The
+ * search always runs to completion, but if an error occurs, output
+ * might have been lost.
+ */
+extern int
+search_ida_enumerate(struct pdb_catalogue *cat, const struct fsm *fsm,
+    const struct puzzle *p, size_t limit, FILE *out,
+    void (*on_solved)(const struct path *, void *), void *payload, int flags,
+    struct search_enumeration *result)
+{
+	struct enum_state est;
+	struct path path;
+
+	result->n_solutions = 0;
+
+	est.result = result;
+	est.out = out;
+	est.on_solved = on_solved;
+	est.payload = payload;
+
+	result->expanded = search_ida_bounded(cat, fsm, p, limit, &path,
+	    add_solution, &est, flags | IDA_LAST_FULL, NULL, NULL);
+	result->pathlen = path.pathlen;
+
+	if (out != NULL && (fflush(out) != 0 || ferror(out)))
+		return (-1);
+
+	return (0);
+}
@@ -28,17 +28,22 @@
 #define _POSIX_C_SOURCE 200809L
 #include <errno.h>
 #include <fcntl.h>
+#include <stdalign.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include "bitpdb.h"
 #include "heuristic.h"
+#include "mod3pdb.h"
 #include "transposition.h"
 #include "tileset.h"
 #include "puzzle.h"
 #include "pdb.h"
+#include "shmreg.h"
 
 /*
  * A heuristic function driver.  Each driver is responsible for some
@@ -53,6 +58,7 @@ typedef int heu_driver(struct heuristic *heu, const char *heudir,
 static heu_driver pdb_driver, ipdb_driver, zpdb_driver;
 static heu_driver bitpdb_driver, zbitpdb_driver;
 static heu_driver bitpdb_zstd_driver, zbitpdb_zstd_driver;
+static heu_driver mod3pdb_driver, zmod3pdb_driver;
 
 /*
  * All available drivers.  The array is terminated with a NULL sentinel.
@@ -75,6 +81,9 @@ const struct {
 	"bpdb.zst", bitpdb_zstd_driver, 0,
 	"zbpdb.zst", zbitpdb_zstd_driver, HEU_ZEROTILE,
 
+	"m3pdb", mod3pdb_driver, 0,
+	"zm3pdb", zmod3pdb_driver, HEU_ZEROTILE,
+
 	"pdb", bitpdb_driver, HEU_SIMILAR,
 	"zpdb", zbitpdb_driver, HEU_SIMILAR | HEU_ZEROTILE,
 	"bpdb.zst", bitpdb_driver, HEU_SIMILAR,
@@ -90,6 +99,11 @@ const struct {
 	"bpdb", bitpdb_zstd_driver, HEU_SIMILAR,
 	"zbpdb", zbitpdb_zstd_driver, HEU_SIMILAR | HEU_ZEROTILE,
 
+	"pdb", mod3pdb_driver, HEU_SIMILAR,
+	"zpdb", zmod3pdb_driver, HEU_SIMILAR | HEU_ZEROTILE,
+	"m3pdb", pdb_driver, HEU_SIMILAR,
+	"zm3pdb", zpdb_driver, HEU_SIMILAR | HEU_ZEROTILE,
+
 	NULL,	NULL, 0,
 };
 
@@ -101,7 +115,14 @@ const struct {
  * not present.  If HEU_VERBOSE is set, print status information to
  * stderr.  If HEU_NOMORPH is set, do not look for isomorphic
  * heuristics.  If HEU_SIMILAR is set, look for different
- * representations of the same heuristic type, too.
+ * representations of the same heuristic type, too.  If HEU_SHARED is
+ * set, tables that would otherwise be decompressed or generated into
+ * private memory are placed into a shared memory registry (see
+ * shmreg.h) so concurrent processes on the same host share them.  If
+ * HEU_WARMUP is set, PDBs loaded from disk are read into memory in the
+ * background; with HEU_MLOCK, they are also locked into memory.  If
+ * HEU_BLOCKED is set, PDBs not placed in shared memory are rearranged
+ * into the blocked layout (see pdb.h) for better locality of lookups.
  */
 extern int
 heu_open(struct heuristic *heu,
@@ -227,6 +248,134 @@ success:
 /*
  * hval, hdiff, and free implementations for struct patterndb based heuristics.
  */
+/*
+ * If heudir contains the zero-aware PDB for ts, map it and return it.
+ * Otherwise, return NULL.  This is used to derive identified PDBs
+ * without generating them from scratch.
+ */
+static struct patterndb *
+map_zpdb(const char *heudir, tileset ts, int flags)
+{
+	struct patterndb *zpdb;
+	int fd, saved_errno = errno;
+	char pathbuf[PATH_MAX], ztsstr[TILESET_LIST_LEN];
+
+	if (heudir == NULL)
+		return (NULL);
+
+	ts = tileset_add(ts, ZERO_TILE);
+	tileset_list_string(ztsstr, ts);
+	if (snprintf(pathbuf, PATH_MAX, "%s/%s.pdb", heudir, ztsstr) >= PATH_MAX)
+		return (NULL);
+
+	fd = open(pathbuf, O_RDONLY);
+	if (fd == -1) {
+		errno = saved_errno;
+		return (NULL);
+	}
+
+	zpdb = pdb_mmap(ts, fd, PDB_MAP_RDONLY);
+	close(fd);
+	if (zpdb == NULL) {
+		if (flags & HEU_VERBOSE)
+			perror(pathbuf);
+
+		errno = saved_errno;
+		return (NULL);
+	}
+
+	if (flags & HEU_VERBOSE)
+		fprintf(stderr, "Identifying PDB file %s\n", pathbuf);
+
+	return (zpdb);
+}
+
+/*
+ * Write a key for the shared table derived from the file or directory
+ * path with the given kind and tile set string to key.  The key
+ * identifies the file by device, inode and modification time so
+ * processes using different files never share a table.  The
+ * modification time of directories is ignored as it changes whenever
+ * a PDB is written into them.  Return 0 on success, -1 with errno set
+ * on failure.
+ */
+static int
+shared_key(char *key, size_t len, const char *kind, const char *tsstr, const char *path)
+{
+	struct stat st;
+
+	memset(&st, 0, sizeof st);
+	if (path != NULL && stat(path, &st) != 0)
+		return (-1);
+
+	if (S_ISDIR(st.st_mode))
+		st.st_mtime = 0;
+
+	if (snprintf(key, len, "%s-%s-%jx-%jx-%jx", kind, tsstr, (uintmax_t)st.st_dev,
+	    (uintmax_t)st.st_ino, (uintmax_t)st.st_mtime) >= (int)len) {
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * A PDB whose entries live in a shared table.
+ */
+struct shared_pdb {
+	struct patterndb pdb;
+	struct shmreg reg;
+	const char *heudir;
+	int flags, identify;
+};
+
+/*
+ * Generate the PDB for shared table data.  This is called back by
+ * shmreg_attach() if we are the first process to need the PDB.
+ */
+static int
+fill_shared_pdb(void *data, size_t size, void *arg)
+{
+	struct shared_pdb *spdb = arg;
+	struct patterndb *pdb, *zpdb;
+	int error;
+
+	zpdb = spdb->identify ? map_zpdb(spdb->heudir, spdb->pdb.aux.ts, spdb->flags) : NULL;
+	if (zpdb != NULL) {
+		pdb = pdb_identify_copy(zpdb);
+		pdb_free(zpdb);
+		if (pdb == NULL)
+			return (-1);
+	} else {
+		pdb = pdb_allocate(spdb->identify ? tileset_add(spdb->pdb.aux.ts, ZERO_TILE) : spdb->pdb.aux.ts);
+		if (pdb == NULL)
+			return (-1);
+
+		pdb_generate(pdb, spdb->flags & HEU_VERBOSE ? stderr : NULL);
+		if (spdb->identify && pdb_identify(pdb) != 0) {
+			error = errno;
+			pdb_free(pdb);
+			errno = error;
+			return (-1);
+		}
+	}
+
+	memcpy(data, (void *)pdb->data, size);
+	pdb_free(pdb);
+
+	return (0);
+}
+
+static void
+shared_pdb_free_wrapper(void *provider)
+{
+	struct shared_pdb *spdb = provider;
+
+	shmreg_detach(&spdb->reg);
+	free(spdb);
+}
+
 static int
 pdb_hval_wrapper(void *provider, const struct puzzle *p)
 {
@@ -250,6 +399,93 @@ pdb_free_wrapper(void *provider)
 	pdb_free((struct patterndb *)provider);
 }
 
+/*
+ * Create a PDB like common_pdb_driver() does, but in the shared memory
+ * registry.  Only the process actually generating the PDB writes it to
+ * pathbuf unless pathbuf is NULL.
+ */
+static int
+create_shared_pdb(struct heuristic *heu, const char *heudir,
+    tileset ts, const char *tsstr, int flags, const char *pathbuf,
+    const char *suffix, int identify)
+{
+	FILE *pdbfile;
+	struct shared_pdb *spdb;
+	int created, saved_errno;
+	char key[sizeof spdb->reg.name];
+
+	if (shared_key(key, sizeof key, suffix, tsstr, heudir) != 0) {
+		if (flags & HEU_VERBOSE) {
+			saved_errno = errno;
+			perror("shared_key");
+			errno = saved_errno;
+		}
+
+		return (-1);
+	}
+
+	spdb = aligned_alloc(alignof(struct shared_pdb), sizeof *spdb);
+	if (spdb == NULL) {
+		if (flags & HEU_VERBOSE) {
+			saved_errno = errno;
+			perror("aligned_alloc");
+			errno = saved_errno;
+		}
+
+		return (-1);
+	}
+
+	make_index_aux(&spdb->pdb.aux, ts);
+	spdb->pdb.mapped = 0;
+	spdb->pdb.map_offset = 0;
+	spdb->pdb.layout = PDB_LAYOUT_LINEAR;
+	spdb->pdb.block_shift = 0;
+	spdb->pdb.block_stride = 0;
+	spdb->pdb.warm = NULL;
+	spdb->heudir = heudir;
+	spdb->flags = flags;
+	spdb->identify = identify;
+
+	if (flags & HEU_VERBOSE)
+		fprintf(stderr, "Creating or attaching shared PDB for tile set %s\n", tsstr);
+
+	created = shmreg_attach(&spdb->reg, key, search_space_size(&spdb->pdb.aux),
+	    fill_shared_pdb, spdb);
+	if (created < 0) {
+		saved_errno = errno;
+		if (flags & HEU_VERBOSE)
+			perror("shmreg_attach");
+
+		free(spdb);
+		errno = saved_errno;
+
+		return (-1);
+	}
+
+	spdb->pdb.data = (atomic_uchar *)spdb->reg.data;
+
+	/* the process generating the PDB writes it back to disk */
+	if (created && pathbuf != NULL) {
+		if (flags & HEU_VERBOSE)
+			fprintf(stderr, "Writing PDB to file %s\n", pathbuf);
+
+		pdbfile = fopen(pathbuf, "wb");
+		if (pdbfile == NULL || pdb_store(pdbfile, &spdb->pdb) != 0)
+			if (flags & HEU_VERBOSE)
+				perror(pathbuf);
+
+		if (pdbfile != NULL)
+			fclose(pdbfile);
+	}
+
+	heu->provider = spdb;
+	heu->hval = pdb_hval_wrapper;
+	heu->hdiff = pdb_hdiff_wrapper;
+	heu->free = shared_pdb_free_wrapper;
+
+	return (0);
+}
+
 /*
  * The common code to drive struct patterndb base pattern databases.
  * suffix is the file suffix we use to find the pattern database,
@@ -260,8 +496,9 @@ common_pdb_driver(struct heuristic *heu, const char *heudir,
     tileset ts, char *tsstr, int flags, const char *suffix, int identify)
 {
 	FILE *pdbfile;
-	struct patterndb *pdb;
-	int fd, saved_errno;
+	struct patterndb *pdb, *zpdb;
+	struct pdb_header *hdr = NULL;
+	int fd, saved_errno, level = (flags & HEU_VERIFY_MASK) >> HEU_VERIFY_SHIFT;
 	char pathbuf[PATH_MAX];
 
 	if (heudir == NULL) {
@@ -302,6 +539,12 @@ common_pdb_driver(struct heuristic *heu, const char *heudir,
 
 	pdb = pdb_mmap(ts, fd, PDB_MAP_RDONLY);
 	saved_errno = errno;
+	if (pdb != NULL && level != PDB_VERIFY_NONE && pdb_header_read(&hdr, fd) < 0) {
+		saved_errno = errno;
+		pdb_free(pdb);
+		pdb = NULL;
+	}
+
 	close(fd);
 
 	/*
@@ -319,21 +562,80 @@ common_pdb_driver(struct heuristic *heu, const char *heudir,
 		return (-1);
 	}
 
+	if (level != PDB_VERIFY_NONE) {
+		if (flags & HEU_VERBOSE)
+			fprintf(stderr, "Verifying PDB file %s\n", pathbuf);
+
+		if (pdb_verify_level(pdb, hdr, level, PDB_VERIFY_SAMPLES,
+		    flags & HEU_VERBOSE ? stderr : NULL) != 0) {
+			if (flags & HEU_VERBOSE)
+				fprintf(stderr, "PDB file %s is damaged\n", pathbuf);
+
+			free(hdr);
+			pdb_free(pdb);
+
+			/* regenerate the PDB if we may */
+			if (flags & HEU_CREATE)
+				goto create_pdb;
+
+			errno = EINVAL;
+			return (-1);
+		}
+
+		free(hdr);
+	}
+
+	/*
+	 * advise and touch in the background so the search can start
+	 * right away.  pdb_free() stops the warmup before unmapping the
+	 * PDB.  A PDB that is going to be rearranged is read in full
+	 * and unmapped right away, so don't bother.
+	 */
+	if (flags & (HEU_WARMUP | HEU_MLOCK) && !(flags & HEU_BLOCKED)) {
+		if (flags & HEU_VERBOSE)
+			fprintf(stderr, "Warming up PDB file %s\n", pathbuf);
+
+		if (pdb_warmup(pdb, PDB_WARM_ADVISE | PDB_WARM_BACKGROUND
+		    | (flags & HEU_WARMUP ? PDB_WARM_TOUCH : 0)
+		    | (flags & HEU_MLOCK ? PDB_WARM_LOCK : 0),
+		    flags & HEU_VERBOSE ? stderr : NULL) != 0 && flags & HEU_VERBOSE)
+			perror("pdb_warmup");
+	}
+
 	goto success;
 
 create_pdb:
-	if (flags & HEU_VERBOSE)
-		fprintf(stderr, "Creating PDB for tile set %s\n", tsstr);
+	if (flags & HEU_SHARED)
+		return (create_shared_pdb(heu, heudir, ts, tsstr, flags,
+		    heudir == NULL ? NULL : pathbuf, suffix, identify));
+
+	/* derive an identified PDB from the zero-aware PDB if we have it */
+	zpdb = identify ? map_zpdb(heudir, ts, flags) : NULL;
+	if (zpdb != NULL) {
+		pdb = pdb_identify_copy(zpdb);
+		saved_errno = errno;
+		pdb_free(zpdb);
+		if (pdb == NULL) {
+			if (flags & HEU_VERBOSE)
+				perror("pdb_identify_copy");
 
-	pdb = pdb_allocate(identify ? tileset_add(ts, ZERO_TILE) : ts);
-	if (pdb == NULL) {
-		if (flags & HEU_VERBOSE) {
-			saved_errno = errno;
-			perror("pdb_allocate");
 			errno = saved_errno;
+			return (-1);
 		}
+	} else {
+		if (flags & HEU_VERBOSE)
+			fprintf(stderr, "Creating PDB for tile set %s\n", tsstr);
+
+		pdb = pdb_allocate(identify ? tileset_add(ts, ZERO_TILE) : ts);
+		if (pdb == NULL) {
+			if (flags & HEU_VERBOSE) {
+				saved_errno = errno;
+				perror("pdb_allocate");
+				errno = saved_errno;
+			}
 
-		return (-1);
+			return (-1);
+		}
 	}
 
 	if (heudir == NULL)
@@ -351,13 +653,26 @@ create_pdb:
 			perror(pathbuf);
 	}
 
-	pdb_generate(pdb, flags & HEU_VERBOSE ? stderr : NULL);
+	if (zpdb == NULL) {
+		pdb_generate(pdb, flags & HEU_VERBOSE ? stderr : NULL);
 
-	if (identify) {
-		if (flags & HEU_VERBOSE)
-			fprintf(stderr, "Identifying PDB for tile set %s\n", tsstr);
+		if (identify) {
+			if (flags & HEU_VERBOSE)
+				fprintf(stderr, "Identifying PDB for tile set %s\n", tsstr);
+
+			if (pdb_identify(pdb) != 0) {
+				saved_errno = errno;
+				if (flags & HEU_VERBOSE)
+					perror("pdb_identify");
+
+				if (pdbfile != NULL)
+					fclose(pdbfile);
 
-		pdb_identify(pdb);
+				pdb_free(pdb);
+				errno = saved_errno;
+				return (-1);
+			}
+		}
 	}
 
 	if (pdbfile == NULL)
@@ -390,6 +705,18 @@ create_pdb:
 	}
 
 success:
+	if (flags & HEU_BLOCKED) {
+		if (flags & HEU_VERBOSE)
+			fprintf(stderr, "Rearranging PDB for tile set %s\n", tsstr);
+
+		if (pdb_relayout(pdb, PDB_LAYOUT_BLOCKED, PDB_LAYOUT_SHIFT) != 0) {
+			if (flags & HEU_VERBOSE)
+				perror("pdb_relayout");
+		} else if (flags & HEU_MLOCK && pdb_warmup(pdb, PDB_WARM_LOCK,
+		    flags & HEU_VERBOSE ? stderr : NULL) != 0 && flags & HEU_VERBOSE)
+			perror("pdb_warmup");
+	}
+
 	heu->provider = pdb;
 	heu->hval = pdb_hval_wrapper;
 	heu->hdiff = pdb_hdiff_wrapper;
@@ -457,19 +784,132 @@ bitpdb_free_wrapper(void *provider)
 }
 
 /*
- * Common code for all bitpdb drivers.  load_func and store_func
- * abstract over bitpdb_load vs. bitpdb_load_compressed.
+ * If heudir contains an anchor table for the bitpdb bpdb of tile set
+ * tsstr, load it.  Errors are not fatal as the anchors merely serve to
+ * speed up lookups.
+ */
+static void
+load_bitpdb_anchors(struct bitpdb *bpdb, const char *heudir,
+    const char *tsstr, int flags)
+{
+	FILE *anchorfile;
+	int saved_errno = errno;
+	char pathbuf[PATH_MAX];
+
+	if (heudir == NULL || snprintf(pathbuf, PATH_MAX, "%s/%s.bpdb.anc",
+	    heudir, tsstr) >= PATH_MAX)
+		return;
+
+	anchorfile = fopen(pathbuf, "rb");
+	if (anchorfile == NULL) {
+		if (flags & HEU_VERBOSE && errno != ENOENT)
+			perror(pathbuf);
+
+		errno = saved_errno;
+		return;
+	}
+
+	if (flags & HEU_VERBOSE)
+		fprintf(stderr, "Loading anchor file %s\n", pathbuf);
+
+	if (bitpdb_load_anchors(bpdb, anchorfile) != 0 && flags & HEU_VERBOSE)
+		perror(pathbuf);
+
+	fclose(anchorfile);
+	errno = saved_errno;
+}
+
+/*
+ * A bitpdb whose data lives in a shared table.
+ */
+struct shared_bitpdb {
+	struct bitpdb bpdb;
+	struct shmreg reg;
+	FILE *pdbfile;
+	int (*read_func)(struct bitpdb *, FILE *);
+};
+
+/*
+ * Read the bitpdb into shared table data.  This is called back by
+ * shmreg_attach() if we are the first process to need the bitpdb.
+ */
+static int
+fill_shared_bitpdb(void *data, size_t size, void *arg)
+{
+	struct shared_bitpdb *sbpdb = arg;
+
+	(void)size;
+	sbpdb->bpdb.data = data;
+
+	return (sbpdb->read_func(&sbpdb->bpdb, sbpdb->pdbfile));
+}
+
+static void
+shared_bitpdb_free_wrapper(void *provider)
+{
+	struct shared_bitpdb *sbpdb = provider;
+
+	shmreg_detach(&sbpdb->reg);
+	free(sbpdb->bpdb.anchors);
+	free(sbpdb);
+}
+
+/*
+ * Load the bitpdb for ts from pdbfile (found at pathbuf) through the
+ * shared memory registry using read_func.  Return the bitpdb on
+ * success, NULL with errno set on failure.
+ */
+static struct bitpdb *
+load_shared_bitpdb(tileset ts, const char *tsstr, FILE *pdbfile,
+    const char *pathbuf, const char *suffix,
+    int (*read_func)(struct bitpdb *, FILE *))
+{
+	struct shared_bitpdb *sbpdb;
+	int error;
+	char key[sizeof sbpdb->reg.name];
+
+	if (shared_key(key, sizeof key, suffix, tsstr, pathbuf) != 0)
+		return (NULL);
+
+	sbpdb = aligned_alloc(alignof(struct shared_bitpdb), sizeof *sbpdb);
+	if (sbpdb == NULL)
+		return (NULL);
+
+	make_index_aux(&sbpdb->bpdb.aux, ts);
+	sbpdb->bpdb.mapped = 0;
+	sbpdb->bpdb.anchor_shift = 0;
+	sbpdb->bpdb.anchors = NULL;
+	sbpdb->pdbfile = pdbfile;
+	sbpdb->read_func = read_func;
+
+	if (shmreg_attach(&sbpdb->reg, key, bitpdb_size(&sbpdb->bpdb.aux),
+	    fill_shared_bitpdb, sbpdb) < 0) {
+		error = errno;
+		free(sbpdb);
+		errno = error;
+
+		return (NULL);
+	}
+
+	sbpdb->bpdb.data = sbpdb->reg.data;
+
+	return (&sbpdb->bpdb);
+}
+
+/*
+ * Common code for all bitpdb drivers.  read_func and store_func
+ * abstract over bitpdb_read vs. bitpdb_read_compressed.
  */
 static int
 common_bitpdb_driver(struct heuristic *heu, const char *heudir,
     tileset ts, char *tsstr, int flags, const char *suffix,
-    struct bitpdb *(*load_func)(tileset, FILE *),
+    int (*read_func)(struct bitpdb *, FILE *),
     int (*store_func)(FILE *, struct bitpdb *))
 {
 	FILE *pdbfile;
 	struct patterndb *pdb;
 	struct bitpdb *bpdb;
-	int saved_errno;
+	int saved_errno, shared = 0;
 	char pathbuf[PATH_MAX];
 
 	if (heudir == NULL) {
@@ -508,7 +948,19 @@ common_bitpdb_driver(struct heuristic *heu, const char *heudir,
 	if (flags & HEU_VERBOSE)
 		fprintf(stderr, "Loading bitpdb file %s\n", pathbuf);
 
-	bpdb = load_func(ts, pdbfile);
+	if (flags & HEU_SHARED) {
+		bpdb = load_shared_bitpdb(ts, tsstr, pdbfile, pathbuf, suffix, read_func);
+		shared = 1;
+	} else {
+		bpdb = bitpdb_allocate(ts);
+		if (bpdb != NULL && read_func(bpdb, pdbfile) != 0) {
+			saved_errno = errno;
+			bitpdb_free(bpdb);
+			bpdb = NULL;
+			errno = saved_errno;
+		}
+	}
+
 	saved_errno = errno;
 	fclose(pdbfile);
 
@@ -520,7 +972,7 @@ common_bitpdb_driver(struct heuristic *heu, const char *heudir,
 	if (bpdb == NULL) {
 		errno = saved_errno;
 		if (flags & HEU_VERBOSE) {
-			perror("bitpdb_load(_compressed)");
+			perror("bitpdb_read(_compressed)");
 			errno = saved_errno;
 		}
 
@@ -598,10 +1050,12 @@ create_pdb:
 	fclose(pdbfile);
 
 success:
+	load_bitpdb_anchors(bpdb, heudir, tsstr, flags);
+
 	heu->provider = bpdb;
 	heu->hval = bitpdb_hval_wrapper;
 	heu->hdiff = bitpdb_hdiff_wrapper;
-	heu->free = bitpdb_free_wrapper;
+	heu->free = shared ? shared_bitpdb_free_wrapper : bitpdb_free_wrapper;
 
 	return (0);
 }
@@ -620,7 +1074,7 @@ zbitpdb_driver(struct heuristic *heu, const char *heudir,
 	tileset_list_string(tsstr, ts);
 
 	return (common_bitpdb_driver(heu, heudir, ts, tsstr, flags,
-	    "bpdb", bitpdb_load, bitpdb_store));
+	    "bpdb", bitpdb_read, bitpdb_store));
 }
 
 /*
@@ -631,7 +1085,7 @@ bitpdb_driver(struct heuristic *heu, const char *heudir,
     tileset ts, char *tsstr, int flags)
 {
 	return (common_bitpdb_driver(heu, heudir, ts, tsstr, flags,
-	    "bpdb", bitpdb_load, bitpdb_store));
+	    "bpdb", bitpdb_read, bitpdb_store));
 }
 
 /*
@@ -648,7 +1102,7 @@ zbitpdb_zstd_driver(struct heuristic *heu, const char *heudir,
 	tileset_list_string(tsstr, ts);
 
 	return (common_bitpdb_driver(heu, heudir, ts, tsstr, flags,
-	    "bpdb.zst", bitpdb_load_compressed, bitpdb_store_compressed));
+	    "bpdb.zst", bitpdb_read_compressed, bitpdb_store_compressed));
 }
 
 /*
@@ -659,5 +1113,192 @@ bitpdb_zstd_driver(struct heuristic *heu, const char *heudir,
     tileset ts, char *tsstr, int flags)
 {
 	return (common_bitpdb_driver(heu, heudir, ts, tsstr, flags,
-	    "bpdb.zst", bitpdb_load_compressed, bitpdb_store_compressed));
+	    "bpdb.zst", bitpdb_read_compressed, bitpdb_store_compressed));
+}
+
+/*
+ * hval, hdiff, and free implementations for struct mod3pdb based
+ * heuristics.
+ */
+static int
+mod3pdb_hval_wrapper(void *provider, const struct puzzle *p)
+{
+
+	return (mod3pdb_lookup_puzzle((struct mod3pdb *)provider, p));
+}
+
+static int
+mod3pdb_hdiff_wrapper(void *provider, const struct puzzle *p, int old_h)
+{
+
+	return (mod3pdb_diff_lookup((struct mod3pdb *)provider, p, old_h));
+}
+
+static void
+mod3pdb_free_wrapper(void *provider)
+{
+
+	mod3pdb_free((struct mod3pdb *)provider);
+}
+
+/*
+ * Common code for all mod3pdb drivers.  If the mod3pdb is not found
+ * and HEU_CREATE is given, generate a PDB and convert it.
+ */
+static int
+common_mod3pdb_driver(struct heuristic *heu, const char *heudir,
+    tileset ts, char *tsstr, int flags)
+{
+	FILE *pdbfile;
+	struct patterndb *pdb;
+	struct mod3pdb *m3pdb;
+	int saved_errno;
+	char pathbuf[PATH_MAX];
+
+	if (heudir == NULL) {
+		if (flags & HEU_CREATE)
+			goto create_pdb;
+
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if (snprintf(pathbuf, PATH_MAX, "%s/%s.m3pdb", heudir, tsstr) >= PATH_MAX) {
+		errno = ENAMETOOLONG;
+		if (flags & HEU_VERBOSE) {
+			perror("mod3pdb_driver");
+			errno = ENAMETOOLONG;
+		}
+
+		return (-1);
+	}
+
+	pdbfile = fopen(pathbuf, "rb");
+	if (pdbfile == NULL) {
+		/* don't annoy the user with useless ENOENT messages */
+		if (flags & HEU_VERBOSE && errno != ENOENT) {
+			saved_errno = errno;
+			perror(pathbuf);
+			errno = saved_errno;
+		}
+
+		if (flags & HEU_CREATE)
+			goto create_pdb;
+		else
+			return (-1);
+	}
+
+	if (flags & HEU_VERBOSE)
+		fprintf(stderr, "Loading mod3pdb file %s\n", pathbuf);
+
+	m3pdb = mod3pdb_load(ts, pdbfile);
+	saved_errno = errno;
+	fclose(pdbfile);
+
+	if (m3pdb == NULL) {
+		errno = saved_errno;
+		if (flags & HEU_VERBOSE) {
+			perror("mod3pdb_load");
+			errno = saved_errno;
+		}
+
+		return (-1);
+	}
+
+	goto success;
+
+create_pdb:
+	if (flags & HEU_VERBOSE)
+		fprintf(stderr, "Creating PDB for tile set %s\n", tsstr);
+
+	pdb = pdb_allocate(ts);
+	if (pdb == NULL) {
+		if (flags & HEU_VERBOSE) {
+			saved_errno = errno;
+			perror("pdb_allocate");
+			errno = saved_errno;
+		}
+
+		return (-1);
+	}
+
+	if (heudir == NULL)
+		pdbfile = NULL;
+	else {
+		pdbfile = fopen(pathbuf, "w+b");
+
+		/*
+		 * if the file can't be opened for writing, proceed
+		 * with the generation but don't write the PDB back
+		 * to disk.
+		 */
+		if (pdbfile == NULL && flags & HEU_VERBOSE)
+			perror(pathbuf);
+	}
+
+	pdb_generate(pdb, flags & HEU_VERBOSE ? stderr : NULL);
+
+	if (flags & HEU_VERBOSE)
+		fprintf(stderr, "Converting PDB to mod3pdb\n");
+
+	m3pdb = mod3pdb_from_pdb(pdb, MOD3PDB_BASE_SHIFT);
+	saved_errno = errno;
+	pdb_free(pdb);
+	if (m3pdb == NULL) {
+		if (flags & HEU_VERBOSE) {
+			errno = saved_errno;
+			perror("mod3pdb_from_pdb");
+		}
+
+		if (pdbfile != NULL)
+			fclose(pdbfile);
+
+		errno = saved_errno;
+		return (-1);
+	}
+
+	if (pdbfile == NULL)
+		goto success;
+
+	if (flags & HEU_VERBOSE)
+		fprintf(stderr, "Writing mod3pdb to file %s\n", pathbuf);
+
+	if (mod3pdb_store(pdbfile, m3pdb) != 0 && flags & HEU_VERBOSE)
+		perror("mod3pdb_store");
+
+	fclose(pdbfile);
+
+success:
+	heu->provider = m3pdb;
+	heu->hval = mod3pdb_hval_wrapper;
+	heu->hdiff = mod3pdb_hdiff_wrapper;
+	heu->free = mod3pdb_free_wrapper;
+
+	return (0);
+}
+
+/*
+ * Driver for mod3pdbs that account for the zero tile.
+ */
+static int
+zmod3pdb_driver(struct heuristic *heu, const char *heudir,
+    tileset ts, char *tsstr_arg, int flags)
+{
+	char tsstr[TILESET_LIST_LEN];
+
+	(void)tsstr_arg;
+	ts = tileset_add(ts, ZERO_TILE);
+	tileset_list_string(tsstr, ts);
+
+	return (common_mod3pdb_driver(heu, heudir, ts, tsstr, flags));
+}
+
+/*
+ * Driver for mod3pdbs that do not account for the zero tile.
+ */
+static int
+mod3pdb_driver(struct heuristic *heu, const char *heudir,
+    tileset ts, char *tsstr, int flags)
+{
+	return (common_mod3pdb_driver(heu, heudir, ts, tsstr, flags));
 }
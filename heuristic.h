@@ -63,6 +63,15 @@ enum {
 	HEU_VERBOSE = 1 << 2,   /* print status messages to stderr */
 	HEU_SIMILAR = 1 << 3,   /* try to find a similar PDB, too */
 	HEU_ZEROTILE = 1 << 4,	/* heuristic pays attention to the zero tile */
+
+	/* PDB verification level (PDB_VERIFY_*) to apply when loading a PDB */
+	HEU_VERIFY_SHIFT = 5,
+	HEU_VERIFY_MASK = 3 << HEU_VERIFY_SHIFT,
+
+	HEU_SHARED = 1 << 7,	/* share decompressed/generated tables between processes */
+	HEU_WARMUP = 1 << 8,	/* read PDBs into memory in the background */
+	HEU_MLOCK = 1 << 9,	/* lock PDBs into memory */
+	HEU_BLOCKED = 1 << 10,	/* rearrange PDBs into the blocked layout */
 };
 
 /*
@@ -72,6 +81,8 @@ enum {
  * zpdb    zero-aware pattern database
  * bitpdb  additive bit pattern database
  * zbitpdb zero-aware bit pattern database
+ * m3pdb   additive pattern database storing h modulo 3
+ * zm3pdb  zero-aware pattern database storing h modulo 3
  *
  * the type can be suffixed with ".zst" to make heu_open generate a
  * zstd compressed pattern database.
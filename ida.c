@@ -33,27 +33,200 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "catalogue.h"
 #include "fsm.h"
 #include "pdb.h"
+#include "perfcount.h"
+#include "perimeter.h"
 #include "puzzle.h"
 #include "search.h"
 #include "tileset.h"
 #include "transposition.h"
 
+/*
+ * When checkpointing is enabled, the clock is checked every
+ * CHECKPOINT_CHECK_INTERVAL expanded nodes to see if a new checkpoint
+ * is due.  This must be a power of two.
+ */
+enum { CHECKPOINT_CHECK_INTERVAL = 1 << 20 };
+
+/*
+ * The state of the search.  solution holds the last solution found as
+ * path is overwritten when the search continues past it.  If resuming
+ * is set, we are on the way to the node at depth resume_len a
+ * checkpoint was taken at.  resume holds for each node on the way the
+ * index of the child to continue with.
+ */
 struct search_state {
 	jmp_buf finish;
 	struct pdb_catalogue *cat;
 	const struct fsm *fsm;
-	struct path *path;
+	struct path *path, solution;
 	size_t bound;
 	unsigned long long expanded, pruned;
 	int n_solutions, flags;
 	void (*on_solved)(const struct path *, void *);
 	void *on_solved_payload;
+
+	struct search_stats *stats;
+
+	struct search_checkpoint *cp;
+	struct timespec last_checkpoint;
+	size_t resume_len;
+	int resuming;
+	unsigned char resume[SEARCH_PATH_LEN];
 };
 
+/*
+ * Return the number of seconds elapsed from begin to end.
+ */
+static double
+seconds_between(struct timespec begin, struct timespec end)
+{
+	return ((end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1000000000.0);
+}
+
+/*
+ * If sst->cp->interval seconds have passed since the last checkpoint,
+ * write a new checkpoint for the node at depth g we are about to
+ * expand.  Failure to write a checkpoint is reported but otherwise
+ * ignored.
+ */
+static void
+checkpoint(struct search_state *sst, size_t g)
+{
+	struct search_checkpoint *cp = sst->cp;
+	struct timespec now;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
+		perror("clock_gettime");
+		return;
+	}
+
+	if (seconds_between(sst->last_checkpoint, now) < cp->interval)
+		return;
+
+	cp->bound = sst->bound;
+	cp->round_expanded = sst->expanded;
+	cp->n_solutions = sst->n_solutions;
+	cp->path.pathlen = g;
+	memcpy(cp->path.moves, sst->path->moves, g);
+	cp->solution = sst->solution;
+
+	if (checkpoint_update(cp) != 0)
+		perror(cp->filename);
+	else if (sst->flags & IDA_VERBOSE)
+		fprintf(stderr, "Wrote checkpoint to %s at depth %zu\n", cp->filename, g);
+
+	sst->last_checkpoint = now;
+}
+
+/*
+ * Record that a solution of length g has been found.  The solution
+ * is in sst->path->moves.  Unless we want to find all solutions,
+ * terminate the search.
+ */
+static void
+found_solution(struct search_state *sst, size_t g)
+{
+	sst->n_solutions++;
+	sst->path->pathlen = g;
+	sst->solution.pathlen = g;
+	memcpy(sst->solution.moves, sst->path->moves, g);
+
+	if (sst->flags & IDA_VERBOSE)
+		fprintf(stderr, "Solution found at depth %zu\n", g);
+
+	if (sst->on_solved != NULL)
+		sst->on_solved(sst->path, sst->on_solved_payload);
+
+	if (~sst->flags & IDA_LAST_FULL)
+		longjmp(sst->finish, 1);
+}
+
+/*
+ * Configuration p at depth g has been found to be dist moves away
+ * from the goal by looking it up in the perimeter.  Complete the path
+ * to the goal by following moves that reduce the distance by one.  If
+ * we want to find all solutions, follow all such moves, subject to the
+ * same finite state machine pruning as in expand_node().
+ */
+static void
+descend_perimeter(struct search_state *sst, size_t g, struct puzzle *p,
+    struct fsm_state st, int dist)
+{
+	struct fsm_state ast;
+	size_t i, n_moves, zloc, dest;
+	const signed char *moves;
+
+	if (dist == 0) {
+		found_solution(sst, g);
+		return;
+	}
+
+	zloc = zero_location(p);
+	moves = get_moves(zloc);
+	n_moves = move_count(zloc);
+
+	for (i = 0; i < n_moves; i++) {
+		dest = moves[i];
+		ast = fsm_advance_idx(sst->fsm, st, i);
+
+		if (fsm_moribundness(sst->fsm, ast) <= sst->bound - (g + 1))
+			continue;
+
+		move(p, dest);
+		if (perimeter_lookup(sst->cat->perimeter, p) == dist - 1) {
+			sst->path->moves[g] = dest;
+			descend_perimeter(sst, g + 1, p, ast, dist - 1);
+		}
+		move(p, zloc);
+	}
+}
+
+/*
+ * Record statistics for a node with h value h and partial h values ph:
+ * its h value and which heuristics and PDBs were decisive, i.e. made
+ * up a heuristic yielding the maximum h value.
+ */
+static void
+count_node(struct search_stats *stats, struct pdb_catalogue *cat,
+    size_t h, const struct partial_hvals *ph)
+{
+	unsigned long long parts = 0;
+	unsigned heumap;
+	size_t i;
+
+	if (h < PDB_HISTOGRAM_LEN)
+		stats->hvals[h]++;
+
+	heumap = catalogue_max_heuristics(cat, ph);
+	for (i = 0; i < cat->n_heuristics; i++)
+		if (heumap & 1U << i) {
+			stats->heu_decisive[i]++;
+			parts |= cat->parts[i];
+		}
+
+	for (; parts != 0; parts &= parts - 1)
+		stats->pdb_decisive[ctzll(parts)]++;
+}
+
+/*
+ * Record the PDB lookups catalogue_diff_hvals() performs when tile is
+ * moved.
+ */
+static void
+count_lookups(struct search_stats *stats, struct pdb_catalogue *cat, size_t tile)
+{
+	size_t i;
+
+	for (i = 0; i < cat->n_heus; i++)
+		if (tileset_has(cat->pdbs_ts[i], tile))
+			stats->lookups[i]++;
+}
+
 /*
  * Expand the search tree for configuration p recursively.  Assume the
  * search path up to here has had length g already.  Use the search
@@ -65,43 +238,83 @@ expand_node(struct search_state *sst, size_t g, struct puzzle *p,
 {
 	struct partial_hvals pph;
 	struct fsm_state ast;
-	size_t i, h, n_moves, zloc, dest, tile;
+	const struct perimeter *per = sst->cat->perimeter;
+	size_t i, first, h, n_moves, zloc, dest, tile;
+	int dist;
 	const signed char *moves;
 
+	/* nodes on the way to a checkpoint have been counted before */
 	h = catalogue_ph_hval(sst->cat, ph);
-	if (h == 0 && memcmp(p->tiles, solved_puzzle.tiles, TILE_COUNT) == 0) {
-		sst->n_solutions++;
-		sst->path->pathlen = g;
-
-		if (sst->flags & IDA_VERBOSE)
-			fprintf(stderr, "Solution found at depth %zu\n", g);
-
-		if (sst->on_solved != NULL)
-			sst->on_solved(sst->path, sst->on_solved_payload);
-
-		if (~sst->flags & IDA_LAST_FULL)
-			longjmp(sst->finish, 1);
+	if (sst->stats != NULL && !sst->resuming)
+		count_node(sst->stats, sst->cat, h, ph);
 
+	if (h == 0 && memcmp(p->tiles, solved_puzzle.tiles, TILE_COUNT) == 0) {
+		found_solution(sst, g);
 		return;
 	}
 
 	/* apply h value pruning */
-	if (g + h > sst->bound)
+	if (g + h > sst->bound) {
+		if (sst->stats != NULL)
+			sst->stats->pruned_h[g]++;
+
 		return;
+	}
+
+	/*
+	 * When resuming from a checkpoint, skip the children searched
+	 * before the checkpoint was taken.  The nodes on the way to the
+	 * checkpoint have already been expanded and counted.
+	 */
+	if (sst->resuming && g < sst->resume_len)
+		first = sst->resume[g];
+	else {
+		sst->resuming = 0;
+		first = 0;
+
+		/*
+		 * Perimeter search: configurations within the perimeter
+		 * have a known distance and are not expanded.  As h is
+		 * admissible, only configurations with h <= per->depth
+		 * can be in the perimeter.  Those that are not are at
+		 * least per->depth + 1 moves away from the goal.
+		 */
+		if (per != NULL && h <= per->depth) {
+			dist = perimeter_lookup(per, p);
+			if (dist != PERIMETER_OUTSIDE) {
+				if (g + dist <= sst->bound)
+					descend_perimeter(sst, g, p, st, dist);
+
+				return;
+			}
+
+			if (g + per->depth + 1 > sst->bound)
+				return;
+		}
+
+		if (sst->cp != NULL && (sst->expanded & CHECKPOINT_CHECK_INTERVAL - 1) == 0)
+			checkpoint(sst, g);
+
+		sst->expanded++;
+		if (sst->stats != NULL)
+			sst->stats->expanded[g]++;
+	}
 
 	fsm_prefetch(sst->fsm, st);
-	sst->expanded++;
 	zloc = zero_location(p);
 	moves = get_moves(zloc);
 	n_moves = move_count(zloc);
 
-	for (i = 0; i < n_moves; i++) {
+	for (i = first; i < n_moves; i++) {
 		dest = moves[i];
 		ast = fsm_advance_idx(sst->fsm, st, i);
 
 		/* moribund state pruning */
 		if (fsm_moribundness(sst->fsm, ast) <= sst->bound - (g + 1)) {
 			sst->pruned++;
+			if (sst->stats != NULL)
+				sst->stats->pruned_fsm[g]++;
+
 			continue;
 		}
 
@@ -111,6 +324,9 @@ expand_node(struct search_state *sst, size_t g, struct puzzle *p,
 		move(p, dest);
 		pph = *ph;
 		catalogue_diff_hvals(&pph, sst->cat, p, tile);
+		if (sst->stats != NULL && !sst->resuming)
+			count_lookups(sst->stats, sst->cat, tile);
+
 		expand_node(sst, g + 1, p, ast, &pph);
 		move(p, zloc);
 	}
@@ -122,17 +338,22 @@ expand_node(struct search_state *sst, size_t g, struct puzzle *p,
  * Update bound with the least bound needed to expand extra nodes.
  * Write the number of expanded nodes to expanded.  For each solution found,
  * if on_solved is not NULL call on_solved on the solution with
- * payload as the second argument
+ * payload as the second argument.  If cp is not NULL, periodically
+ * write checkpoints as configured in cp.  If resume is nonzero, resume
+ * the search from the state in cp.  If stats is not NULL, add
+ * statistics about the search to stats.
  */
 static int
 search_to_bound(struct path *path, struct pdb_catalogue *cat,
     const struct fsm *fsm, const struct puzzle *p, size_t bound,
     unsigned long long *expanded, void (*on_solved)(const struct path *,
-    void *), void *payload, int flags) {
+    void *), void *payload, int flags, struct search_checkpoint *cp,
+    int resume, struct search_stats *stats) {
 	struct partial_hvals ph;
 	struct puzzle pp;
 	struct search_state sst;
 	struct fsm_state st;
+	size_t i, zloc;
 
 	sst.cat = cat;
 	sst.fsm = fsm;
@@ -140,11 +361,37 @@ search_to_bound(struct path *path, struct pdb_catalogue *cat,
 	sst.flags = flags;
 
 	sst.n_solutions = 0;
+	sst.solution.pathlen = SEARCH_NO_PATH;
 	sst.expanded = 0;
 	sst.pruned = 0;
 	sst.bound = bound;
 	sst.on_solved = on_solved;
 	sst.on_solved_payload = payload;
+	sst.stats = stats;
+
+	/* don't write checkpoints if we don't know where to */
+	sst.cp = cp != NULL && cp->filename != NULL ? cp : NULL;
+	sst.resuming = 0;
+	if (sst.cp != NULL && clock_gettime(CLOCK_MONOTONIC, &sst.last_checkpoint) != 0) {
+		perror("clock_gettime");
+		sst.cp = NULL;
+	}
+
+	/* reconstruct the child index stack from the checkpointed path */
+	if (resume) {
+		sst.n_solutions = cp->n_solutions;
+		if (sst.n_solutions > 0)
+			sst.solution = cp->solution;
+
+		sst.expanded = cp->round_expanded;
+		sst.resuming = 1;
+		sst.resume_len = cp->path.pathlen;
+		zloc = zero_location(p);
+		for (i = 0; i < cp->path.pathlen; i++) {
+			sst.resume[i] = move_index(zloc, cp->path.moves[i]);
+			zloc = cp->path.moves[i];
+		}
+	}
 
 	if (setjmp(sst.finish))
 		goto finish;
@@ -152,6 +399,9 @@ search_to_bound(struct path *path, struct pdb_catalogue *cat,
 	pp = *p; /* allow us to modify p */
 	st = fsm_start_state(zero_location(&pp));
 	catalogue_partial_hvals(&ph, sst.cat, &pp);
+	if (stats != NULL && !resume)
+		for (i = 0; i < cat->n_heus; i++)
+			stats->lookups[i]++;
 
 	expand_node((struct search_state *)&sst, 0, &pp, st, &ph);
 
@@ -161,8 +411,7 @@ finish:
 	if (flags & IDA_VERBOSE)
 		fprintf(stderr, "Finite state machine pruned %llu nodes in previous round.\n", sst.pruned);
 
-	if (sst.n_solutions == 0)
-		path->pathlen = SEARCH_NO_PATH;
+	*path = sst.solution;
 
 	return (sst.n_solutions);
 }
@@ -214,17 +463,29 @@ verify(const struct puzzle *p, const struct path *path)
  * return the number of nodes expanded.  If f is not NULL, print
  * diagnostic messages to f.  If on_solved is not NULL, call on_solved
  * for each solution found with the solution and payload for arguments.
+ * If cp is not NULL and cp->filename is not NULL, write a checkpoint
+ * to cp->filename every cp->interval seconds.  If cp holds a valid
+ * checkpoint for p made with the same catalogue and finite state
+ * machine, resume the search from there.  Once the search is complete,
+ * the checkpoint file is removed and cp->valid is cleared.  If stats
+ * is not NULL, add detailed statistics about the search to stats, see
+ * search.h for details.  When resuming from a checkpoint, only the
+ * part of the search after the checkpoint is accounted for.
  */
 extern unsigned long long
 search_ida_bounded(struct pdb_catalogue *cat, const struct fsm *fsm,
     const struct puzzle *p, size_t limit, struct path *path,
-    void (*on_solved)(const struct path *, void *), void *payload, int flags)
+    void (*on_solved)(const struct path *, void *), void *payload, int flags,
+    struct search_checkpoint *cp, struct search_stats *stats)
 {
 	struct timespec begin, round_begin, round_end, duration;
-	unsigned long long expanded, total_expanded = 0;
+	struct timespec stats_begin, stats_end;
+	struct perf_counters pc;
+	unsigned long long expanded, total_expanded = 0, resumed_expanded = 0;
+	unsigned long long fingerprint = 0;
 	double dur;
 	size_t bound;
-	int n_solution = 0, no_clocks = 0;
+	int n_solution = 0, no_clocks = 0, resume = 0;
 
 	if (~flags & IDA_VERBOSE)
 		no_clocks = 1;
@@ -235,15 +496,61 @@ search_ida_bounded(struct pdb_catalogue *cat, const struct fsm *fsm,
 		round_end = begin;
 
 	path->pathlen = SEARCH_NO_PATH;
-	for (bound = catalogue_hval(cat, p); n_solution == 0 && bound <= limit; bound += 2) {
+	bound = catalogue_hval(cat, p);
+	if (cp != NULL)
+		fingerprint = checkpoint_fingerprint(cat, fsm, p);
+
+	if (cp != NULL && cp->valid && memcmp(cp->p.tiles, p->tiles, TILE_COUNT) == 0
+	    && cp->fingerprint == fingerprint
+	    && cp->bound >= bound && (cp->bound - bound) % 2 == 0) {
+		if (flags & IDA_VERBOSE)
+			fprintf(stderr, "Resuming search with bound %zu at depth %zu, %llu nodes expanded\n",
+			    cp->bound, cp->path.pathlen, cp->expanded + cp->round_expanded);
+
+		bound = cp->bound;
+		total_expanded = cp->expanded;
+		resumed_expanded = cp->expanded + cp->round_expanded;
+		resume = 1;
+	} else if (cp != NULL) {
+		if (cp->valid && flags & IDA_VERBOSE)
+			fprintf(stderr, "Checkpoint does not match search, starting afresh\n");
+
+		cp->valid = 0;
+		cp->p = *p;
+		cp->fingerprint = fingerprint;
+	}
+
+	for (; n_solution == 0 && bound <= limit; bound += 2) {
 		if (flags & IDA_VERBOSE)
 			fprintf(stderr, "Searching for solution with bound %zu\n", bound);
 
-		n_solution = search_to_bound(path, cat, fsm, p, bound, &expanded, on_solved, payload, flags);
+		if (cp != NULL)
+			cp->expanded = total_expanded;
+
+		if (stats != NULL && clock_gettime(CLOCK_THREAD_CPUTIME_ID, &stats_begin) != 0)
+			perror("clock_gettime");
+
+		perf_begin(&pc);
+		n_solution = search_to_bound(path, cat, fsm, p, bound, &expanded,
+		    on_solved, payload, flags, cp, resume, stats);
+		perf_end(&pc);
 		total_expanded += expanded;
+		resume = 0;
 
-		if (flags & IDA_VERBOSE)
+		if (stats != NULL) {
+			if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &stats_end) != 0)
+				perror("clock_gettime");
+
+			duration = timediff(stats_begin, stats_end);
+			stats->round_count[bound]++;
+			stats->round_expanded[bound] += expanded;
+			stats->round_time[bound] += duration.tv_sec + duration.tv_nsec / 1000000000.0;
+		}
+
+		if (flags & IDA_VERBOSE) {
 			fprintf(stderr, "Expanded %llu nodes during previous round.\n", expanded);
+			perf_report(stderr, &pc, "node", expanded);
+		}
 
 		if (no_clocks)
 			continue;
@@ -277,7 +584,14 @@ search_ida_bounded(struct pdb_catalogue *cat, const struct fsm *fsm,
 		duration = timediff(begin, round_end);
 		dur = duration.tv_sec + duration.tv_nsec / 1000000000.0;
 		fprintf(stderr, "Spent %.3f seconds in total, %.2f nodes/s\n",
-		    dur, total_expanded / dur);
+		    dur, (total_expanded - resumed_expanded) / dur);
+	}
+
+	/* the search is complete, the checkpoint is no longer needed */
+	if (cp != NULL) {
+		cp->valid = 0;
+		if (cp->filename != NULL && unlink(cp->filename) != 0 && errno != ENOENT)
+			perror(cp->filename);
 	}
 
 	if (flags & IDA_VERIFY && !verify(p, path)) {
@@ -298,5 +612,5 @@ search_ida(struct pdb_catalogue *cat, const struct fsm *fsm,
     const struct puzzle *p, struct path *path,
     void (*on_solved)(const struct path *, void *), void *payload, int flags)
 {
-	return (search_ida_bounded(cat, fsm, p, SEARCH_PATH_LEN, path, on_solved, payload, flags));
+	return (search_ida_bounded(cat, fsm, p, SEARCH_PATH_LEN, path, on_solved, payload, flags, NULL, NULL));
 }
@@ -26,7 +26,9 @@
 /* index.c -- compute puzzle indices */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -70,6 +72,25 @@ const unsigned factorials[INDEX_MAX_TILES + 1] = {
  */
 struct index_table *index_tables[INDEX_MAX_TILES + 1] = {};
 
+/*
+ * Tables for unindex_permutation_table().  perm_digits[m][v] holds the
+ * first three digits of the permutation index of m tiles in the
+ * factorial number system, four bits per digit, where v is the index
+ * modulo perm_group[m] = m * (m - 1) * (m - 2).  If m < 3, all m digits
+ * are stored and perm_group[m] = m!.  The tables for m are generated
+ * by make_perm_tables() once perm_group[m] is needed.
+ */
+enum { PERM_GROUP_MAX = INDEX_MAX_TILES * (INDEX_MAX_TILES - 1) * (INDEX_MAX_TILES - 2) };
+static unsigned short perm_digits[INDEX_MAX_TILES + 1][PERM_GROUP_MAX];
+static unsigned perm_group[INDEX_MAX_TILES + 1];
+
+/*
+ * Guards the generation of the lazily allocated tables above and of
+ * the unrank tables, as make_index_aux() may be called from multiple
+ * threads at once.
+ */
+static pthread_mutex_t index_tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Compute the permutation index of those tiles listed in ts which must
  * occupy the grid locations listed in map.  This is done by computing
@@ -105,6 +126,47 @@ index_permutation(tileset ts, tileset map, const struct puzzle *p)
 	return (pidx);
 }
 
+#ifdef __SSE4_1__
+/*
+ * Compute the same permutation index as index_permutation(), but
+ * without a dependency chain from one tile to the next.  The inversion
+ * number of tile k is the number of tiles after k in aux->ts whose
+ * grid location is lower than that of tile k.  The grid locations of
+ * the tiles are gathered into a vector using aux->permshuf and compared
+ * with the vector shifted by 1, 2, ... lanes, counting the inversions
+ * of all tiles at once.  Unused lanes are padded with INT8_MAX so they
+ * never count as lower.  The inversion numbers are then multiplied up
+ * in three steps using the weights in aux->permweight*.
+ */
+static permindex
+index_permutation_table(const struct index_aux *aux, const struct puzzle *p)
+{
+	__m128i tileslo = _mm_loadu_si128((const __m128i *)p->tiles);
+	__m128i tileshi = _mm_loadu_si128((const __m128i *)(p->tiles + 16));
+	__m128i fill = _mm_set1_epi8(INT8_MAX), inv = _mm_setzero_si128();
+	__m128i loc, pairs, quads;
+	unsigned n_tile = aux->n_tile;
+
+	loc = _mm_or_si128(
+	    _mm_shuffle_epi8(tileslo, _mm_loadu_si128((const __m128i *)aux->permshuf[0])),
+	    _mm_shuffle_epi8(tileshi, _mm_loadu_si128((const __m128i *)aux->permshuf[1])));
+	loc = _mm_or_si128(loc, _mm_loadu_si128((const __m128i *)aux->permfill));
+
+#define STEP(j) if (n_tile > j) \
+	inv = _mm_sub_epi8(inv, _mm_cmpgt_epi8(loc, _mm_alignr_epi8(fill, loc, j)))
+	STEP(1); STEP(2); STEP(3); STEP(4); STEP(5); STEP(6);
+	STEP(7); STEP(8); STEP(9); STEP(10); STEP(11);
+#undef STEP
+
+	pairs = _mm_maddubs_epi16(inv, _mm_loadu_si128((const __m128i *)aux->permweight1));
+	quads = _mm_madd_epi16(pairs, _mm_loadu_si128((const __m128i *)aux->permweight2));
+
+	return (_mm_cvtsi128_si32(quads)
+	    + aux->permweight3[0] * _mm_extract_epi32(quads, 1)
+	    + aux->permweight3[1] * _mm_extract_epi32(quads, 2));
+}
+#endif /* __SSE4_1__ */
+
 /*
  * Compute the structured index for the equivalence class of p by the
  * tiles selected by aux->ts and store it in idx.  Use aux to lookup
@@ -118,7 +180,12 @@ compute_index(const struct index_aux *aux, struct index *idx, const struct puzzl
 
 	idx->maprank = tileset_rank(map);
 	prefetch(aux->idxt + idx->maprank);
-	idx->pidx = index_permutation(tsnz, map, p);
+#ifdef __SSE4_1__
+	if (aux->engine == INDEX_ENGINE_TABLE)
+		idx->pidx = index_permutation_table(aux, p);
+	else
+#endif
+		idx->pidx = index_permutation(tsnz, map, p);
 
 	if (tileset_has(aux->ts, ZERO_TILE))
 		idx->eqidx = aux->idxt[idx->maprank].eqclasses[zero_location(p)];
@@ -169,6 +236,34 @@ unindex_permutation(struct puzzle *p, tileset ts, tileset map, permindex pidx)
 	}
 }
 
+/*
+ * Like unindex_permutation(), but take the digits of pidx from
+ * perm_digits three at a time, needing one division per three tiles
+ * instead of one per tile.
+ */
+static void
+unindex_permutation_table(struct puzzle *p, tileset ts, tileset map, permindex pidx)
+{
+	size_t i;
+	unsigned n_tiles, group, digits, j;
+	tileset tile;
+
+	for (n_tiles = tileset_count(ts); n_tiles > 0; n_tiles -= j) {
+		group = perm_group[n_tiles];
+		digits = perm_digits[n_tiles][pidx % group];
+		pidx /= group;
+
+		for (j = 0; j < 3 && j < n_tiles; j++) {
+			i = tileset_get_least(ts);
+			ts = tileset_remove_least(ts);
+			tile = rankselect(map, digits >> 4 * j & 0xf);
+			p->tiles[i] = tileset_get_least(tile);
+			map = tileset_difference(map, tile);
+			p->grid[p->tiles[i]] = i;
+		}
+	}
+}
+
 /*
  * Half of the work of inverting an index depends on the map only.  This
  * function does this first part only to speed up index inversion for
@@ -198,7 +293,10 @@ invert_index_rest(const struct index_aux *aux, struct puzzle *p, const struct in
 	tileset map = tileset_unrank(tileset_count(tsnz), idx->maprank);
 
 	prefetch(aux->idxt + idx->maprank);
-	unindex_permutation(p, tsnz, map, idx->pidx);
+	if (aux->engine == INDEX_ENGINE_TABLE)
+		unindex_permutation_table(p, tsnz, map, idx->pidx);
+	else
+		unindex_permutation(p, tsnz, map, idx->pidx);
 
 	if (tileset_has(aux->ts, ZERO_TILE))
 		move(p, canonical_zero_location(aux, idx));
@@ -256,10 +354,68 @@ make_index_table(tileset ts)
 	return (idxt);
 }
 
+/*
+ * Fill in the tables for the table driven permutation index engine
+ * into aux and generate the required perm_digits tables.  For
+ * index_permutation_table(), permshuf[0] and permshuf[1] gather the
+ * grid locations of the tiles in aux->ts from the first and second
+ * half of p->tiles into lanes 0 to n_tile - 1, lanes n_tile to 15 are
+ * set to INT8_MAX by permfill.  If d[k] is the inversion number of
+ * tile k, permweight1 combines pairs of digits into d[2k] + (n - 2k)
+ * d[2k+1], permweight2 combines pairs of these into quads and
+ * permweight3 holds the place values of quads 1 and 2.  Weights for
+ * unused lanes are zero.
+ */
+static void
+make_perm_tables(struct index_aux *aux)
+{
+	tileset tsnz = tileset_remove(aux->ts, ZERO_TILE);
+	unsigned k, m, d0, d1, d2, n = aux->n_tile, tile;
+
+	memset(aux->permshuf, 0x80, sizeof aux->permshuf);
+	memset(aux->permfill, INT8_MAX, sizeof aux->permfill);
+	memset(aux->permweight1, 0, sizeof aux->permweight1);
+	memset(aux->permweight2, 0, sizeof aux->permweight2);
+
+	for (k = 0; !tileset_empty(tsnz); k++, tsnz = tileset_remove_least(tsnz)) {
+		tile = tileset_get_least(tsnz);
+		aux->permshuf[tile >= 16][k] = tile % 16;
+		aux->permfill[k] = 0;
+	}
+
+	for (k = 0; 2 * k < n; k++) {
+		aux->permweight1[2 * k] = 1;
+		aux->permweight1[2 * k + 1] = 2 * k + 1 < n ? n - 2 * k : 0;
+	}
+
+	for (k = 0; 4 * k < n; k++) {
+		aux->permweight2[2 * k] = 1;
+		aux->permweight2[2 * k + 1] = 4 * k + 2 < n ? (n - 4 * k) * (n - 4 * k - 1) : 0;
+	}
+
+	aux->permweight3[0] = n > 4 ? factorials[n] / factorials[n - 4] : 0;
+	aux->permweight3[1] = n > 8 ? factorials[n] / factorials[n - 8] : 0;
+
+	for (m = n; m > 0; m -= m < 3 ? m : 3) {
+		if (perm_group[m] != 0)
+			continue;
+
+		for (d2 = 0; d2 < (m > 2 ? m - 2 : 1); d2++)
+			for (d1 = 0; d1 < (m > 1 ? m - 1 : 1); d1++)
+				for (d0 = 0; d0 < m; d0++)
+					perm_digits[m][d0 + m * d1 + m * (m - 1) * d2] =
+					    d0 | d1 << 4 | d2 << 8;
+
+		perm_group[m] = m < 3 ? factorials[m] : m * (m - 1) * (m - 2);
+	}
+}
+
 /*
  * Initialize aux with the correct values to compute indices for the
  * tileset ts.  Allocate tables as needed.  If storage is insufficient
- * for the required tables, abort the program.
+ * for the required tables, abort the program.  The table driven
+ * permutation index engine is used if the CPU supports it.  This
+ * function may be called from multiple threads at once.
  */
 extern void
 make_index_aux(struct index_aux *aux, tileset ts)
@@ -273,6 +429,7 @@ make_index_aux(struct index_aux *aux, tileset ts)
 	aux->n_perm = factorials[aux->n_tile];
 	aux->solved_parity = tileset_parity(tsnz);
 
+	pthread_mutex_lock(&index_tables_lock);
 	tileset_unrank_init(aux->n_tile);
 
 	/* see puzzle_partially_equal() for details */
@@ -285,6 +442,14 @@ make_index_aux(struct index_aux *aux, tileset ts)
 		aux->tiles[i++] = ~tileset_get_least(tsnz);
 
 	aux->idxt = make_index_table(aux->ts);
+
+	make_perm_tables(aux);
+	pthread_mutex_unlock(&index_tables_lock);
+#ifdef __SSE4_1__
+	aux->engine = INDEX_ENGINE_TABLE;
+#else
+	aux->engine = INDEX_ENGINE_SERIAL;
+#endif
 }
 
 /*
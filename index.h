@@ -92,16 +92,27 @@ struct index_table {
  * For the indexing and unindexing operations we use this auxillary
  * structure.  It contains everything we need to quickly compute and
  * reverse tilesets for a given tile set, including a pointer to an
- * appropriate strzct index_table.
+ * appropriate strzct index_table.  The member engine selects how
+ * permutation indices are computed (INDEX_ENGINE_SERIAL or
+ * INDEX_ENGINE_TABLE).  make_index_aux() picks the fastest engine
+ * available, but both compute the same indices, so engine can be
+ * changed afterwards, e.g. for benchmarking.  The perm* members are
+ * the tables used by the table driven engine, see make_perm_tables().
  */
 struct index_aux {
 	alignas(32) unsigned char tsmask[32]; /* for use with SSE 4.2 and AVX2 puzzle_partially_equal() */
 	alignas(16) unsigned char tiles[16]; /* for use with the SSE 4.2 tileset_map() */
+	alignas(16) unsigned char permshuf[2][16]; /* gather tile locations */
+	alignas(16) unsigned char permfill[16]; /* pad unused lanes */
+	alignas(16) signed char permweight1[16]; /* combine digits into pairs */
+	alignas(16) short permweight2[8]; /* combine pairs into quads */
+	unsigned permweight3[2]; /* combine quads into the index */
 
 	unsigned n_tile; /* number of tiles not including the zero tile */
 	unsigned n_maprank; /* number of different maprank values */
 	unsigned n_perm; /* number of permutations */
 	unsigned solved_parity; /* parity of the solved configuration */
+	int engine; /* permutation index engine */
 
 	tileset ts;
 	struct index_table *idxt;
@@ -113,6 +124,10 @@ enum {
 
 	/* buffer length for index_string() */
 	INDEX_STR_LEN = 27, /* (########## ########## ##)\0 */
+
+	/* values for index_aux.engine */
+	INDEX_ENGINE_SERIAL = 0, /* one popcount or division per tile */
+	INDEX_ENGINE_TABLE = 1, /* precomputed tables, needs SSE 4.1 */
 };
 
 extern void	compute_index(const struct index_aux*, struct index*, const struct puzzle*);
@@ -175,20 +190,27 @@ search_space_size(const struct index_aux *aux)
 }
 
 /*
- * Compute the offset a configuration for index idx would have from the
- * beginning of the PDB if each PDB entry was one byte in size.
+ * Return the number of the table (i.e. the combination of maprank and
+ * eqidx) idx lies in.  This is a number between 0 and
+ * eqclass_total(aux) - 1.
  */
 static inline size_t
-index_offset(const struct index_aux *aux, const struct index *idx)
+index_map_offset(const struct index_aux *aux, const struct index *idx)
 {
-	size_t map_offset;
-
 	if (tileset_has(aux->ts, ZERO_TILE))
-		map_offset = aux->idxt[idx->maprank].offset + idx->eqidx;
+		return (aux->idxt[idx->maprank].offset + idx->eqidx);
 	else
-		map_offset = idx->maprank;
+		return (idx->maprank);
+}
 
-	return (map_offset * aux->n_perm + idx->pidx);
+/*
+ * Compute the offset a configuration for index idx would have from the
+ * beginning of the PDB if each PDB entry was one byte in size.
+ */
+static inline size_t
+index_offset(const struct index_aux *aux, const struct index *idx)
+{
+	return (index_map_offset(aux, idx) * aux->n_perm + idx->pidx);
 }
 
 /*
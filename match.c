@@ -27,6 +27,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -35,6 +36,7 @@
 #include "match.h"
 #include "tileset.h"
 #include "heuristic.h"
+#include "pdb.h"
 #include "puzzle.h"
 #include "transposition.h"
 
@@ -50,15 +52,59 @@
  * finds the best partitioning for each half.  This requires only
  * (12 ! 24) * (1 + 2 * (6 ! 12) / 2!) / 2! = 1.250.672.150 operations,
  * a much less scary number.
+ *
+ * The ranks of the quarters of each half and the sum of their
+ * qualities do not depend on the configuration.  Hence, when many
+ * configurations are evaluated, each half is set up once (struct
+ * half_splits) and then evaluated for all configurations at the same
+ * time.  For this, the match vectors are transposed such that the
+ * partial h values of all configurations for one tile set are adjacent
+ * in memory, making the inner loops amenable to vectorisation.
  */
 enum {
 	TWELVE_TILES = 2704156, /* 24 choose 12 */
 	SIX_OF_TWELVE = 924, /* 12 choose 6 */
+	HALF_SPLITS = SIX_OF_TWELVE / 2,
+
+	/* configurations needed to evaluate all at once, see half_best() */
+	VECTOR_THRESHOLD = 64,
+};
+
+/*
+ * The ways to split a half into two quarters.  For split i, lorank[i]
+ * and hirank[i] are the ranks of the two quarters and quality[i] is
+ * their combined quality.
+ */
+struct half_splits {
+	tileset half;
+	tsrank lorank[HALF_SPLITS], hirank[HALF_SPLITS];
+	unsigned long long quality[HALF_SPLITS];
+};
+
+/*
+ * The best splits of one half for each configuration.  For
+ * configuration j, max[j] is the highest h value found, count[j] the
+ * number of splits with that h value, and best[j] the index of the
+ * highest quality split among them with its quality in quality[j].
+ */
+struct half_best {
+	unsigned short *max, *count, *best;
+	unsigned long long *quality;
 };
 
-static int	match_half_best(const unsigned char[MATCH_SIZE],
-    const struct quality[MATCH_SIZE], tileset, tileset[2],
-    unsigned long long *, unsigned long long *);
+/*
+ * One contiguous range of halves [begin, end) evaluated by one thread.
+ * The best partitionings found for each of the n_match configurations
+ * are stored in matches with their h values in max.
+ */
+struct match_task {
+	const unsigned char *vt;
+	const struct quality *qualities;
+	struct match *matches;
+	unsigned *max;
+	size_t n_match, begin, end;
+	int error;
+};
 
 /*
  * Load a quality vector from qualityfile.  On success, return a
@@ -136,108 +182,380 @@ fail2:	free(qualities);
 }
 
 /*
- * Find the best way to partition the tray into 4 groups of six tiles
- * and store the optimal matches in match.  The best partitioning is the
- * partitioning with the highest possible h value for the configuration
- * whose partial h values are given in match with the best quality as
- * indicated by the qualities vector.  On success return 1,  on error,
- * return 0 and set errno to indicate a reason.
+ * Compute the quarters of half and their qualities.  The unrank table
+ * for 6 tiles must have been initialised beforehand.
  */
-extern int
-match_find_best(struct match *match, const unsigned char matchv[MATCH_SIZE],
-    const struct quality qualities[MATCH_SIZE])
+static void
+half_splits_init(struct half_splits *hs, const struct quality qualities[MATCH_SIZE],
+    tileset half)
 {
-	unsigned long long locount, hicount, loqual, hiqual;
-	size_t i, j;
-	tileset half, quarters[4];
-	int max, hlo, hhi;
+	size_t i;
+	tileset loquarter, hiquarter;
 
-	tileset_unrank_init(6);
-	tileset_unrank_init(12);
+	hs->half = half;
+	for (i = 0; i < HALF_SPLITS; i++) {
+		loquarter = pdep(half, tileset_unrank(6, i));
+		hiquarter = tileset_difference(half, loquarter);
+
+		hs->lorank[i] = tileset_ranknz(loquarter);
+		hs->hirank[i] = tileset_ranknz(hiquarter);
+		hs->quality[i] = qualities[hs->lorank[i]].havg
+		    + qualities[hs->hirank[i]].havg;
+	}
+}
 
-	memset(match, 0, sizeof *match);
-
-	max = 0;
-	for (i = 0; i < TWELVE_TILES / 2; i++) {
-		half = tileset_unranknz(12, i);
-		hlo = match_half_best(matchv, qualities, half, quarters, &locount, &loqual);
-		hhi = match_half_best(matchv, qualities,
-		    tileset_difference(NONZERO_TILES, half), quarters + 2, &hicount, &hiqual);
-		assert(locount != 0);
-		assert(hicount != 0);
-		if (hlo + hhi > max) {
-			max = hlo + hhi;
-			match->count = 0;
-			match->quality = 0;
+/*
+ * Account for split i of a half with quality quality for each of the
+ * n configurations, whose h values for the two quarters are given in
+ * lo and hi.  This loop is written branch free and with restrict
+ * qualified pointers so the compiler can vectorise it.
+ */
+static inline void
+half_split(unsigned short *restrict max, unsigned short *restrict count,
+    unsigned short *restrict best, unsigned long long *restrict bestq,
+    const unsigned char *restrict lo, const unsigned char *restrict hi,
+    unsigned long long quality, unsigned short i, size_t n)
+{
+	size_t j;
+	unsigned short hval, gt, eq, upd;
+
+	for (j = 0; j < n; j++) {
+		hval = lo[j] + hi[j];
+		gt = -(hval > max[j]);
+		eq = -(hval == max[j]);
+		upd = gt | eq & -(unsigned short)(quality >= bestq[j]);
+
+		max[j] = max[j] & ~gt | hval & gt;
+		count[j] = count[j] + (eq & 1) & ~gt | 1 & gt;
+		best[j] = best[j] & ~upd | i & upd;
+		bestq[j] = upd ? quality : bestq[j];
+	}
+}
+
+/*
+ * Try all ways to split the half described by hs into two quarters
+ * for each of the n configurations in the transposed match vector vt
+ * and record the best splits in hb.  The splits are visited in the
+ * same order as a scalar search would, so ties are broken the same.
+ * For large batches, all configurations are updated for one split at
+ * a time with half_split().  Below VECTOR_THRESHOLD configurations,
+ * the overhead of doing so is not worth it and each configuration is
+ * processed on its own, keeping its state in registers.
+ */
+static void
+half_best(struct half_best *hb, const struct half_splits *hs,
+    const unsigned char *vt, size_t n)
+{
+	const unsigned char *v;
+	unsigned long long bestq;
+	size_t i, j;
+	unsigned max, count, best, hval;
+
+	if (n >= VECTOR_THRESHOLD) {
+		for (j = 0; j < n; j++) {
+			hb->max[j] = 0;
+			hb->count[j] = 0;
+			hb->best[j] = 0;
+			hb->quality[j] = 0;
 		}
 
-		if (hlo + hhi >= max) {
-			match->count += locount * hicount;
+		for (i = 0; i < HALF_SPLITS; i++)
+			half_split(hb->max, hb->count, hb->best, hb->quality,
+			    vt + hs->lorank[i] * n, vt + hs->hirank[i] * n,
+			    hs->quality[i], i, n);
 
-			if (loqual + hiqual >= match->quality) {
-				match->quality = loqual + hiqual;
+		return;
+	}
 
-				for (j = 0; j < 4; j++) {
-					match->ts[j] = quarters[j];
-					match->hval[j] = matchv[tileset_ranknz(quarters[j])];
-				}
+	for (j = 0; j < n; j++) {
+		v = vt + j;
+		max = 0;
+		count = 0;
+		best = 0;
+		bestq = 0;
+
+		for (i = 0; i < HALF_SPLITS; i++) {
+			hval = v[hs->lorank[i] * n] + v[hs->hirank[i] * n];
+			if (hval < max)
+				continue;
+
+			if (hval > max) {
+				max = hval;
+				count = 0;
+				bestq = 0;
+			}
+
+			count++;
+			if (hs->quality[i] >= bestq) {
+				bestq = hs->quality[i];
+				best = i;
 			}
 		}
+
+		hb->max[j] = max;
+		hb->count[j] = count;
+		hb->best[j] = best;
+		hb->quality[j] = bestq;
 	}
+}
 
-	/* each partitioning was tried twice, account for this in count */
-	match->count /= 2;
+/*
+ * Allocate the arrays of hb for n configurations.  Return 0 on success,
+ * -1 on failure with errno set.
+ */
+static int
+half_best_alloc(struct half_best *hb, size_t n)
+{
+	hb->max = malloc(n * sizeof *hb->max);
+	hb->count = malloc(n * sizeof *hb->count);
+	hb->best = malloc(n * sizeof *hb->best);
+	hb->quality = malloc(n * sizeof *hb->quality);
 
-	return (1);
+	if (hb->max == NULL || hb->count == NULL || hb->best == NULL
+	    || hb->quality == NULL)
+		return (-1);
+
+	return (0);
 }
 
 /*
- * Try all ways to match the given half into two quarters.  Return the
- * highest h value found, store one partitioning with the highest
- * h value to quarters and the number of partitionings with that h value
- * to count.  The match returned is the highest quality match found.
- * Store the quality of the match in quality.
+ * Release the arrays allocated by half_best_alloc().
  */
-static int
-match_half_best(const unsigned char matchv[MATCH_SIZE],
-    const struct quality qualities[MATCH_SIZE], tileset half,
-    tileset quarters[2], unsigned long long *count, unsigned long long *maxqual)
+static void
+half_best_free(struct half_best *hb)
 {
+	free(hb->max);
+	free(hb->count);
+	free(hb->best);
+	free(hb->quality);
+}
+
+/*
+ * Record the split hs->half into the quarters chosen by hb for
+ * configuration j in quarters and their h values in hval.
+ */
+static void
+record_split(tileset quarters[2], unsigned char hval[2],
+    const struct half_splits *hs, const struct half_best *hb,
+    const unsigned char *vt, size_t n, size_t j)
+{
+	size_t i = hb->best[j];
+
+	quarters[0] = pdep(hs->half, tileset_unrank(6, i));
+	quarters[1] = tileset_difference(hs->half, quarters[0]);
+	hval[0] = vt[hs->lorank[i] * n + j];
+	hval[1] = vt[hs->hirank[i] * n + j];
+}
+
+/*
+ * Evaluate the halves task->begin to task->end - 1 and their
+ * complements for all configurations.  This is a thread worker.
+ */
+static void *
+match_worker(void *taskarg)
+{
+	struct match_task *task = taskarg;
+	struct match *match;
+	struct half_splits *hs;
+	struct half_best hb[2];
 	unsigned long long quality;
-	size_t i;
-	tileset loquarter, hiquarter;
-	tsrank lorank, hirank;
-	int max = 0, hval;
+	size_t i, j, n = task->n_match;
+	unsigned hval;
+
+	memset(hb, 0, sizeof hb);
+	hs = malloc(2 * sizeof *hs);
+	if (hs == NULL || half_best_alloc(hb + 0, n) != 0
+	    || half_best_alloc(hb + 1, n) != 0) {
+		task->error = errno;
+		goto done;
+	}
 
-	*count = 0;
-	*maxqual = 0;
+	for (i = task->begin; i < task->end; i++) {
+		half_splits_init(hs + 0, task->qualities, tileset_unranknz(12, i));
+		half_splits_init(hs + 1, task->qualities,
+		    tileset_difference(NONZERO_TILES, hs[0].half));
 
-	for (i = 0; i < SIX_OF_TWELVE / 2; i++) {
-		loquarter = pdep(half, tileset_unrank(6, i));
-		hiquarter = tileset_difference(half, loquarter);
+		half_best(hb + 0, hs + 0, task->vt, n);
+		half_best(hb + 1, hs + 1, task->vt, n);
+
+		for (j = 0; j < n; j++) {
+			match = task->matches + j;
+			assert(hb[0].count[j] != 0);
+			assert(hb[1].count[j] != 0);
+
+			hval = hb[0].max[j] + hb[1].max[j];
+			if (hval > task->max[j]) {
+				task->max[j] = hval;
+				match->count = 0;
+				match->quality = 0;
+			}
+
+			if (hval < task->max[j])
+				continue;
+
+			match->count += (unsigned long long)hb[0].count[j] * hb[1].count[j];
+			quality = hb[0].quality[j] + hb[1].quality[j];
+			if (quality >= match->quality) {
+				match->quality = quality;
+				record_split(match->ts + 0, match->hval + 0, hs + 0, hb + 0, task->vt, n, j);
+				record_split(match->ts + 2, match->hval + 2, hs + 1, hb + 1, task->vt, n, j);
+			}
+		}
+	}
+
+done:	half_best_free(hb + 0);
+	half_best_free(hb + 1);
+	free(hs);
+
+	return (NULL);
+}
+
+/*
+ * Run match_worker() for each of the n tasks, using one thread per
+ * task.  If threads cannot be created, run the remaining tasks on the
+ * calling thread.
+ */
+static void
+run_tasks(struct match_task *tasks, int n)
+{
+	pthread_t pool[PDB_MAX_JOBS];
+	int i, spawned, error;
+
+	for (i = 0; i < n; i++) {
+		error = pthread_create(pool + i, NULL, match_worker, tasks + i);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_create");
+			break;
+		}
+	}
+
+	spawned = i;
+	for (; i < n; i++)
+		match_worker(tasks + i);
+
+	for (i = 0; i < spawned; i++) {
+		error = pthread_join(pool[i], NULL);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_join");
+			abort();
+		}
+	}
+}
+
+/*
+ * Find the best way to partition the tray into 4 groups of six tiles
+ * and store the optimal matches in match.  The best partitioning is the
+ * partitioning with the highest possible h value for the configuration
+ * whose partial h values are given in match with the best quality as
+ * indicated by the qualities vector.  On success return 1,  on error,
+ * return 0 and set errno to indicate a reason.
+ */
+extern int
+match_find_best(struct match *match, const unsigned char matchv[MATCH_SIZE],
+    const struct quality qualities[MATCH_SIZE])
+{
+
+	return (match_find_best_batch(match, &matchv, 1, qualities));
+}
+
+/*
+ * Like match_find_best(), but find the best partitionings for the
+ * n_match configurations whose match vectors are given in matchvs and
+ * store them in matches.  The work is distributed over pdb_jobs
+ * threads.  This is much faster than calling match_find_best() for
+ * each configuration.
+ */
+extern int
+match_find_best_batch(struct match *matches, const unsigned char *const matchvs[],
+    size_t n_match, const struct quality qualities[MATCH_SIZE])
+{
+	struct match_task tasks[PDB_MAX_JOBS], *task;
+	struct match *match;
+	unsigned char *vt = NULL;
+	size_t i, j, n_half = TWELVE_TILES / 2;
+	int jobs = pdb_jobs, error = 0;
+
+	tileset_unrank_init(6);
+	tileset_unrank_init(12);
+
+	memset(matches, 0, n_match * sizeof *matches);
+	memset(tasks, 0, sizeof tasks);
 
-		lorank = tileset_ranknz(loquarter);
-		hirank = tileset_ranknz(hiquarter);
+	if (n_match == 0)
+		return (1);
 
-		hval = matchv[lorank] + matchv[hirank];
-		quality = qualities[lorank].havg + qualities[hirank].havg;
+	/* transpose the match vectors unless there is just one */
+	if (n_match > 1) {
+		vt = malloc(MATCH_SIZE * n_match);
+		if (vt == NULL)
+			return (0);
+
+		for (j = 0; j < n_match; j++)
+			for (i = 0; i < MATCH_SIZE; i++)
+				vt[i * n_match + j] = matchvs[j][i];
+	}
 
-		if (hval > max) {
-			max = hval;
-			*count = 0;
-			*maxqual = 0;
+	for (i = 0; i < (size_t)jobs; i++) {
+		task = tasks + i;
+		task->vt = vt != NULL ? vt : matchvs[0];
+		task->qualities = qualities;
+		task->n_match = n_match;
+		task->begin = n_half * i / jobs;
+		task->end = n_half * (i + 1) / jobs;
+		task->matches = calloc(n_match, sizeof *task->matches);
+		task->max = calloc(n_match, sizeof *task->max);
+		if (task->matches == NULL || task->max == NULL) {
+			error = errno;
+			jobs = i + 1;
+			goto fail;
 		}
+	}
+
+	run_tasks(tasks, jobs);
 
-		if (hval >= max) {
-			++*count;
+	/*
+	 * Merge the results in the order of the ranges to obtain the
+	 * same result as a sequential search.
+	 */
+	for (i = 0; i < (size_t)jobs; i++) {
+		if (tasks[i].error != 0) {
+			error = tasks[i].error;
+			goto fail;
+		}
 
-			if (quality >= *maxqual) {
-				quarters[0] = loquarter;
-				quarters[1] = hiquarter;
-				*maxqual = quality;
+		for (j = 0; j < n_match; j++) {
+			match = tasks[i].matches + j;
+			if (i == 0 || tasks[i].max[j] > tasks[0].max[j]) {
+				tasks[0].max[j] = tasks[i].max[j];
+				matches[j] = *match;
+			} else if (tasks[i].max[j] == tasks[0].max[j]) {
+				matches[j].count += match->count;
+				if (match->quality >= matches[j].quality) {
+					matches[j].quality = match->quality;
+					memcpy(matches[j].ts, match->ts, sizeof match->ts);
+					memcpy(matches[j].hval, match->hval, sizeof match->hval);
+				}
 			}
 		}
 	}
 
-	return (max);
+	/* each partitioning was tried twice, account for this in count */
+	for (j = 0; j < n_match; j++)
+		matches[j].count /= 2;
+
+fail:	for (i = 0; i < (size_t)jobs; i++) {
+		free(tasks[i].matches);
+		free(tasks[i].max);
+	}
+
+	free(vt);
+
+	if (error != 0) {
+		errno = error;
+		return (0);
+	}
+
+	return (1);
 }
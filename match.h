@@ -50,7 +50,8 @@ enum {
  * 4 groups of 6 tiles.  By incrementally looking up configurations in
  * various pattern databases with match_amend, a vector of partial
  * h values can be created.  Using this vector, an optimal partitioning
- * can be determined with match_find_best.  Similarly, a pessimal
+ * can be determined with match_find_best, or for many configurations
+ * at once with match_find_best_batch.  Similarly, a pessimal
  * partitioning can be determined with match_find_worst.  The member
  * count contains the number of matches with this h value, quality
  * contains the quality of the partitioning found.
@@ -77,6 +78,7 @@ struct quality {
 
 extern struct quality *qualities_load(const char *);
 extern int	match_find_best(struct match *, const unsigned char[MATCH_SIZE], const struct quality[MATCH_SIZE]);
+extern int	match_find_best_batch(struct match *, const unsigned char *const[], size_t, const struct quality[MATCH_SIZE]);
 //extern size_t	match_find_worst(struct match *, size_t, const unsigned char *);
 
 /*
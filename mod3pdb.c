@@ -0,0 +1,371 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* mod3pdb.c -- PDBs storing h values modulo 3 */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mod3pdb.h"
+#include "index.h"
+#include "puzzle.h"
+#include "tileset.h"
+
+/*
+ * Allocate a struct mod3pdb for tile set ts with 1 << shift entries
+ * per base without allocating any tables.  Return NULL and set errno
+ * on failure.
+ */
+static struct mod3pdb *
+mod3pdb_dummy(tileset ts, int shift)
+{
+	struct mod3pdb *m3pdb;
+
+	m3pdb = aligned_alloc(alignof(struct mod3pdb), sizeof *m3pdb);
+	if (m3pdb == NULL)
+		return (NULL);
+
+	make_index_aux(&m3pdb->aux, ts);
+	m3pdb->base_shift = shift;
+	m3pdb->data = NULL;
+	m3pdb->bases = NULL;
+
+	return (m3pdb);
+}
+
+/*
+ * Allocate a mod3pdb for tile set ts with 1 << shift entries per base.
+ * If storage is insufficient, return NULL and set errno.  The entries
+ * and bases are undefined initially.
+ */
+extern struct mod3pdb *
+mod3pdb_allocate(tileset ts, int shift)
+{
+	struct mod3pdb *m3pdb;
+	int error;
+
+	if (shift < 0 || shift > MOD3PDB_MAX_BASE_SHIFT) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	m3pdb = mod3pdb_dummy(ts, shift);
+	if (m3pdb == NULL)
+		return (NULL);
+
+	m3pdb->data = malloc(mod3pdb_size(&m3pdb->aux));
+	m3pdb->bases = malloc(mod3pdb_base_count(&m3pdb->aux, shift));
+	if (m3pdb->data == NULL || m3pdb->bases == NULL) {
+		error = errno;
+		mod3pdb_free(m3pdb);
+		errno = error;
+		return (NULL);
+	}
+
+	return (m3pdb);
+}
+
+/*
+ * Release storage associated with m3pdb.
+ */
+extern void
+mod3pdb_free(struct mod3pdb *m3pdb)
+{
+
+	free(m3pdb->data);
+	free(m3pdb->bases);
+	free(m3pdb);
+}
+
+/*
+ * Read exactly n bytes from f into buf.  Return 0 on success.  On
+ * failure return -1 and set errno, using EINVAL for short reads.
+ */
+static int
+read_exactly(void *buf, size_t n, FILE *f)
+{
+	size_t count;
+
+	count = fread(buf, 1, n, f);
+	if (count != n) {
+		/* tell apart short read from IO error */
+		if (!ferror(f))
+			errno = EINVAL;
+
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Load a mod3pdb for tile set ts from pdbfile and return a pointer to
+ * the mod3pdb just loaded.  On error, return NULL and set errno to
+ * indicate the problem.  pdbfile must be a binary file opened for
+ * reading with the file pointer positioned right at the beginning of
+ * the mod3pdb.  The file pointer is located at the end of the mod3pdb
+ * on success and is undefined on failure.
+ */
+extern struct mod3pdb *
+mod3pdb_load(tileset ts, FILE *pdbfile)
+{
+	struct mod3pdb *m3pdb;
+	int shift, error;
+
+	m3pdb = mod3pdb_dummy(ts, 0);
+	if (m3pdb == NULL)
+		return (NULL);
+
+	m3pdb->data = malloc(mod3pdb_size(&m3pdb->aux));
+	if (m3pdb->data == NULL)
+		goto fail;
+
+	if (read_exactly(m3pdb->data, mod3pdb_size(&m3pdb->aux), pdbfile) != 0)
+		goto fail;
+
+	shift = getc(pdbfile);
+	if (shift == EOF || shift > MOD3PDB_MAX_BASE_SHIFT) {
+		if (!ferror(pdbfile))
+			errno = EINVAL;
+
+		goto fail;
+	}
+
+	m3pdb->base_shift = shift;
+	m3pdb->bases = malloc(mod3pdb_base_count(&m3pdb->aux, shift));
+	if (m3pdb->bases == NULL)
+		goto fail;
+
+	if (read_exactly(m3pdb->bases, mod3pdb_base_count(&m3pdb->aux, shift), pdbfile) != 0)
+		goto fail;
+
+	return (m3pdb);
+
+fail:
+	error = errno;
+	mod3pdb_free(m3pdb);
+	errno = error;
+
+	return (NULL);
+}
+
+/*
+ * Write m3pdb to FILE f in the format described in mod3pdb.h.  Return
+ * 0 on success, -1 on error.  Set errno to indicate the cause on error.
+ * f must be a binary file open for writing, the file pointer is
+ * positioned after the end of the mod3pdb on success, undefined on
+ * failure.
+ */
+extern int
+mod3pdb_store(FILE *f, struct mod3pdb *m3pdb)
+{
+	size_t size = mod3pdb_size(&m3pdb->aux);
+	size_t n_base = mod3pdb_base_count(&m3pdb->aux, m3pdb->base_shift);
+	int error;
+
+	if (fwrite(m3pdb->data, 1, size, f) != size
+	    || putc(m3pdb->base_shift, f) == EOF
+	    || fwrite(m3pdb->bases, 1, n_base, f) != n_base
+	    || fflush(f) != 0) {
+		error = errno;
+
+		/* tell apart end of medium from IO error */
+		if (!ferror(f))
+			errno = ENOSPC;
+		else
+			errno = error;
+
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Generate a mod3pdb with 1 << shift entries per base from pdb, which
+ * must be in the linear layout.  On success, return the mod3pdb, on
+ * failure return NULL and set errno to indicate the error that
+ * occurred.
+ */
+extern struct mod3pdb *
+mod3pdb_from_pdb(struct patterndb *pdb, int shift)
+{
+	struct mod3pdb *m3pdb;
+	size_t i, j, n, n_base, block;
+	int h, min, max;
+
+	if (pdb->layout != PDB_LAYOUT_LINEAR) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	m3pdb = mod3pdb_allocate(pdb->aux.ts, shift);
+	if (m3pdb == NULL)
+		return (NULL);
+
+	n = search_space_size(&pdb->aux);
+	memset(m3pdb->data, 0, mod3pdb_size(&m3pdb->aux));
+
+	n_base = mod3pdb_base_count(&m3pdb->aux, shift);
+	block = (size_t)1 << shift;
+	for (i = 0; i < n_base; i++) {
+		min = INT_MAX;
+		max = 0;
+		for (j = i * block; j < (i + 1) * block && j < n; j++) {
+			h = atomic_load_explicit(pdb->data + j, memory_order_relaxed);
+			m3pdb->data[j / 4] |= h % 3 << 2 * (j % 4);
+
+			if (h < min)
+				min = h;
+
+			if (h > max)
+				max = h;
+		}
+
+		m3pdb->bases[i] = max - min < 3 && min < MOD3PDB_NO_BASE ? min : MOD3PDB_NO_BASE;
+	}
+
+	return (m3pdb);
+}
+
+/*
+ * Return the residue stored in m3pdb for offset.
+ */
+static int
+mod3pdb_entry(const struct mod3pdb *m3pdb, size_t offset)
+{
+	return (m3pdb->data[offset / 4] >> 2 * (offset % 4) & 3);
+}
+
+/*
+ * If the block containing offset has a base, return the h value of the
+ * entry at offset whose residue is entry.  Otherwise, return -1.
+ */
+static int
+base_hval(const struct mod3pdb *m3pdb, size_t offset, int entry)
+{
+	int base;
+
+	base = m3pdb->bases[offset >> m3pdb->base_shift];
+	if (base == MOD3PDB_NO_BASE)
+		return (-1);
+
+	return (base + (entry + 3 - base % 3) % 3);
+}
+
+/*
+ * Given the h value old_h of a configuration adjacent to one whose
+ * residue is entry, return the h value of the latter.
+ */
+static int
+diff_hval(int old_h, int entry)
+{
+	/* the change in h value indexed by the difference of residues */
+	static const signed char delta[3] = { 0, +1, -1 };
+
+	return (old_h + delta[(entry + 3 - old_h % 3) % 3]);
+}
+
+/*
+ * Perform a differential lookup into m3pdb.  old_h must be the h value
+ * for a puzzle configuration directly connected with p in the quotient
+ * graph induced by m3pdb->aux.ts.  Return the distance found.
+ */
+extern int
+mod3pdb_diff_lookup(struct mod3pdb *m3pdb, const struct puzzle *p, int old_h)
+{
+	struct index idx;
+
+	compute_index(&m3pdb->aux, &idx, p);
+
+	return (diff_hval(old_h, mod3pdb_entry(m3pdb, index_offset(&m3pdb->aux, &idx))));
+}
+
+/*
+ * Determine the h value for puzzle configuration p.  If the block of p
+ * has a base, this is immediate.  Otherwise, walk towards the goal in
+ * the quotient graph induced by m3pdb->aux.ts until we reach a
+ * configuration whose block has a base or the goal itself.
+ */
+extern int
+mod3pdb_lookup_puzzle(struct mod3pdb *m3pdb, const struct puzzle *parg)
+{
+	struct move moves[MAX_MOVES];
+	struct index idx;
+	struct puzzle p = *parg;
+	size_t n_moves, i, offset;
+	int initial_h, cur_h, next_h, base_h, entry;
+
+	/* some multiple of 3 higher than the diameter of the search space */
+	enum { DUMMY_HVAL = 255 };
+
+	compute_index(&m3pdb->aux, &idx, &p);
+	offset = index_offset(&m3pdb->aux, &idx);
+	entry = mod3pdb_entry(m3pdb, offset);
+	base_h = base_hval(m3pdb, offset, entry);
+	if (base_h >= 0)
+		return (base_h);
+
+	initial_h = DUMMY_HVAL + entry;
+	next_h = initial_h;
+
+	do {
+		cur_h = next_h;
+		n_moves = generate_moves(moves, eqclass_from_index(&m3pdb->aux, &idx));
+
+		assert(n_moves > 0);
+		for (i = 0; i < n_moves; i++) {
+			move(&p, moves[i].zloc);
+			move(&p, moves[i].dest);
+
+			compute_index(&m3pdb->aux, &idx, &p);
+			offset = index_offset(&m3pdb->aux, &idx);
+			entry = mod3pdb_entry(m3pdb, offset);
+			next_h = diff_hval(cur_h, entry);
+
+			/* h values are relative to initial_h until now */
+			base_h = base_hval(m3pdb, offset, entry);
+			if (base_h >= 0)
+				return (initial_h - next_h + base_h);
+
+			if (next_h < cur_h)
+				break;
+
+			move(&p, moves[i].zloc);
+		}
+
+		/* sanity check: make sure we don't descend infinitely */
+		assert(next_h > 0);
+	} while (next_h < cur_h);
+
+	/* if we couldn't make any progess, we are done */
+	assert(puzzle_partially_equal(&solved_puzzle, &p, &m3pdb->aux));
+	return (initial_h - cur_h);
+}
@@ -0,0 +1,99 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MOD3PDB_H
+#define MOD3PDB_H
+
+#include <limits.h>
+#include <stdio.h>
+
+#include "index.h"
+#include "tileset.h"
+#include "puzzle.h"
+#include "pdb.h"
+
+/*
+ * A mod3pdb stores each entry of a PDB modulo 3 in two bits.  If the
+ * PDB represents a consistent heuristic, the h values of adjacent
+ * configurations differ by at most one, so knowing the h value of one
+ * configuration and the residue of the other, we know the h value of
+ * the other one, too.  Unlike a bitpdb, this doesn't depend on the
+ * parity of the configurations involved.
+ *
+ * For direct lookups, the entries are grouped into blocks of
+ * 1 << base_shift entries.  If the h values in a block differ by less
+ * than 3, bases holds the least h value in the block, from which the
+ * h value of each entry of the block follows.  Otherwise, the base is
+ * MOD3PDB_NO_BASE and a direct lookup walks towards the goal until it
+ * encounters an entry whose block has a base.
+ *
+ * On disk, a mod3pdb is stored as the data table, followed by a single
+ * byte holding base_shift, followed by the table of bases.
+ */
+struct mod3pdb {
+	struct index_aux aux;
+	int base_shift;
+	unsigned char *data;
+	unsigned char *bases;
+};
+
+enum {
+	/* default block size for bases: 16 entries (four bytes of data) */
+	MOD3PDB_BASE_SHIFT = 4,
+	MOD3PDB_MAX_BASE_SHIFT = 20,
+
+	/* marks a block without base */
+	MOD3PDB_NO_BASE = UCHAR_MAX,
+};
+
+/* mod3pdb.c */
+extern struct mod3pdb	*mod3pdb_allocate(tileset, int);
+extern void		 mod3pdb_free(struct mod3pdb *);
+extern struct mod3pdb	*mod3pdb_load(tileset, FILE *);
+extern int		 mod3pdb_store(FILE *, struct mod3pdb *);
+extern struct mod3pdb	*mod3pdb_from_pdb(struct patterndb *, int);
+extern int		 mod3pdb_lookup_puzzle(struct mod3pdb *, const struct puzzle *);
+extern int		 mod3pdb_diff_lookup(struct mod3pdb *, const struct puzzle *, int);
+
+/*
+ * Return the size of the data table for a mod3pdb corresponding to aux.
+ */
+static inline size_t
+mod3pdb_size(const struct index_aux *aux)
+{
+	return ((search_space_size(aux) + 3) / 4);
+}
+
+/*
+ * Return the number of bases for a mod3pdb corresponding to aux with
+ * 1 << shift entries per base.
+ */
+static inline size_t
+mod3pdb_base_count(const struct index_aux *aux, int shift)
+{
+	return ((search_space_size(aux) + ((size_t)1 << shift) - 1) >> shift);
+}
+
+#endif /* MOD3PDB_H */
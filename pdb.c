@@ -27,10 +27,12 @@
 
 #define _POSIX_C_SOURCE 200809L
 #include <errno.h>
+#include <stdalign.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "tileset.h"
 #include "index.h"
@@ -77,13 +79,19 @@ pdb_dummy(tileset ts)
 {
 	struct patterndb *pdb;
 
-	pdb = malloc(sizeof *pdb);
+	/* struct index_aux needs more alignment than malloc() provides */
+	pdb = aligned_alloc(alignof(struct patterndb), sizeof *pdb);
 	if (pdb == NULL)
 		return (NULL);
 
 	make_index_aux(&pdb->aux, ts);
 	pdb->mapped = 0;
+	pdb->map_offset = 0;
+	pdb->layout = PDB_LAYOUT_LINEAR;
+	pdb->block_shift = 0;
+	pdb->block_stride = 0;
 	pdb->data = NULL;
+	pdb->warm = NULL;
 
 	return (pdb);
 }
@@ -121,8 +129,11 @@ extern void
 pdb_free(struct patterndb *pdb)
 {
 
+	pdb_warm_stop(pdb);
+
 	if (pdb->mapped)
-		munmap(pdb->data, search_space_size(&pdb->aux));
+		munmap((void *)(pdb->data - pdb->map_offset),
+		    search_space_size(&pdb->aux) + pdb->map_offset);
 	else
 		free(pdb->data);
 
@@ -143,50 +154,87 @@ pdb_clear(struct patterndb *pdb)
  * Load a PDB for tileset ts from file and return a pointer to the PDB
  * just loaded.  On error, return NULL and set errno to indicate the
  * problem.  pdbfile must be a binary file opened for reading with the
- * file pointer positioned right at the beginning of the PDB.  The file
- * pointer is located at the end of the PDB on success and is undefined
- * on failure.
+ * file pointer positioned right at the beginning of the PDB.  Both PDB
+ * files with a header and raw PDB files are accepted.  If the file has
+ * a header, it must match ts.  The file pointer is located at the end
+ * of the PDB on success and is undefined on failure.
  */
 extern struct patterndb *
 pdb_load(tileset ts, FILE *pdbfile)
 {
 	struct patterndb *pdb = pdb_allocate(ts);
-	size_t count, size;
+	struct pdb_header *hdr;
+	size_t count, size, peeked;
 	int error;
+	char magic[8];
 
 	if (pdb == NULL)
 		return (NULL);
 
 	size = search_space_size(&pdb->aux);
-	count = fread((void *)pdb->data, 1, size, pdbfile);
+	peeked = fread(magic, 1, sizeof magic, pdbfile);
+	if (peeked == sizeof magic && memcmp(magic, PDB_MAGIC, sizeof magic) == 0) {
+		if (pdb_header_fread(&hdr, pdbfile, magic) != 0)
+			goto fail;
+
+		error = pdb_header_check(hdr, &pdb->aux);
+		free(hdr);
+		if (error != 0)
+			goto fail;
+
+		peeked = 0;
+	} else if (peeked > size)
+		peeked = size; /* can only happen for tiny PDBs */
+
+	memcpy((void *)pdb->data, magic, peeked);
+	count = peeked + fread((void *)(pdb->data + peeked), 1, size - peeked, pdbfile);
 	if (count != size) {
-		error = errno;
-		pdb_free(pdb);
-
 		/* tell apart short read from IO error */
 		if (!ferror(pdbfile))
 			errno = EINVAL;
-		else
-			errno = error;
 
-		return (NULL);
+		goto fail;
 	}
 
 	return (pdb);
+
+fail:
+	error = errno;
+	pdb_free(pdb);
+	errno = error;
+
+	return (NULL);
 }
 
 /*
- * Write pdb to pdbfile.  Return 0 an success.  On error, return -1 and
- * set errno to indicate the cause of the error.  pdbfile must be a
- * binary file open for writing.  The file pointer is positioned after
- * the end of the PDB on success, undefined on failure.
+ * Write pdb to pdbfile, preceded by a header.  Return 0 an success.  On
+ * error, return -1 and set errno to indicate the cause of the error.
+ * Only PDBs in the linear layout can be stored.
+ * pdbfile must be a binary file open for writing.  The file pointer is
+ * positioned after the end of the PDB on success, undefined on failure.
  */
 extern int
 pdb_store(FILE *pdbfile, struct patterndb *pdb)
 {
+	struct pdb_header *hdr;
 	size_t count, size = search_space_size(&pdb->aux);
 	int error;
 
+	/* PDB files are always in the linear layout */
+	if (pdb->layout != PDB_LAYOUT_LINEAR) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	hdr = pdb_header_make(pdb, PDB_FORMAT_PDB, 0);
+	if (hdr == NULL)
+		return (-1);
+
+	error = pdb_header_write(pdbfile, hdr);
+	free(hdr);
+	if (error != 0)
+		return (-1);
+
 	count = fwrite((void *)pdb->data, 1, size, pdbfile);
 	if (count != size) {
 		error = errno;
@@ -209,13 +257,19 @@ pdb_store(FILE *pdbfile, struct patterndb *pdb)
  * Load a PDB from file descriptor fd by mapping it into RAM.  This
  * might perform better than pdb_load().  Use flags to decide what
  * protection the mapping has and whether changes are written back to
- * the input file.
+ * the input file.  If the file has a header, it is checked against ts
+ * and the PDB data following it is mapped.  A file too short to hold
+ * the PDB is rejected with EINVAL.
  */
 extern struct patterndb *
 pdb_mmap(tileset ts, int pdbfd, int mapflags)
 {
-	struct patterndb *pdb = pdb_dummy(ts);
+	struct patterndb *pdb;
+	struct pdb_header *hdr;
+	struct stat st;
+	size_t size, offset = 0;
 	int prot, flags, error;
+	unsigned char *base;
 
 	switch (mapflags) {
 	case PDB_MAP_RDONLY:
@@ -238,17 +292,48 @@ pdb_mmap(tileset ts, int pdbfd, int mapflags)
 		return (NULL);
 	}
 
+	pdb = pdb_dummy(ts);
 	if (pdb == NULL)
 		return (NULL);
 
-	pdb->mapped = 1;
-	pdb->data = mmap(NULL, search_space_size(&pdb->aux), prot, flags, pdbfd, 0);
-	if (pdb->data == MAP_FAILED) {
-		error = errno;
-		free(pdb);
-		errno = error;
-		return (NULL);
+	switch (pdb_header_read(&hdr, pdbfd)) {
+	case -1:
+		goto fail;
+
+	case 1:
+		error = pdb_header_check(hdr, &pdb->aux);
+		offset = hdr->data_offset;
+		free(hdr);
+		if (error != 0)
+			goto fail;
+
+		break;
+	}
+
+	/* mapping past the end of the file would cause SIGBUS later */
+	size = search_space_size(&pdb->aux);
+	if (fstat(pdbfd, &st) != 0)
+		goto fail;
+
+	if (S_ISREG(st.st_mode) && (size_t)st.st_size < offset + size) {
+		errno = EINVAL;
+		goto fail;
 	}
 
+	base = mmap(NULL, offset + size, prot, flags, pdbfd, 0);
+	if (base == MAP_FAILED)
+		goto fail;
+
+	pdb->mapped = 1;
+	pdb->map_offset = offset;
+	pdb->data = (atomic_uchar *)(base + offset);
+
 	return (pdb);
+
+fail:
+	error = errno;
+	free(pdb);
+	errno = error;
+
+	return (NULL);
 }
@@ -27,6 +27,7 @@
 #define PDB_H
 
 #include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <limits.h>
 
@@ -38,13 +39,31 @@
  * representing the distance from the represented partial puzzle
  * configuration to the solved puzzle.  The member aux describes the
  * tile set we use to compute indices.  data points to the content of
- * the PDB, organized first by map rank, then by permutation index,
- * and finally by equivalence class.
+ * the PDB, organized first by map rank, then by equivalence class,
+ * and finally by permutation index.  If the PDB has been mapped from a
+ * file with a header, map_offset is the offset of data from the start
+ * of the mapping.
+ *
+ * This is the linear layout (PDB_LAYOUT_LINEAR) used for PDB files and
+ * everything that walks through a PDB table by table.  For searching,
+ * a PDB can be rearranged into the blocked layout (PDB_LAYOUT_BLOCKED)
+ * with pdb_relayout().  The permutation indices are cut into blocks of
+ * 1 << block_shift and the PDB is organized first by block, then by
+ * table (map rank and equivalence class) and finally by permutation
+ * index within the block.  When a tile moves horizontally, its
+ * permutation index does not change, so the successors of a node are
+ * only (1 << block_shift) * the difference in table number apart
+ * instead of n_perm times that.  block_stride is the number of tables,
+ * i.e. eqclass_total(&aux).  Blocked PDBs only support lookups.
  */
 struct patterndb {
 	struct index_aux aux;
 	int mapped; /* true if PDB has been allocated using mmap() */
+	int layout; /* PDB_LAYOUT_LINEAR or PDB_LAYOUT_BLOCKED */
+	unsigned block_shift;
+	size_t map_offset, block_stride;
 	atomic_uchar *data;
+	struct pdb_warm *warm; /* background warmup in progress or NULL */
 };
 
 _Static_assert(sizeof(atomic_uchar) == 1, "Machine does not support proper atomic chars.");
@@ -69,6 +88,28 @@ enum {
 
 	/* the maximal amount of PDBs used at once */
 	PDB_MAX_COUNT = TILE_COUNT - 1,
+
+	/* verification levels for pdb_verify_level, each includes the previous */
+	PDB_VERIFY_NONE = 0,	/* do not verify */
+	PDB_VERIFY_HEADER = 1,	/* check header and block checksums */
+	PDB_VERIFY_SAMPLE = 2,	/* check consistency of random entries */
+	PDB_VERIFY_FULL = 3,	/* check consistency of all entries */
+
+	/* default number of entries checked by PDB_VERIFY_SAMPLE */
+	PDB_VERIFY_SAMPLES = 1 << 16,
+
+	/* flags for pdb_warmup */
+	PDB_WARM_ADVISE = 1 << 0,	/* advise random access, read ahead */
+	PDB_WARM_TOUCH = 1 << 1,	/* touch every page */
+	PDB_WARM_LOCK = 1 << 2,		/* lock into memory */
+	PDB_WARM_BACKGROUND = 1 << 3,	/* touch and lock in the background */
+
+	/* memory layouts for pdb_relayout */
+	PDB_LAYOUT_LINEAR = 0,
+	PDB_LAYOUT_BLOCKED = 1,
+
+	/* default block size for PDB_LAYOUT_BLOCKED */
+	PDB_LAYOUT_SHIFT = 3,
 };
 
 /*
@@ -83,6 +124,60 @@ extern int pdb_jobs;
 
 extern const unsigned pdbcount[TILE_COUNT];
 
+/*
+ * Statistics about one round of PDB generation as recorded by
+ * pdb_generate_rounds():  the number of entries expanded in the round
+ * and the wall clock time it took in seconds.
+ */
+struct pdbgen_round {
+	size_t count;
+	double seconds;
+};
+
+/*
+ * Statistics about a PDB as computed by pdb_statistics() in a single
+ * pass:  how often each entry occurs, the entropy of the entries in
+ * bits per entry, and the values pdb_eta() and pdb_h_average() would return.
+ */
+struct pdb_stats {
+	unsigned long long histogram[PDB_HISTOGRAM_LEN];
+	double entropy, eta, h_average;
+};
+
+/*
+ * PDB files written by pdb_store() start with a header describing the
+ * PDB, followed by a checksum for each block of 1 << block_shift bytes
+ * of PDB data, followed by the PDB data itself at offset data_offset.
+ * data_offset is a multiple of PDB_HEADER_ALIGN so the PDB data is
+ * page aligned when the file is mapped.  All fields are in host byte
+ * order.  The checksums are CRC-32C.  header_checksum covers the
+ * header with header_checksum set to zero and the block checksums.
+ * Files not starting with PDB_MAGIC are raw PDB dumps as written by
+ * earlier versions and are still accepted.
+ */
+struct pdb_header {
+	char magic[8];
+	uint32_t version, format, tileset, morphism;
+	uint64_t n_entries, data_offset;
+	uint32_t block_shift, n_blocks;
+	uint32_t header_checksum, reserved;
+	uint64_t histogram[PDB_HISTOGRAM_LEN];
+	uint32_t checksums[];
+};
+
+#define PDB_MAGIC "24puzPDB"
+
+enum {
+	PDB_HEADER_VERSION = 1,
+	PDB_HEADER_ALIGN = 4096,
+
+	/* checksums are computed over blocks of 1 << PDB_BLOCK_SHIFT bytes */
+	PDB_BLOCK_SHIFT = 20,
+
+	/* values for the format field */
+	PDB_FORMAT_PDB = 0,
+};
+
 /* pdb.c */
 extern struct patterndb	*pdb_dummy(tileset);
 extern struct patterndb	*pdb_allocate(tileset);
@@ -94,12 +189,31 @@ extern int	pdb_store(FILE *, struct patterndb *);
 
 /* various */
 extern int	pdb_generate(struct patterndb *, FILE *);
+extern int	pdb_generate_rounds(struct patterndb *, FILE *, struct pdbgen_round[PDB_HISTOGRAM_LEN]);
 extern int	pdb_verify(struct patterndb *, FILE *);
-extern void	pdb_identify(struct patterndb *);
+extern int	pdb_verify_level(struct patterndb *, const struct pdb_header *, int, size_t, FILE *);
+extern int	pdb_identify(struct patterndb *);
+extern struct patterndb *pdb_identify_copy(struct patterndb *);
+
+/* pdbheader.c */
+extern struct pdb_header *pdb_header_make(struct patterndb *, unsigned, unsigned);
+extern int	pdb_header_read(struct pdb_header **, int);
+extern int	pdb_header_fread(struct pdb_header **, FILE *, const char[8]);
+extern int	pdb_header_write(FILE *, const struct pdb_header *);
+extern int	pdb_header_check(const struct pdb_header *, const struct index_aux *);
+extern int	pdb_check_checksums(size_t *, struct patterndb *, const struct pdb_header *, FILE *);
+
+/* pdblayout.c */
+extern int	pdb_relayout(struct patterndb *, int, unsigned);
+
+/* pdbwarm.c */
+extern int	pdb_warmup(struct patterndb *, int, FILE *);
+extern void	pdb_warm_stop(struct patterndb *);
 
 /* quality.c */
 extern double	pdb_eta(struct patterndb *);
 extern double	pdb_h_average(struct patterndb *);
+extern int	pdb_statistics(struct pdb_stats *, struct patterndb *);
 
 /*
  * Return a pointer to the PDB entry for idx.
@@ -107,8 +221,16 @@ extern double	pdb_h_average(struct patterndb *);
 static inline atomic_uchar *
 pdb_entry_pointer(struct patterndb *pdb, const struct index *idx)
 {
+	size_t block;
+	unsigned shift = pdb->block_shift;
+
+	if (pdb->layout == PDB_LAYOUT_LINEAR)
+		return (pdb->data + index_offset(&pdb->aux, idx));
+
+	block = (size_t)(idx->pidx >> shift) * pdb->block_stride
+	    + index_map_offset(&pdb->aux, idx);
 
-	return (pdb->data + index_offset(&pdb->aux, idx));
+	return (pdb->data + (block << shift) + (idx->pidx & (1u << shift) - 1));
 }
 
 /*
@@ -154,7 +276,8 @@ pdb_conditional_update(struct patterndb *pdb, const struct index *idx, unsigned
 }
 
 /*
- * Return the number entries in table i in pdb.
+ * Return the number entries in table i in pdb.  The entries of a
+ * table are only contiguous in the linear layout.
  */
 static inline size_t
 pdb_table_size(struct patterndb *pdb, size_t i)
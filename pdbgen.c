@@ -25,15 +25,18 @@
 
 /* pdbgen.c -- generate pattern databases */
 
+#define _POSIX_C_SOURCE 200809L
 #include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "puzzle.h"
 #include "tileset.h"
 #include "index.h"
 #include "pdb.h"
 #include "parallel.h"
+#include "perfcount.h"
 
 /*
  * Update the PDB for configuration p by finding all positions we can
@@ -117,12 +120,27 @@ generate_cohort(void *cfgarg, struct index *idx)
  * updates are written to f after each round.  This function returns
  * the number of rounds needed to fill the PDB.  This number is one
  * higher than the highest distance encountered.  Up to jobs threads
- * are used to compute the PDB in parallel.
+ * are used to compute the PDB in parallel.  If perf_enabled is set,
+ * performance counter readings for each round are written to f, too.
  */
 extern int
 pdb_generate(struct patterndb *pdb, FILE *f)
 {
+	return (pdb_generate_rounds(pdb, f, NULL));
+}
+
+/*
+ * Like pdb_generate(), but if rounds is not NULL, record the number of
+ * entries expanded and the time taken for each round in rounds.  The
+ * return value says how many rounds were recorded.
+ */
+extern int
+pdb_generate_rounds(struct patterndb *pdb, FILE *f,
+    struct pdbgen_round rounds[PDB_HISTOGRAM_LEN])
+{
+	struct perf_counters pc;
 	struct pdbgen_config cfg;
+	struct timespec begin, end;
 	struct index idx;
 
 	cfg.pcfg.pdb = pdb;
@@ -136,9 +154,22 @@ pdb_generate(struct patterndb *pdb, FILE *f)
 	do {
 		cfg.count = 0;
 		cfg.round++;
+		perf_begin(&pc);
+		clock_gettime(CLOCK_MONOTONIC, &begin);
 		pdb_iterate_parallel(&cfg.pcfg);
-		if (f != NULL)
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		perf_end(&pc);
+
+		if (rounds != NULL && cfg.round <= PDB_HISTOGRAM_LEN) {
+			rounds[cfg.round - 1].count = cfg.count;
+			rounds[cfg.round - 1].seconds = end.tv_sec - begin.tv_sec
+			    + (end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+		}
+
+		if (f != NULL) {
 			fprintf(f, "%3d: %20zu\n", cfg.round - 1, cfg.count);
+			perf_report(f, &pc, "entry", cfg.count);
+		}
 	} while (cfg.count != 0);
 
 	return (cfg.round);
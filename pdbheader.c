@@ -0,0 +1,418 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* pdbheader.c -- PDB file headers and checksums */
+
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __SSE4_2__
+# include <immintrin.h>
+#endif
+
+#include "index.h"
+#include "pdb.h"
+#include "tileset.h"
+
+/*
+ * Update the CRC-32C crc with the len bytes in buf.
+ */
+static uint32_t
+crc32c(uint32_t crc, const void *bufarg, size_t len)
+{
+	const unsigned char *buf = bufarg;
+	size_t i = 0;
+	int j;
+
+	crc = ~crc;
+
+#ifdef __SSE4_2__
+	uint64_t word;
+
+	for (; i + sizeof word <= len; i += sizeof word) {
+		memcpy(&word, buf + i, sizeof word);
+		crc = (uint32_t)_mm_crc32_u64(crc, word);
+	}
+#endif
+
+	for (; i < len; i++) {
+		crc ^= buf[i];
+		for (j = 0; j < 8; j++)
+			crc = crc >> 1 ^ (0x82f63b78 & -(crc & 1));
+	}
+
+	return (~crc);
+}
+
+/*
+ * Checksum computation shared by the threads of checksum_blocks().
+ */
+struct checksum_task {
+	const unsigned char *data;
+	uint32_t *sums;
+	size_t n, n_blocks;
+	int shift;
+	atomic_size_t next;
+};
+
+static void *
+checksum_worker(void *taskarg)
+{
+	struct checksum_task *task = taskarg;
+	size_t i, begin, len;
+
+	while (i = atomic_fetch_add(&task->next, 1), i < task->n_blocks) {
+		begin = i << task->shift;
+		len = task->n - begin < (size_t)1 << task->shift ?
+		    task->n - begin : (size_t)1 << task->shift;
+		task->sums[i] = crc32c(0, task->data + begin, len);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Compute the checksums of the blocks of 1 << shift bytes the n bytes
+ * in data are made of and store them in sums.  Use pdb_jobs threads.
+ * If fewer threads can be spawned, the calling thread does the rest.
+ */
+static void
+checksum_blocks(uint32_t *sums, const unsigned char *data, size_t n, int shift)
+{
+	struct checksum_task task;
+	pthread_t pool[PDB_MAX_JOBS];
+	int i, spawned, error;
+
+	task.data = data;
+	task.sums = sums;
+	task.n = n;
+	task.n_blocks = (n + ((size_t)1 << shift) - 1) >> shift;
+	task.shift = shift;
+	atomic_init(&task.next, 0);
+
+	/* the calling thread computes checksums, too */
+	for (i = 1; i < pdb_jobs; i++) {
+		error = pthread_create(pool + i, NULL, checksum_worker, &task);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_create");
+			break;
+		}
+	}
+
+	spawned = i;
+	checksum_worker(&task);
+
+	for (i = 1; i < spawned; i++) {
+		error = pthread_join(pool[i], NULL);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_join");
+			abort();
+		}
+	}
+}
+
+/*
+ * Return the size of the header hdr including the block checksums.
+ */
+static size_t
+header_size(const struct pdb_header *hdr)
+{
+	return (sizeof *hdr + hdr->n_blocks * sizeof hdr->checksums[0]);
+}
+
+/*
+ * Compute the header checksum of hdr.
+ */
+static uint32_t
+header_checksum(const struct pdb_header *hdr)
+{
+	struct pdb_header fixed = *hdr;
+
+	fixed.header_checksum = 0;
+
+	return (crc32c(crc32c(0, &fixed, sizeof fixed),
+	    hdr->checksums, hdr->n_blocks * sizeof hdr->checksums[0]));
+}
+
+/*
+ * Check if the fixed part of hdr is consistent with itself.  Return 0
+ * if it is.  Otherwise, return -1 and set errno to EINVAL.
+ */
+static int
+header_valid(const struct pdb_header *hdr)
+{
+	if (memcmp(hdr->magic, PDB_MAGIC, sizeof hdr->magic) != 0
+	    || hdr->version != PDB_HEADER_VERSION
+	    || hdr->format != PDB_FORMAT_PDB
+	    || hdr->block_shift >= 48
+	    || hdr->n_blocks != (hdr->n_entries + ((uint64_t)1 << hdr->block_shift) - 1) >> hdr->block_shift
+	    || hdr->data_offset % PDB_HEADER_ALIGN != 0
+	    || hdr->data_offset < header_size(hdr)) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Create a header for pdb, recording format and morphism.  This
+ * computes the histogram and the block checksums of pdb in parallel.
+ * Return the header on success.  On failure, return NULL and set errno.
+ * The header is allocated with malloc() and should be released with
+ * free().
+ */
+extern struct pdb_header *
+pdb_header_make(struct patterndb *pdb, unsigned format, unsigned morphism)
+{
+	struct pdb_header *hdr;
+	struct pdb_stats stats;
+	size_t n = search_space_size(&pdb->aux), n_blocks;
+
+	n_blocks = (n + ((size_t)1 << PDB_BLOCK_SHIFT) - 1) >> PDB_BLOCK_SHIFT;
+	hdr = calloc(1, sizeof *hdr + n_blocks * sizeof hdr->checksums[0]);
+	if (hdr == NULL)
+		return (NULL);
+
+	memcpy(hdr->magic, PDB_MAGIC, sizeof hdr->magic);
+	hdr->version = PDB_HEADER_VERSION;
+	hdr->format = format;
+	hdr->tileset = pdb->aux.ts;
+	hdr->morphism = morphism;
+	hdr->n_entries = n;
+	hdr->block_shift = PDB_BLOCK_SHIFT;
+	hdr->n_blocks = n_blocks;
+	hdr->data_offset = (header_size(hdr) + PDB_HEADER_ALIGN - 1) / PDB_HEADER_ALIGN * PDB_HEADER_ALIGN;
+
+	if (pdb_statistics(&stats, pdb) != 0) {
+		free(hdr);
+		return (NULL);
+	}
+
+	memcpy(hdr->histogram, stats.histogram, sizeof hdr->histogram);
+	checksum_blocks(hdr->checksums, (const unsigned char *)pdb->data, n, PDB_BLOCK_SHIFT);
+	hdr->header_checksum = header_checksum(hdr);
+
+	return (hdr);
+}
+
+/*
+ * Read the header of the PDB file fd into a newly allocated buffer and
+ * store a pointer to it in *hdrp.  The file offset of fd is not
+ * changed.  Return 1 if a valid header was found, 0 if the file has no
+ * header, and -1 with errno set on error.  A damaged header is an
+ * error and reported as EINVAL.
+ */
+extern int
+pdb_header_read(struct pdb_header **hdrp, int fd)
+{
+	struct pdb_header fixed, *hdr;
+	ssize_t count;
+	size_t size;
+
+	count = pread(fd, &fixed, sizeof fixed, 0);
+	if (count < 0)
+		return (errno == ESPIPE ? 0 : -1);
+
+	if ((size_t)count < sizeof fixed.magic
+	    || memcmp(fixed.magic, PDB_MAGIC, sizeof fixed.magic) != 0)
+		return (0);
+
+	if ((size_t)count < sizeof fixed || header_valid(&fixed) != 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	size = header_size(&fixed);
+	hdr = malloc(size);
+	if (hdr == NULL)
+		return (-1);
+
+	*hdr = fixed;
+	count = pread(fd, hdr->checksums, size - sizeof fixed, sizeof fixed);
+	if (count < 0 || (size_t)count != size - sizeof fixed
+	    || header_checksum(hdr) != hdr->header_checksum) {
+		if (count >= 0)
+			errno = EINVAL;
+
+		free(hdr);
+		return (-1);
+	}
+
+	*hdrp = hdr;
+
+	return (1);
+}
+
+/*
+ * Like pdb_header_read(), but read the header from f, the first eight
+ * bytes of which have already been read into magic and match
+ * PDB_MAGIC.  On success, return 0 and leave the file pointer at the
+ * beginning of the PDB data.  On failure, return -1 and set errno.
+ */
+extern int
+pdb_header_fread(struct pdb_header **hdrp, FILE *f, const char magic[8])
+{
+	struct pdb_header fixed, *hdr;
+	size_t size, rest;
+	int c;
+
+	memcpy(fixed.magic, magic, sizeof fixed.magic);
+	if (fread((char *)&fixed + sizeof fixed.magic, 1, sizeof fixed - sizeof fixed.magic, f)
+	    != sizeof fixed - sizeof fixed.magic)
+		goto short_read;
+
+	if (header_valid(&fixed) != 0)
+		return (-1);
+
+	size = header_size(&fixed);
+	hdr = malloc(size);
+	if (hdr == NULL)
+		return (-1);
+
+	*hdr = fixed;
+	if (fread(hdr->checksums, 1, size - sizeof fixed, f) != size - sizeof fixed) {
+		free(hdr);
+		goto short_read;
+	}
+
+	if (header_checksum(hdr) != hdr->header_checksum) {
+		free(hdr);
+		errno = EINVAL;
+		return (-1);
+	}
+
+	/* skip padding */
+	for (rest = hdr->data_offset - size; rest > 0; rest--) {
+		c = getc(f);
+		if (c == EOF) {
+			free(hdr);
+			goto short_read;
+		}
+	}
+
+	*hdrp = hdr;
+
+	return (0);
+
+short_read:
+	/* tell apart short read from IO error */
+	if (!ferror(f))
+		errno = EINVAL;
+
+	return (-1);
+}
+
+/*
+ * Write hdr to f followed by padding up to hdr->data_offset.  Return 0
+ * on success, -1 with errno set on failure.
+ */
+extern int
+pdb_header_write(FILE *f, const struct pdb_header *hdr)
+{
+	static const char zeroes[PDB_HEADER_ALIGN];
+	size_t size = header_size(hdr), padding = hdr->data_offset - size;
+	int error;
+
+	if (fwrite(hdr, 1, size, f) != size || fwrite(zeroes, 1, padding, f) != padding) {
+		error = errno;
+
+		/* tell apart end of medium from IO error */
+		if (!ferror(f))
+			errno = ENOSPC;
+		else
+			errno = error;
+
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Check if hdr describes a PDB for aux.  Return 0 if it does.  If it
+ * doesn't, return -1 and set errno to EINVAL.
+ */
+extern int
+pdb_header_check(const struct pdb_header *hdr, const struct index_aux *aux)
+{
+	if (hdr->tileset != aux->ts || hdr->n_entries != search_space_size(aux)) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Recompute the block checksums of pdb in parallel and compare them
+ * with those recorded in hdr.  Print the blocks that do not match to f
+ * unless f is NULL and store their number to *n_bad.  pdb must be in
+ * the linear layout, else errno is EINVAL.  Return 0 on success, -1 on
+ * error with errno set.
+ */
+extern int
+pdb_check_checksums(size_t *n_bad, struct patterndb *pdb,
+    const struct pdb_header *hdr, FILE *f)
+{
+	uint32_t *sums;
+	size_t i, end, n = search_space_size(&pdb->aux);
+
+	if (pdb->layout != PDB_LAYOUT_LINEAR) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	sums = malloc(hdr->n_blocks * sizeof *sums);
+	if (sums == NULL)
+		return (-1);
+
+	checksum_blocks(sums, (const unsigned char *)pdb->data, n, hdr->block_shift);
+
+	*n_bad = 0;
+	for (i = 0; i < hdr->n_blocks; i++) {
+		if (sums[i] == hdr->checksums[i])
+			continue;
+
+		++*n_bad;
+		end = (i + 1) << hdr->block_shift;
+		if (f != NULL)
+			fprintf(f, "Checksum mismatch in block %zu (bytes %zu to %zu)\n",
+			    i, i << hdr->block_shift, (end < n ? end : n) - 1);
+	}
+
+	free(sums);
+
+	return (0);
+}
@@ -25,9 +25,11 @@
 
 /* pdbident.c -- turn a zero-aware PDB into a zero-unaware PDB */
 
-#include <assert.h>
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "tileset.h"
 #include "index.h"
@@ -87,26 +89,117 @@ move_tables(struct patterndb *pdb)
 		pdb->data = newdata;
 }
 
+/*
+ * Configuration for identify_copy_worker().  ipdb is the zero-unaware
+ * PDB the identified entries of pcfg.pdb are written to.
+ */
+struct identify_config {
+	struct parallel_config pcfg;
+	struct patterndb *ipdb;
+};
+
+/*
+ * Identify the equivalence classes of the cohort given by idx and write
+ * the result to the corresponding table of cfg->ipdb.
+ */
+static void
+identify_copy_worker(void *cfgarg, struct index *idx)
+{
+	struct identify_config *cfg = cfgarg;
+	struct index_aux *aux = &cfg->pcfg.pdb->aux;
+	size_t pidx, eqidx, n_perm = aux->n_perm;
+	size_t n_eqclass = eqclass_count(aux, idx->maprank);
+	int min, entry;
+	const atomic_uchar *table = pdb_entry_pointer(cfg->pcfg.pdb, idx);
+	atomic_uchar *out = cfg->ipdb->data + idx->maprank * n_perm;
+
+	for (pidx = 0; pidx < n_perm; pidx++) {
+		min = table[pidx];
+		for (eqidx = 1; eqidx < n_eqclass; eqidx++) {
+			entry = table[eqidx * n_perm + pidx];
+			min = entry < min ? entry : min;
+		}
+
+		out[pidx] = min;
+	}
+}
+
+/*
+ * Compute the zero-unaware PDB corresponding to the zero-aware PDB
+ * zpdb by identifying its equivalence classes as pdb_identify() does.
+ * zpdb is not modified and may be mapped read-only, so this works
+ * straight from a PDB file.  The work is distributed by map rank over
+ * pdb_jobs threads.  Only the identified PDB is allocated, which is
+ * smaller than zpdb.  Return the identified PDB on success, NULL with
+ * errno set on failure.  If zpdb is zero-unaware or not in the linear
+ * layout, errno is EINVAL.
+ */
+extern struct patterndb *
+pdb_identify_copy(struct patterndb *zpdb)
+{
+	struct identify_config cfg;
+
+	if (!tileset_has(zpdb->aux.ts, ZERO_TILE)
+	    || zpdb->layout != PDB_LAYOUT_LINEAR) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	cfg.ipdb = pdb_allocate(tileset_remove(zpdb->aux.ts, ZERO_TILE));
+	if (cfg.ipdb == NULL)
+		return (NULL);
+
+	cfg.pcfg.pdb = zpdb;
+	cfg.pcfg.worker = identify_copy_worker;
+	pdb_iterate_parallel(&cfg.pcfg);
+
+	return (cfg.ipdb);
+}
+
 /*
  * Turn zero-aware PDB pdb into a zero-unaware PDB by identifying its
  * equivalence classes, choosing the minimum of all equivalence classes
  * distance for each map/perm.  If pdb is zero-unaware, this is a no-op.
- * Otherwise, it is assumed that pdb has been allocated, the function
- * overwrites the content of pdb with the new values in place.
+ * If pdb has been allocated, the function overwrites the content of pdb
+ * with the new values in place.  If pdb is mapped, the identified PDB
+ * is computed with pdb_identify_copy() and replaces the mapping.
+ * Only PDBs in the linear layout can be identified, errno is EINVAL
+ * for others.  Return 0 on success, -1 with errno set on failure.  pdb
+ * is unchanged on failure.
  */
-extern void
+extern int
 pdb_identify(struct patterndb *pdb)
 {
 	struct parallel_config cfg;
+	struct patterndb *ipdb;
+
+	if (pdb->layout != PDB_LAYOUT_LINEAR) {
+		errno = EINVAL;
+		return (-1);
+	}
 
 	if (!tileset_has(pdb->aux.ts, ZERO_TILE))
-		return;
+		return (0);
 
-	assert(!pdb->mapped);
+	if (pdb->mapped) {
+		ipdb = pdb_identify_copy(pdb);
+		if (ipdb == NULL)
+			return (-1);
+
+		pdb_warm_stop(pdb);
+		munmap((void *)(pdb->data - pdb->map_offset),
+		    search_space_size(&pdb->aux) + pdb->map_offset);
+		*pdb = *ipdb;
+		free(ipdb);
+
+		return (0);
+	}
 
 	cfg.pdb = pdb;
 	cfg.worker = identify_worker;
 
 	pdb_iterate_parallel(&cfg);
 	move_tables(pdb);
+
+	return (0);
 }
@@ -0,0 +1,120 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* pdblayout.c -- rearrange PDBs in memory */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "index.h"
+#include "parallel.h"
+#include "pdb.h"
+
+/*
+ * Configuration for relayout_worker().  dst is a copy of the PDB
+ * description with the new layout and the new storage.
+ */
+struct relayout_config {
+	struct parallel_config pcfg;
+	struct patterndb dst;
+};
+
+/*
+ * Copy all entries of the cohort given by idx from the old to the new
+ * layout.
+ */
+static void
+relayout_worker(void *cfgarg, struct index *idx)
+{
+	struct relayout_config *cfg = cfgarg;
+	struct patterndb *src = cfg->pcfg.pdb;
+	size_t n_eqclass = eqclass_count(&src->aux, idx->maprank);
+	unsigned n_perm = src->aux.n_perm;
+
+	for (idx->eqidx = 0; idx->eqidx < n_eqclass; idx->eqidx++)
+		for (idx->pidx = 0; idx->pidx < n_perm; idx->pidx++)
+			*pdb_entry_pointer(&cfg->dst, idx) = *pdb_entry_pointer(src, idx);
+}
+
+/*
+ * Rearrange pdb into layout, which is one of PDB_LAYOUT_LINEAR and
+ * PDB_LAYOUT_BLOCKED.  For the blocked layout, the permutation indices
+ * are cut into blocks of 1 << shift entries, see pdb.h.  The entries
+ * are copied into newly allocated storage using pdb_jobs threads and
+ * the old storage is released, so a mapped PDB is no longer mapped
+ * afterwards.  Return 0 on success, -1 with errno set on failure.  If
+ * the block size does not divide the number of permutations, errno is
+ * EINVAL.  pdb is unchanged on failure.
+ */
+extern int
+pdb_relayout(struct patterndb *pdb, int layout, unsigned shift)
+{
+	struct relayout_config cfg;
+	size_t size = search_space_size(&pdb->aux);
+
+	switch (layout) {
+	case PDB_LAYOUT_LINEAR:
+		shift = 0;
+		break;
+
+	case PDB_LAYOUT_BLOCKED:
+		if (shift >= 32 || pdb->aux.n_perm % (1u << shift) != 0) {
+			errno = EINVAL;
+			return (-1);
+		}
+
+		break;
+
+	default:
+		errno = EINVAL;
+		return (-1);
+	}
+
+	pdb_warm_stop(pdb);
+
+	cfg.dst = *pdb;
+	cfg.dst.mapped = 0;
+	cfg.dst.map_offset = 0;
+	cfg.dst.layout = layout;
+	cfg.dst.block_shift = shift;
+	cfg.dst.block_stride = layout == PDB_LAYOUT_BLOCKED ? eqclass_total(&pdb->aux) : 0;
+	cfg.dst.data = malloc(size);
+	if (cfg.dst.data == NULL)
+		return (-1);
+
+	cfg.pcfg.pdb = pdb;
+	cfg.pcfg.worker = relayout_worker;
+	pdb_iterate_parallel(&cfg.pcfg);
+
+	if (pdb->mapped)
+		munmap((void *)(pdb->data - pdb->map_offset), size + pdb->map_offset);
+	else
+		free(pdb->data);
+
+	*pdb = cfg.dst;
+
+	return (0);
+}
@@ -25,14 +25,29 @@
 
 /* pdbverify.c -- validate a pattern database */
 
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "puzzle.h"
 #include "tileset.h"
 #include "index.h"
 #include "pdb.h"
 #include "parallel.h"
+#include "random.h"
+
+enum {
+	/* number of progress reports printed during verification */
+	VERIFY_REPORTS = 16,
+
+	/* number of samples checked between progress updates */
+	VERIFY_SAMPLE_BATCH = 4096,
+};
 
 /*
  * Verify if p's entry pdist in a zero-aware pattern database pdb is
@@ -120,14 +135,63 @@ verify_entry(struct patterndb *pdb, struct index *idx, FILE *f)
 
 /*
  * Just as with genpdb, this structure controls one verification thread.
- * Each thread verifies the PDB in chunks of PDB_CHUNK_SIZE.
+ * Each thread verifies the PDB one cohort at a time.  Verification
+ * stops as soon as result is set.  done counts the entries verified so
+ * far out of total and is used for progress reports.
  */
 struct verify_config {
 	struct parallel_config pcfg;
 	_Atomic int result;
+	atomic_size_t done;
+	size_t total;
+	struct timespec start;
 	FILE *f;
 };
 
+/*
+ * Return the number of seconds elapsed since start.
+ */
+static double
+seconds_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9);
+}
+
+/*
+ * Record that count more entries have been verified.  Print a progress
+ * report to cfg->f whenever another 1/VERIFY_REPORTS of the work has
+ * been done.
+ */
+static void
+verify_progress(struct verify_config *cfg, size_t count)
+{
+	size_t done, step = cfg->total / VERIFY_REPORTS + 1;
+	double seconds;
+
+	done = atomic_fetch_add_explicit(&cfg->done, count, memory_order_relaxed) + count;
+	if (cfg->f == NULL || done / step == (done - count) / step)
+		return;
+
+	seconds = seconds_since(&cfg->start);
+	fprintf(cfg->f, "Verified %zu of %zu entries (%5.1f%%) in %.2fs, %.0f entries/s\n",
+	    done, cfg->total, (100.0 * done) / cfg->total, seconds, done / seconds);
+}
+
+/*
+ * Record that the PDB was found to be inconsistent and make the other
+ * threads stop as soon as possible.
+ */
+static void
+verify_fail(struct verify_config *cfg)
+{
+	cfg->result = 1;
+	atomic_store(&cfg->pcfg.nextrank, cfg->pcfg.pdb->aux.n_maprank);
+}
+
 /*
  * Verify one cohort of the PDB.  Set cfg->result to 1 if the PDB was
  * found to be inconsistent.
@@ -139,38 +203,253 @@ verify_cohort(void *cfgarg, struct index *idx)
 	struct patterndb *pdb = cfg->pcfg.pdb;
 	size_t i, j, n_eqclass = eqclass_count(&pdb->aux, idx->maprank),
 	    n_perm = pdb->aux.n_perm;
-	int result = 0;
 
 	for (i = 0; i < n_eqclass; i++) {
+		/* some other thread found a problem? */
+		if (cfg->result)
+			return;
+
 		idx->eqidx = i;
 		for (j = 0; j < n_perm; j++) {
 			idx->pidx = j;
-			result |= verify_entry(pdb, idx, cfg->f);
+			if (verify_entry(pdb, idx, cfg->f)) {
+				verify_fail(cfg);
+				return;
+			}
 		}
 	}
 
-	cfg->result |= result;
+	verify_progress(cfg, n_eqclass * n_perm);
+}
+
+/*
+ * Prepare cfg for the verification of total entries in pdb.
+ */
+static void
+verify_init(struct verify_config *cfg, struct patterndb *pdb, size_t total, FILE *f)
+{
+	cfg->pcfg.pdb = pdb;
+	cfg->pcfg.worker = verify_cohort;
+	cfg->result = 0;
+	atomic_init(&cfg->done, 0);
+	cfg->total = total;
+	cfg->f = f;
+	clock_gettime(CLOCK_MONOTONIC, &cfg->start);
+}
+
+/*
+ * Print a summary of the verification described by cfg to cfg->f.
+ */
+static void
+verify_summary(struct verify_config *cfg)
+{
+	double seconds;
+
+	if (cfg->f == NULL)
+		return;
+
+	seconds = seconds_since(&cfg->start);
+	fprintf(cfg->f, "%s after verifying %zu entries in %.2fs, %.0f entries/s\n",
+	    cfg->result ? "Inconsistency found" : "No inconsistencies found",
+	    (size_t)cfg->done, seconds, cfg->done / seconds);
 }
 
 /*
  * Verify the pattern database pdb by checking if each entry is
- * consistent with the others.  If f is not NULL, inconsistencies are
- * printed to f.  For further details on the verification process, read
- * the comment above the function verify_position().  This function
- * returns zero if the pattern database was found to be consistent,
- * nonzero otherwise.
+ * consistent with the others.  If f is not NULL, inconsistencies and
+ * progress reports are printed to f.  Verification stops at the first
+ * inconsistency found.  For further details on the verification
+ * process, read the comment above the function verify_entry().  This
+ * function returns zero if the pattern database was found to be
+ * consistent, nonzero otherwise.  PDBs not in the linear layout cannot
+ * be verified; for them, errno is set to EINVAL and -1 is returned.
  */
 extern int
 pdb_verify(struct patterndb *pdb, FILE *f)
 {
 	struct verify_config cfg;
 
-	cfg.pcfg.pdb = pdb;
-	cfg.pcfg.worker = verify_cohort;
-	cfg.result = 0;
-	cfg.f = f;
+	if (pdb->layout != PDB_LAYOUT_LINEAR) {
+		errno = EINVAL;
+		return (-1);
+	}
 
+	verify_init(&cfg, pdb, search_space_size(&pdb->aux), f);
 	pdb_iterate_parallel(&cfg.pcfg);
+	verify_summary(&cfg);
+
+	return (cfg.result);
+}
+
+/*
+ * One thread checking random samples.  Each thread uses its own
+ * random number stream.  The stream numbers are offset by a salt
+ * taken from the clock, so each verification checks different
+ * entries.
+ */
+struct sample_task {
+	struct verify_config *cfg;
+	size_t n_samples;
+	unsigned stream;
+};
+
+static void *
+sample_worker(void *taskarg)
+{
+	struct sample_task *task = taskarg;
+	struct verify_config *cfg = task->cfg;
+	struct patterndb *pdb = cfg->pcfg.pdb;
+	struct random_state saved;
+	struct index idx;
+	size_t i;
+
+	/* we might run on the caller's thread, don't disturb its generator */
+	random_save(&saved);
+	random_stream(task->stream);
+
+	for (i = 0; i < task->n_samples; i++) {
+		if (i % VERIFY_SAMPLE_BATCH == 0) {
+			if (cfg->result)
+				break;
+
+			if (i > 0)
+				verify_progress(cfg, VERIFY_SAMPLE_BATCH);
+		}
+
+		random_index(&pdb->aux, &idx);
+		if (verify_entry(pdb, &idx, cfg->f)) {
+			verify_fail(cfg);
+			goto end;
+		}
+	}
+
+	if (i > 0)
+		verify_progress(cfg, (i - 1) % VERIFY_SAMPLE_BATCH + 1);
+
+end:	random_restore(&saved);
+
+	return (NULL);
+}
+
+/*
+ * Check the consistency of n_samples random entries of pdb using
+ * pdb_jobs threads.  Return zero if all entries checked are consistent,
+ * nonzero otherwise.
+ */
+static int
+verify_samples(struct patterndb *pdb, size_t n_samples, FILE *f)
+{
+	struct verify_config cfg;
+	struct sample_task tasks[PDB_MAX_JOBS];
+	struct timespec now;
+	pthread_t pool[PDB_MAX_JOBS];
+	unsigned salt = 0;
+	int i, jobs = pdb_jobs, error;
+
+	verify_init(&cfg, pdb, n_samples, f);
+
+	if (clock_gettime(CLOCK_REALTIME, &now) == 0)
+		salt = now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+	for (i = 0; i < jobs; i++) {
+		tasks[i].cfg = &cfg;
+		tasks[i].n_samples = n_samples / jobs + (i < n_samples % jobs);
+		tasks[i].stream = salt + i;
+	}
+
+	/* for easier debugging, don't multithread when jobs == 1 */
+	if (jobs == 1)
+		sample_worker(tasks);
+	else for (i = 0; i < jobs; i++) {
+		error = pthread_create(pool + i, NULL, sample_worker, tasks + i);
+		if (error == 0)
+			continue;
+
+		errno = error;
+		perror("pthread_create");
+
+		/* check the remaining samples ourselves */
+		for (jobs = i; i < pdb_jobs; i++)
+			sample_worker(tasks + i);
+
+		break;
+	}
+
+	for (i = 0; i < jobs && pdb_jobs > 1; i++) {
+		error = pthread_join(pool[i], NULL);
+		if (error == 0)
+			continue;
+
+		errno = error;
+		perror("pthread_join");
+		abort();
+	}
+
+	verify_summary(&cfg);
 
 	return (cfg.result);
 }
+
+/*
+ * Verify pdb to the given level, one of the PDB_VERIFY_* constants.
+ * Each level includes the checks of the levels below it:
+ *
+ * PDB_VERIFY_HEADER checks that hdr belongs to pdb and that the block
+ * checksums recorded in it match.  If hdr is NULL, i.e. the PDB was
+ * read from a file without a header, there is nothing to check.
+ *
+ * PDB_VERIFY_SAMPLE checks the consistency of n_samples random entries
+ * as described above verify_entry().
+ *
+ * PDB_VERIFY_FULL checks the consistency of all entries.
+ *
+ * Checking stops at the first problem found.  If f is not NULL,
+ * problems and progress reports are printed to f.  Return zero if no
+ * problems were found, nonzero otherwise.  Like pdb_verify(), this
+ * fails with EINVAL unless pdb is in the linear layout.
+ */
+extern int
+pdb_verify_level(struct patterndb *pdb, const struct pdb_header *hdr,
+    int level, size_t n_samples, FILE *f)
+{
+	size_t n_bad;
+
+	if (pdb->layout != PDB_LAYOUT_LINEAR) {
+		if (f != NULL)
+			fprintf(f, "PDB is not in the linear layout, cannot verify\n");
+
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if (level >= PDB_VERIFY_HEADER && hdr != NULL) {
+		if (pdb_header_check(hdr, &pdb->aux) != 0) {
+			if (f != NULL)
+				fprintf(f, "PDB header does not match the PDB\n");
+
+			return (1);
+		}
+
+		if (pdb_check_checksums(&n_bad, pdb, hdr, f) != 0) {
+			if (f != NULL)
+				fprintf(f, "Cannot check checksums: %s\n", strerror(errno));
+
+			return (1);
+		}
+
+		if (n_bad != 0) {
+			if (f != NULL)
+				fprintf(f, "%zu of %zu blocks damaged\n",
+				    n_bad, (size_t)hdr->n_blocks);
+
+			return (1);
+		}
+	}
+
+	if (level >= PDB_VERIFY_FULL)
+		return (pdb_verify(pdb, f));
+	else if (level == PDB_VERIFY_SAMPLE)
+		return (verify_samples(pdb, n_samples, f));
+	else
+		return (0);
+}
@@ -0,0 +1,300 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* pdbwarm.c -- bring PDBs into memory ahead of time */
+
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "pdb.h"
+
+enum {
+	/* number of bytes touched at once by each thread */
+	WARM_CHUNK_SIZE = 1 << 22,
+
+	/* number of progress reports printed */
+	WARM_REPORTS = 8,
+};
+
+/*
+ * State shared between the threads touching a PDB.  Chunks of
+ * WARM_CHUNK_SIZE bytes are handed out through nextchunk.
+ */
+struct warm_task {
+	const volatile unsigned char *data;
+	size_t size, pagesize;
+	atomic_size_t nextchunk, done;
+	struct timespec start;
+	FILE *f;
+	const atomic_int *stop;
+};
+
+/*
+ * Touch all pages in the chunks handed out by task.  Stop early once
+ * *task->stop becomes nonzero.
+ */
+static void *
+touch_worker(void *taskarg)
+{
+	struct warm_task *task = taskarg;
+	size_t chunk, i, begin, end, done, step = task->size / WARM_REPORTS + 1;
+	struct timespec now;
+	double seconds;
+	unsigned char sink = 0;
+
+	for (;;) {
+		if (task->stop != NULL && atomic_load(task->stop))
+			break;
+
+		chunk = atomic_fetch_add(&task->nextchunk, 1);
+		if (chunk * WARM_CHUNK_SIZE >= task->size)
+			break;
+
+		begin = chunk * WARM_CHUNK_SIZE;
+		end = begin + WARM_CHUNK_SIZE;
+		if (end > task->size)
+			end = task->size;
+
+		for (i = begin; i < end; i += task->pagesize)
+			sink += task->data[i];
+
+		done = atomic_fetch_add(&task->done, end - begin) + (end - begin);
+		if (task->f == NULL || done / step == (done - (end - begin)) / step)
+			continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		seconds = (now.tv_sec - task->start.tv_sec) + (now.tv_nsec - task->start.tv_nsec) * 1e-9;
+		fprintf(task->f, "Warmed up %zu of %zu MiB (%3.0f%%) in %.2fs, %.1f MiB/s\n",
+		    done >> 20, task->size >> 20, (100.0 * done) / task->size, seconds,
+		    done / seconds / (1 << 20));
+	}
+
+	(void)sink;
+
+	return (NULL);
+}
+
+/*
+ * Touch every page of the size bytes at data using up to jobs threads.
+ * If fewer threads can be spawned, the calling thread does the work.
+ * If stop is not NULL, give up once *stop becomes nonzero.
+ */
+static void
+touch_pages(const unsigned char *data, size_t size, int jobs, FILE *f,
+    const atomic_int *stop)
+{
+	struct warm_task task;
+	pthread_t pool[PDB_MAX_JOBS];
+	int i, error;
+
+	task.data = data;
+	task.size = size;
+	task.pagesize = sysconf(_SC_PAGESIZE);
+	atomic_init(&task.nextchunk, 0);
+	atomic_init(&task.done, 0);
+	task.f = f;
+	task.stop = stop;
+	clock_gettime(CLOCK_MONOTONIC, &task.start);
+
+	for (i = 1; i < jobs; i++) {
+		error = pthread_create(pool + i, NULL, touch_worker, &task);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_create");
+			break;
+		}
+	}
+
+	jobs = i;
+	touch_worker(&task);
+
+	for (i = 1; i < jobs; i++) {
+		error = pthread_join(pool[i], NULL);
+		if (error != 0) {
+			errno = error;
+			perror("pthread_join");
+			abort();
+		}
+	}
+}
+
+/*
+ * A warmup running in the background.  base and size describe the
+ * whole mapping of the PDB.  The thread gives up once stop is set.
+ */
+struct pdb_warm {
+	pthread_t thread;
+	unsigned char *base;
+	size_t size;
+	int flags;
+	FILE *f;
+	atomic_int stop;
+};
+
+static void *
+warm_background_worker(void *arg)
+{
+	struct pdb_warm *wb = arg;
+
+	if (wb->flags & PDB_WARM_TOUCH)
+		touch_pages(wb->base, wb->size, pdb_jobs, wb->f, &wb->stop);
+
+	if (atomic_load(&wb->stop))
+		return (NULL);
+
+	if (wb->flags & PDB_WARM_ADVISE && wb->flags & PDB_WARM_TOUCH)
+		posix_madvise(wb->base, wb->size, POSIX_MADV_RANDOM);
+
+	if (wb->flags & PDB_WARM_LOCK && mlock(wb->base, wb->size) != 0 && wb->f != NULL)
+		perror("mlock");
+
+	if (wb->f != NULL)
+		fprintf(wb->f, "Warmed up %zu MiB of PDB in the background\n", wb->size >> 20);
+
+	return (NULL);
+}
+
+/*
+ * Stop the background warmup of pdb if there is one and wait for its
+ * threads to finish.  This must happen before the memory of pdb is
+ * released and is done by pdb_free() and pdb_relayout().
+ */
+extern void
+pdb_warm_stop(struct patterndb *pdb)
+{
+	int error;
+
+	if (pdb->warm == NULL)
+		return;
+
+	atomic_store(&pdb->warm->stop, 1);
+	error = pthread_join(pdb->warm->thread, NULL);
+	if (error != 0) {
+		errno = error;
+		perror("pthread_join");
+		abort();
+	}
+
+	free(pdb->warm);
+	pdb->warm = NULL;
+}
+
+/*
+ * Bring pdb into memory so the first lookups do not have to wait for
+ * the disk.  flags is a combination of the following:
+ *
+ * PDB_WARM_ADVISE tells the kernel that pdb is accessed randomly and
+ * will be needed soon, causing it to read pdb asynchronously.  If pdb
+ * is touched, too, sequential access is advised until touching is done
+ * so the kernel reads ahead while we scan through pdb.
+ *
+ * PDB_WARM_TOUCH reads every page of pdb using pdb_jobs threads,
+ * printing progress reports to f unless f is NULL.
+ *
+ * PDB_WARM_LOCK locks pdb into memory so it is never paged out.  This
+ * may fail due to resource limits.
+ *
+ * PDB_WARM_BACKGROUND performs touching and locking in a background
+ * thread so searches can begin right away.  The thread is remembered
+ * in pdb and stopped by pdb_warm_stop() when pdb is freed.
+ *
+ * The whole table is touched and locked regardless of its layout, so
+ * this works for blocked PDBs, too.  Advice only applies to mapped
+ * PDBs.  Return 0 on success, -1 with errno set if any of the steps
+ * failed.  Failure is not fatal, pdb can still be used.
+ */
+extern int
+pdb_warmup(struct patterndb *pdb, int flags, FILE *f)
+{
+	struct pdb_warm *wb;
+	size_t size = search_space_size(&pdb->aux) + pdb->map_offset;
+	int error, result = 0;
+	unsigned char *base = (unsigned char *)pdb->data - pdb->map_offset;
+
+	if (!pdb->mapped)
+		flags &= ~PDB_WARM_ADVISE;
+
+	if (flags & PDB_WARM_ADVISE) {
+		error = posix_madvise(base, size, flags & PDB_WARM_TOUCH ?
+		    POSIX_MADV_SEQUENTIAL : POSIX_MADV_RANDOM);
+		if (error == 0)
+			error = posix_madvise(base, size, POSIX_MADV_WILLNEED);
+
+		if (error != 0) {
+			errno = error;
+			result = -1;
+		}
+	}
+
+	if (flags & PDB_WARM_BACKGROUND && flags & (PDB_WARM_TOUCH | PDB_WARM_LOCK)) {
+		pdb_warm_stop(pdb);
+
+		wb = malloc(sizeof *wb);
+		if (wb == NULL)
+			return (-1);
+
+		wb->base = base;
+		wb->size = size;
+		wb->flags = flags;
+		wb->f = f;
+		atomic_init(&wb->stop, 0);
+
+		error = pthread_create(&wb->thread, NULL, warm_background_worker, wb);
+		if (error != 0) {
+			free(wb);
+			errno = error;
+			return (-1);
+		}
+
+		pdb->warm = wb;
+
+		return (result);
+	}
+
+	if (flags & PDB_WARM_TOUCH) {
+		touch_pages(base, size, pdb_jobs, f, NULL);
+
+		if (flags & PDB_WARM_ADVISE) {
+			error = posix_madvise(base, size, POSIX_MADV_RANDOM);
+			if (error != 0) {
+				errno = error;
+				result = -1;
+			}
+		}
+	}
+
+	if (flags & PDB_WARM_LOCK && mlock(base, size) != 0)
+		result = -1;
+
+	return (result);
+}
@@ -0,0 +1,227 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* perfcount.c -- hardware performance counters */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+#endif
+
+#include "perfcount.h"
+
+int perf_enabled = 0;
+
+/* set once we have complained about missing counters */
+static atomic_flag warned = ATOMIC_FLAG_INIT;
+
+/*
+ * Complain about performance counters being unavailable, reporting
+ * errno.  Only do so the first time this function is called.
+ */
+static void
+warn_unavailable(void)
+{
+	int error = errno;
+
+	if (atomic_flag_test_and_set(&warned))
+		return;
+
+	fprintf(stderr, "Performance counters unavailable: %s\n", strerror(error));
+}
+
+#ifdef __linux__
+/* type and config of each event, see perf_event_open(2) */
+static const struct {
+	unsigned type;
+	unsigned long long config;
+} events[PERF_COUNTER_COUNT] = {
+	[PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[PERF_LLC_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	[PERF_DTLB_MISSES] = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+	    | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+	[PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+/*
+ * Open a counter for event i on the calling thread and the threads it
+ * creates.  The counter is initially disabled.  Return a file
+ * descriptor or -1 on failure with errno set.
+ */
+static int
+open_counter(int i)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof attr);
+	attr.size = sizeof attr;
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+/*
+ * Start counting events with pc.  If perf_enabled is not set or no
+ * counters are available, do nothing.
+ */
+extern void
+perf_begin(struct perf_counters *pc)
+{
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++) {
+		pc->fds[i] = -1;
+		pc->values[i] = 0;
+	}
+
+	pc->available = 0;
+
+	if (!perf_enabled)
+		return;
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++) {
+		pc->fds[i] = open_counter(i);
+		if (pc->fds[i] == -1)
+			warn_unavailable();
+		else
+			pc->available |= 1U << i;
+	}
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++)
+		if (pc->fds[i] != -1)
+			ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/*
+ * Stop counting events with pc and store the counts in pc->values.
+ * If the kernel had to multiplex the counters, the counts are scaled
+ * to estimate the full count.
+ */
+extern void
+perf_end(struct perf_counters *pc)
+{
+	unsigned long long buf[3]; /* value, time enabled, time running */
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++)
+		if (pc->fds[i] != -1)
+			ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++) {
+		if (pc->fds[i] == -1)
+			continue;
+
+		/* a counter that never got scheduled is as good as none */
+		if (read(pc->fds[i], buf, sizeof buf) != sizeof buf || buf[2] == 0)
+			pc->available &= ~(1U << i);
+		else if (buf[2] < buf[1])
+			pc->values[i] = (double)buf[0] * buf[1] / buf[2];
+		else
+			pc->values[i] = buf[0];
+
+		close(pc->fds[i]);
+		pc->fds[i] = -1;
+	}
+}
+#else /* !defined(__linux__) */
+/*
+ * perf_event_open() is specific to Linux.  On other systems, no
+ * counters are available.
+ */
+extern void
+perf_begin(struct perf_counters *pc)
+{
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_COUNT; i++) {
+		pc->fds[i] = -1;
+		pc->values[i] = 0;
+	}
+
+	pc->available = 0;
+
+	if (perf_enabled) {
+		errno = ENOSYS;
+		warn_unavailable();
+	}
+}
+
+extern void
+perf_end(struct perf_counters *pc)
+{
+	(void)pc;
+}
+#endif /* __linux__ */
+
+/*
+ * Print the counts in pc to f in a single line, normalised to n units
+ * of work called unit (e.g. "node").  Counters that are not available
+ * are printed as n/a.  If no counters are available, print nothing.
+ */
+extern void
+perf_report(FILE *f, const struct perf_counters *pc, const char *unit, double n)
+{
+	static const char *names[PERF_COUNTER_COUNT] = {
+		[PERF_LLC_MISSES] = "LLC misses",
+		[PERF_DTLB_MISSES] = "dTLB misses",
+		[PERF_BRANCH_MISSES] = "branch misses",
+	};
+
+	int i;
+
+	if (pc->available == 0)
+		return;
+
+	if (pc->available & 1U << PERF_CYCLES && pc->available & 1U << PERF_INSTRUCTIONS
+	    && pc->values[PERF_CYCLES] != 0)
+		fprintf(f, "IPC %.2f", (double)pc->values[PERF_INSTRUCTIONS] / pc->values[PERF_CYCLES]);
+	else
+		fprintf(f, "IPC n/a");
+
+	for (i = PERF_LLC_MISSES; i < PERF_COUNTER_COUNT; i++)
+		if (~pc->available & 1U << i)
+			fprintf(f, ", %s n/a", names[i]);
+		else if (n > 0)
+			fprintf(f, ", %.3f %s/%s", pc->values[i] / n, names[i], unit);
+		else
+			fprintf(f, ", %llu %s", pc->values[i], names[i]);
+
+	fputc('\n', f);
+}
@@ -0,0 +1,74 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* perfcount.h -- hardware performance counters */
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdio.h>
+
+/*
+ * The hardware events we measure.  PERF_LLC_MISSES counts last level
+ * cache misses, PERF_DTLB_MISSES data TLB misses on loads.
+ */
+enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_LLC_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_COUNTER_COUNT,
+};
+
+/*
+ * A set of hardware performance counters.  Counting starts with
+ * perf_begin() and ends with perf_end(), which places the counts in
+ * values.  The counters also count any threads created by the calling
+ * thread in between, so they can be wrapped around calls to
+ * pdb_iterate_parallel().  Bit i of available is set if counter i
+ * could be used.  It is clear if the kernel does not support
+ * perf_event_open(), the CPU does not have such a counter, or we lack
+ * the permission to use it.  In this case, values[i] is 0.
+ */
+struct perf_counters {
+	int fds[PERF_COUNTER_COUNT];
+	unsigned long long values[PERF_COUNTER_COUNT];
+	unsigned available;
+};
+
+/*
+ * If perf_enabled is set, pdb_generate() and search_ida_bounded()
+ * measure each round with performance counters and report the results
+ * along with their other status information.  This is a global
+ * variable like pdb_jobs.  It is 0 initially.
+ */
+extern int perf_enabled;
+
+extern void	perf_begin(struct perf_counters *);
+extern void	perf_end(struct perf_counters *);
+extern void	perf_report(FILE *, const struct perf_counters *, const char *, double);
+
+#endif /* PERFCOUNT_H */
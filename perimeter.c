@@ -0,0 +1,157 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* perimeter.c -- tables of all configurations close to the goal */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "compact.h"
+#include "perimeter.h"
+#include "puzzle.h"
+
+/*
+ * Return the parity of the distance of p to the solved configuration.
+ * As every move moves the zero tile to a square of the other colour on
+ * a checkerboard, this is just the colour of the zero tile's square.
+ */
+static int
+distance_parity(const struct puzzle *p)
+{
+	size_t zloc = zero_location(p);
+
+	return ((zloc / 5 + zloc % 5) & 1);
+}
+
+/*
+ * Generate a perimeter of the given depth by breadth-first search from
+ * the solved configuration.  If f is not NULL, print the number of
+ * configurations found in each round to f.  On success, return the
+ * perimeter.  On failure, return NULL and set errno.
+ */
+extern struct perimeter *
+perimeter_generate(int depth, FILE *f)
+{
+	struct perimeter *per;
+	struct cp_slice old_cps, new_cps;
+	struct compact_puzzle cp;
+	size_t j;
+	int i, error;
+
+	if (depth < 0 || depth > PERIMETER_MAX_DEPTH) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	per = malloc(sizeof *per);
+	if (per == NULL)
+		return (NULL);
+
+	per->depth = depth;
+	cps_init(&per->cps);
+
+	cps_init(&new_cps);
+	pack_puzzle(&cp, &solved_puzzle);
+	cps_append(&new_cps, &cp);
+
+	for (i = 0;; i++) {
+		if (f != NULL)
+			fprintf(f, "%3d: %20zu\n", i, new_cps.len);
+
+		/* add round i to the perimeter, remembering i / 2 in the move mask */
+		for (j = 0; j < new_cps.len; j++) {
+			cp = new_cps.data[j];
+			clear_move_mask(&cp);
+			cp.lo |= i / 2;
+			cps_append(&per->cps, &cp);
+		}
+
+		if (i == depth)
+			break;
+
+		old_cps = new_cps;
+		cps_init(&new_cps);
+		error = cps_round(&new_cps, &old_cps);
+		cps_free(&old_cps);
+		if (error != 0)
+			goto fail;
+	}
+
+	cps_free(&new_cps);
+
+	/* the rounds are disjoint, so no configuration appears twice */
+	qsort(per->cps.data, per->cps.len, sizeof *per->cps.data, compare_cp_nomask);
+
+	return (per);
+
+fail:	error = errno;
+	cps_free(&new_cps);
+	cps_free(&per->cps);
+	free(per);
+	errno = error;
+
+	return (NULL);
+}
+
+/*
+ * Release the storage associated with per.
+ */
+extern void
+perimeter_free(struct perimeter *per)
+{
+
+	cps_free(&per->cps);
+	free(per);
+}
+
+/*
+ * Look up p in per.  If p is in the perimeter, return its distance to
+ * the solved configuration.  Otherwise, return PERIMETER_OUTSIDE.
+ */
+extern int
+perimeter_lookup(const struct perimeter *per, const struct puzzle *p)
+{
+	struct compact_puzzle cp;
+	const struct compact_puzzle *data = per->cps.data;
+	size_t lo = 0, hi = per->cps.len, mid;
+	int cmp;
+
+	pack_puzzle(&cp, p);
+
+	/* invariant: if cp is in data, it is in data[lo] ... data[hi - 1] */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = compare_cp_nomask(&cp, data + mid);
+		if (cmp == 0)
+			return (2 * move_mask(data + mid) + distance_parity(p));
+		else if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return (PERIMETER_OUTSIDE);
+}
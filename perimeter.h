@@ -0,0 +1,67 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* perimeter.h -- tables of all configurations close to the goal */
+
+#ifndef PERIMETER_H
+#define PERIMETER_H
+
+#include <stdio.h>
+
+#include "compact.h"
+#include "puzzle.h"
+
+/*
+ * A perimeter holds all configurations within depth moves of the
+ * solved configuration together with their exact distance.  Perimeter
+ * search uses it to stop IDA* as soon as it reaches the perimeter
+ * instead of searching the last depth plies of each iteration over and
+ * over again.  Configurations not found in the perimeter are known to
+ * be at least depth + 1 moves away from the goal.
+ *
+ * The configurations are stored in cps sorted by compare_cp_nomask().
+ * As the move masks are not needed for lookups, we use the move mask
+ * bits to store half the distance of each configuration.  The parity
+ * of the distance is given by the location of the zero tile, so this
+ * is sufficient to reconstruct the distance.  This limits the depth of
+ * the perimeter to PERIMETER_MAX_DEPTH.
+ */
+struct perimeter {
+	struct cp_slice cps;
+	int depth;
+};
+
+enum {
+	PERIMETER_MAX_DEPTH = 2 * MOVE_MASK + 1,
+
+	/* returned by perimeter_lookup() for configurations not in the perimeter */
+	PERIMETER_OUTSIDE = -1,
+};
+
+extern struct perimeter	*perimeter_generate(int, FILE *);
+extern void	perimeter_free(struct perimeter *);
+extern int	perimeter_lookup(const struct perimeter *, const struct puzzle *);
+
+#endif /* PERIMETER_H */
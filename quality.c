@@ -25,13 +25,17 @@
 
 /* pdbquality.c -- determine PDB quality */
 
+#include <errno.h>
+#include <math.h>
 #include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "puzzle.h"
 #include "tileset.h"
 #include "index.h"
+#include "parallel.h"
 #include "pdb.h"
 #include "statistics.h"
 
@@ -52,68 +56,193 @@ region_bias(tileset ts)
 }
 
 /*
- * Compute eta for a complete pattern database.  Works for both APDBs
- * and ZPDBs.
+ * State shared by the workers of pdb_statistics().  The contributions
+ * of each map rank to eta and the h average are stored separately and
+ * summed up in order afterwards so the result does not depend on the
+ * order in which the threads process the map ranks.
  */
-extern double
-pdb_eta(struct patterndb *pdb)
+struct stats_config {
+	struct parallel_config pcfg;
+	atomic_ullong histogram[PDB_HISTOGRAM_LEN];
+	double *map_eta, *map_hsum;
+};
+
+/*
+ * Compute a histogram of the n entries in table and store it in
+ * histogram.  Return one more than the largest entry; histogram
+ * entries past that are left untouched.  counts is scratch space that
+ * must be zero on entry and is zero again on return.  Counting into
+ * four interleaved histograms avoids stalls when the same entry occurs
+ * several times in a row, which is the common case in a PDB.  The
+ * largest entry is found first in a loop the compiler can vectorise so
+ * only the used part of the histograms has to be visited afterwards.
+ */
+static size_t
+table_histogram(unsigned long long histogram[PDB_HISTOGRAM_LEN],
+    unsigned counts[4][PDB_HISTOGRAM_LEN], const unsigned char *table, size_t n)
 {
-	const struct index_aux *aux = &pdb->aux;
-	double eta = 0.0;
-	struct index idx;
+	size_t i, len;
+	unsigned char max = 0;
 
-	idx.pidx = 0;
+	for (i = 0; i < n; i++)
+		max = table[i] > max ? table[i] : max;
 
-	for (idx.maprank = 0; idx.maprank < aux->n_maprank; idx.maprank++)
-		for (idx.eqidx = 0; idx.eqidx < eqclass_count(aux, idx.maprank); idx.eqidx++) {
-			size_t i, histogram[PDB_HISTOGRAM_LEN];
-			double map_eta = 0.0;
-			const unsigned char *table;
+	for (i = 0; i + 4 <= n; i += 4) {
+		counts[0][table[i + 0]]++;
+		counts[1][table[i + 1]]++;
+		counts[2][table[i + 2]]++;
+		counts[3][table[i + 3]]++;
+	}
 
-			memset(histogram, 0, sizeof histogram);
-			table = (const unsigned char *)pdb_entry_pointer(pdb, &idx);
+	for (; i < n; i++)
+		counts[0][table[i]]++;
 
-			for (i = 0; i < aux->n_perm; i++)
-				histogram[table[i]]++;
+	len = (size_t)max + 1;
+	for (i = 0; i < len; i++) {
+		histogram[i] = counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+		counts[0][i] = counts[1][i] = counts[2][i] = counts[3][i] = 0;
+	}
 
-			for (i = 0; i < PDB_HISTOGRAM_LEN; i++)
-				map_eta = histogram[PDB_HISTOGRAM_LEN - i - 1] + map_eta / B;
+	return (len);
+}
 
-			eta += map_eta * region_bias(eqclass_from_index(aux, &idx));
+/*
+ * Gather statistics for all equivalence classes of the map rank in idx.
+ */
+static void
+stats_worker(void *cfgarg, struct index *idx)
+{
+	struct stats_config *cfg = cfgarg;
+	struct patterndb *pdb = cfg->pcfg.pdb;
+	const struct index_aux *aux = &pdb->aux;
+	size_t i, len, total_len = 0, n_eqclass = eqclass_count(aux, idx->maprank);
+	unsigned long long histogram[PDB_HISTOGRAM_LEN], total[PDB_HISTOGRAM_LEN];
+	unsigned counts[4][PDB_HISTOGRAM_LEN];
+	double eta = 0.0, hsum = 0.0, map_eta, bias;
+	long long unsigned map_hsum;
+
+	memset(total, 0, sizeof total);
+	memset(counts, 0, sizeof counts);
+
+	for (idx->eqidx = 0; idx->eqidx < n_eqclass; idx->eqidx++) {
+		len = table_histogram(histogram, counts,
+		    (const unsigned char *)pdb_entry_pointer(pdb, idx), aux->n_perm);
+
+		map_hsum = 0;
+		for (i = 0; i < len; i++) {
+			map_hsum += histogram[i] * i;
+			total[i] += histogram[i];
 		}
 
-	eta /= (double)aux->n_perm * (TILE_COUNT - aux->n_tile) * (double)aux->n_maprank;
+		map_eta = 0.0;
+		for (i = len; i > 0; i--)
+			map_eta = histogram[i - 1] + map_eta / B;
+
+		bias = region_bias(eqclass_from_index(aux, idx));
+		eta += map_eta * bias;
+		hsum += map_hsum * bias;
 
-	return (eta);
+		if (len > total_len)
+			total_len = len;
+	}
+
+	cfg->map_eta[idx->maprank] = eta;
+	cfg->map_hsum[idx->maprank] = hsum;
+
+	for (i = 0; i < total_len; i++)
+		if (total[i] != 0)
+			atomic_fetch_add_explicit(cfg->histogram + i, total[i],
+			    memory_order_relaxed);
 }
 
 /*
- * Compute the average h value for a complete pattern database.  Works
- * for both APDBs and ZPDBs.  Very similar to pdb_eta.
+ * Compute the histogram, entropy, eta, and h average of pdb in one pass
+ * using pdb_jobs threads and store them in stats.  Works for both APDBs
+ * and ZPDBs.  Only PDBs in the linear layout are supported; for other
+ * layouts, errno is EINVAL.  Return 0 on success, -1 with errno set on
+ * failure.
  */
-extern double
-pdb_h_average(struct patterndb *pdb)
+extern int
+pdb_statistics(struct pdb_stats *stats, struct patterndb *pdb)
 {
+	struct stats_config cfg;
 	const struct index_aux *aux = &pdb->aux;
-	double hsum = 0.0;
-	struct index idx;
+	size_t i, n = search_space_size(aux);
+	double eta = 0.0, hsum = 0.0, scale, prob;
+
+	if (pdb->layout != PDB_LAYOUT_LINEAR) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	cfg.pcfg.pdb = pdb;
+	cfg.pcfg.worker = stats_worker;
+	for (i = 0; i < PDB_HISTOGRAM_LEN; i++)
+		atomic_init(cfg.histogram + i, 0);
+
+	cfg.map_eta = malloc(aux->n_maprank * sizeof *cfg.map_eta);
+	cfg.map_hsum = malloc(aux->n_maprank * sizeof *cfg.map_hsum);
+	if (cfg.map_eta == NULL || cfg.map_hsum == NULL) {
+		free(cfg.map_eta);
+		free(cfg.map_hsum);
+		return (-1);
+	}
+
+	pdb_iterate_parallel(&cfg.pcfg);
+
+	for (i = 0; i < aux->n_maprank; i++) {
+		eta += cfg.map_eta[i];
+		hsum += cfg.map_hsum[i];
+	}
+
+	free(cfg.map_eta);
+	free(cfg.map_hsum);
+
+	scale = (double)aux->n_perm * (TILE_COUNT - aux->n_tile) * (double)aux->n_maprank;
+	stats->eta = eta / scale;
+	stats->h_average = hsum / scale;
+
+	stats->entropy = 0.0;
+	for (i = 0; i < PDB_HISTOGRAM_LEN; i++) {
+		stats->histogram[i] = atomic_load(cfg.histogram + i);
+		if (stats->histogram[i] == 0)
+			continue;
+
+		prob = stats->histogram[i] / (double)n;
+		stats->entropy -= prob * log2(prob);
+	}
+
+	return (0);
+}
 
-	idx.pidx = 0;
+/*
+ * Compute eta for a complete pattern database.  Works for both APDBs
+ * and ZPDBs.  This is a wrapper around pdb_statistics().  On failure,
+ * return NaN and set errno.
+ */
+extern double
+pdb_eta(struct patterndb *pdb)
+{
+	struct pdb_stats stats;
 
-	for (idx.maprank = 0; idx.maprank < aux->n_maprank; idx.maprank++)
-		for (idx.eqidx = 0; idx.eqidx < eqclass_count(aux, idx.maprank); idx.eqidx++) {
-			long long unsigned map_hsum = 0;
-			size_t i;
-			const unsigned char *table;
+	if (pdb_statistics(&stats, pdb) != 0)
+		return (NAN);
 
-			table = (const unsigned char *)pdb_entry_pointer(pdb, &idx);
-			for (i = 0; i < aux->n_perm; i++)
-				map_hsum += table[i];
+	return (stats.eta);
+}
 
-			hsum += map_hsum * region_bias(eqclass_from_index(aux, &idx));
-		}
+/*
+ * Compute the average h value for a complete pattern database.  Works
+ * for both APDBs and ZPDBs.  This is a wrapper around pdb_statistics().
+ * On failure, return NaN and set errno.
+ */
+extern double
+pdb_h_average(struct patterndb *pdb)
+{
+	struct pdb_stats stats;
 
-	hsum /= (double)aux->n_perm * (TILE_COUNT - aux->n_tile) * (double)aux->n_maprank;
+	if (pdb_statistics(&stats, pdb) != 0)
+		return (NAN);
 
-	return (hsum);
+	return (stats.h_average);
 }
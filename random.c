@@ -1,5 +1,5 @@
 /*-
- * Copyright (c) 2017--2018, 2020 Robert Clausecker. All rights reserved.
+ * Copyright (c) 2017--2018, 2020, 2026 Robert Clausecker. All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
  * modification, are permitted provided that the following conditions
@@ -27,7 +27,9 @@
 #define _POSIX_C_SOURCE 200809L
 #include <string.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
+#include "builtins.h"
 #include "puzzle.h"
 #include "tileset.h"
 #include "index.h"
@@ -35,199 +37,365 @@
 
 /* the default random seed.  Taken from /dev/random. */
 #define DEFAULT_SEED { \
-	0xf8c53aa7, 0x16a4b97b, 0x13ed4568, 0x120e6496, \
-	0x77bb4a8a, 0xeb39eae5, 0x46555774, 0x76d53591, \
-	0x64f9b515, 0xc5185564, 0x76b545d0, 0xd02bebe1, \
-	0xc73982f9, 0x5cc173a7, 0xb7002b87, 0x44d93488, \
-	0xe42e0343, 0x19525a6c, 0x38005946, 0x3a92c714, \
-	0x713da8b0, 0xad0d7988, 0x0788d23a, 0xd756c34c, \
-	0x8d38a159, 0x47c83127, 0x65c0e1b3, 0x141c0dd6, \
-	0xef0fea11, 0x4248804d, 0x19dd12ef, 0xe3c9b5da, \
+	0xf8c53aa716a4b97bULL, 0x13ed4568120e6496ULL, \
+	0x77bb4a8aeb39eae5ULL, 0x4655577476d53591ULL, \
 }
 
-/* the current state of the random number generator */
-static unsigned int seed_v[32] = DEFAULT_SEED;
-static unsigned char seed_i = 0;
-
-/* a mutex guarding the seed */
-pthread_mutex_t seed_lock = PTHREAD_MUTEX_INITIALIZER;
-
 /*
- * Transition the random number generator by one step.  Return the
- * random number gained.  seed must be locked before calling this
- * function.  This function implements a WELL random number generator
- * as given by Wikipedia:
+ * The random number generator is xoshiro256** as described in
+ *
+ *     D. Blackman, S. Vigna: Scrambled Linear Pseudorandom Number
+ *     Generators.  ACM Trans. Math. Softw. 47 (2021).
  *
- * https://de.wikipedia.org/w/index.php?title=Well_Equidistributed_Long-period_Linear&oldid=179828249
+ * Each thread has its own generator state so no locking is needed to
+ * draw random numbers.  Stream 0 uses the base state set by set_seed()
+ * directly.  For the other streams, the base state is hashed together
+ * with the stream number using splitmix64, which takes constant time
+ * for any stream number and gives each stream a distinct state.  The
+ * chance of two such streams overlapping within a program's lifetime
+ * is negligible given the 2^256 - 1 period of the generator.  Threads
+ * are assigned stream numbers in the order they first draw random
+ * numbers (wrapping around after 2^32 threads), unless a number is set
+ * explicitly with random_stream().  Whenever set_seed() is called,
+ * seed_generation is incremented, causing all threads to rederive
+ * their state on their next use of the generator.
  */
-static unsigned int
-random_step(void)
+static unsigned long long base_state[4] = DEFAULT_SEED;
+static atomic_uint seed_generation = 1, next_stream = 0;
+
+/* a mutex guarding base_state */
+static pthread_mutex_t seed_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the generator state of the current thread */
+static _Thread_local struct random_state rng;
+
+static inline unsigned long long
+rotl(unsigned long long x, int k)
 {
-	unsigned int z0, z1, z2, V0, VM1, VM2, VM3, VRm1;
-
-	V0   = seed_v[seed_i];
-	VM1  = seed_v[seed_i +  3 & 31];
-	VM2  = seed_v[seed_i + 24 & 31];
-	VM3  = seed_v[seed_i + 10 & 31];
-	VRm1 = seed_v[seed_i + 31 & 31];
-
-	z0 = VRm1;
-	z1 = V0 ^ VM1 ^ VM1 >>  8; 
-	z2 = (VM2 ^ VM2 << 19 ^ VM3 ^ VM3 << 14) & 0xffffffff;
-	seed_v[seed_i] = z1 ^ z2;
-	seed_v[seed_i + 31 & 31] = (z0 ^ z0 << 11 ^ z1 ^ z1 << 7 ^ z2 ^ z2 << 13) & 0xffffffff;
-	seed_i = seed_i + 31 & 31;
-
-	return (seed_v[seed_i]);
+	return (x << k | x >> (64 - k));
 }
 
 /*
- * Seed the random number generator with newseed.
+ * Advance s by one step of xoshiro256**.  Return the random number
+ * gained.
  */
-extern void
-set_seed(unsigned long long newseed)
+static inline unsigned long long
+xoshiro_next(unsigned long long s[4])
 {
-	static const unsigned int default_seed[32] = DEFAULT_SEED;
-	int err, i;
+	unsigned long long result, t;
 
-	err = pthread_mutex_lock(&seed_lock);
-	assert(err == 0);
+	result = rotl(s[1] * 5, 7) * 9;
+	t = s[1] << 17;
 
-	memcpy(seed_v, default_seed, 32 * sizeof *seed_v);
-	seed_v[0] = newseed >>  0 & 0xffffffff;
-	seed_v[1] = newseed >> 32 & 0xffffffff;
-	seed_i = 0;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
 
-	/* mix the seed bytes into the rest of the state */
-	for (i = 0; i < 1000; i++)
-		random_step();
+	return (result);
+}
 
-	err = pthread_mutex_unlock(&seed_lock);
-	assert(err == 0);
+/*
+ * Mix z using the splitmix64 output function.
+ */
+static inline unsigned long long
+splitmix_mix(unsigned long long z)
+{
+	z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ z >> 27) * 0x94d049bb133111ebULL;
+
+	return (z ^ z >> 31);
 }
 
 /*
- * Compute a random 32 bit number.  This function is MT-safe.
+ * Derive the generator state for the current thread from base_state
+ * and the thread's stream number.
  */
-extern unsigned int
-random32(void)
+static void
+random_init_thread(void)
 {
-	unsigned int r;
+	unsigned long long salt;
+	unsigned i;
 	int err;
 
+	if (!rng.has_stream) {
+		rng.stream = atomic_fetch_add(&next_stream, 1);
+		rng.has_stream = 1;
+	}
+
 	err = pthread_mutex_lock(&seed_lock);
 	assert(err == 0);
 
-	r = random_step();
+	rng.generation = atomic_load(&seed_generation);
+	memcpy(rng.s, base_state, sizeof rng.s);
 
 	err = pthread_mutex_unlock(&seed_lock);
 	assert(err == 0);
 
-	return (r);
+	if (rng.stream == 0)
+		return;
+
+	/* as 4 * stream + i differ, so do the states of different streams */
+	for (i = 0; i < 4; i++) {
+		salt = (4ULL * rng.stream + i) * 0x9e3779b97f4a7c15ULL;
+		rng.s[i] = splitmix_mix(rng.s[i] + salt);
+	}
 }
 
 /*
- * Compute a random 64 bit number.  This function is MT-safe.
+ * Transition the current thread's random number generator by one
+ * step.  Return the random number gained.
  */
-extern unsigned long long
-random64(void)
+static unsigned long long
+random_step(void)
 {
-	unsigned int r1, r2;
-	int err;
+	if (rng.generation != atomic_load_explicit(&seed_generation, memory_order_relaxed))
+		random_init_thread();
+
+	return (xoshiro_next(rng.s));
+}
+
+/*
+ * Seed the random number generator with newseed.  The seed is
+ * expanded into the generator state using splitmix64.  Threads pick
+ * up the new seed the next time they draw random numbers.
+ */
+extern void
+set_seed(unsigned long long newseed)
+{
+	int err, i;
 
 	err = pthread_mutex_lock(&seed_lock);
 	assert(err == 0);
 
-	r1 = random_step();
-	r2 = random_step();
+	for (i = 0; i < 4; i++)
+		base_state[i] = splitmix_mix(newseed += 0x9e3779b97f4a7c15ULL);
+
+	atomic_fetch_add(&seed_generation, 1);
 
 	err = pthread_mutex_unlock(&seed_lock);
 	assert(err == 0);
+}
 
-	return ((unsigned long long)r1 << 32 | r2);
+/*
+ * Set the stream number of the calling thread to stream.  Threads
+ * using the same stream number draw the same random numbers.  For
+ * reproducible results, each worker thread of a multithreaded program
+ * should call this function with its thread number before drawing
+ * random numbers.  Otherwise, stream numbers are assigned in the order
+ * threads first use the generator.
+ */
+extern void
+random_stream(unsigned stream)
+{
+	rng.stream = stream;
+	rng.has_stream = 1;
+	rng.generation = 0;
 }
 
 /*
- * Set p to a random puzzle configuration drawn from random_seed.  Note
- * that since a puzzle configuration has 82.7 bits of entropy but we
- * only extract 64 bits of entry from the RNG, not all puzzle
- * configurations are guaranteed to be generated.
+ * Save the generator state of the calling thread to state.
  */
 extern void
-random_puzzle(struct puzzle *p)
+random_save(struct random_state *state)
 {
-	__uint128_t rnd;
-	unsigned long long rnd1, rnd2;
-	size_t i, j, parity = 0;
-	int ipos, jpos, err;
+	*state = rng;
+}
 
-	/* silence valgrind as we technically read uninitialized values */
-	memset(p, 0, sizeof *p);
+/*
+ * Restore the generator state of the calling thread from state as
+ * saved by random_save().  If set_seed() has been called in between,
+ * the state is rederived from the new seed on the next use.
+ */
+extern void
+random_restore(const struct random_state *state)
+{
+	rng = *state;
+}
 
-	err = pthread_mutex_lock(&seed_lock);
-	assert(err == 0);
+/*
+ * Compute a random 32 bit number.  This function is MT-safe.
+ */
+extern unsigned int
+random32(void)
+{
+	return (random_step() >> 32);
+}
 
-	/*
-	 * Since we consume many of the 128 bits of entropy we get, we
-	 * must be careful to avoid modulo bias.  This is done by
-	 * capping the range of random numbers we admit upwards to get a
-	 * clean multiple of the range we are interested in.
-	 */
-	do {
-		rnd = 0;
-		for (i = 0; i < 4; i++)
-			rnd = rnd << 32 | random_step();
+/*
+ * Compute a random 64 bit number.  This function is MT-safe.
+ */
+extern unsigned long long
+random64(void)
+{
+	return (random_step());
+}
 
-		/* 23 * 24 * 25! */
-	} while (rnd >= (__uint128_t)39742454749 * 23 * 24 *
-		    2432902008176640000ULL * 6375600ULL /* 25! */);
+/*
+ * A reservoir of random bits.  This is used to draw many small random
+ * numbers quickly.  The generator state of the current thread is
+ * copied into the reservoir by entropy_begin() and written back by
+ * entropy_end(), so the compiler can keep it in registers.
+ */
+struct entropy {
+	unsigned long long s[4];
+	unsigned long long bits;
+	int avail;		/* number of bits left in bits */
+};
+
+static inline void
+entropy_begin(struct entropy *e)
+{
+	if (rng.generation != atomic_load_explicit(&seed_generation, memory_order_relaxed))
+		random_init_thread();
 
-	err = pthread_mutex_unlock(&seed_lock);
-	assert(err == 0);
+	memcpy(e->s, rng.s, sizeof e->s);
+	e->avail = 0;
+}
+
+static inline void
+entropy_end(const struct entropy *e)
+{
+	memcpy(rng.s, e->s, sizeof rng.s);
+}
 
-	rnd1 = rnd % 2432902008176640000ULL; /* 1 * 2 * ... * 20 */
-	rnd2 = rnd / 2432902008176640000ULL;
+/*
+ * Draw k random bits from e, where 0 < k <= 32.
+ */
+static inline unsigned
+entropy_bits(struct entropy *e, int k)
+{
+	unsigned r;
 
-	/* consumes log2(1 * 2 * 3 * ... * 20) = 61.0774 bits of entropy */
-	for (i = 0; i < 20; i++) {
-		j = rnd1 % (i + 1);
-		rnd1 /= i + 1;
-		p->tiles[i] = p->tiles[j];
-		p->tiles[j] = i;
-		parity ^= i != j;
+	if (e->avail < k) {
+		e->bits = xoshiro_next(e->s);
+		e->avail = 64;
 	}
 
-	/* consumes log2(21 * ... * 25) = 22.6041 bits of entropy */
-	for (i = 20; i < 25; i++) {
-		j = rnd2 % (i + 1);
-		rnd2 /= i + 1;
-		p->tiles[i] = p->tiles[j];
-		p->tiles[j] = i;
-		parity ^= i != j;
+	r = e->bits & (1ULL << k) - 1;
+	e->bits >>= k;
+	e->avail -= k;
+
+	return (r);
+}
+
+/*
+ * Draw n uniformly distributed random numbers from e such that
+ * 0 <= out[i] < bounds[i].  product is the product of all bounds and
+ * must not exceed 2^64 - 1.  All numbers are extracted from a single
+ * 64 bit random word by repeated multiplication, rejecting words that
+ * would introduce a bias, as described in
+ *
+ *     N. Brackett-Rozinsky, D. Lemire: Batched Ranged Random Integer
+ *     Generation.  Softw. Pract. Exp. 55 (2025).
+ */
+static inline void
+entropy_batch(struct entropy *e, unsigned char out[], const unsigned char bounds[],
+    size_t n, unsigned long long product)
+{
+	__uint128_t m;
+	unsigned long long r;
+	size_t i;
+
+	for (;;) {
+		r = xoshiro_next(e->s);
+		for (i = 0; i < n; i++) {
+			m = (__uint128_t)r * bounds[i];
+			out[i] = m >> 64;
+			r = m;
+		}
+
+		/* the division is only needed in rare cases */
+		if (r >= product || r >= -product % product)
+			return;
 	}
+}
 
+/*
+ * Fill p[0] to p[n-1] with uniformly distributed random solvable
+ * puzzle configurations.  This is faster than calling random_puzzle()
+ * n times as the generator state is kept in registers for the whole
+ * batch.
+ */
+extern void
+random_puzzles(struct puzzle *p, size_t n)
+{
 	/*
-	 * For the puzzle to be solvable, the the parity of the tile
-	 * permutation must agree with the parity of the zero tile's
-	 * square number.  If this parity is violated, we simply swap
-	 * two random tiles to restore it.  If this needs to be done,
-	 * log2(24 * 23) = 9.10852 bits of entropy are consumed.
+	 * The puzzles are generated by decoding a random Lehmer code,
+	 * which needs random numbers below 25, 24, ..., 1.  These are
+	 * split into two batches, the second of which also holds the
+	 * two numbers needed for fixing up the parity.
 	 */
-	if (parity ^ zero_location(p) & 1) {
-		i = 1 + rnd2 % 24;
-		rnd2 /= 24;
-		j = 1 + rnd2 % 23;
-		j += j >= i;
-
-		ipos = p->tiles[i];
-		jpos = p->tiles[j];
+	static const unsigned char bounds_lo[15] = {
+		25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11,
+	}, bounds_hi[12] = {
+		10, 9, 8, 7, 6, 5, 4, 3, 2, 1, TILE_COUNT - 1, TILE_COUNT - 2,
+	};
+
+	struct entropy e;
+	size_t k;
+	unsigned i, j, tile, bit, remaining, parity;
+	unsigned char rnd[TILE_COUNT + 2], tmp;
+
+	entropy_begin(&e);
+
+	for (k = 0; k < n; k++) {
+		entropy_batch(&e, rnd, bounds_lo, 15, 4274473667143680000ULL);
+		entropy_batch(&e, rnd + 15, bounds_hi, 12, 3628800ULL * 24 * 23);
+
+		/* silence valgrind as we technically read uninitialized values */
+		memset(p + k, 0, sizeof p[k]);
+
+		/*
+		 * Place the rnd[i]th of the remaining tiles on square i.
+		 * The tiles remaining are kept in a bit mask so no
+		 * loads from p are needed.  The number of inversions of
+		 * the permutation is the sum of the rnd[i].
+		 */
+		remaining = (1 << TILE_COUNT) - 1;
+		parity = 0;
+		for (i = 0; i < TILE_COUNT; i++) {
+			bit = rankselect(remaining, rnd[i]);
+			remaining ^= bit;
+			tile = ctz(bit);
+			p[k].grid[i] = tile;
+			p[k].tiles[tile] = i;
+			parity ^= rnd[i];
+		}
 
-		p->tiles[i] = jpos;
-		p->tiles[j] = ipos;
+		/*
+		 * For the puzzle to be solvable, the the parity of the
+		 * tile permutation must agree with the parity of the
+		 * zero tile's square number.  If this parity is
+		 * violated, we simply swap two random tiles to restore
+		 * it.
+		 */
+		if ((parity ^ p[k].tiles[ZERO_TILE]) & 1) {
+			i = 1 + rnd[TILE_COUNT];
+			j = 1 + rnd[TILE_COUNT + 1];
+			j += j >= i;
+
+			tmp = p[k].tiles[i];
+			p[k].tiles[i] = p[k].tiles[j];
+			p[k].tiles[j] = tmp;
+			p[k].grid[p[k].tiles[i]] = i;
+			p[k].grid[p[k].tiles[j]] = j;
+		}
 	}
 
-	for (i = 0; i < TILE_COUNT; i++)
-		p->grid[p->tiles[i]] = i;
+	entropy_end(&e);
+}
+
+/*
+ * Set p to a uniformly distributed random solvable puzzle
+ * configuration.
+ */
+extern void
+random_puzzle(struct puzzle *p)
+{
+	random_puzzles(p, 1);
 }
 
 /*
@@ -252,47 +420,31 @@ random_index(const struct index_aux *aux, struct index *idx)
 }
 
 /*
- * Perform an n step random walk from p, using fsm to prune moves.
- * Return 1 if the random walk was successful, 0 otherwise.  A random
- * walk is unsuccessful if the fsm at some point doesn't provide us
- * with a move to progress.
+ * Perform an n step random walk from p, using fsm to prune moves and
+ * drawing random bits from e.  Return 1 if the random walk was
+ * successful, 0 otherwise.
  */
-extern int
-random_walk(struct puzzle *p, int steps, const struct fsm *fsm)
+static int
+walk(struct puzzle *p, int steps, const struct fsm *fsm, struct entropy *e)
 {
 	struct fsm_state st;
-	unsigned int entropy;
-	int err, res = 0, i, n_move, reservoir = 0;
+	int i, n_move;
 	signed char moves[4];
 
-	err = pthread_mutex_lock(&seed_lock);
-	assert(err == 0);
-
-	entropy = random_step();
-	reservoir = 16;
-
 	st = fsm_start_state(zero_location(p));
 
 	while (steps > 0) {
 		n_move = fsm_get_moves_moribund(moves, st, fsm, steps);
 
 		switch (n_move) {
-		case 0:	goto fail; /* cannot proceed */
+		case 0:	return (0); /* cannot proceed */
 
 		case 1: i = 0; /* no choice to make */
 			break;
 
 		default:
-			do {
-				if (reservoir == 0) {
-					entropy = random_step();
-					reservoir = 16;
-				}
-
-				i = entropy & 3;
-				entropy >>= 2;
-				reservoir--;
-			} while (i >= n_move);
+			do i = entropy_bits(e, 2);
+			while (i >= n_move);
 		}
 
 		st = fsm_advance(fsm, st, moves[i]);
@@ -300,10 +452,51 @@ random_walk(struct puzzle *p, int steps, const struct fsm *fsm)
 		steps--;
 	}
 
-	res = 1;
+	return (1);
+}
 
-fail:	err = pthread_mutex_unlock(&seed_lock);
-	assert(err == 0);
+/*
+ * Perform an n step random walk from p, using fsm to prune moves.
+ * Return 1 if the random walk was successful, 0 otherwise.  A random
+ * walk is unsuccessful if the fsm at some point doesn't provide us
+ * with a move to progress.
+ */
+extern int
+random_walk(struct puzzle *p, int steps, const struct fsm *fsm)
+{
+	struct entropy e;
+	int res;
+
+	entropy_begin(&e);
+	res = walk(p, steps, fsm, &e);
+	entropy_end(&e);
 
 	return (res);
 }
+
+/*
+ * Fill p[0] to p[n-1] with the end points of successful n step random
+ * walks from start, using fsm to prune moves.  Unsuccessful walks are
+ * retried.  Return the number of walks attempted.  If fsm permits no
+ * walk of the given length, this function does not terminate.
+ */
+extern unsigned long long
+random_walks(struct puzzle *p, size_t n, const struct puzzle *start,
+    int steps, const struct fsm *fsm)
+{
+	struct entropy e;
+	unsigned long long attempts = 0;
+	size_t k;
+
+	entropy_begin(&e);
+
+	for (k = 0; k < n; k++)
+		do {
+			p[k] = *start;
+			attempts++;
+		} while (!walk(p + k, steps, fsm, &e));
+
+	entropy_end(&e);
+
+	return (attempts);
+}
@@ -30,11 +30,30 @@
 #include "index.h"
 #include "fsm.h"
 
+/*
+ * The state of a thread's random number generator.  Library code that
+ * switches the calling thread to a stream of its own with
+ * random_stream() can save the caller's state with random_save() and
+ * restore it with random_restore() afterwards.
+ */
+struct random_state {
+	unsigned long long s[4];
+	unsigned generation; /* 0 if state needs to be initialised */
+	unsigned stream;
+	int has_stream;
+};
+
 extern void	set_seed(unsigned long long);
+extern void	random_stream(unsigned);
+extern void	random_save(struct random_state *);
+extern void	random_restore(const struct random_state *);
 extern unsigned long long	random64(void);
 extern unsigned int		random32(void);
 extern void	random_puzzle(struct puzzle *);
+extern void	random_puzzles(struct puzzle *, size_t);
 extern void	random_index(const struct index_aux *, struct index *);
 extern int	random_walk(struct puzzle *, int, const struct fsm *);
+extern unsigned long long random_walks(struct puzzle *, size_t,
+    const struct puzzle *, int, const struct fsm *);
 
 #endif /* RANDOM_H */
@@ -62,13 +62,101 @@ struct path {
 	unsigned char moves[SEARCH_PATH_LEN];
 };
 
+/*
+ * For instances that take days to solve, search_ida_bounded() can
+ * periodically save its state to a checkpoint file so the search can
+ * be resumed after a crash.  The members filename and interval
+ * configure where and how often (in seconds) checkpoints are written.
+ * The remaining members describe the state of the search: the instance
+ * p, the bound of the round in progress, the number of nodes expanded
+ * in previous rounds and in the current round, the number of solutions
+ * found in the current round, the last solution found, and the path to
+ * the node the search is to be resumed at.  The child index stack of
+ * the search is implied by path.  fingerprint identifies the catalogue
+ * and finite state machine the search was made with, see
+ * checkpoint_fingerprint().  If valid is nonzero and p and fingerprint
+ * match the search to be made, search_ida_bounded() resumes from this
+ * state.
+ */
+struct search_checkpoint {
+	const char *filename;
+	double interval;
+
+	struct puzzle p;
+	struct path path, solution;
+	size_t bound;
+	unsigned long long expanded, round_expanded, fingerprint;
+	int n_solutions, valid;
+};
+
+/*
+ * The result of search_ida_enumerate(): the length of the optimal
+ * solutions (or SEARCH_NO_PATH), the number of optimal solutions
+ * found, and the number of nodes expanded.
+ */
+struct search_enumeration {
+	size_t pathlen;
+	unsigned long long n_solutions, expanded;
+};
+
+/*
+ * Detailed statistics about IDA* searches.  If a pointer to a struct
+ * search_stats is passed to search_ida_bounded(), the statistics of
+ * the search are added to it, so one struct can accumulate statistics
+ * over many searches.  Initialise it with search_stats_init() first.
+ *
+ * Per depth g, we record the number of nodes expanded, the number of
+ * nodes cut off because g + h exceeds the bound, and the number of
+ * moves pruned by the finite state machine.  As nodes one move past
+ * the bound are cut off, too, these arrays have SEARCH_DEPTHS_LEN
+ * entries.  hvals is a histogram of
+ * the h values of all nodes visited.  For each PDB in the catalogue
+ * (indexed like cat->heus), lookups counts how often it was looked up
+ * and pdb_decisive how often it was part of a heuristic yielding the
+ * maximal h value of a node.  heu_decisive counts the latter per
+ * heuristic (indexed like cat->parts).  Finally, for each bound, the
+ * number of rounds searched, the nodes expanded in them, and the CPU
+ * time spent on them in seconds is recorded.
+ */
+enum { SEARCH_DEPTHS_LEN = SEARCH_PATH_LEN + 2 };
+
+struct search_stats {
+	unsigned long long expanded[SEARCH_DEPTHS_LEN];
+	unsigned long long pruned_h[SEARCH_DEPTHS_LEN];
+	unsigned long long pruned_fsm[SEARCH_DEPTHS_LEN];
+
+	unsigned long long hvals[PDB_HISTOGRAM_LEN];
+
+	unsigned long long lookups[CATALOGUE_HEUS_LEN];
+	unsigned long long pdb_decisive[CATALOGUE_HEUS_LEN];
+	unsigned long long heu_decisive[HEURISTICS_LEN];
+
+	unsigned long long round_count[SEARCH_PATH_LEN + 1];
+	unsigned long long round_expanded[SEARCH_PATH_LEN + 1];
+	double round_time[SEARCH_PATH_LEN + 1];
+};
+
 /* search.c */
 extern void	 path_string(char[PATH_STR_LEN], const struct path *);
 extern char	*path_parse(struct path *, const char *);
 extern void	 path_walk(struct puzzle *, const struct path *);
 
+/* checkpoint.c */
+extern int	checkpoint_load(struct search_checkpoint *, FILE *);
+extern int	checkpoint_store(FILE *, const struct search_checkpoint *);
+extern int	checkpoint_update(const struct search_checkpoint *);
+extern unsigned long long checkpoint_fingerprint(struct pdb_catalogue *, const struct fsm *, const struct puzzle *);
+
+/* searchstats.c */
+extern void	search_stats_init(struct search_stats *);
+extern void	search_stats_merge(struct search_stats *, const struct search_stats *);
+extern int	search_stats_dump(FILE *, const struct search_stats *, const struct pdb_catalogue *);
+
+/* enumerate.c */
+extern int	search_ida_enumerate(struct pdb_catalogue *, const struct fsm *, const struct puzzle *, size_t, FILE *, void (*)(const struct path *, void *), void *, int, struct search_enumeration *);
+
 /* various */
 extern unsigned long long	search_ida(struct pdb_catalogue *, const struct fsm *, const struct puzzle *, struct path *, void (*)(const struct path *, void *), void *, int);
-extern unsigned long long	search_ida_bounded(struct pdb_catalogue *, const struct fsm *, const struct puzzle *, size_t, struct path *, void (*)(const struct path *, void *), void *, int);
+extern unsigned long long	search_ida_bounded(struct pdb_catalogue *, const struct fsm *, const struct puzzle *, size_t, struct path *, void (*)(const struct path *, void *), void *, int, struct search_checkpoint *, struct search_stats *);
 
 #endif /* SEARCH_H */
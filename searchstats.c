@@ -0,0 +1,176 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* searchstats.c -- detailed statistics about IDA* searches */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "catalogue.h"
+#include "search.h"
+#include "tileset.h"
+
+/*
+ * Clear stats so it can be used to accumulate statistics.
+ */
+extern void
+search_stats_init(struct search_stats *stats)
+{
+	memset(stats, 0, sizeof *stats);
+}
+
+/*
+ * Add the statistics in src to dst.  This is useful to combine the
+ * statistics of searches carried out in multiple threads.
+ */
+extern void
+search_stats_merge(struct search_stats *dst, const struct search_stats *src)
+{
+	size_t i;
+
+	for (i = 0; i < SEARCH_DEPTHS_LEN; i++) {
+		dst->expanded[i] += src->expanded[i];
+		dst->pruned_h[i] += src->pruned_h[i];
+		dst->pruned_fsm[i] += src->pruned_fsm[i];
+	}
+
+	for (i = 0; i <= SEARCH_PATH_LEN; i++) {
+		dst->round_count[i] += src->round_count[i];
+		dst->round_expanded[i] += src->round_expanded[i];
+		dst->round_time[i] += src->round_time[i];
+	}
+
+	for (i = 0; i < PDB_HISTOGRAM_LEN; i++)
+		dst->hvals[i] += src->hvals[i];
+
+	for (i = 0; i < CATALOGUE_HEUS_LEN; i++) {
+		dst->lookups[i] += src->lookups[i];
+		dst->pdb_decisive[i] += src->pdb_decisive[i];
+	}
+
+	for (i = 0; i < HEURISTICS_LEN; i++)
+		dst->heu_decisive[i] += src->heu_decisive[i];
+}
+
+/*
+ * Return the number of leading entries of the array a of length n up
+ * to and including the last nonzero entry.
+ */
+static size_t
+used_len(const unsigned long long *a, size_t n)
+{
+	while (n > 0 && a[n - 1] == 0)
+		n--;
+
+	return (n);
+}
+
+/*
+ * Write stats to f as a JSON object.  cat is the catalogue used for
+ * the searches the statistics were collected from and is used to
+ * describe the PDBs and heuristics.  The object has the members
+ *
+ *     depths      per depth: expanded, pruned_h, pruned_fsm
+ *     hvals       histogram of h values
+ *     rounds      per bound: count, expanded, seconds
+ *     pdbs        per PDB: tiles, lookups, decisive
+ *     heuristics  per heuristic: pdbs (indices into pdbs), decisive
+ *
+ * Trailing depths and h values that were never seen are omitted, as
+ * are bounds without rounds.  Return 0 on success, -1 on error with
+ * errno set.
+ */
+extern int
+search_stats_dump(FILE *f, const struct search_stats *stats,
+    const struct pdb_catalogue *cat)
+{
+	size_t i, n, depths;
+	unsigned long long parts;
+	int error;
+	const char *sep;
+	char tsstr[TILESET_LIST_LEN];
+
+	/* every node visited is either expanded or cut off */
+	depths = used_len(stats->expanded, SEARCH_DEPTHS_LEN);
+	n = used_len(stats->pruned_h, SEARCH_DEPTHS_LEN);
+	if (n > depths)
+		depths = n;
+
+	fputs("{\n\t\"depths\": [", f);
+	for (i = 0; i < depths; i++)
+		fprintf(f, "%s\n\t\t{ \"depth\": %zu, \"expanded\": %llu, \"pruned_h\": %llu, \"pruned_fsm\": %llu }",
+		    i == 0 ? "" : ",", i, stats->expanded[i], stats->pruned_h[i], stats->pruned_fsm[i]);
+
+	fputs("\n\t],\n\t\"hvals\": [", f);
+	n = used_len(stats->hvals, PDB_HISTOGRAM_LEN);
+	for (i = 0; i < n; i++)
+		fprintf(f, "%s%llu", i == 0 ? "" : ", ", stats->hvals[i]);
+
+	fputs("],\n\t\"rounds\": [", f);
+	sep = "";
+	for (i = 0; i <= SEARCH_PATH_LEN; i++) {
+		if (stats->round_count[i] == 0)
+			continue;
+
+		fprintf(f, "%s\n\t\t{ \"bound\": %zu, \"count\": %llu, \"expanded\": %llu, \"seconds\": %.6f }",
+		    sep, i, stats->round_count[i], stats->round_expanded[i], stats->round_time[i]);
+		sep = ",";
+	}
+
+	fputs("\n\t],\n\t\"pdbs\": [", f);
+	for (i = 0; i < cat->n_heus; i++) {
+		tileset_list_string(tsstr, cat->pdbs_ts[i]);
+		fprintf(f, "%s\n\t\t{ \"tiles\": \"%s\", \"lookups\": %llu, \"decisive\": %llu }",
+		    i == 0 ? "" : ",", tsstr, stats->lookups[i], stats->pdb_decisive[i]);
+	}
+
+	fputs("\n\t],\n\t\"heuristics\": [", f);
+	for (i = 0; i < cat->n_heuristics; i++) {
+		fprintf(f, "%s\n\t\t{ \"pdbs\": [", i == 0 ? "" : ",");
+		for (parts = cat->parts[i]; parts != 0; parts &= parts - 1)
+			fprintf(f, "%d%s", ctzll(parts), (parts & parts - 1) != 0 ? ", " : "");
+
+		fprintf(f, "], \"decisive\": %llu }", stats->heu_decisive[i]);
+	}
+
+	fputs("\n\t]\n}\n", f);
+
+	if (fflush(f) != 0 || ferror(f)) {
+		error = errno;
+
+		/* tell apart end of medium from IO error */
+		if (!ferror(f))
+			errno = ENOSPC;
+		else
+			errno = error;
+
+		return (-1);
+	}
+
+	return (0);
+}
@@ -0,0 +1,332 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* shmreg.c -- host-wide registry of shared read-only tables */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /* for flock() */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shmreg.h"
+
+#define SHMREG_MAGIC "24puzSHM"
+#define SHMREG_PREFIX "24puzzle-"
+#define LOCK_SUFFIX ".lock"
+
+/* where shared memory objects show up in the file system */
+#define SHM_DIR "/dev/shm"
+
+/*
+ * The header at the beginning of each shared table.  ready is set once
+ * the table has been produced completely.
+ */
+struct shmreg_header {
+	char magic[8];
+	uint64_t size;
+	uint32_t ready;
+};
+
+/*
+ * The tables attached by this process.  These are detached on exit so
+ * the tables do not outlive the processes using them.
+ */
+static struct shmreg *attached = NULL;
+static pthread_mutex_t attached_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t atexit_once = PTHREAD_ONCE_INIT;
+
+static void
+detach_all(void)
+{
+	while (attached != NULL)
+		shmreg_detach(attached);
+}
+
+static void
+register_detach_all(void)
+{
+	atexit(detach_all);
+}
+
+/*
+ * Acquire an exclusive lock on the lock object lockname, creating it
+ * if needed.  If the lock object is removed by shmreg_detach() while
+ * we wait for the lock, try again with a fresh lock object.  Return a
+ * file descriptor holding the lock or -1 with errno set on failure.
+ */
+static int
+lock_registry(const char *lockname)
+{
+	struct stat st;
+	int lfd, error;
+
+	for (;;) {
+		lfd = shm_open(lockname, O_RDWR | O_CREAT, 0600);
+		if (lfd == -1)
+			return (-1);
+
+		if (flock(lfd, LOCK_EX) != 0 || fstat(lfd, &st) != 0) {
+			error = errno;
+			close(lfd);
+			errno = error;
+			return (-1);
+		}
+
+		if (st.st_nlink > 0)
+			return (lfd);
+
+		close(lfd);
+	}
+}
+
+/*
+ * If no process is attached to the table name, remove it and its lock
+ * object.  Tables are skipped if their lock object is held, so we
+ * never wait for a table to be produced.
+ */
+static void
+reclaim_table(const char *name)
+{
+	struct stat st;
+	int lfd, fd;
+	char lockname[256 + sizeof LOCK_SUFFIX];
+
+	snprintf(lockname, sizeof lockname, "%s" LOCK_SUFFIX, name);
+	lfd = shm_open(lockname, O_RDWR | O_CREAT, 0600);
+	if (lfd == -1)
+		return;
+
+	/* lock objects removed while we open them are dead already */
+	if (flock(lfd, LOCK_EX | LOCK_NB) != 0 || fstat(lfd, &st) != 0 || st.st_nlink == 0) {
+		close(lfd);
+		return;
+	}
+
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd == -1) {
+		if (errno == ENOENT)
+			shm_unlink(lockname);
+	} else {
+		if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+			shm_unlink(name);
+			shm_unlink(lockname);
+		}
+
+		close(fd);
+	}
+
+	close(lfd);
+}
+
+/*
+ * Processes killed by a signal do not detach their tables.  The
+ * kernel drops their shared locks, but if no other process asks for
+ * the same table again, nobody removes it.  Look for such tables and
+ * remove them, which is safe as every process using a table holds a
+ * shared lock on it.  If SHM_DIR cannot be read, do nothing.
+ */
+static void
+reclaim_stale(void)
+{
+	struct dirent *ent;
+	DIR *dir;
+	size_t len;
+	char name[256 + 1];
+
+	dir = opendir(SHM_DIR);
+	if (dir == NULL)
+		return;
+
+	while (ent = readdir(dir), ent != NULL) {
+		len = strlen(ent->d_name);
+		if (strncmp(ent->d_name, SHMREG_PREFIX, strlen(SHMREG_PREFIX)) != 0
+		    || len >= sizeof name - 1)
+			continue;
+
+		if (len >= strlen(LOCK_SUFFIX)
+		    && strcmp(ent->d_name + len - strlen(LOCK_SUFFIX), LOCK_SUFFIX) == 0)
+			continue;
+
+		snprintf(name, sizeof name, "/%s", ent->d_name);
+		reclaim_table(name);
+	}
+
+	closedir(dir);
+}
+
+/*
+ * Attach the shared table for key of size bytes to reg.  If the table
+ * does not exist yet, create it and call fill(data, size, arg) to
+ * produce its contents.  fill shall return 0 on success and -1 with
+ * errno set on failure.  Other processes asking for the same table
+ * wait until it has been produced.  The table is mapped read-only.
+ * Stale tables left behind by processes that died without detaching
+ * are removed first.  Return 1 if we produced the table, 0 if it
+ * already existed, and -1 with errno set on failure.
+ */
+extern int
+shmreg_attach(struct shmreg *reg, const char *key, size_t size,
+    int (*fill)(void *, size_t, void *), void *arg)
+{
+	struct shmreg_header *hdr;
+	struct stat st;
+	size_t i, total = SHMREG_HEADER_SIZE + size;
+	int lfd, error, created = 0, fresh = 0;
+	char lockname[sizeof reg->name + sizeof LOCK_SUFFIX];
+	unsigned char *base;
+
+	reclaim_stale();
+
+	/* names must start with a slash and contain no further slashes */
+	if (snprintf(reg->name, sizeof reg->name, "/" SHMREG_PREFIX "%s", key) >= (int)sizeof reg->name) {
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+
+	for (i = 1; reg->name[i] != '\0'; i++)
+		if (reg->name[i] == '/')
+			reg->name[i] = '_';
+
+	reg->size = size;
+	snprintf(lockname, sizeof lockname, "%s" LOCK_SUFFIX, reg->name);
+	lfd = lock_registry(lockname);
+	if (lfd == -1)
+		return (-1);
+
+	reg->fd = shm_open(reg->name, O_RDWR | O_CREAT, 0600);
+	if (reg->fd == -1)
+		goto fail1;
+
+	/* announce that we are using the table */
+	if (flock(reg->fd, LOCK_SH) != 0 || fstat(reg->fd, &st) != 0)
+		goto fail2;
+
+	if (st.st_size == 0) {
+		fresh = 1;
+		if (ftruncate(reg->fd, (off_t)total) != 0)
+			goto fail2;
+	} else if ((size_t)st.st_size != total) {
+		errno = EINVAL;
+		goto fail2;
+	}
+
+	base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, reg->fd, 0);
+	if (base == MAP_FAILED)
+		goto fail2;
+
+	hdr = (struct shmreg_header *)base;
+	if (!hdr->ready) {
+		fresh = 1;
+		if (fill(base + SHMREG_HEADER_SIZE, size, arg) != 0)
+			goto fail3;
+
+		memcpy(hdr->magic, SHMREG_MAGIC, sizeof hdr->magic);
+		hdr->size = size;
+		hdr->ready = 1;
+		created = 1;
+	} else if (memcmp(hdr->magic, SHMREG_MAGIC, sizeof hdr->magic) != 0
+	    || hdr->size != size) {
+		errno = EINVAL;
+		goto fail3;
+	}
+
+	if (mprotect(base, total, PROT_READ) != 0)
+		goto fail3;
+
+	close(lfd);
+	reg->data = base + SHMREG_HEADER_SIZE;
+
+	pthread_once(&atexit_once, register_detach_all);
+	pthread_mutex_lock(&attached_lock);
+	reg->next = attached;
+	reg->prev = &attached;
+	if (attached != NULL)
+		attached->prev = &reg->next;
+
+	attached = reg;
+	pthread_mutex_unlock(&attached_lock);
+
+	return (created);
+
+fail3:	error = errno;
+	munmap(base, total);
+	errno = error;
+fail2:	error = errno;
+
+	/* nobody can be using a table that has not been produced */
+	if (fresh)
+		shm_unlink(reg->name);
+
+	close(reg->fd);
+	errno = error;
+fail1:	error = errno;
+	close(lfd);
+	errno = error;
+
+	return (-1);
+}
+
+/*
+ * Detach the shared table reg.  If no other process is attached to
+ * it, remove it.
+ */
+extern void
+shmreg_detach(struct shmreg *reg)
+{
+	int lfd;
+	char lockname[sizeof reg->name + sizeof LOCK_SUFFIX];
+
+	pthread_mutex_lock(&attached_lock);
+	*reg->prev = reg->next;
+	if (reg->next != NULL)
+		reg->next->prev = reg->prev;
+
+	pthread_mutex_unlock(&attached_lock);
+
+	munmap(reg->data - SHMREG_HEADER_SIZE, SHMREG_HEADER_SIZE + reg->size);
+
+	snprintf(lockname, sizeof lockname, "%s" LOCK_SUFFIX, reg->name);
+	lfd = lock_registry(lockname);
+
+	/* are we the last process using the table? */
+	if (lfd != -1 && flock(reg->fd, LOCK_EX | LOCK_NB) == 0) {
+		shm_unlink(reg->name);
+		shm_unlink(lockname);
+	}
+
+	close(reg->fd);
+	if (lfd != -1)
+		close(lfd);
+}
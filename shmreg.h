@@ -0,0 +1,64 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef SHMREG_H
+#define SHMREG_H
+
+#include <stddef.h>
+
+/*
+ * A host-wide registry of read-only tables in POSIX shared memory.
+ * Tables that are expensive to produce, such as decompressed bitpdbs
+ * or freshly generated PDBs, are produced once by the first process
+ * asking for them and then attached read-only by all other processes
+ * on the same host asking for a table with the same key.
+ *
+ * Each table is a shared memory object named after its key, starting
+ * with a header of SHMREG_HEADER_SIZE bytes followed by the table.
+ * Production of a table is serialised by an exclusive lock on a
+ * companion lock object.  Each process attached to the table holds a
+ * shared lock on the table, so these locks serve as reference counts
+ * that the kernel drops when a process dies.  The last process to
+ * detach removes the table.  If a process dies while producing a
+ * table, the next process produces it again.  Tables still attached
+ * when the process exits are detached automatically.  Tables left
+ * behind by processes killed by a signal are found and removed when
+ * the next table is attached.
+ */
+struct shmreg {
+	unsigned char *data;
+	size_t size;
+	int fd;
+	char name[256];
+	struct shmreg *next, **prev; /* list of attached tables */
+};
+
+enum { SHMREG_HEADER_SIZE = 4096 };
+
+extern int	shmreg_attach(struct shmreg *, const char *, size_t,
+    int (*)(void *, size_t, void *), void *);
+extern void	shmreg_detach(struct shmreg *);
+
+#endif /* SHMREG_H */
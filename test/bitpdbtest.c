@@ -60,7 +60,7 @@ compare_hvalues(struct patterndb *pdb, struct bitpdb *bpdb)
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-t tile,...] [-n n_puzzle] [-s seed] pdb bitpdb\n", argv0);
+	fprintf(stderr, "Usage: %s [-t tile,...] [-n n_puzzle] [-s seed] [-a anchorfile] pdb bitpdb\n", argv0);
 	exit(EXIT_FAILURE);
 }
 
@@ -69,13 +69,18 @@ main(int argc, char *argv[])
 {
 	struct patterndb *pdb;
 	struct bitpdb *bpdb;
-	FILE *pdbfile, *bpdbfile;
+	FILE *pdbfile, *bpdbfile, *anchorfile;
 	long i, n_puzzle = 1;
 	int optchar;
 	tileset ts = DEFAULT_TILESET;
+	const char *anchorname = NULL;
 
-	while (optchar = getopt(argc, argv, "n:s:t:"), optchar != -1)
+	while (optchar = getopt(argc, argv, "a:n:s:t:"), optchar != -1)
 		switch (optchar) {
+		case 'a':
+			anchorname = optarg;
+			break;
+
 		case 'n':
 			n_puzzle = strtol(optarg, NULL, 0);
 			break;
@@ -128,6 +133,21 @@ main(int argc, char *argv[])
 
 	fclose(bpdbfile);
 
+	if (anchorname != NULL) {
+		anchorfile = fopen(anchorname, "rb");
+		if (anchorfile == NULL) {
+			perror(anchorname);
+			return (EXIT_FAILURE);
+		}
+
+		if (bitpdb_load_anchors(bpdb, anchorfile) != 0) {
+			perror(anchorname);
+			return (EXIT_FAILURE);
+		}
+
+		fclose(anchorfile);
+	}
+
 	for (i = 0; i < n_puzzle; i++)
 		if (compare_hvalues(pdb, bpdb))
 			return (EXIT_FAILURE);
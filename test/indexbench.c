@@ -36,6 +36,7 @@
 #include "index.h"
 #include "random.h"
 #include "pdb.h"
+#include "fsm.h"
 
 /*
  * A catalogue of 16 PDBs @ 6 tiles as a benchmark.  These are basically
@@ -70,6 +71,10 @@ static tileset bench_ts[TESTWIDTH] = {
 enum {
 	WANT_LOOKUP = 1 << 0,
 	WANT_ZPDB = 1 << 1,
+	WANT_WALK = 1 << 2,
+	WANT_BLOCKED = 1 << 3,
+	WANT_SERIAL = 1 << 4,
+	WANT_INVERT = 1 << 5,
 };
 
 /*
@@ -122,10 +127,31 @@ dobench(struct patterndb **pdbs, const tileset *tilesets, size_t npdb,
 	}
 }
 
+/*
+ * Benchmark: invert the npuzzle * npdb indices in indices, which have
+ * been computed for each puzzle and PDB in turn.
+ */
+static void
+dobench_invert(struct patterndb **pdbs, size_t npdb,
+    const struct index *indices, size_t npuzzle)
+{
+	struct puzzle p;
+	size_t i, j;
+	volatile int sink; /* prevent the compiler from optimising this away */
+
+	for (i = 0; i < npuzzle; i++)
+		for (j = 0; j < npdb; j++) {
+			invert_index(&pdbs[j]->aux, &p, indices + i * npdb + j);
+			sink = p.grid[0];
+		}
+
+	(void)sink;
+}
+
 static void
 usage(const char *argv0)
 {
-	fprintf(stderr, "Usage: %s [-lz] [runs]\n", argv0);
+	fprintf(stderr, "Usage: %s [-ilswz] [-b shift] [runs]\n", argv0);
 	exit(EXIT_FAILURE);
 }
 
@@ -135,13 +161,32 @@ main(int argc, char *argv[])
 	struct timespec begin, end;
 	struct patterndb *pdbs[TESTWIDTH];
 	struct puzzle *puzzles;
+	struct index *indices = NULL;
 	double fbegin, fend, dur;
 	long j, runs = 10;
 	size_t i;
+	unsigned shift = PDB_LAYOUT_SHIFT;
 	int optchar, flags = 0;
 
-	while (optchar = getopt(argc, argv, "lz"), optchar != -1)
+	while (optchar = getopt(argc, argv, "b:ilswz"), optchar != -1)
 		switch (optchar) {
+		case 'b':
+			flags |= WANT_BLOCKED;
+			shift = atoi(optarg);
+			break;
+
+		case 'i':
+			flags |= WANT_INVERT;
+			break;
+
+		case 's':
+			flags |= WANT_SERIAL;
+			break;
+
+		case 'w':
+			flags |= WANT_WALK;
+			break;
+
 		case 'z':
 			flags |= WANT_ZPDB;
 			break;
@@ -181,6 +226,12 @@ main(int argc, char *argv[])
 			}
 
 			randomize(pdbs[i]);
+
+			if (flags & WANT_BLOCKED
+			    && pdb_relayout(pdbs[i], PDB_LAYOUT_BLOCKED, shift) != 0) {
+				perror("pdb_relayout");
+				return (EXIT_FAILURE);
+			}
 		}
 	else
 		/* allocate dummies */
@@ -199,16 +250,48 @@ main(int argc, char *argv[])
 		return (EXIT_FAILURE);
 	}
 
-	for (i = 0; i < NPUZZLE; i++)
-		random_puzzle(puzzles + i);
+	/* with -w, each puzzle is one move away from the previous one */
+	if (flags & WANT_WALK) {
+		random_puzzle(puzzles);
+		for (i = 1; i < NPUZZLE; i++) {
+			puzzles[i] = puzzles[i - 1];
+			random_walk(puzzles + i, 1, &fsm_simple);
+		}
+	} else
+		for (i = 0; i < NPUZZLE; i++)
+			random_puzzle(puzzles + i);
+
+	/* with -s, use the serial index engine for comparison */
+	if (flags & WANT_SERIAL)
+		for (i = 0; i < TESTWIDTH; i++)
+			pdbs[i]->aux.engine = INDEX_ENGINE_SERIAL;
+
+	/* with -i, compute the indices ahead of time and invert them */
+	if (flags & WANT_INVERT) {
+		indices = malloc(NPUZZLE * TESTWIDTH * sizeof *indices);
+		if (indices == NULL) {
+			perror("malloc");
+			return (EXIT_FAILURE);
+		}
+
+		for (i = 0; i < NPUZZLE * TESTWIDTH; i++)
+			compute_index(&pdbs[i % TESTWIDTH]->aux, indices + i,
+			    puzzles + i / TESTWIDTH);
+	}
 
 	/* warm up round */
-	dobench(pdbs, bench_ts, TESTWIDTH, puzzles, NPUZZLE, flags);
+	if (flags & WANT_INVERT)
+		dobench_invert(pdbs, TESTWIDTH, indices, NPUZZLE);
+	else
+		dobench(pdbs, bench_ts, TESTWIDTH, puzzles, NPUZZLE, flags);
 
 	clock_gettime(CLOCK_REALTIME, &begin);
 
 	for (j = 0; j < runs; j++)
-		dobench(pdbs, bench_ts, TESTWIDTH, puzzles, NPUZZLE, flags);
+		if (flags & WANT_INVERT)
+			dobench_invert(pdbs, TESTWIDTH, indices, NPUZZLE);
+		else
+			dobench(pdbs, bench_ts, TESTWIDTH, puzzles, NPUZZLE, flags);
 
 	clock_gettime(CLOCK_REALTIME, &end);
 
@@ -115,6 +115,36 @@ test_index(const struct index_aux *aux, const struct index *idx)
 	return (1);
 }
 
+/*
+ * Check if the table driven engine in aux computes the same index for p
+ * as the serial engine in serial_aux.  Return 1 if it does, return 0
+ * and print some information if it does not.
+ */
+static int
+test_engines(const struct index_aux *aux, const struct index_aux *serial_aux,
+    const struct puzzle *p)
+{
+	char puzzle_str[PUZZLE_STR_LEN], index_str[INDEX_STR_LEN];
+	struct index idx, serial_idx;
+
+	compute_index(aux, &idx, p);
+	compute_index(serial_aux, &serial_idx, p);
+
+	if (!index_equal(aux->ts, &idx, &serial_idx)) {
+		printf("test_engines failed for 0x%07x:\n", aux->ts);
+		puzzle_string(puzzle_str, p);
+		puts(puzzle_str);
+		index_string(aux->ts, index_str, &idx);
+		puts(index_str);
+		index_string(aux->ts, index_str, &serial_idx);
+		puts(index_str);
+
+		return (0);
+	}
+
+	return (1);
+}
+
 static void
 usage(char *argv0)
 {
@@ -127,7 +157,7 @@ main(int argc, char *argv[])
 	size_t i, n = 10000;
 	struct puzzle p;
 	struct index idx;
-	struct index_aux aux;
+	struct index_aux aux, serial_aux;
 	tileset ts = TEST_TS;
 	int optchar;
 
@@ -151,16 +181,19 @@ main(int argc, char *argv[])
 
 	set_seed(time(NULL));
 	make_index_aux(&aux, ts);
+	serial_aux = aux;
+	serial_aux.engine = INDEX_ENGINE_SERIAL;
 
 	for (i = 0; i < n; i++) {
 		random_puzzle(&p);
-		if (!test_puzzle(&aux, &p))
+		if (!test_puzzle(&aux, &p) || !test_puzzle(&serial_aux, &p)
+		    || !test_engines(&aux, &serial_aux, &p))
 			return (EXIT_FAILURE);
 	}
 
 	for (i = 0; i < n; i++) {
 		random_index(&aux, &idx);
-		if (!test_index(&aux, &idx))
+		if (!test_index(&aux, &idx) || !test_index(&serial_aux, &idx))
 			return (EXIT_FAILURE);
 	}
 
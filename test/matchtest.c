@@ -0,0 +1,240 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* matchtest.c -- check match_find_best_batch() against match_find_best() */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "match.h"
+#include "pdb.h"
+#include "puzzle.h"
+#include "random.h"
+#include "tileset.h"
+
+/*
+ * Generating a catalogue of PDBs for every six tile set is far too
+ * expensive for a test.  Instead, the partial h value of a tile set
+ * is the sum of the Manhattan distances of its tiles plus a random
+ * bonus from 0 to 3 for the tile set, where the bonuses play the role
+ * of the catalogue.
+ */
+enum { MAX_BONUS = 3 };
+
+/*
+ * Fill v with the partial h values of p for the catalogue given by
+ * bonus.
+ */
+static void
+fill_matchv(unsigned char v[MATCH_SIZE], const unsigned char bonus[MATCH_SIZE],
+    const struct puzzle *p)
+{
+	size_t i;
+	unsigned dist[TILE_COUNT], h;
+	tileset ts;
+	int dx, dy;
+
+	for (i = 1; i < TILE_COUNT; i++) {
+		dx = p->tiles[i] % 5 - (int)i % 5;
+		dy = p->tiles[i] / 5 - (int)i / 5;
+		dist[i] = abs(dx) + abs(dy);
+	}
+
+	for (i = 0; i < MATCH_SIZE; i++) {
+		h = bonus[i];
+		for (ts = tileset_unranknz(6, i); !tileset_empty(ts); ts = tileset_remove_least(ts))
+			h += dist[tileset_get_least(ts)];
+
+		v[i] = h;
+	}
+}
+
+/*
+ * Check if the matches a and b agree.  Return 1 if they do, 0 if they
+ * do not.
+ */
+static int
+match_equal(const struct match *a, const struct match *b)
+{
+	return (memcmp(a->ts, b->ts, sizeof a->ts) == 0
+	    && memcmp(a->hval, b->hval, sizeof a->hval) == 0
+	    && a->count == b->count && a->quality == b->quality);
+}
+
+/*
+ * Print match m to stdout.
+ */
+static void
+print_match(const struct match *m)
+{
+	char tsstr[TILESET_LIST_LEN];
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		tileset_list_string(tsstr, m->ts[i]);
+		printf("%s%s (%d)", i == 0 ? "" : " ", tsstr, m->hval[i]);
+	}
+
+	printf(", count %llu, quality %llu\n", m->count, m->quality);
+}
+
+/*
+ * Find the best matches for the n_puzzle configurations whose match
+ * vectors are given in vs in one batch and one by one and check that
+ * the results agree.  Return 1 if they do, 0 otherwise.
+ */
+static int
+test_batch(unsigned char *const vs[], const struct puzzle *puzzles,
+    size_t n_puzzle, const struct quality *qualities)
+{
+	struct match *batch, single;
+	size_t i;
+	int res = 0;
+	char puzzle_str[PUZZLE_STR_LEN];
+
+	batch = malloc(n_puzzle * sizeof *batch);
+	if (batch == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!match_find_best_batch(batch, (const unsigned char *const *)vs, n_puzzle, qualities)) {
+		perror("match_find_best_batch");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < n_puzzle; i++) {
+		if (!match_find_best(&single, vs[i], qualities)) {
+			perror("match_find_best");
+			exit(EXIT_FAILURE);
+		}
+
+		if (!match_equal(batch + i, &single)) {
+			printf("test_batch failed with %d jobs for puzzle %zu:\n", pdb_jobs, i);
+			puzzle_string(puzzle_str, puzzles + i);
+			puts(puzzle_str);
+			print_match(batch + i);
+			print_match(&single);
+			goto end;
+		}
+	}
+
+	res = 1;
+
+end:	free(batch);
+
+	return (res);
+}
+
+static void
+usage(char *argv0)
+{
+	printf("Usage: %s [-i iterations] [-j nproc] [-n n_puzzle]\n", argv0);
+	exit(EXIT_FAILURE);
+}
+
+extern int
+main(int argc, char *argv[])
+{
+	struct quality *qualities;
+	struct puzzle *puzzles;
+	size_t i, j, n_iter = 2, n_puzzle = 3;
+	unsigned char **vs, *bonus;
+	int optchar, jobs = 2;
+
+	while (optchar = getopt(argc, argv, "i:j:n:"), optchar != -1)
+		switch (optchar) {
+		case 'i':
+			n_iter = atol(optarg);
+			break;
+
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs < 1 || jobs > PDB_MAX_JOBS) {
+				printf("Number of threads must be between 1 and %d: %s\n",
+				    PDB_MAX_JOBS, optarg);
+				usage(argv[0]);
+			}
+
+			break;
+
+		case 'n':
+			n_puzzle = atol(optarg);
+			if (n_puzzle < 2) {
+				printf("Need at least two puzzles for a batch: %s\n", optarg);
+				usage(argv[0]);
+			}
+
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+
+	set_seed(time(NULL));
+	tileset_unrank_init(6);
+
+	puzzles = malloc(n_puzzle * sizeof *puzzles);
+	vs = malloc(n_puzzle * sizeof *vs);
+	bonus = malloc(MATCH_SIZE);
+	qualities = malloc(MATCH_SIZE * sizeof *qualities);
+	if (puzzles == NULL || vs == NULL || bonus == NULL || qualities == NULL) {
+		perror("malloc");
+		return (EXIT_FAILURE);
+	}
+
+	for (j = 0; j < n_puzzle; j++) {
+		vs[j] = matchv_allocate();
+		if (vs[j] == NULL) {
+			perror("matchv_allocate");
+			return (EXIT_FAILURE);
+		}
+	}
+
+	for (i = 0; i < n_iter; i++) {
+		for (j = 0; j < MATCH_SIZE; j++) {
+			bonus[j] = random32() % (MAX_BONUS + 1);
+
+			/* few distinct qualities, so ties are broken, too */
+			qualities[j].havg = random32() % 16;
+			qualities[j].peta = 0.0;
+		}
+
+		random_puzzles(puzzles, n_puzzle);
+		for (j = 0; j < n_puzzle; j++)
+			fill_matchv(vs[j], bonus, puzzles + j);
+
+		/* the batch is split between threads, so try different counts */
+		pdb_jobs = 1 + i % jobs;
+		if (!test_batch(vs, puzzles, n_puzzle, qualities))
+			return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,159 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* mod3pdbtest -- verify that pdb and mod3pdb yield the same h values */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "puzzle.h"
+#include "tileset.h"
+#include "pdb.h"
+#include "mod3pdb.h"
+#include "random.h"
+
+/*
+ * Compare the h values pdb and m3pdb give for a random puzzle, both
+ * by direct lookup and differentially from each of its neighbours.
+ * Return 0 if they agree, print a message and return -1 if they don't.
+ */
+static int
+compare_hvalues(struct patterndb *pdb, struct mod3pdb *m3pdb)
+{
+	struct puzzle p;
+	size_t i, n_moves;
+	int pdb_hval, m3pdb_hval, dest, zloc;
+	char puzstr[PUZZLE_STR_LEN];
+
+	random_puzzle(&p);
+	pdb_hval = pdb_lookup_puzzle(pdb, &p);
+	m3pdb_hval = mod3pdb_lookup_puzzle(m3pdb, &p);
+
+	if (pdb_hval != m3pdb_hval) {
+		puzzle_string(puzstr, &p);
+		printf("Mismatch! pdb predicts %d but mod3pdb predicts %d for puzzle\n%s\n",
+		    pdb_hval, m3pdb_hval, puzstr);
+
+		return (-1);
+	}
+
+	zloc = zero_location(&p);
+	n_moves = move_count(zloc);
+	for (i = 0; i < n_moves; i++) {
+		dest = get_moves(zloc)[i];
+		move(&p, dest);
+		m3pdb_hval = mod3pdb_diff_lookup(m3pdb, &p, pdb_hval);
+		if (m3pdb_hval != pdb_lookup_puzzle(pdb, &p)) {
+			puzzle_string(puzstr, &p);
+			printf("Mismatch! pdb predicts %d but mod3pdb predicts %d differentially for puzzle\n%s\n",
+			    pdb_lookup_puzzle(pdb, &p), m3pdb_hval, puzstr);
+
+			return (-1);
+		}
+
+		move(&p, zloc);
+	}
+
+	return (0);
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-t tile,...] [-n n_puzzle] [-s seed] pdb mod3pdb\n", argv0);
+	exit(EXIT_FAILURE);
+}
+
+extern int
+main(int argc, char *argv[])
+{
+	struct patterndb *pdb;
+	struct mod3pdb *m3pdb;
+	FILE *pdbfile, *m3pdbfile;
+	long i, n_puzzle = 1;
+	int optchar;
+	tileset ts = DEFAULT_TILESET;
+
+	while (optchar = getopt(argc, argv, "n:s:t:"), optchar != -1)
+		switch (optchar) {
+		case 'n':
+			n_puzzle = strtol(optarg, NULL, 0);
+			break;
+
+		case 's':
+			set_seed(strtoll(optarg, NULL, 0));
+			break;
+
+		case 't':
+			if (tileset_parse(&ts, optarg) != 0) {
+				printf("Invalid tileset: %s\n", optarg);
+				usage(argv[0]);
+			}
+
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+
+	if (argc != optind + 2)
+		usage(argv[0]);
+
+	pdbfile = fopen(argv[optind], "rb");
+	if (pdbfile == NULL) {
+		perror(argv[optind]);
+		return (EXIT_FAILURE);
+	}
+
+	m3pdbfile = fopen(argv[optind + 1], "rb");
+	if (m3pdbfile == NULL) {
+		perror(argv[optind + 1]);
+		return (EXIT_FAILURE);
+	}
+
+	pdb = pdb_mmap(ts, fileno(pdbfile), PDB_MAP_RDONLY);
+	if (pdb == NULL) {
+		perror(argv[optind]);
+		return (EXIT_FAILURE);
+	}
+
+	fclose(pdbfile);
+
+	m3pdb = mod3pdb_load(ts, m3pdbfile);
+	if (m3pdb == NULL) {
+		perror(argv[optind + 1]);
+		return (EXIT_FAILURE);
+	}
+
+	fclose(m3pdbfile);
+
+	for (i = 0; i < n_puzzle; i++)
+		if (compare_hvalues(pdb, m3pdb))
+			return (EXIT_FAILURE);
+
+	return (EXIT_SUCCESS);
+}
@@ -79,7 +79,7 @@ static void *
 qualitytest_worker(void *qtcfg_arg)
 {
 	struct qualitytest_config *qtcfg = qtcfg_arg;
-	struct puzzle p;
+	struct puzzle p, puzzles[CHUNK_SIZE];
 	struct partial_hvals ph;
 	size_t histogram[PDB_HISTOGRAM_LEN] = {};
 	size_t bestheu[HEURISTICS_LEN] = {}, onlyheu[HEURISTICS_LEN] = {};
@@ -95,8 +95,9 @@ qualitytest_worker(void *qtcfg_arg)
 		if (n > CHUNK_SIZE)
 			n = CHUNK_SIZE;
 
+		random_puzzles(puzzles, n);
 		for (i = 0; i < n; i++) {
-			random_puzzle(&p);
+			p = puzzles[i];
 
 			catalogue_partial_hvals(&ph, qtcfg->cat, &p);
 			dist = catalogue_ph_hval(qtcfg->cat, &ph);
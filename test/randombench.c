@@ -0,0 +1,163 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* randombench.c -- benchmark random puzzle and random walk generation */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "puzzle.h"
+#include "fsm.h"
+#include "random.h"
+
+enum { BATCH_SIZE = 1024 };
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-m fsmfile] [-n n_puzzle] [-s seed] [-w steps]\n", argv0);
+
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Return the current time in seconds.
+ */
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/*
+ * Print the throughput of the benchmark named name, which generated
+ * n puzzles in dur seconds.
+ */
+static void
+report(const char *name, size_t n, double dur)
+{
+	printf("%-16s %10.3fs %12.0f puzzles/s\n", name, dur, n / dur);
+}
+
+extern int
+main(int argc, char *argv[])
+{
+	static struct puzzle puzzles[BATCH_SIZE];
+	const struct fsm *fsm = &fsm_simple;
+	FILE *fsmfile;
+	size_t i, j, n_puzzle = 10000000;
+	double begin;
+	int optchar, steps = 0;
+	volatile unsigned sink = 0; /* prevent the compiler from optimising this away */
+
+	while (optchar = getopt(argc, argv, "m:n:s:w:"), optchar != -1)
+		switch (optchar) {
+		case 'm':
+			fsmfile = fopen(optarg, "rb");
+			if (fsmfile == NULL) {
+				perror(optarg);
+				return (EXIT_FAILURE);
+			}
+
+			fsm = fsm_load(fsmfile);
+			if (fsm == NULL) {
+				perror("fsm_load");
+				return (EXIT_FAILURE);
+			}
+
+			fclose(fsmfile);
+			break;
+
+		case 'n':
+			n_puzzle = strtoull(optarg, NULL, 0);
+			break;
+
+		case 's':
+			set_seed(strtoull(optarg, NULL, 0));
+			break;
+
+		case 'w':
+			steps = atoi(optarg);
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+
+	if (argc != optind)
+		usage(argv[0]);
+
+	/* round up to a whole number of batches */
+	n_puzzle = (n_puzzle + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+
+	begin = now();
+	for (i = 0; i < n_puzzle; i += BATCH_SIZE) {
+		for (j = 0; j < BATCH_SIZE; j++)
+			random_puzzle(puzzles + j);
+
+		sink += puzzles[0].tiles[0];
+	}
+
+	report("random_puzzle", n_puzzle, now() - begin);
+
+	begin = now();
+	for (i = 0; i < n_puzzle; i += BATCH_SIZE) {
+		random_puzzles(puzzles, BATCH_SIZE);
+		sink += puzzles[0].tiles[0];
+	}
+
+	report("random_puzzles", n_puzzle, now() - begin);
+
+	if (steps == 0)
+		return (EXIT_SUCCESS);
+
+	begin = now();
+	for (i = 0; i < n_puzzle; i += BATCH_SIZE) {
+		for (j = 0; j < BATCH_SIZE; j++)
+			do puzzles[j] = solved_puzzle;
+			while (!random_walk(puzzles + j, steps, fsm));
+
+		sink += puzzles[0].tiles[0];
+	}
+
+	report("random_walk", n_puzzle, now() - begin);
+
+	begin = now();
+	for (i = 0; i < n_puzzle; i += BATCH_SIZE) {
+		random_walks(puzzles, BATCH_SIZE, &solved_puzzle, steps, fsm);
+		sink += puzzles[0].tiles[0];
+	}
+
+	report("random_walks", n_puzzle, now() - begin);
+
+	return (EXIT_SUCCESS);
+}
@@ -118,7 +118,7 @@ do_sample(struct sample_config *cfg)
 	if (heu > cfg->distance_limit)
 		return;
 
-	search_ida_bounded(cfg->cat, &fsm_simple, &p, cfg->distance_limit, &path, NULL, NULL, 0);
+	search_ida_bounded(cfg->cat, &fsm_simple, &p, cfg->distance_limit, &path, NULL, NULL, 0, NULL, NULL);
 	if (path.pathlen == SEARCH_NO_PATH || path.pathlen > cfg->distance_limit)
 		return;
 
@@ -0,0 +1,378 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* searchbench.c -- benchmark the throughput of IDA* */
+
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "catalogue.h"
+#include "fsm.h"
+#include "pdb.h"
+#include "puzzle.h"
+#include "search.h"
+
+enum { LINEBUF_LEN = 1024, CHUNK_SIZE = 128 };
+
+/*
+ * The outcome of searching one instance.  instance is the number of
+ * the instance in the puzzle file, counting from 1.
+ */
+struct result {
+	long instance;
+	size_t pathlen;
+	unsigned long long expanded;
+	double seconds;
+};
+
+/*
+ * Parse an instance from line.  Both plain puzzle files (one puzzle
+ * per line) and files in the format of doc/korf.txt (instance number,
+ * puzzle, and further columns) are understood.  Return 0 on success,
+ * -1 if line does not hold an instance.
+ */
+static int
+parse_instance(struct puzzle *p, const char *line)
+{
+	if (puzzle_parse(p, line) == 0)
+		return (0);
+
+	/* skip the instance number */
+	while (isspace(*line))
+		line++;
+
+	if (!isdigit(*line))
+		return (-1);
+
+	while (isdigit(*line))
+		line++;
+
+	return (puzzle_parse(p, line));
+}
+
+/*
+ * Return the number of seconds elapsed from begin to end.
+ */
+static double
+seconds_between(struct timespec begin, struct timespec end)
+{
+	return (end.tv_sec - begin.tv_sec + (end.tv_nsec - begin.tv_nsec) / 1000000000.0);
+}
+
+static int
+compare_double(const void *a_arg, const void *b_arg)
+{
+	double a = *(const double *)a_arg, b = *(const double *)b_arg;
+
+	return ((a > b) - (a < b));
+}
+
+/*
+ * Return the q-th percentile of the n sorted values in a using the
+ * nearest rank method.
+ */
+static double
+percentile(const double *a, size_t n, int q)
+{
+	size_t rank = (q * n + 99) / 100;
+
+	return (a[rank > 0 ? rank - 1 : 0]);
+}
+
+/*
+ * Compare results with the results in the baseline file of the same
+ * format written by a previous run.  Print a comparison to stdout.
+ * Different path lengths or node counts for the same instance indicate
+ * a change in behaviour rather than performance and are reported as
+ * such.  Return the number of such mismatches or -1 if the baseline
+ * could not be read.
+ */
+static int
+compare_baseline(const char *baseline, const struct result *results, size_t n)
+{
+	FILE *f;
+	struct result r;
+	size_t i;
+	double seconds = 0.0, old_seconds = 0.0;
+	long long pathlen;
+	int mismatches = 0, found = 0;
+	char linebuf[LINEBUF_LEN];
+
+	f = fopen(baseline, "r");
+	if (f == NULL) {
+		perror(baseline);
+		return (-1);
+	}
+
+	while (fgets(linebuf, sizeof linebuf, f) != NULL) {
+		if (sscanf(linebuf, "%ld %lld %llu %lf", &r.instance, &pathlen, &r.expanded, &r.seconds) != 4)
+			continue;
+
+		for (i = 0; i < n; i++)
+			if (results[i].instance == r.instance)
+				break;
+
+		if (i == n)
+			continue;
+
+		found++;
+		seconds += results[i].seconds;
+		old_seconds += r.seconds;
+
+		if ((long long)results[i].pathlen != pathlen || results[i].expanded != r.expanded) {
+			printf("Mismatch for instance %ld: %lld/%llu in baseline, %lld/%llu now\n",
+			    r.instance, pathlen, r.expanded,
+			    (long long)results[i].pathlen, results[i].expanded);
+			mismatches++;
+		}
+	}
+
+	fclose(f);
+
+	printf("Compared %d instances with %s: %d mismatches, %.3f s before, %.3f s now (%+.1f%%)\n",
+	    found, baseline, mismatches, old_seconds, seconds,
+	    old_seconds > 0.0 ? 100.0 * (seconds - old_seconds) / old_seconds : 0.0);
+
+	return (mismatches);
+}
+
+/*
+ * Write results and a summary to f.  Lines not starting with an
+ * instance number start with # so the per-instance lines can be read
+ * back by compare_baseline().
+ */
+static void
+write_results(FILE *f, const char *catname, const char *fsmname,
+    const char *puzzlename, int rounds, const struct result *results, size_t n)
+{
+	struct rusage ru;
+	unsigned long long expanded = 0;
+	size_t i;
+	double seconds = 0.0, *times;
+
+	fprintf(f, "# catalogue %s\n# fsm %s\n# puzzles %s\n# rounds %d\n",
+	    catname, fsmname, puzzlename, rounds);
+	fprintf(f, "# instance pathlen expanded seconds\n");
+
+	times = malloc(n * sizeof *times);
+	if (times == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < n; i++) {
+		fprintf(f, "%ld %lld %llu %.6f\n", results[i].instance,
+		    (long long)results[i].pathlen, results[i].expanded, results[i].seconds);
+		expanded += results[i].expanded;
+		seconds += results[i].seconds;
+		times[i] = results[i].seconds;
+	}
+
+	qsort(times, n, sizeof *times, compare_double);
+
+	fprintf(f, "# total %zu instances %llu nodes %.6f s %.2f nodes/s\n",
+	    n, expanded, seconds, seconds > 0.0 ? expanded / seconds : 0.0);
+	if (n > 0)
+		fprintf(f, "# seconds p50 %.6f p90 %.6f p99 %.6f max %.6f\n",
+		    percentile(times, n, 50), percentile(times, n, 90),
+		    percentile(times, n, 99), times[n - 1]);
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		fprintf(f, "# maxrss %ld kB\n", ru.ru_maxrss);
+
+	free(times);
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-B] [-d pdbdir] [-j nproc] [-m fsmfile] [-n n_puzzle] [-r rounds] [-o outfile] [-b baseline] catalogue puzzles\n", argv0);
+
+	exit(EXIT_FAILURE);
+}
+
+extern int
+main(int argc, char *argv[])
+{
+	struct pdb_catalogue *cat;
+	const struct fsm *fsm = &fsm_simple;
+	struct result *results;
+	struct timespec begin, end;
+	struct puzzle p;
+	struct path path;
+	FILE *fsmfile, *puzzles, *outfile = stdout;
+	size_t n = 0, limit;
+	long instance = 0, n_puzzle = -1;
+	int optchar, rounds = 0, mismatches = 0, catflags = 0;
+	char linebuf[LINEBUF_LEN], *pdbdir = NULL, *fsmname = "simple", *baseline = NULL;
+
+	while (optchar = getopt(argc, argv, "Bb:d:j:m:n:o:r:"), optchar != -1)
+		switch (optchar) {
+		case 'B':
+			catflags |= CAT_BLOCKED;
+			break;
+
+		case 'b':
+			baseline = optarg;
+			break;
+
+		case 'd':
+			pdbdir = optarg;
+			break;
+
+		case 'j':
+			pdb_jobs = atoi(optarg);
+			if (pdb_jobs < 1 || pdb_jobs > PDB_MAX_JOBS) {
+				fprintf(stderr, "Number of threads must be between 1 and %d\n",
+				    PDB_MAX_JOBS);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 'm':
+			fsmname = optarg;
+			fsmfile = fopen(optarg, "rb");
+			if (fsmfile == NULL) {
+				perror(optarg);
+				return (EXIT_FAILURE);
+			}
+
+			fsm = fsm_load(fsmfile);
+			if (fsm == NULL) {
+				perror("fsm_load");
+				return (EXIT_FAILURE);
+			}
+
+			fclose(fsmfile);
+			break;
+
+		case 'n':
+			n_puzzle = strtol(optarg, NULL, 0);
+			break;
+
+		case 'o':
+			outfile = fopen(optarg, "w");
+			if (outfile == NULL) {
+				perror(optarg);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+
+	if (argc != optind + 2)
+		usage(argv[0]);
+
+	cat = catalogue_load(argv[optind], pdbdir, catflags, stderr);
+	if (cat == NULL) {
+		perror("catalogue_load");
+		return (EXIT_FAILURE);
+	}
+
+	puzzles = fopen(argv[optind + 1], "r");
+	if (puzzles == NULL) {
+		perror(argv[optind + 1]);
+		return (EXIT_FAILURE);
+	}
+
+	results = malloc(CHUNK_SIZE * sizeof *results);
+	if (results == NULL) {
+		perror("malloc");
+		return (EXIT_FAILURE);
+	}
+
+	while (n_puzzle < 0 || n < (size_t)n_puzzle) {
+		if (fgets(linebuf, sizeof linebuf, puzzles) == NULL)
+			break;
+
+		if (parse_instance(&p, linebuf) != 0)
+			continue;
+
+		instance++;
+
+		if (n % CHUNK_SIZE == 0 && n > 0) {
+			results = realloc(results, (n + CHUNK_SIZE) * sizeof *results);
+			if (results == NULL) {
+				perror("realloc");
+				return (EXIT_FAILURE);
+			}
+		}
+
+		/*
+		 * Searching the instances in doc/korf.txt to completion
+		 * takes days with weak heuristics, so the search can be
+		 * limited to the first few rounds.  The node counts of
+		 * such a search are just as reproducible.
+		 */
+		if (rounds > 0)
+			limit = catalogue_hval(cat, &p) + 2 * (rounds - 1);
+		else
+			limit = SEARCH_PATH_LEN;
+
+		fprintf(stderr, "Searching instance %ld\n", instance);
+
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		results[n].expanded = search_ida_bounded(cat, fsm, &p, limit, &path,
+		    NULL, NULL, 0, NULL, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		results[n].instance = instance;
+		results[n].pathlen = path.pathlen;
+		results[n].seconds = seconds_between(begin, end);
+		n++;
+	}
+
+	if (ferror(puzzles)) {
+		perror(argv[optind + 1]);
+		return (EXIT_FAILURE);
+	}
+
+	fclose(puzzles);
+
+	write_results(outfile, argv[optind], fsmname, argv[optind + 1], rounds, results, n);
+	if (fflush(outfile) != 0 || ferror(outfile)) {
+		perror("write_results");
+		return (EXIT_FAILURE);
+	}
+
+	if (baseline != NULL)
+		mismatches = compare_baseline(baseline, results, n);
+
+	return (mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
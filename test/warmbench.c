@@ -0,0 +1,211 @@
+/*-
+ * Copyright (c) 2026 Robert Clausecker. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* warmbench.c -- measure the time to steady-state PDB lookup throughput */
+
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pdb.h"
+#include "puzzle.h"
+#include "random.h"
+#include "tileset.h"
+
+enum {
+	BATCH_SIZE = 1 << 16,
+
+	/* max number of batches recorded */
+	MAX_BATCHES = 1 << 16,
+};
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-c] [-j nproc] [-t tile,...] [-T seconds] [-w none|advise|touch|background|lock] pdbfile\n", argv0);
+
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Return the current time in seconds.
+ */
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/*
+ * Parse a warmup mode into pdb_warmup() flags.  Return -1 if mode is
+ * not a valid mode.
+ */
+static int
+parse_mode(const char *mode)
+{
+	if (strcmp(mode, "none") == 0)
+		return (0);
+	else if (strcmp(mode, "advise") == 0)
+		return (PDB_WARM_ADVISE);
+	else if (strcmp(mode, "touch") == 0)
+		return (PDB_WARM_ADVISE | PDB_WARM_TOUCH);
+	else if (strcmp(mode, "background") == 0)
+		return (PDB_WARM_ADVISE | PDB_WARM_TOUCH | PDB_WARM_BACKGROUND);
+	else if (strcmp(mode, "lock") == 0)
+		return (PDB_WARM_ADVISE | PDB_WARM_TOUCH | PDB_WARM_LOCK);
+	else
+		return (-1);
+}
+
+/*
+ * Measure the throughput of random lookups into the PDB in pdbfile
+ * in batches for the given number of seconds, starting with the page
+ * cache evicted unless -c is given.  The clock starts before the
+ * warmup, so a foreground warmup counts against the time to steady
+ * state.  Steady state is taken to be the median throughput of the
+ * last quarter of the batches; the time to steady state is the time
+ * at which the first batch reaching 90% of that throughput finished.
+ */
+extern int
+main(int argc, char *argv[])
+{
+	static double rate[MAX_BATCHES], when[MAX_BATCHES], sorted[MAX_BATCHES];
+	struct patterndb *pdb;
+	struct puzzle p;
+	tileset ts = DEFAULT_TILESET;
+	size_t i, j, n_batch, quarter;
+	double seconds = 10.0, begin, batch_begin, end, steady, tmp;
+	int optchar, fd, mode = 0, keep_cache = 0;
+	volatile unsigned sink = 0; /* prevent the compiler from optimising this away */
+
+	while (optchar = getopt(argc, argv, "T:cj:t:w:"), optchar != -1)
+		switch (optchar) {
+		case 'T':
+			seconds = strtod(optarg, NULL);
+			break;
+
+		case 'c':
+			keep_cache = 1;
+			break;
+
+		case 'j':
+			pdb_jobs = atoi(optarg);
+			if (pdb_jobs < 1 || pdb_jobs > PDB_MAX_JOBS) {
+				fprintf(stderr, "Number of threads must be between 1 and %d\n",
+				    PDB_MAX_JOBS);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 't':
+			if (tileset_parse(&ts, optarg) != 0) {
+				fprintf(stderr, "Invalid tile set: %s\n", optarg);
+				return (EXIT_FAILURE);
+			}
+
+			break;
+
+		case 'w':
+			mode = parse_mode(optarg);
+			if (mode < 0)
+				usage(argv[0]);
+
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+
+	if (argc != optind + 1)
+		usage(argv[0]);
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd == -1) {
+		perror(argv[optind]);
+		return (EXIT_FAILURE);
+	}
+
+	/* start cold */
+	if (!keep_cache && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0)
+		fprintf(stderr, "Cannot evict %s from the page cache\n", argv[optind]);
+
+	begin = now();
+	pdb = pdb_mmap(ts, fd, PDB_MAP_RDONLY);
+	if (pdb == NULL) {
+		perror("pdb_mmap");
+		return (EXIT_FAILURE);
+	}
+
+	close(fd);
+
+	if (mode != 0 && pdb_warmup(pdb, mode, stderr) != 0)
+		perror("pdb_warmup");
+
+	for (n_batch = 0; n_batch < MAX_BATCHES; n_batch++) {
+		batch_begin = now();
+		for (i = 0; i < BATCH_SIZE; i++) {
+			random_puzzle(&p);
+			sink += pdb_lookup_puzzle(pdb, &p);
+		}
+
+		end = now();
+		rate[n_batch] = BATCH_SIZE / (end - batch_begin);
+		when[n_batch] = end - begin;
+		if (end - begin >= seconds)
+			break;
+	}
+
+	if (n_batch < MAX_BATCHES)
+		n_batch++;
+
+	/* median of the last quarter by insertion sort */
+	quarter = n_batch - n_batch * 3 / 4;
+	for (i = 0; i < quarter; i++) {
+		tmp = rate[n_batch - quarter + i];
+		for (j = i; j > 0 && sorted[j - 1] > tmp; j--)
+			sorted[j] = sorted[j - 1];
+
+		sorted[j] = tmp;
+	}
+
+	steady = sorted[quarter / 2];
+	for (i = 0; i < n_batch && rate[i] < 0.9 * steady; i++)
+		;
+
+	printf("first batch       %12.0f lookups/s after %8.3fs\n", rate[0], when[0]);
+	printf("steady state      %12.0f lookups/s\n", steady);
+	printf("time to steady    %12.3fs (%zu of %zu batches)\n", when[i], i + 1, n_batch);
+
+	return (EXIT_SUCCESS);
+}